@@ -0,0 +1,158 @@
+/**
+ * @file lightblue_monitor.c
+ * @brief Prints the events published by lightblued
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <osal_core.h>
+
+#include <lb_client.h>
+
+static void printAddress(const uint8_t* address)
+{
+   // Bluetooth addresses are transmitted least significant byte first
+   printf("%02x:%02x:%02x:%02x:%02x:%02x", address[5], address[4], address[3], address[2], address[1], address[0]);
+}
+
+static void printData(const uint8_t* data, uint8_t length)
+{
+   for (uint32_t ii = 0; ii < length; ii ++)
+   {
+      printf(" %02x", data[ii]);
+   }
+}
+
+static void printEvent(const struct LBC_Event* event)
+{
+   printf("%10llu %2u ", (unsigned long long) event->timestamp_ms, (unsigned) event->controller);
+
+   switch (event->type)
+   {
+      case LBC_EVENT_ADVERTISEMENT:
+         printf("advertisement ");
+         printAddress(event->address);
+         printf(" %4d dBm:", (int) event->rssi);
+         printData(event->data, event->length);
+         break;
+
+      case LBC_EVENT_DISCOVERY_COMPLETE:
+         printf("discovery complete");
+         break;
+
+      case LBC_EVENT_DISCONNECTED:
+         printf("device %08x disconnected: %02x", (unsigned) event->device, (unsigned) event->status);
+         break;
+
+      case LBC_EVENT_PRIMARY_SERVICE:
+         printf("device %08x service %04x-%04x:", (unsigned) event->device, (unsigned) event->attributeHandle, (unsigned) event->endHandle);
+         printData(event->data, event->length);
+         break;
+
+      case LBC_EVENT_NOTIFICATION:
+         printf("device %08x notification %04x:", (unsigned) event->device, (unsigned) event->attributeHandle);
+         printData(event->data, event->length);
+         break;
+
+      default:
+         printf("event %u", (unsigned) event->type);
+         break;
+   }
+
+   putchar('\n');
+}
+
+int main(int argc, char* argv[])
+{
+   if ((argc < 2) || ((argc > 2) && strcmp(argv[2], "scan")))
+   {
+      puts("Usage: lightblue_monitor <socket path> [scan]");
+      return 1;
+   }
+
+   if (os_initialize() < 0)
+   {
+      puts("Failed to initialize OS abstraction library");
+      return 2;
+   }
+
+   struct LBC_Client* client = lbc_connect(argv[1]);
+   if (! client)
+   {
+      printf("Failed to connect to %s.\n", argv[1]);
+      os_cleanup();
+      return 3;
+   }
+
+   const uint32_t controllerCount = lbc_getControllerCount(client);
+
+   struct LBC_DeviceInfo device[64];
+   const uint32_t deviceCount = lbc_getConnectedDevices(client, device, sizeof(device) / sizeof(device[0]));
+
+   printf("%u controllers, %u connected devices\n", (unsigned) controllerCount, (unsigned) deviceCount);
+   for (uint32_t ii = 0; ii < deviceCount; ii ++)
+   {
+      printf("   device %08x on controller %u: ", (unsigned) device[ii].device, (unsigned) device[ii].controller);
+      printAddress(device[ii].address);
+      putchar('\n');
+   }
+
+   if (argc > 2)
+   {
+      for (uint32_t ii = 0; ii < controllerCount; ii ++)
+      {
+         enum LB_STATUS status = lbc_startDeviceDiscovery(client, ii);
+         if (LB_OK != status)
+         {
+            printf("Failed to start discovery on controller %u: %u\n", (unsigned) ii, (unsigned) status);
+         }
+      }
+   }
+
+   puts("Waiting for events. Press Ctrl-C to quit.");
+
+   while (! os_interrupted())
+   {
+      if (! lbc_waitForEvents(client, 500))
+      {
+         continue;
+      }
+
+      const struct LBC_Event* event;
+      while ((event = lbc_peekEvent(client)))
+      {
+         printEvent(event);
+
+         if (! lbc_consumeEvent(client))
+         {
+            printf("Events lost; %u overruns\n", (unsigned) lbc_getOverrunCount(client));
+         }
+      }
+   }
+
+   // the discoveries started by this client stop with it
+   lbc_disconnect(client);
+
+   os_cleanup();
+
+   return 0;
+}
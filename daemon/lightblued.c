@@ -0,0 +1,967 @@
+/**
+ * @file lightblued.c
+ * @brief Daemon sharing Bluetooth controllers among client processes
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <osal_core.h>
+#include <osal_file.h>
+#include <osal_io.h>
+#include <osal_ipc.h>
+
+#include <hci.h>
+#include <controller.h>
+#include <commands.h>
+#include <manager.h>
+
+#include <lightblued.h>
+
+#define RING_CAPACITY      (1u << 20)
+
+// each client holds two connections
+#define MAX_SESSIONS       128
+#define MAX_CONTROLLERS    32
+
+// a waiting client is checked for disconnection this often
+#define WAIT_POLL_MS       1000
+
+struct session
+{
+   struct os_ipcConnection*   connection;
+
+   // discoveries started by the client, one bit per controller
+   uint32_t                   scanning;
+
+   // signaled when events are published while the client waits for them
+   struct os_condition*       ready;
+   bool                       waiting;
+};
+
+struct deviceSlot
+{
+   struct LB_Device*          device;
+   uint32_t                   controller;
+   uint32_t                   generation;
+
+   // requests using the device; it is not closed, nor the slot reused, until they are done
+   uint32_t                   users;
+};
+
+static struct
+{
+   struct LB_Manager*         manager;
+   struct LB_Controller*      controller[MAX_CONTROLLERS];
+   uint32_t                   controllerCount;
+
+   const char*                ringPath;
+   struct os_mappedFile*      ringFile;
+   struct LBD_RingHeader*     ring;
+   uint8_t*                   records;
+   struct os_lock*            ringLock;
+
+   /*
+    * Taken by the library events, on the I/O thread; never held across a
+    * blocking library call
+    */
+   struct os_lock*            lock;
+   struct session*            session[MAX_SESSIONS];
+   uint32_t                   sessionCount;
+   struct deviceSlot          device[LBD_MAX_DEVICES];
+   struct os_condition*       deviceIdle;
+   bool                       stopping;
+   struct os_condition*       sessionsClosed;
+
+   // serializes starting and stopping discoveries
+   struct os_lock*            scanLock;
+   uint32_t                   scanners[MAX_CONTROLLERS];
+
+   struct os_ipcServer*       server;
+   struct os_condition*       acceptStopped;
+} lbd;
+
+/*
+ * Device identifiers carry the generation of their slot, so an identifier
+ * kept after the device was closed does not name the next device using the
+ * slot
+ */
+static uint32_t makeDeviceId(uint32_t index, uint32_t generation)
+{
+   return (generation << 8) | index;
+}
+
+static uint32_t findController(struct LB_Controller* controller)
+{
+   for (uint32_t ii = 0; ii < lbd.controllerCount; ii ++)
+   {
+      if (controller == lbd.controller[ii])
+      {
+         return ii;
+      }
+   }
+
+   return UINT16_MAX;
+}
+
+static bool findDevice(struct LB_Device* device, uint32_t* id, uint32_t* controller)
+{
+   bool found = false;
+
+   os_lock(lbd.lock);
+
+   for (uint32_t ii = 0; ii < LBD_MAX_DEVICES; ii ++)
+   {
+      if (device == lbd.device[ii].device)
+      {
+         *id         = makeDeviceId(ii, lbd.device[ii].generation);
+         *controller = lbd.device[ii].controller;
+         found       = true;
+         break;
+      }
+   }
+
+   os_unlock(lbd.lock);
+
+   return found;
+}
+
+static uint32_t addDevice(struct LB_Device* device, uint32_t controller)
+{
+   uint32_t id = UINT32_MAX;
+
+   os_lock(lbd.lock);
+
+   for (uint32_t ii = 0; ii < LBD_MAX_DEVICES; ii ++)
+   {
+      if ((! lbd.device[ii].device) && (0 == lbd.device[ii].users))
+      {
+         lbd.device[ii].device     = device;
+         lbd.device[ii].controller = controller;
+         lbd.device[ii].generation = (lbd.device[ii].generation + 1) & 0xFFFFFF;
+         id = makeDeviceId(ii, lbd.device[ii].generation);
+         break;
+      }
+   }
+
+   os_unlock(lbd.lock);
+
+   return id;
+}
+
+/*
+ * Takes a reference to the device, released with putDevice; another client
+ * closing the device meanwhile waits for it
+ */
+static struct LB_Device* getDevice(uint32_t id)
+{
+   uint32_t index = id & 0xFF;
+   struct LB_Device* device = NULL;
+
+   os_lock(lbd.lock);
+
+   if ((index < LBD_MAX_DEVICES) && (lbd.device[index].generation == (id >> 8)))
+   {
+      device = lbd.device[index].device;
+      if (device)
+      {
+         lbd.device[index].users ++;
+      }
+   }
+
+   os_unlock(lbd.lock);
+
+   return device;
+}
+
+static void putDevice(uint32_t id)
+{
+   uint32_t index = id & 0xFF;
+
+   os_lock(lbd.lock);
+
+   assert(lbd.device[index].users);
+   if (0 == -- lbd.device[index].users)
+   {
+      os_signalCondition(lbd.deviceIdle, NULL);
+   }
+
+   os_unlock(lbd.lock);
+}
+
+/*
+ * Whoever removes the device from the table closes the connection, once
+ * the requests still using the device are done
+ */
+static struct LB_Device* removeDevice(uint32_t id, uint32_t* controller)
+{
+   uint32_t index = id & 0xFF;
+   struct LB_Device* device = NULL;
+
+   os_lock(lbd.lock);
+
+   if ((index < LBD_MAX_DEVICES) && (lbd.device[index].generation == (id >> 8)))
+   {
+      device      = lbd.device[index].device;
+      *controller = lbd.device[index].controller;
+      lbd.device[index].device = NULL;
+   }
+
+   while (device && lbd.device[index].users)
+   {
+      // reset under the lock; the users are released under it too, so no signal is lost
+      os_resetCondition(lbd.deviceIdle);
+      os_unlock(lbd.lock);
+
+      os_waitForCondition(lbd.deviceIdle, WAIT_POLL_MS, NULL);
+
+      os_lock(lbd.lock);
+   }
+
+   os_unlock(lbd.lock);
+
+   return device;
+}
+
+static void wakeWaiters(void)
+{
+   os_lock(lbd.lock);
+
+   for (uint32_t ii = 0; ii < lbd.sessionCount; ii ++)
+   {
+      if (lbd.session[ii]->waiting)
+      {
+         lbd.session[ii]->waiting = false;
+         os_signalCondition(lbd.session[ii]->ready, NULL);
+      }
+   }
+
+   os_unlock(lbd.lock);
+}
+
+/*
+ * Events are written once, and every client reads them in place
+ */
+static void publish(const struct LBC_Event* event, const uint8_t* data)
+{
+   const uint32_t capacity = lbd.ring->capacity;
+   const uint32_t size = (uint32_t) ((sizeof(struct LBC_Event) + event->length + LBD_RING_ALIGNMENT - 1) & ~(size_t) (LBD_RING_ALIGNMENT - 1));
+
+   os_lock(lbd.ringLock);
+
+   uint32_t head   = atomic_load_explicit(&lbd.ring->head, memory_order_relaxed);
+   uint32_t offset = head & (capacity - 1);
+
+   // records do not wrap around
+   uint32_t padding = (capacity - offset < size) ? capacity - offset : 0;
+
+   // the readers of the bytes about to be overwritten must see them as lost
+   atomic_store_explicit(&lbd.ring->claimed, head + padding + size, memory_order_relaxed);
+   atomic_thread_fence(memory_order_release);
+
+   if (padding)
+   {
+      struct LBC_Event* pad = (struct LBC_Event*) (lbd.records + offset);
+      pad->size = padding;
+      pad->type = LBC_EVENT_PADDING;
+      offset = 0;
+   }
+
+   struct LBC_Event* record = (struct LBC_Event*) (lbd.records + offset);
+   *record = *event;
+   record->size = size;
+   memcpy(record->data, data, event->length);
+
+   atomic_store_explicit(&lbd.ring->head, head + padding + size, memory_order_release);
+
+   os_unlock(lbd.ringLock);
+
+   wakeWaiters();
+}
+
+static void initializeEvent(struct LBC_Event* event, enum LBC_EventType type, uint32_t controller, uint32_t device)
+{
+   memset(event, 0, sizeof(*event));
+   event->type         = (uint16_t) type;
+   event->controller   = (uint16_t) controller;
+   event->device       = device;
+   event->timestamp_ms = os_getTime_ms();
+}
+
+void lb_on_observedDeviceAdvertisment(struct LB_Controller* controller, const uint8_t* address, int8_t rssi, const uint8_t* data, uint8_t length)
+{
+   struct LBC_Event event;
+   initializeEvent(&event, LBC_EVENT_ADVERTISEMENT, findController(controller), UINT32_MAX);
+   memcpy(event.address, address, sizeof(event.address));
+   event.rssi   = rssi;
+   event.length = length;
+
+   publish(&event, data);
+}
+
+void lb_on_deviceDiscoveryComplete(struct LB_Controller* controller)
+{
+   struct LBC_Event event;
+   initializeEvent(&event, LBC_EVENT_DISCOVERY_COMPLETE, findController(controller), UINT32_MAX);
+
+   publish(&event, NULL);
+}
+
+static void publishDisconnection(uint32_t id, uint32_t controller, enum HCI_StatusCode reason)
+{
+   struct LBC_Event event;
+   initializeEvent(&event, LBC_EVENT_DISCONNECTED, controller, id);
+   event.status = (uint8_t) reason;
+
+   publish(&event, NULL);
+}
+
+static void releaseDevice(void* arg)
+{
+   uint32_t controller;
+
+   struct LB_Device* device = removeDevice((uint32_t) (uintptr_t) arg, &controller);
+   if (device)
+   {
+      lb_closeDeviceConnection(device);
+   }
+}
+
+/*
+ * Devices closed by a client are out of the table by the time the library
+ * reports them disconnected
+ */
+void lb_on_disconnectedFromDevice(struct LB_Device* device, enum HCI_StatusCode reason)
+{
+   uint32_t id;
+   uint32_t controller;
+
+   if (findDevice(device, &id, &controller))
+   {
+      publishDisconnection(id, controller, reason);
+
+      // closing the connection blocks, which the I/O thread must not do
+      os_executeLater(0, releaseDevice, (void*) (uintptr_t) id);
+   }
+}
+
+void lb_on_discoveredPrimaryService(struct LB_Device* device, uint16_t attributeHandle, uint16_t groupEndHandle, const uint8_t* attribute, uint8_t attributeLength)
+{
+   uint32_t id;
+   uint32_t controller;
+
+   if (findDevice(device, &id, &controller))
+   {
+      struct LBC_Event event;
+      initializeEvent(&event, LBC_EVENT_PRIMARY_SERVICE, controller, id);
+      event.attributeHandle = attributeHandle;
+      event.endHandle       = groupEndHandle;
+      event.length          = attributeLength;
+
+      publish(&event, attribute);
+   }
+}
+
+void lb_on_receivedNotification(struct LB_Device* device, uint16_t attributeHandle, uint8_t status, const uint8_t* attributeValue, uint8_t attributeLength)
+{
+   uint32_t id;
+   uint32_t controller;
+
+   if (findDevice(device, &id, &controller))
+   {
+      struct LBC_Event event;
+      initializeEvent(&event, LBC_EVENT_NOTIFICATION, controller, id);
+      event.attributeHandle = attributeHandle;
+      event.status          = status;
+      event.length          = attributeLength;
+
+      publish(&event, attributeValue);
+   }
+}
+
+/*
+ * A discovery runs while any client has it started; reports are not
+ * filtered for duplicates, so the clients see every advertisement
+ */
+static enum LB_STATUS startDiscovery(struct session* session, uint32_t controller)
+{
+   static const struct LB_ScanParameters parameters =
+   {
+      .active           = true,
+      .interval         = 2000,
+      .window           = 2000,
+      .filterDuplicates = false,
+      .randomOwnAddress = true,
+      .duration_ms      = 0,
+   };
+
+   if (controller >= lbd.controllerCount)
+   {
+      return LB_INVALID_PARAMETERS;
+   }
+
+   enum LB_STATUS status = LB_OK;
+
+   os_lock(lbd.scanLock);
+
+   if (! (session->scanning & (1u << controller)))
+   {
+      if (0 == lbd.scanners[controller])
+      {
+         status = lb_startBackgroundScan(lbd.controller[controller], &parameters, NULL);
+      }
+
+      if (LB_OK == status)
+      {
+         lbd.scanners[controller] ++;
+         session->scanning |= 1u << controller;
+      }
+   }
+
+   os_unlock(lbd.scanLock);
+
+   return status;
+}
+
+static enum LB_STATUS stopDiscovery(struct session* session, uint32_t controller)
+{
+   if (controller >= lbd.controllerCount)
+   {
+      return LB_INVALID_PARAMETERS;
+   }
+
+   enum LB_STATUS status = LB_OK;
+
+   os_lock(lbd.scanLock);
+
+   if (session->scanning & (1u << controller))
+   {
+      session->scanning &= ~(1u << controller);
+
+      if (0 == -- lbd.scanners[controller])
+      {
+         status = lb_stopBackgroundScan(lbd.controller[controller]);
+      }
+   }
+
+   os_unlock(lbd.scanLock);
+
+   return status;
+}
+
+static uint32_t findDeviceController(struct LB_Device* device)
+{
+   struct LB_Device* connected[LBD_MAX_DEVICES];
+
+   for (uint32_t ii = 0; ii < lbd.controllerCount; ii ++)
+   {
+      uint32_t count = lb_getConnectedDevices(lbd.controller[ii], connected, LBD_MAX_DEVICES);
+
+      for (uint32_t jj = 0; jj < count; jj ++)
+      {
+         if (device == connected[jj])
+         {
+            return ii;
+         }
+      }
+   }
+
+   return UINT16_MAX;
+}
+
+static enum LB_STATUS openConnection(const uint8_t* address, uint32_t* id)
+{
+   struct LB_Device* device = NULL;
+
+   enum LB_STATUS status = lb_openManagedDeviceConnection(lbd.manager, address, NULL, &device);
+   if (LB_OK != status)
+   {
+      return status;
+   }
+
+   *id = addDevice(device, findDeviceController(device));
+   if (UINT32_MAX == *id)
+   {
+      lb_closeDeviceConnection(device);
+      return LB_CONNECTION_LIMIT_REACHED;
+   }
+
+   return LB_OK;
+}
+
+static enum LB_STATUS closeConnection(uint32_t id)
+{
+   uint32_t controller;
+
+   struct LB_Device* device = removeDevice(id, &controller);
+   if (! device)
+   {
+      return LB_DEVICE_NOT_CONNECTED;
+   }
+
+   enum LB_STATUS status = lb_closeDeviceConnection(device);
+
+   // the other clients learn that the device is gone
+   publishDisconnection(id, controller, HCI_CONNECTION_TERMINATED);
+
+   return status;
+}
+
+static uint32_t listDevices(struct LBC_DeviceInfo* info)
+{
+   uint32_t count = 0;
+
+   os_lock(lbd.lock);
+
+   for (uint32_t ii = 0; ii < LBD_MAX_DEVICES; ii ++)
+   {
+      if (lbd.device[ii].device)
+      {
+         memset(&info[count], 0, sizeof(info[count]));
+         info[count].device     = makeDeviceId(ii, lbd.device[ii].generation);
+         info[count].controller = lbd.device[ii].controller;
+         lb_getDeviceAddress(lbd.device[ii].device, info[count].address);
+         count ++;
+      }
+   }
+
+   os_unlock(lbd.lock);
+
+   return count;
+}
+
+static enum LB_STATUS execute(struct session* session, const struct LBD_Request* request, struct LBD_Response* response)
+{
+   if (LBD_START_DISCOVERY == request->command)
+   {
+      return startDiscovery(session, request->controller);
+   }
+
+   if (LBD_STOP_DISCOVERY == request->command)
+   {
+      return stopDiscovery(session, request->controller);
+   }
+
+   if (LBD_OPEN_CONNECTION == request->command)
+   {
+      return openConnection(request->address, &response->open.device);
+   }
+
+   if (LBD_CLOSE_CONNECTION == request->command)
+   {
+      return closeConnection(request->device);
+   }
+
+   if (LBD_GET_DEVICES == request->command)
+   {
+      response->devices.count = listDevices(response->devices.device);
+      return LB_OK;
+   }
+
+   if ((request->command < LBD_DISCOVER_SERVICES) || (request->command > LBD_READ))
+   {
+      return LB_INVALID_PARAMETERS;
+   }
+
+   struct LB_Device* device = getDevice(request->device);
+   if (! device)
+   {
+      return LB_DEVICE_NOT_CONNECTED;
+   }
+
+   enum LB_STATUS status;
+
+   switch (request->command)
+   {
+      case LBD_DISCOVER_SERVICES:
+         status = lb_startServiceDiscovery(device);
+         break;
+
+      case LBD_WRITE:
+         status = lb_writeCharValue(device, request->attributeHandle, request->value, request->length);
+         break;
+
+      case LBD_WRITE_WITHOUT_RESPONSE:
+         status = lb_writeCharValueWithoutResponse(device, request->attributeHandle, request->value, request->length);
+         break;
+
+      case LBD_READ:
+         status = lb_readCharValue(device, request->attributeHandle, response->read.value, request->length, &response->read.length);
+         break;
+
+      default:
+         status = LB_INVALID_PARAMETERS;
+         break;
+   }
+
+   putDevice(request->device);
+
+   return status;
+}
+
+static void serveCommands(struct session* session)
+{
+   struct LBD_Request  request;
+   struct LBD_Response response;
+
+   while (os_receiveIpc(session->connection, &request, sizeof(request)))
+   {
+      memset(&response, 0, sizeof(response));
+      response.status = execute(session, &request, &response);
+
+      if (! os_sendIpc(session->connection, &response, sizeof(response)))
+      {
+         break;
+      }
+   }
+
+   for (uint32_t ii = 0; ii < lbd.controllerCount; ii ++)
+   {
+      stopDiscovery(session, ii);
+   }
+}
+
+/*
+ * Returns false if the daemon is stopping or the client went away; a
+ * client does not send anything while it waits, so data to receive means
+ * the connection was closed
+ */
+static bool waitForEvents(struct session* session, uint32_t cursor)
+{
+   os_lock(lbd.lock);
+
+   while ((! lbd.stopping) && (cursor == atomic_load_explicit(&lbd.ring->head, memory_order_acquire)))
+   {
+      session->waiting = true;
+      os_resetCondition(session->ready);
+      os_unlock(lbd.lock);
+
+      if ((! os_waitForCondition(session->ready, WAIT_POLL_MS, NULL)) && os_waitForIpcData(session->connection, 0))
+      {
+         return false;
+      }
+
+      os_lock(lbd.lock);
+   }
+
+   session->waiting = false;
+   bool stopping = lbd.stopping;
+
+   os_unlock(lbd.lock);
+
+   return ! stopping;
+}
+
+static void serveEvents(struct session* session)
+{
+   struct LBD_Request request;
+
+   while (os_receiveIpc(session->connection, &request, sizeof(request)) && (LBD_WAIT == request.command))
+   {
+      const uint8_t doorbell = LBD_DOORBELL;
+
+      if ((! waitForEvents(session, request.cursor)) || (! os_sendIpc(session->connection, &doorbell, sizeof(doorbell))))
+      {
+         break;
+      }
+   }
+}
+
+static void closeSession(struct session* session)
+{
+   os_lock(lbd.lock);
+
+   for (uint32_t ii = 0; ii < lbd.sessionCount; ii ++)
+   {
+      if (session == lbd.session[ii])
+      {
+         lbd.session[ii] = lbd.session[-- lbd.sessionCount];
+         break;
+      }
+   }
+
+   if (0 == lbd.sessionCount)
+   {
+      os_signalCondition(lbd.sessionsClosed, NULL);
+   }
+
+   os_unlock(lbd.lock);
+
+   os_closeIpc(session->connection);
+   os_destroyCondition(session->ready);
+   free(session);
+}
+
+/*
+ * Runs on a library worker for the lifetime of the connection
+ */
+static void serveClient(void* arg)
+{
+   struct session* session = arg;
+
+   struct LBD_Request  request;
+   struct LBD_Response response;
+
+   memset(&response, 0, sizeof(response));
+   response.status = LB_INVALID_PARAMETERS;
+
+   if (os_receiveIpc(session->connection, &request, sizeof(request)) &&
+       (LBD_HELLO == request.command) && (LBD_PROTOCOL_VERSION == request.version))
+   {
+      if (LBD_ROLE_COMMANDS == request.role)
+      {
+         response.status = LB_OK;
+         response.hello.controllerCount = lbd.controllerCount;
+         strncpy(response.hello.ringPath, lbd.ringPath, LBD_MAX_PATH - 1);
+      }
+      else if (LBD_ROLE_EVENTS == request.role)
+      {
+         response.status = LB_OK;
+      }
+   }
+
+   if (os_sendIpc(session->connection, &response, sizeof(response)) && (LB_OK == response.status))
+   {
+      if (LBD_ROLE_COMMANDS == request.role)
+      {
+         serveCommands(session);
+      }
+      else
+      {
+         serveEvents(session);
+      }
+   }
+
+   closeSession(session);
+}
+
+static bool openSession(struct os_ipcConnection* connection)
+{
+   struct session* session = calloc(1, sizeof(struct session));
+   if (! session)
+   {
+      return false;
+   }
+
+   session->connection = connection;
+   session->ready      = os_createCondition();
+
+   if (! session->ready)
+   {
+      free(session);
+      return false;
+   }
+
+   os_lock(lbd.lock);
+
+   bool accepted = (! lbd.stopping) && (lbd.sessionCount < MAX_SESSIONS);
+   if (accepted)
+   {
+      lbd.session[lbd.sessionCount ++] = session;
+      os_resetCondition(lbd.sessionsClosed);
+   }
+
+   os_unlock(lbd.lock);
+
+   if (! accepted)
+   {
+      os_destroyCondition(session->ready);
+      free(session);
+      return false;
+   }
+
+   if (! os_executeLater(0, serveClient, session))
+   {
+      // no worker; the session was never served
+      session->connection = NULL;
+      closeSession(session);
+      return false;
+   }
+
+   return true;
+}
+
+static void acceptClients(void* arg)
+{
+   (void) arg;
+
+   struct os_ipcConnection* connection;
+
+   while ((connection = os_acceptIpcConnection(lbd.server)))
+   {
+      if (! openSession(connection))
+      {
+         os_closeIpc(connection);
+      }
+   }
+
+   os_signalCondition(lbd.acceptStopped, NULL);
+}
+
+/*
+ * Stops accepting clients, then disconnects the connected ones and waits
+ * for their workers to finish
+ */
+static void stopServing(void)
+{
+   os_stopIpcServer(lbd.server);
+   os_waitForCondition(lbd.acceptStopped, UINT32_MAX, NULL);
+
+   os_lock(lbd.lock);
+
+   lbd.stopping = true;
+
+   for (uint32_t ii = 0; ii < lbd.sessionCount; ii ++)
+   {
+      os_shutdownIpc(lbd.session[ii]->connection);
+      os_signalCondition(lbd.session[ii]->ready, NULL);
+   }
+
+   os_unlock(lbd.lock);
+
+   os_waitForCondition(lbd.sessionsClosed, UINT32_MAX, NULL);
+}
+
+static bool createRing(const char* path)
+{
+   lbd.ringFile = os_mapFile(path, LBD_RING_HEADER_SIZE + RING_CAPACITY, true);
+   if (! lbd.ringFile)
+   {
+      return false;
+   }
+
+   lbd.ringPath = path;
+   lbd.ring     = os_getMappedAddress(lbd.ringFile);
+   lbd.records  = (uint8_t*) lbd.ring + LBD_RING_HEADER_SIZE;
+
+   lbd.ring->magic    = LBD_RING_MAGIC;
+   lbd.ring->version  = LBD_RING_VERSION;
+   lbd.ring->capacity = RING_CAPACITY;
+   atomic_store_explicit(&lbd.ring->claimed, 0, memory_order_relaxed);
+   atomic_store_explicit(&lbd.ring->head, 0, memory_order_release);
+
+   return true;
+}
+
+static bool createManager(const char* const* ports, uint32_t portCount)
+{
+   if ((1 == portCount) && strchr(ports[0], '*'))
+   {
+      lbd.manager = lb_createManagerForPorts(ports[0], NULL);
+   }
+   else
+   {
+      lbd.manager = lb_createManager(ports, portCount, NULL);
+   }
+
+   if (! lbd.manager)
+   {
+      return false;
+   }
+
+   struct LB_ManagedController state;
+
+   for (uint32_t ii = 0; (ii < MAX_CONTROLLERS) && lb_getManagedController(lbd.manager, ii, &state); ii ++)
+   {
+      lbd.controller[ii] = state.controller;
+      lbd.controllerCount ++;
+   }
+
+   return true;
+}
+
+int main(int argc, char* argv[])
+{
+   if (argc < 4)
+   {
+      puts("Usage: lightblued <socket path> <ring file path> <serial port pattern | serial port...>");
+      puts("The ring file path should be absolute; clients open it as given.");
+      return 1;
+   }
+
+   if (lb_initialize() < 0)
+   {
+      puts("Failed to initialize lightBLUE library");
+      return 2;
+   }
+
+   io_setDebugLevel(0);
+   lb_setDebugLevel(0);
+
+   lbd.lock           = os_createLock();
+   lbd.ringLock       = os_createLock();
+   lbd.scanLock       = os_createLock();
+   lbd.sessionsClosed = os_createCondition();
+   lbd.acceptStopped  = os_createCondition();
+   lbd.deviceIdle     = os_createCondition();
+
+   // no session is open yet
+   os_signalCondition(lbd.sessionsClosed, NULL);
+
+   if (! createRing(argv[2]))
+   {
+      printf("Failed to map %s.\n", argv[2]);
+      lb_cleanup();
+      return 3;
+   }
+
+   if (! createManager((const char* const*) &argv[3], (uint32_t) (argc - 3)))
+   {
+      puts("No controller could be initialized.");
+      os_unmapFile(lbd.ringFile);
+      lb_cleanup();
+      return 3;
+   }
+
+   lbd.server = os_createIpcServer(argv[1]);
+   if ((! lbd.server) || (! os_executeLater(0, acceptClients, NULL)))
+   {
+      printf("Failed to listen on %s.\n", argv[1]);
+      os_destroyIpcServer(lbd.server);
+      lb_destroyManager(lbd.manager);
+      os_unmapFile(lbd.ringFile);
+      lb_cleanup();
+      return 4;
+   }
+
+   printf("Serving %u controllers on %s. Press Ctrl-C to quit.\n", (unsigned) lbd.controllerCount, argv[1]);
+   os_waitForKeyboardInterrupt();
+
+   stopServing();
+
+   os_destroyIpcServer(lbd.server);
+   lb_destroyManager(lbd.manager);
+   os_unmapFile(lbd.ringFile);
+
+   os_destroyCondition(lbd.deviceIdle);
+   os_destroyCondition(lbd.acceptStopped);
+   os_destroyCondition(lbd.sessionsClosed);
+   os_destroyLock(lbd.scanLock);
+   os_destroyLock(lbd.ringLock);
+   os_destroyLock(lbd.lock);
+
+   lb_cleanup();
+
+   return 0;
+}
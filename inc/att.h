@@ -0,0 +1,173 @@
+/**
+ * @file att.h
+ * @brief Attribute Protocol definitions
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+/*
+ * Based on:
+ *    Bluetooth Core Specification Version 4.2, Vol 3, Part A and Part F
+ */
+
+#ifndef __ATT_H__
+#define __ATT_H__
+
+#include <stdint.h>
+
+/** @addtogroup lightBLUE lightBLUE
+ *
+ * @{
+ *
+ * @addtogroup lightBLUE_att Host ATT Client
+ *
+ * Protocol definitions used by the host ATT client and L2CAP signaling on
+ * controllers that pass ACL data to the host.
+ *
+ * @{
+ */
+
+/** L2CAP channel identifiers on LE links
+ */
+enum L2CAP_ChannelId
+{
+   L2CAP_CID_ATT                       = 0x0004,
+   L2CAP_CID_LE_SIGNALING              = 0x0005,
+   L2CAP_CID_SMP                       = 0x0006,
+   L2CAP_CID_DYNAMIC_FIRST             = 0x0040,
+   L2CAP_CID_DYNAMIC_LAST              = 0x007F,
+};
+
+/** L2CAP signaling command codes used on LE links
+ */
+enum L2CAP_SignalingCode
+{
+   L2CAP_COMMAND_REJECT                = 0x01,
+   L2CAP_DISCONNECTION_REQ             = 0x06,
+   L2CAP_DISCONNECTION_RSP             = 0x07,
+   L2CAP_CONNECTION_PARAMETER_UPDATE_REQ = 0x12,
+   L2CAP_CONNECTION_PARAMETER_UPDATE_RSP = 0x13,
+   L2CAP_LE_CREDIT_CONNECTION_REQ      = 0x14,
+   L2CAP_LE_CREDIT_CONNECTION_RSP      = 0x15,
+   L2CAP_LE_FLOW_CONTROL_CREDIT        = 0x16,
+};
+
+/** Results of an LE Credit Based Connection Request
+ */
+enum L2CAP_LECreditConnectionResult
+{
+   L2CAP_LE_CONNECTION_SUCCESSFUL      = 0x0000,
+   L2CAP_LE_PSM_NOT_SUPPORTED          = 0x0002,
+   L2CAP_LE_NO_RESOURCES               = 0x0004,
+   L2CAP_LE_INSUFFICIENT_AUTHENTICATION = 0x0005,
+   L2CAP_LE_INSUFFICIENT_AUTHORIZATION = 0x0006,
+   L2CAP_LE_INSUFFICIENT_KEY_SIZE      = 0x0007,
+   L2CAP_LE_INSUFFICIENT_ENCRYPTION    = 0x0008,
+   L2CAP_LE_INVALID_SOURCE_CID         = 0x0009,
+   L2CAP_LE_SOURCE_CID_ALLOCATED       = 0x000A,
+};
+
+/** Size of the signaling command header: code, identifier and length
+ */
+#define L2CAP_SIGNALING_HEADER_LENGTH  4
+
+/** Smallest MTU and MPS allowed on LE credit based channels
+ */
+#define L2CAP_LE_MIN_MTU               23
+
+/** Size of the basic L2CAP header: length and channel identifier
+ */
+#define L2CAP_HEADER_LENGTH            4
+
+/** ATT MTU on LE links before any exchange
+ */
+#define ATT_DEFAULT_MTU                23
+
+/** Attribute Protocol PDU opcodes
+ */
+enum ATT_Opcode
+{
+   ATT_ERROR_RSP                       = 0x01,
+   ATT_EXCHANGE_MTU_REQ                = 0x02,
+   ATT_EXCHANGE_MTU_RSP                = 0x03,
+   ATT_FIND_INFORMATION_REQ            = 0x04,
+   ATT_FIND_INFORMATION_RSP            = 0x05,
+   ATT_FIND_BY_TYPE_VALUE_REQ          = 0x06,
+   ATT_FIND_BY_TYPE_VALUE_RSP          = 0x07,
+   ATT_READ_BY_TYPE_REQ                = 0x08,
+   ATT_READ_BY_TYPE_RSP                = 0x09,
+   ATT_READ_REQ                        = 0x0A,
+   ATT_READ_RSP                        = 0x0B,
+   ATT_READ_BLOB_REQ                   = 0x0C,
+   ATT_READ_BLOB_RSP                   = 0x0D,
+   ATT_READ_MULTIPLE_REQ               = 0x0E,
+   ATT_READ_MULTIPLE_RSP               = 0x0F,
+   ATT_READ_BY_GROUP_TYPE_REQ          = 0x10,
+   ATT_READ_BY_GROUP_TYPE_RSP          = 0x11,
+   ATT_WRITE_REQ                       = 0x12,
+   ATT_WRITE_RSP                       = 0x13,
+   ATT_PREPARE_WRITE_REQ               = 0x16,
+   ATT_PREPARE_WRITE_RSP               = 0x17,
+   ATT_EXECUTE_WRITE_REQ               = 0x18,
+   ATT_EXECUTE_WRITE_RSP               = 0x19,
+   ATT_HANDLE_VALUE_NTF                = 0x1B,
+   ATT_HANDLE_VALUE_IND                = 0x1D,
+   ATT_HANDLE_VALUE_CFM                = 0x1E,
+   ATT_WRITE_CMD                       = 0x52,
+};
+
+/** Attribute Protocol error codes
+ */
+enum ATT_ErrorCode
+{
+   ATT_ERR_INVALID_HANDLE              = 0x01,
+   ATT_ERR_READ_NOT_PERMITTED          = 0x02,
+   ATT_ERR_WRITE_NOT_PERMITTED         = 0x03,
+   ATT_ERR_INVALID_PDU                 = 0x04,
+   ATT_ERR_INSUFFICIENT_AUTHENTICATION = 0x05,
+   ATT_ERR_REQUEST_NOT_SUPPORTED       = 0x06,
+   ATT_ERR_INVALID_OFFSET              = 0x07,
+   ATT_ERR_INSUFFICIENT_AUTHORIZATION  = 0x08,
+   ATT_ERR_PREPARE_QUEUE_FULL          = 0x09,
+   ATT_ERR_ATTRIBUTE_NOT_FOUND         = 0x0A,
+   ATT_ERR_ATTRIBUTE_NOT_LONG          = 0x0B,
+   ATT_ERR_INSUFFICIENT_KEY_SIZE       = 0x0C,
+   ATT_ERR_INVALID_VALUE_LENGTH        = 0x0D,
+   ATT_ERR_UNLIKELY                    = 0x0E,
+   ATT_ERR_INSUFFICIENT_ENCRYPTION     = 0x0F,
+   ATT_ERR_UNSUPPORTED_GROUP_TYPE      = 0x10,
+   ATT_ERR_INSUFFICIENT_RESOURCES      = 0x11,
+};
+
+/** GATT attribute types
+ */
+enum GATT_AttributeType
+{
+   GATT_PRIMARY_SERVICE                = 0x2800,
+   GATT_SECONDARY_SERVICE              = 0x2801,
+   GATT_INCLUDE                        = 0x2802,
+   GATT_CHARACTERISTIC                 = 0x2803,
+};
+
+/** @}
+ *
+ * @}
+ */
+
+#endif // __ATT_H__
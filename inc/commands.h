@@ -24,6 +24,8 @@
 #ifndef __COMMANDS_H__
 #define __COMMANDS_H__
 
+#include <stdbool.h>
+
 #include <hci.h>
 
 /** @addtogroup lightBLUE lightBLUE
@@ -43,6 +45,10 @@ struct LB_Controller;
  */
 struct LB_Device;
 
+/** Opaque L2CAP connection-oriented channel
+ */
+struct LB_Channel;
+
 /** Status code returned from all lightBLUE methods
  */
 enum LB_STATUS
@@ -53,6 +59,151 @@ enum LB_STATUS
    LB_CONTROLLER_NOT_CONNECTED,
    LB_DEVICE_NOT_CONNECTED,
    LB_OPERATION_TIMEOUT,
+   LB_INVALID_PARAMETERS,
+   LB_CONNECTION_LIMIT_REACHED,
+   LB_CHANNEL_CLOSED,
+   LB_QUEUE_FULL,
+   LB_CONNECTION_FAILED,
+};
+
+/** Device discovery parameters
+ */
+struct LB_ScanParameters
+{
+   bool     active;                 /**< request scan responses from advertisers */
+   uint16_t interval;               /**< scan interval, in 0.625 ms units (4 - 16384) */
+   uint16_t window;                 /**< scan window, in 0.625 ms units (4 - interval) */
+   bool     filterDuplicates;       /**< report each advertiser only once per discovery */
+   bool     randomOwnAddress;       /**< use a random address for scan requests; the standard HCI scan always uses the public address */
+   uint32_t duration_ms;            /**< discovery duration; 0 selects the controller default */
+};
+
+/** Selects which observed advertisements are passed to lb_on_observedDeviceAdvertisment
+ */
+enum LB_AdvertisementReportMode
+{
+   LB_REPORT_ALL,                   /**< every advertisement report */
+   LB_REPORT_NEW_DEVICES,           /**< only the first report from each device */
+   LB_REPORT_CHANGES,               /**< the first report, and reports with changed data or RSSI */
+};
+
+/** Configuration of the observed device table
+ */
+struct LB_ObserverConfig
+{
+   uint32_t capacity;               /**< maximum number of devices tracked */
+   enum LB_AdvertisementReportMode  reportMode;
+   uint8_t  rssiThreshold;          /**< change in averaged RSSI, in dBm, reported in LB_REPORT_CHANGES mode; 0 ignores RSSI */
+};
+
+/** Aggregated advertisements received from one device
+ */
+struct LB_ObservedDevice
+{
+   uint8_t  address[6];
+   uint64_t firstSeen_ms;           /**< as returned by os_getTime_ms */
+   uint64_t lastSeen_ms;
+   uint32_t reportCount;
+   int8_t   rssiLast;
+   int8_t   rssiMin;
+   int8_t   rssiMax;
+   int8_t   rssiAverage;            /**< exponentially weighted moving average, weight 1/8 */
+   uint8_t  dataLength;
+   uint8_t  data[31];               /**< last advertising payload */
+};
+
+/** Maximum number of scan filters installed at once
+ */
+#define LB_MAX_SCAN_FILTERS      32
+
+/** Advertisement filter; a report passes if it satisfies all enabled criteria
+ */
+struct LB_ScanFilter
+{
+   int8_t      minRSSI;             /**< weaker reports are rejected; INT8_MIN accepts any */
+   bool        matchServiceUUID;
+   uint16_t    serviceUUID;         /**< 16-bit service UUID that must be advertised */
+   bool        matchCompanyId;
+   uint16_t    companyId;           /**< company identifier of the manufacturer specific data */
+   const char* namePrefix;          /**< prefix of the local name; NULL to ignore */
+};
+
+/** Controller configuration, applied by lb_initializeHCI
+ */
+struct LB_ControllerConfig
+{
+   uint8_t  maxConnections;         /**< number of simultaneous device connections (1 - 8) */
+   bool     scanWhileConnected;     /**< keep device discovery available while connected */
+   bool     standardScan;           /**< discover devices with the standard LE scan commands instead of the vendor procedures */
+};
+
+/** Timeouts of the blocking operations, in milliseconds; a zero field
+ * selects the default, given in parentheses
+ *
+ * A device runs one discovery, read, write or connection update at a time,
+ * and queues the others; their timeouts include the time spent queued.
+ */
+struct LB_Timeouts
+{
+   uint32_t command_ms;             /**< HCI command status or completion (1000) */
+   uint32_t connect_ms;             /**< connection establishment (2000) */
+   uint32_t disconnect_ms;          /**< disconnection (1000) */
+   uint32_t serviceDiscovery_ms;    /**< primary service discovery (10000) */
+   uint32_t connectionUpdate_ms;    /**< connection parameter update, on top of ten connection intervals (1000) */
+   uint32_t read_ms;                /**< characteristic read (1000) */
+   uint32_t write_ms;               /**< characteristic write (1000) */
+   uint32_t attTransaction_ms;      /**< ATT transaction, with the host ATT client (30000) */
+   uint32_t signaling_ms;           /**< L2CAP signaling request (30000) */
+   uint32_t aclCredit_ms;           /**< wait for a controller ACL buffer (1000) */
+   uint32_t channelCredit_ms;       /**< wait for credits on a connection-oriented channel (10000) */
+};
+
+/** Scheduling class of the requests queued on a device
+ *
+ * Each device runs one request at a time, in order within a class. The
+ * controller issues the requests of the higher classes first, and shares
+ * every class round-robin among the devices with queued requests.
+ */
+enum LB_Priority
+{
+   LB_PRIORITY_CONTROL,             /**< default for writes and connection updates */
+   LB_PRIORITY_NORMAL,              /**< default for reads and service discovery */
+   LB_PRIORITY_BULK,                /**< background transfers */
+
+   LB_PRIORITY_COUNT,
+};
+
+/** Completion callback of the asynchronous requests
+ *
+ * It is called exactly once, on the I/O thread or on a library worker
+ * thread, and it must not block.
+ *
+ * @param context is the pointer passed with the request
+ * @param status is the status the blocking function would have returned
+ */
+typedef void (* LB_OperationCallback)(void* context, enum LB_STATUS status);
+
+/** Connection parameters, expressed in the units used by the Bluetooth
+ * Core Specification
+ */
+struct LB_ConnectionParameters
+{
+   uint16_t intervalMin;            /**< minimum connection interval, in 1.25 ms units (6 - 3200) */
+   uint16_t intervalMax;            /**< maximum connection interval, in 1.25 ms units (6 - 3200) */
+   uint16_t latency;                /**< slave latency, in connection events (0 - 499) */
+   uint16_t supervisionTimeout;     /**< supervision timeout, in 10 ms units (10 - 3200) */
+   uint16_t minCELength;            /**< minimum connection event length, in 0.625 ms units */
+   uint16_t maxCELength;            /**< maximum connection event length, in 0.625 ms units */
+};
+
+/** Predefined connection parameter sets
+ */
+enum LB_ConnectionProfile
+{
+   LB_CONNECTION_PROFILE_DEFAULT,      /**< 25 - 50 ms interval, no latency */
+   LB_CONNECTION_PROFILE_LOW_LATENCY,  /**< 7.5 ms interval, no latency */
+   LB_CONNECTION_PROFILE_THROUGHPUT,   /**< 7.5 - 15 ms interval, long connection events */
+   LB_CONNECTION_PROFILE_POWER_SAVE,   /**< 500 ms - 1 s interval, slave latency 2 */
 };
 
 /** Sends a formatted command buffer to the controller
@@ -92,7 +243,41 @@ enum LB_STATUS lb_resetHCI(struct LB_Controller* controller);
  */
 void lb_setDebugLevel(uint32_t level);
 
+/** Sets the configuration used by the next call to lb_initializeHCI
+ *
+ * The default configuration supports a single connection, without
+ * scanning while connected.
+ *
+ * On ST BlueNRG controllers the configuration selects the stack data mode:
+ * up to eight connections, or up to four connections with scanning.
+ *
+ * @param controller is the Bluetooth controller
+ * @param config is the controller configuration
+ * @return status
+ */
+enum LB_STATUS lb_setControllerConfig(struct LB_Controller* controller, const struct LB_ControllerConfig* config);
+
+/** Sets the timeouts of the blocking operations on a controller and its
+ * devices
+ *
+ * The new timeouts apply to the operations started afterwards.
+ *
+ * @param controller is the Bluetooth controller
+ * @param timeouts are the timeouts; zero fields select the defaults
+ */
+void lb_setTimeouts(struct LB_Controller* controller, const struct LB_Timeouts* timeouts);
+
+/** Retrieves the timeouts of the blocking operations
+ *
+ * @param controller is the Bluetooth controller
+ * @param[out] timeouts receives the timeouts in effect
+ */
+void lb_getTimeouts(struct LB_Controller* controller, struct LB_Timeouts* timeouts);
+
 /** Request manufacturer-specific initialization of a Bluetooth controller
+ *
+ * Controllers from manufacturers without specific support are driven with
+ * standard HCI commands, with the Attribute Protocol running on the host.
  *
  * @param controller is the Bluetooth controller
  * @return status
@@ -107,6 +292,61 @@ enum LB_STATUS lb_initializeHCI(struct LB_Controller* controller);
  */
 enum LB_STATUS lb_configureAsCentral(struct LB_Controller* controller);
 
+/** Keeps a record of the controller configuration and connections in a
+ * file, for lb_attachHCI
+ *
+ * The file is mapped in memory and updated as devices connect and
+ * disconnect, so the record stays current when the process exits
+ * abruptly. Each controller needs its own file.
+ *
+ * @param controller is the Bluetooth controller
+ * @param path is the file name; NULL stops the recording
+ * @return status
+ */
+enum LB_STATUS lb_setStateFile(struct LB_Controller* controller, const char* path);
+
+/** Attaches to a controller that may have been initialized by an earlier
+ * process, keeping its connections
+ *
+ * The controller is first asked for its version. If the state file shows
+ * it was initialized as a central by the same kind of controller with the
+ * same configuration, the connections recorded in the file are checked
+ * with the controller, and the ones it still has are taken over without a
+ * reset. Otherwise, or if none is left, the controller is initialized as
+ * with lb_initializeHCI and lb_configureAsCentral.
+ *
+ * Until then, the events of the links kept by the controller are dropped.
+ *
+ * @param controller is the Bluetooth controller, with no device connected
+ * @param[out] restored receives the number of connections taken over; 0
+ *    if the controller was initialized from scratch
+ * @return status
+ *
+ * @see lb_setStateFile
+ * @see lb_getConnectedDevices
+ */
+enum LB_STATUS lb_attachHCI(struct LB_Controller* controller, uint32_t* restored);
+
+/** Lists the connected devices
+ *
+ * @param controller is the Bluetooth controller
+ * @param[out] devices receives the devices
+ * @param capacity is the number of elements in devices
+ * @return the number of devices copied
+ */
+uint32_t lb_getConnectedDevices(struct LB_Controller* controller, struct LB_Device** devices, uint32_t capacity);
+
+
+/** Sets the parameters used by subsequent calls to lb_startDeviceDiscovery
+ *
+ * The defaults are an active scan with 1.25 s interval and window, random
+ * own address, duplicate filtering and the controller default duration.
+ *
+ * @param controller is the Bluetooth controller
+ * @param parameters are the discovery parameters
+ * @return status
+ */
+enum LB_STATUS lb_setScanParameters(struct LB_Controller* controller, const struct LB_ScanParameters* parameters);
 
 /** Starts the discovery of peripheral devices that are presently advertising
  *
@@ -122,6 +362,84 @@ enum LB_STATUS lb_startDeviceDiscovery(struct LB_Controller* controller);
  */
 enum LB_STATUS lb_stopDeviceDiscovery(struct LB_Controller* controller);
 
+/** Starts discovering devices in the background, until stopped
+ *
+ * The library restarts the discovery whenever it completes, suspends it
+ * while connections are being established, and switches between the two
+ * parameter sets depending on whether any device is connected. The
+ * connected set should use a short scan window relative to the interval, so
+ * scanning does not starve the connections of radio time.
+ *
+ * If the controller was not configured to scan while connected, background
+ * discovery pauses while any device is connected.
+ *
+ * @param controller is the Bluetooth controller
+ * @param idleParameters are used while no device is connected
+ * @param connectedParameters are used while devices are connected; if NULL,
+ *    the idle parameters are used with the window reduced to 1/8 of the interval
+ * @return status
+ */
+enum LB_STATUS lb_startBackgroundScan(struct LB_Controller* controller, const struct LB_ScanParameters* idleParameters, const struct LB_ScanParameters* connectedParameters);
+
+/** Stops background discovery
+ *
+ * @param controller is the Bluetooth controller
+ * @return status
+ */
+enum LB_STATUS lb_stopBackgroundScan(struct LB_Controller* controller);
+
+/** Installs advertisement filters
+ *
+ * The filters are compiled once, and evaluated on the I/O thread for every
+ * report before it is aggregated or passed to the application. A report
+ * is accepted if it passes any of the filters.
+ *
+ * @param controller is the Bluetooth controller
+ * @param filters are the filters
+ * @param count is the number of filters, at most LB_MAX_SCAN_FILTERS;
+ *    0 removes the filters, accepting every report
+ * @return status
+ */
+enum LB_STATUS lb_setScanFilters(struct LB_Controller* controller, const struct LB_ScanFilter* filters, uint32_t count);
+
+/** Starts aggregating observed advertisements per device
+ *
+ * Reports are accumulated in a table keyed by device address; the report
+ * mode controls which of them are still passed to
+ * lb_on_observedDeviceAdvertisment. When the table is full, reports from
+ * untracked devices are passed through as in LB_REPORT_ALL mode.
+ *
+ * @param controller is the Bluetooth controller
+ * @param config is the table configuration
+ * @return status
+ */
+enum LB_STATUS lb_enableObserver(struct LB_Controller* controller, const struct LB_ObserverConfig* config);
+
+/** Stops aggregating advertisements and releases the table
+ *
+ * @param controller is the Bluetooth controller
+ */
+void lb_disableObserver(struct LB_Controller* controller);
+
+/** Copies the observed device table
+ *
+ * @param controller is the Bluetooth controller
+ * @param[out] devices receives the devices
+ * @param capacity is the number of elements in devices
+ * @return the number of devices copied
+ */
+uint32_t lb_getObservedDevices(struct LB_Controller* controller, struct LB_ObservedDevice* devices, uint32_t capacity);
+
+/** Removes devices that have not been observed recently
+ *
+ * A device that is observed again after removal is reported as new.
+ *
+ * @param controller is the Bluetooth controller
+ * @param maxAge_ms is the time since the last report after which a device is removed
+ * @return the number of devices removed
+ */
+uint32_t lb_expireObservedDevices(struct LB_Controller* controller, uint32_t maxAge_ms);
+
 /** Called by the library when a device advertisement was observed
  *
  * @param controller is the Bluetooth controller
@@ -144,10 +462,28 @@ void lb_on_deviceDiscoveryComplete(struct LB_Controller* controller);
  * @param controller is the Bluetooth controller
  * @param address is the 6-byte Bluetooth address of the device
  * @param[out] device will contain the device reference
- * @return status
+ * @return status; LB_CONNECTION_FAILED if the controller reported a failed
+ * attempt, LB_OPERATION_TIMEOUT if the attempt was cancelled at the timeout
  */
 enum LB_STATUS lb_openDeviceConnection(struct LB_Controller* controller, const uint8_t* address, struct LB_Device** device);
 
+/** Returns the connection parameters associated with a predefined profile
+ *
+ * @param profile is the connection profile
+ * @return the connection parameters, or NULL if the profile is unknown
+ */
+const struct LB_ConnectionParameters* lb_getConnectionProfile(enum LB_ConnectionProfile profile);
+
+/** Creates a connection to a device, using the given connection parameters
+ *
+ * @param controller is the Bluetooth controller
+ * @param address is the 6-byte Bluetooth address of the device
+ * @param parameters are the requested connection parameters
+ * @param[out] device will contain the device reference
+ * @return status, as for lb_openDeviceConnection
+ */
+enum LB_STATUS lb_openDeviceConnectionWithParameters(struct LB_Controller* controller, const uint8_t* address, const struct LB_ConnectionParameters* parameters, struct LB_Device** device);
+
 /** @}
  *
  * @defgroup lightBLUE_device Device Interface
@@ -169,6 +505,35 @@ enum LB_STATUS lb_closeDeviceConnection(struct LB_Device* device);
  */
 void lb_on_disconnectedFromDevice(struct LB_Device* device, enum HCI_StatusCode reason);
 
+/** Changes the parameters of an established connection
+ *
+ * The call returns after the controller reports that the new parameters
+ * are in effect, or that the update has been rejected.
+ *
+ * @param device is the Bluetooth device
+ * @param parameters are the requested connection parameters
+ * @return status
+ */
+enum LB_STATUS lb_updateConnectionParameters(struct LB_Device* device, const struct LB_ConnectionParameters* parameters);
+
+/** Retrieves the parameters currently in effect for a connection
+ *
+ * @param device is the Bluetooth device
+ * @param[out] interval is the connection interval, in 1.25 ms units
+ * @param[out] latency is the slave latency, in connection events
+ * @param[out] supervisionTimeout is the supervision timeout, in 10 ms units
+ * @return status
+ */
+enum LB_STATUS lb_getConnectionParameters(struct LB_Device* device, uint16_t* interval, uint16_t* latency, uint16_t* supervisionTimeout);
+
+/** Retrieves the address of a connected device
+ *
+ * @param device is the Bluetooth device
+ * @param[out] address receives the 6-byte Bluetooth address
+ * @return status
+ */
+enum LB_STATUS lb_getDeviceAddress(struct LB_Device* device, uint8_t* address);
+
 
 /** Starts enumerating the primary services on a connected device
  *
@@ -177,6 +542,17 @@ void lb_on_disconnectedFromDevice(struct LB_Device* device, enum HCI_StatusCode
  */
 enum LB_STATUS lb_startServiceDiscovery(struct LB_Device* device);
 
+/** Queues the enumeration of the primary services on a connected device,
+ * and returns without waiting
+ *
+ * @param device is the Bluetooth device
+ * @param callback is called when the discovery completes or times out
+ * @param context is passed unchanged to the callback
+ * @return LB_OK if the request was queued, in which case the callback will
+ * be called; LB_QUEUE_FULL if the device has too many requests queued
+ */
+enum LB_STATUS lb_startServiceDiscoveryAsync(struct LB_Device* device, LB_OperationCallback callback, void* context);
+
 /** Called by the library when a primary service was observed
  *
  * @param device is the Bluetooth device
@@ -197,6 +573,48 @@ void lb_on_discoveredPrimaryService(struct LB_Device* device, uint16_t attribute
  */
 enum LB_STATUS lb_writeCharValue(struct LB_Device* device, uint16_t attributeHandle, const uint8_t* attributeValue, uint8_t attributeLength);
 
+/** Sets the value of a character attribute on a connected device, in the
+ * given scheduling class
+ *
+ * @param device is the Bluetooth device
+ * @param attributeHandle is the handle of the attribute
+ * @param attributeValue is the new value of the attribute
+ * @param attributeLength is the size of the new value
+ * @param priority is the scheduling class of the request
+ * @return status
+ */
+enum LB_STATUS lb_writeCharValueWithPriority(struct LB_Device* device, uint16_t attributeHandle, const uint8_t* attributeValue, uint8_t attributeLength, enum LB_Priority priority);
+
+/** Queues setting the value of a character attribute on a connected device,
+ * and returns without waiting
+ *
+ * @note The value must not be freed or changed until the callback is called.
+ *
+ * @param device is the Bluetooth device
+ * @param attributeHandle is the handle of the attribute
+ * @param attributeValue is the new value of the attribute
+ * @param attributeLength is the size of the new value
+ * @param priority is the scheduling class of the request
+ * @param callback is called when the write completes or times out
+ * @param context is passed unchanged to the callback
+ * @return LB_OK if the request was queued, in which case the callback will
+ * be called; LB_QUEUE_FULL if the device has too many requests queued
+ */
+enum LB_STATUS lb_writeCharValueAsync(struct LB_Device* device, uint16_t attributeHandle, const uint8_t* attributeValue, uint8_t attributeLength, enum LB_Priority priority, LB_OperationCallback callback, void* context);
+
+/** Sets the value of a character attribute, without waiting for a response
+ *
+ * The call returns once the controller accepted the write; the peer does
+ * not acknowledge it. Used to stream data to a peripheral.
+ *
+ * @param device is the Bluetooth device
+ * @param attributeHandle is the handle of the attribute
+ * @param attributeValue is the new value of the attribute
+ * @param attributeLength is the size of the new value
+ * @return status
+ */
+enum LB_STATUS lb_writeCharValueWithoutResponse(struct LB_Device* device, uint16_t attributeHandle, const uint8_t* attributeValue, uint8_t attributeLength);
+
 /** Retrieves the value of a character attribute on a connected device
  *
  * @param device is the Bluetooth device
@@ -208,6 +626,37 @@ enum LB_STATUS lb_writeCharValue(struct LB_Device* device, uint16_t attributeHan
  */
 enum LB_STATUS lb_readCharValue(struct LB_Device* device, uint16_t attributeHandle, uint8_t* attributeValue, uint8_t attributeCapacity, uint8_t* attributeLength);
 
+/** Retrieves the value of a character attribute on a connected device, in
+ * the given scheduling class
+ *
+ * @param device is the Bluetooth device
+ * @param attributeHandle is the handle of the attribute
+ * @param[out] attributeValue will receive the value of the attribute
+ * @param attributeCapacity is the size of the attribute value buffer
+ * @param[out] attributeLength is the size of the value
+ * @param priority is the scheduling class of the request
+ * @return status
+ */
+enum LB_STATUS lb_readCharValueWithPriority(struct LB_Device* device, uint16_t attributeHandle, uint8_t* attributeValue, uint8_t attributeCapacity, uint8_t* attributeLength, enum LB_Priority priority);
+
+/** Queues retrieving the value of a character attribute on a connected
+ * device, and returns without waiting
+ *
+ * @note The buffers must stay valid until the callback is called.
+ *
+ * @param device is the Bluetooth device
+ * @param attributeHandle is the handle of the attribute
+ * @param[out] attributeValue will receive the value of the attribute
+ * @param attributeCapacity is the size of the attribute value buffer
+ * @param[out] attributeLength is the size of the value
+ * @param priority is the scheduling class of the request
+ * @param callback is called when the read completes or times out
+ * @param context is passed unchanged to the callback
+ * @return LB_OK if the request was queued, in which case the callback will
+ * be called; LB_QUEUE_FULL if the device has too many requests queued
+ */
+enum LB_STATUS lb_readCharValueAsync(struct LB_Device* device, uint16_t attributeHandle, uint8_t* attributeValue, uint8_t attributeCapacity, uint8_t* attributeLength, enum LB_Priority priority, LB_OperationCallback callback, void* context);
+
 
 /** Called by the library when it receives an attribute notification
  *
@@ -219,6 +668,59 @@ enum LB_STATUS lb_readCharValue(struct LB_Device* device, uint16_t attributeHand
  */
 void lb_on_receivedNotification(struct LB_Device* device, uint16_t attributeHandle, uint8_t status, const uint8_t* attributeValue, uint8_t attributeLength);
 
+
+/** Opens an LE credit based connection-oriented channel to a service
+ *
+ * Channels carry a byte stream in both directions without the per-PDU
+ * overhead of the Attribute Protocol, and are intended for bulk transfers.
+ * They require a controller that passes ACL data to the host.
+ *
+ * @param device is the Bluetooth device
+ * @param psm is the LE Protocol/Service Multiplexer of the service
+ * @param[out] channel will contain the channel reference
+ * @return status
+ */
+enum LB_STATUS lb_openChannel(struct LB_Device* device, uint16_t psm, struct LB_Channel** channel);
+
+/** Sends data on a channel
+ *
+ * The data is split into SDUs no larger than the peer MTU. The call
+ * returns once all of it has been passed to the controller, waiting for
+ * credits from the peer as needed.
+ *
+ * @param channel is the channel
+ * @param data is the data to send
+ * @param length is the size of the data
+ * @return status; LB_OPERATION_TIMEOUT if the peer stopped granting credits
+ */
+enum LB_STATUS lb_writeChannel(struct LB_Channel* channel, const uint8_t* data, uint32_t length);
+
+/** Receives data from a channel
+ *
+ * Waits until some data is available, and returns as much of it as fits;
+ * SDU boundaries are not preserved. Credits are granted to the peer as
+ * the received data is consumed.
+ *
+ * @param channel is the channel
+ * @param[out] buffer will receive the data
+ * @param capacity is the size of the buffer
+ * @param[out] length is the size of the received data
+ * @param timeout_ms is the maximum time to wait for data
+ * @return status; LB_CHANNEL_CLOSED once the channel was closed and all
+ *    received data was consumed
+ */
+enum LB_STATUS lb_readChannel(struct LB_Channel* channel, uint8_t* buffer, uint32_t capacity, uint32_t* length, uint32_t timeout_ms);
+
+/** Closes a channel and releases it
+ *
+ * Channels still open when the device connection is closed are released
+ * with it.
+ *
+ * @param channel is the channel
+ * @return status
+ */
+enum LB_STATUS lb_closeChannel(struct LB_Channel* channel);
+
 /** @}
  *
  * @}
@@ -24,6 +24,8 @@
 #ifndef __CONNECTION_H__
 #define __CONNECTION_H__
 
+#include <stdint.h>
+
 /** @addtogroup lightBLUE lightBLUE
  *
  * @{
@@ -37,6 +39,16 @@
  */
 int lb_initialize(void);
 
+/** Initialize the lightBLUE library in single-threaded mode
+ *
+ * No thread is started: the controller data is read, parsed and dispatched,
+ * and the lb_on_ events are invoked, from lb_poll on the calling thread.
+ * The library must be used from that thread only. The blocking functions
+ * call lb_poll while they wait, so they can be used on the polling thread,
+ * except from the events.
+ */
+int lb_initializePolled(void);
+
 /** Un-initialize the lightBLUE library
  */
 void lb_cleanup(void);
@@ -60,11 +72,39 @@ struct LB_Controller;
 struct LB_Controller* lb_connect(const char* portName);
 
 /** Disconnect from a Bluetooth controller
+ *
+ * The device connections are not closed: they stay up in the controller,
+ * and a state file keeps them for a later lb_attachHCI. The device objects
+ * must not be used afterwards.
  *
  * @param controller is a pointer to a controller object
  */
 void lb_disconnect(struct LB_Controller* controller);
 
+/** Returns the OS object signaled when data has arrived from the controller
+ *
+ * An application running its own event loop waits on it, and calls lb_poll
+ * when it is signaled, or when the timeout returned by os_getNextTimeout_ms
+ * elapses.
+ *
+ * @param controller is a pointer to a controller object
+ * @return the handle, or -1 if the library was not initialized with
+ * lb_initializePolled
+ */
+intptr_t lb_getPollFd(struct LB_Controller* controller);
+
+/** Processes the data received from the controllers and the expired
+ * timers; single-threaded mode only
+ *
+ * All the controllers are serviced, not only the given one.
+ *
+ * @param controller is a pointer to a controller object
+ * @param timeout_ms is the maximum amount of time to wait when nothing is
+ * pending
+ * @return the number of events processed
+ */
+int lb_poll(struct LB_Controller* controller, uint32_t timeout_ms);
+
 /** @}
  *
  * @}
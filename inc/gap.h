@@ -30,6 +30,7 @@
 #ifndef __GAP_H__
 #define __GAP_H__
 
+#include <stdbool.h>
 #include <stdint.h>
 
 /** @addtogroup lightBLUE lightBLUE
@@ -47,13 +48,199 @@ enum GAP_AdvertisingData
 {
    AD_TYPE_FLAGS                       = 0x01,
    AD_TYPE_16_BIT_SERV_UUID            = 0x02,
+   AD_TYPE_16_BIT_SERV_UUID_CMPLT      = 0x03,
+   AD_TYPE_32_BIT_SERV_UUID            = 0x04,
+   AD_TYPE_32_BIT_SERV_UUID_CMPLT      = 0x05,
+   AD_TYPE_128_BIT_SERV_UUID           = 0x06,
+   AD_TYPE_128_BIT_SERV_UUID_CMPLT     = 0x07,
    AD_TYPE_SHORTENED_LOCAL_NAME        = 0x08,
    AD_TYPE_COMPLETE_LOCAL_NAME         = 0x09,
    AD_TYPE_TX_POWER_LEVEL              = 0x0A,
    AD_TYPE_SLAVE_CONN_INTERVAL         = 0x12,
+   AD_TYPE_SERVICE_DATA                = 0x16,
+   AD_TYPE_SERVICE_DATA_32_BIT_UUID    = 0x20,
+   AD_TYPE_SERVICE_DATA_128_BIT_UUID   = 0x21,
    AD_TYPE_MANUFACTURER_SPECIFIC_DATA  = 0xFF,
 };
 
+/** One AD structure inside an advertising payload
+ *
+ * The value points into the advertising payload; it is valid only as long
+ * as the payload is.
+ */
+struct GAP_ADStructure
+{
+   uint8_t              type;             /**< AD type, see @ref GAP_AdvertisingData */
+   uint8_t              length;           /**< Length of the value, excluding the type */
+   const uint8_t*       value;            /**< AD value */
+};
+
+/** Iterator over the AD structures of an advertising payload
+ *
+ * Initialize with @ref gap_initADIterator, then call @ref gap_nextADStructure
+ * until it returns false.
+ */
+struct GAP_ADIterator
+{
+   const uint8_t*       position;
+   const uint8_t*       end;
+   bool                 malformed;        /**< Set if iteration stopped on a structure overrunning the payload */
+};
+
+/** List of service UUIDs, all of the same width
+ */
+struct GAP_UUIDList
+{
+   const uint8_t*       value;            /**< UUIDs, little endian */
+   uint8_t              width;            /**< UUID width in bytes: 2, 4 or 16 */
+   uint8_t              count;            /**< Number of UUIDs */
+   bool                 complete;         /**< True if the advertiser claims the list is complete */
+};
+
+/** Service data, preceded by the service UUID
+ */
+struct GAP_ServiceData
+{
+   const uint8_t*       uuid;             /**< Service UUID, little endian */
+   uint8_t              uuidWidth;        /**< UUID width in bytes: 2, 4 or 16 */
+   const uint8_t*       value;            /**< Service data */
+   uint8_t              length;           /**< Length of the service data */
+};
+
+/** Prepares an iterator over an advertising payload
+ *
+ * @param iterator is the iterator to initialize
+ * @param advertisingData is the payload of the advertisement packet
+ * @param length is the length of the advertisement data
+ */
+void gap_initADIterator(struct GAP_ADIterator* iterator, const uint8_t* advertisingData, uint8_t length);
+
+/** Advances to the next AD structure
+ *
+ * Iteration stops at the end of the payload, at a zero length field (the
+ * start of the non-significant part), or at a structure whose length
+ * overruns the payload, in which case the iterator is marked malformed.
+ *
+ * @param iterator is the iterator
+ * @param structure receives the AD structure
+ * @return true if a structure was decoded
+ */
+bool gap_nextADStructure(struct GAP_ADIterator* iterator, struct GAP_ADStructure* structure);
+
+/** Finds the first AD structure of a given type
+ *
+ * @param advertisingData is the payload of the advertisement packet
+ * @param length is the length of the advertisement data
+ * @param type is the AD type to look for
+ * @param structure receives the AD structure
+ * @return true if found
+ */
+bool gap_findADStructure(const uint8_t* advertisingData, uint8_t length, uint8_t type, struct GAP_ADStructure* structure);
+
+/** Extracts the flags
+ *
+ * @param advertisingData is the payload of the advertisement packet
+ * @param length is the length of the advertisement data
+ * @param flags receives the flags
+ * @return true if the payload has a well-formed flags field
+ */
+bool gap_getFlags(const uint8_t* advertisingData, uint8_t length, uint8_t* flags);
+
+/** Extracts the TX power level
+ *
+ * @param advertisingData is the payload of the advertisement packet
+ * @param length is the length of the advertisement data
+ * @param txPower receives the TX power level, in dBm
+ * @return true if the payload has a well-formed TX power level field
+ */
+bool gap_getTxPowerLevel(const uint8_t* advertisingData, uint8_t length, int8_t* txPower);
+
+/** Extracts the local name, preferring the complete name over the shortened one
+ *
+ * The name is not zero terminated.
+ *
+ * @param advertisingData is the payload of the advertisement packet
+ * @param length is the length of the advertisement data
+ * @param name receives a pointer to the name
+ * @param nameLength receives the length of the name
+ * @param complete receives true if the name is complete, may be NULL
+ * @return true if the payload has a local name
+ */
+bool gap_getLocalName(const uint8_t* advertisingData, uint8_t length, const char** name, uint8_t* nameLength, bool* complete);
+
+/** Extracts the first list of service UUIDs with the given width
+ *
+ * @param advertisingData is the payload of the advertisement packet
+ * @param length is the length of the advertisement data
+ * @param width is the UUID width in bytes: 2, 4 or 16
+ * @param list receives the UUID list
+ * @return true if the payload has a well-formed list of the given width
+ */
+bool gap_getServiceUUIDs(const uint8_t* advertisingData, uint8_t length, uint8_t width, struct GAP_UUIDList* list);
+
+/** Returns one 16-bit UUID from a list
+ *
+ * @param list is a list of 16-bit UUIDs
+ * @param index is the index of the UUID, less than the list count
+ * @return the UUID
+ */
+uint16_t gap_getUUID16(const struct GAP_UUIDList* list, uint8_t index);
+
+/** Returns one 32-bit UUID from a list
+ *
+ * @param list is a list of 32-bit UUIDs
+ * @param index is the index of the UUID, less than the list count
+ * @return the UUID
+ */
+uint32_t gap_getUUID32(const struct GAP_UUIDList* list, uint8_t index);
+
+/** Returns one 128-bit UUID from a list
+ *
+ * @param list is a list of 128-bit UUIDs
+ * @param index is the index of the UUID, less than the list count
+ * @return a pointer to the 16 bytes of the UUID, little endian
+ */
+const uint8_t* gap_getUUID128(const struct GAP_UUIDList* list, uint8_t index);
+
+/** Checks whether a 16-bit service UUID is advertised, in either the complete or incomplete list
+ *
+ * @param advertisingData is the payload of the advertisement packet
+ * @param length is the length of the advertisement data
+ * @param uuid is the service UUID
+ * @return true if advertised
+ */
+bool gap_hasServiceUUID16(const uint8_t* advertisingData, uint8_t length, uint16_t uuid);
+
+/** Extracts the manufacturer specific data
+ *
+ * @param advertisingData is the payload of the advertisement packet
+ * @param length is the length of the advertisement data
+ * @param companyId receives the company identifier
+ * @param data receives a pointer to the data following the company identifier
+ * @param dataLength receives the length of the data
+ * @return true if the payload has a well-formed manufacturer specific data field
+ */
+bool gap_getManufacturerData(const uint8_t* advertisingData, uint8_t length, uint16_t* companyId, const uint8_t** data, uint8_t* dataLength);
+
+/** Decodes a service data AD structure
+ *
+ * @param structure is an AD structure of type @ref AD_TYPE_SERVICE_DATA,
+ *    @ref AD_TYPE_SERVICE_DATA_32_BIT_UUID or @ref AD_TYPE_SERVICE_DATA_128_BIT_UUID
+ * @param serviceData receives the service data
+ * @return true if the structure is well-formed service data
+ */
+bool gap_decodeServiceData(const struct GAP_ADStructure* structure, struct GAP_ServiceData* serviceData);
+
+/** Finds the service data for a 16-bit service UUID
+ *
+ * @param advertisingData is the payload of the advertisement packet
+ * @param length is the length of the advertisement data
+ * @param uuid is the service UUID
+ * @param serviceData receives the service data
+ * @return true if found
+ */
+bool gap_getServiceData16(const uint8_t* advertisingData, uint8_t length, uint16_t uuid, struct GAP_ServiceData* serviceData);
+
 /** Decodes advertising packet to stdout
  *
  * @param advertisingData is the payload of the advertisement packet
@@ -146,6 +146,26 @@ enum HCI_Meta_Events
    HCI_LE_LONG_TERM_KEY_REQUEST_EVENT        = 0x05,
 };
 
+/*
+ * 5.4.2 HCI ACL Data Packets
+ */
+struct HCI_ACLDataHeader
+{
+   uint8_t                    packetType;       // == HCI_PACKET_ACL_DATA
+   struct BigEndianUnsigned16 handle;           // connection handle, packet boundary and broadcast flags
+   struct BigEndianUnsigned16 length;
+};
+
+enum HCI_ACLPacketBoundary
+{
+   HCI_ACL_FIRST_NON_FLUSHABLE            = 0x0000,
+   HCI_ACL_CONTINUING_FRAGMENT            = 0x1000,
+   HCI_ACL_FIRST_FLUSHABLE                = 0x2000,
+};
+
+#define HCI_ACL_HANDLE_MASK               0x0FFF
+#define HCI_ACL_BOUNDARY_MASK             0x3000
+
 struct HCI_EventHeader
 {
    uint8_t  packetType;       // == HCI_PACKET_EVENT
@@ -155,10 +175,24 @@ struct HCI_EventHeader
 
 enum HCI_CommandOpcode
 {
+   HCI_DISCONNECT                         = 0x0406,
+
    HCI_READ_LOCAL_VERSION_INFORMATION     = 0x1001,
+   HCI_READ_BUFFER_SIZE                   = 0x1005,
 
+   HCI_SET_EVENT_MASK                     = 0x0C01,
    HCI_RESET                              = 0x0C03,
 
+   HCI_READ_RSSI                          = 0x1405,
+
+   HCI_LE_SET_EVENT_MASK                  = 0x2001,
+   HCI_LE_READ_BUFFER_SIZE                = 0x2002,
+   HCI_LE_SET_SCAN_PARAMETERS             = 0x200B,
+   HCI_LE_SET_SCAN_ENABLE                 = 0x200C,
+   HCI_LE_CREATE_CONNECTION               = 0x200D,
+   HCI_LE_CREATE_CONNECTION_CANCEL        = 0x200E,
+   HCI_LE_CONNECTION_UPDATE               = 0x2013,
+
 };
 
 
@@ -194,6 +228,26 @@ struct HCI_EVENT_Vendor_Specific
 
 void hci_on_vendorSpecificEvent(struct LB_Controller* controller, struct HCI_EVENT_Vendor_Specific* event, uint8_t length);
 
+struct HCI_RESPONSE_LE_Read_Buffer_Size
+{
+   struct BigEndianUnsigned16 dataPacketLength;
+   uint8_t                    totalDataPackets;
+};
+
+struct HCI_RESPONSE_Read_Buffer_Size
+{
+   struct BigEndianUnsigned16 aclDataPacketLength;
+   uint8_t                    synchronousDataPacketLength;
+   struct BigEndianUnsigned16 totalACLDataPackets;
+   struct BigEndianUnsigned16 totalSynchronousDataPackets;
+};
+
+struct HCI_RESPONSE_Read_RSSI
+{
+   struct BigEndianUnsigned16 connectionHandle;
+   int8_t                     rssi;
+};
+
 struct HCI_RESPONSE_Read_Local_Version_Information
 {
    uint8_t                    hciVersion;
@@ -390,6 +444,18 @@ struct Event_HCI_LE_CONNECTION_COMPLETE
    uint8_t                    clockAccuracy;
 };
 
+/*
+ * 7.7.65.3 LE Connection Update Complete Event
+ */
+struct Event_HCI_LE_CONNECTION_UPDATE_COMPLETE
+{
+   uint8_t                    status;
+   struct BigEndianUnsigned16 connectionHandle;
+   struct BigEndianUnsigned16 connectionInterval;
+   struct BigEndianUnsigned16 connectionLatency;
+   struct BigEndianUnsigned16 supervisionTimeout;
+};
+
 /*
  * 7.7.5 Disconnection Complete Event
  */
@@ -0,0 +1,723 @@
+/**
+ * @file lightblue.hpp
+ * @brief C++20 coroutine interface over the asynchronous requests
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+#ifndef __LIGHTBLUE_HPP__
+#define __LIGHTBLUE_HPP__
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <utility>
+
+extern "C"
+{
+#include <osal_core.h>
+
+#include <commands.h>
+#include <controller.h>
+}
+
+/** @addtogroup lightBLUE lightBLUE
+ *
+ * @{
+ *
+ * @defgroup lightBLUE_coroutines C++ Coroutines
+ *
+ * Coroutines awaiting device requests, resumed by an executor.
+ *
+ * The coroutine frames are taken from a pool the executor allocates up
+ * front, and the awaiters live in the frames: awaiting a read, a write or a
+ * discovery allocates nothing. The requests complete on the I/O thread, or
+ * inside lb_poll in single-threaded mode, and the executor resumes the
+ * coroutines on the thread running it.
+ *
+ * @{
+ */
+
+namespace lightblue
+{
+
+class Executor;
+
+/** Intrusive node of the executor ready queue
+ */
+class Resumable
+{
+   friend class Executor;
+
+   Resumable*                 next = nullptr;
+
+protected:
+   std::coroutine_handle<>    handle;
+};
+
+/** Fixed pool of coroutine frames
+ */
+class FramePool
+{
+public:
+
+   /** Allocates the frames
+    *
+    * @param frameSize is the largest coroutine frame served
+    * @param frameCount is the number of frames
+    */
+   FramePool(std::size_t frameSize, std::size_t frameCount) noexcept
+   {
+      blockSize = sizeof(Header) + (frameSize + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+
+      lock   = os_createLock();
+      memory = static_cast<unsigned char*>(std::malloc(blockSize * frameCount));
+
+      if (! (lock && memory))
+      {
+         return;
+      }
+
+      for (std::size_t ii = frameCount; ii > 0; ii --)
+      {
+         Header* header = reinterpret_cast<Header*>(memory + (ii - 1) * blockSize);
+         header->pool = this;
+         header->next = free;
+         free = header;
+      }
+   }
+
+   ~FramePool()
+   {
+      std::free(memory);
+      os_destroyLock(lock);
+   }
+
+   FramePool(const FramePool&) = delete;
+   FramePool& operator=(const FramePool&) = delete;
+
+   /** Takes a frame from the pool
+    *
+    * @param size is the size of the coroutine frame
+    * @return the frame, or nullptr if it is too large or the pool is exhausted
+    */
+   void* allocate(std::size_t size) noexcept
+   {
+      if ((! lock) || (sizeof(Header) + size > blockSize))
+      {
+         return nullptr;
+      }
+
+      os_lock(lock);
+
+      Header* header = free;
+      if (header)
+      {
+         free = header->next;
+      }
+
+      os_unlock(lock);
+
+      return header ? header + 1 : nullptr;
+   }
+
+   /** Returns a frame to the pool it came from
+    *
+    * @param frame is the coroutine frame
+    */
+   static void release(void* frame) noexcept
+   {
+      Header* header = static_cast<Header*>(frame) - 1;
+      FramePool* pool = header->pool;
+
+      os_lock(pool->lock);
+
+      header->next = pool->free;
+      pool->free = header;
+
+      os_unlock(pool->lock);
+   }
+
+private:
+
+   struct alignas(std::max_align_t) Header
+   {
+      FramePool*     pool;
+      Header*        next;
+   };
+
+   struct os_lock*   lock   = nullptr;
+   unsigned char*    memory = nullptr;
+   Header*           free   = nullptr;
+   std::size_t       blockSize;
+};
+
+/** Resumes the coroutines whose requests have completed
+ *
+ * The executor is run by a single thread; the coroutines started on it run
+ * on that thread only, and must not block.
+ */
+class Executor
+{
+public:
+
+   /** Creates an executor and its frame pool
+    *
+    * @param frameSize is the largest coroutine frame
+    * @param frameCount is the maximum number of coroutines alive at once
+    */
+   Executor(std::size_t frameSize, std::size_t frameCount) noexcept :
+      frames(frameSize, frameCount),
+      lock(os_createLock()),
+      ready(os_createCondition())
+   {
+   }
+
+   ~Executor()
+   {
+      os_destroyCondition(ready);
+      os_destroyLock(lock);
+   }
+
+   Executor(const Executor&) = delete;
+   Executor& operator=(const Executor&) = delete;
+
+   /** Queues a suspended coroutine to be resumed; may be called on any thread
+    *
+    * @param node is the awaiter of the coroutine
+    */
+   void post(Resumable& node) noexcept
+   {
+      os_lock(lock);
+
+      node.next = nullptr;
+      *tail = &node;
+      tail = &node.next;
+
+      os_signalCondition(ready, nullptr);
+
+      os_unlock(lock);
+   }
+
+   /** Resumes the queued coroutines, waiting for one if none is queued
+    *
+    * @param timeout_ms is the maximum amount of time to wait
+    * @return the number of coroutines resumed
+    */
+   uint32_t runOnce(uint32_t timeout_ms) noexcept
+   {
+      uint32_t count = resumeReady();
+      if (0 == count)
+      {
+         os_waitForCondition(ready, timeout_ms, nullptr);
+         count = resumeReady();
+      }
+      return count;
+   }
+
+   /** Resumes coroutines until all of them have returned
+    */
+   void run() noexcept
+   {
+      while (tasks.load(std::memory_order_acquire))
+      {
+         runOnce(UINT32_MAX);
+      }
+   }
+
+   /** Processes the controller events, then resumes the coroutines whose
+    * requests they completed; single-threaded mode only
+    *
+    * @param controller is a pointer to a controller object
+    * @param timeout_ms is the maximum amount of time to wait for events
+    * @return the number of coroutines resumed
+    *
+    * @see lb_poll
+    */
+   uint32_t poll(LB_Controller* controller, uint32_t timeout_ms) noexcept
+   {
+      lb_poll(controller, timeout_ms);
+      return resumeReady();
+   }
+
+   /** Returns the number of coroutines started on the executor and not
+    * returned yet
+    */
+   uint32_t pending() const noexcept
+   {
+      return tasks.load(std::memory_order_acquire);
+   }
+
+   FramePool& framePool() noexcept
+   {
+      return frames;
+   }
+
+private:
+
+   friend class Task;
+
+   uint32_t resumeReady() noexcept
+   {
+      os_lock(lock);
+
+      Resumable* node = head;
+      head = nullptr;
+      tail = &head;
+
+      os_resetCondition(ready);
+
+      os_unlock(lock);
+
+      uint32_t count = 0;
+
+      while (node)
+      {
+         // the node lives in the frame, which may be gone after resuming
+         Resumable* next = node->next;
+         node->handle.resume();
+         node = next;
+         count ++;
+      }
+
+      return count;
+   }
+
+   FramePool               frames;
+
+   struct os_lock*         lock;
+   struct os_condition*    ready;
+   Resumable*              head = nullptr;
+   Resumable**             tail = &head;
+
+   std::atomic<uint32_t>   tasks{0};
+};
+
+/** A coroutine started on an executor, which runs it until it returns
+ *
+ * The first parameter of the coroutine must be the executor, which
+ * provides the frame. A coroutine is not started if the pool has no frame
+ * for it; the Task object tells.
+ */
+class Task
+{
+public:
+
+   struct promise_type : Resumable
+   {
+      template <typename... Args>
+      static void* operator new(std::size_t size, Executor& executor, Args&...) noexcept
+      {
+         return executor.framePool().allocate(size);
+      }
+
+      static void operator delete(void* frame) noexcept
+      {
+         FramePool::release(frame);
+      }
+
+      static Task get_return_object_on_allocation_failure() noexcept
+      {
+         return Task(false);
+      }
+
+      template <typename... Args>
+      promise_type(Executor& executor, Args&...) noexcept :
+         executor(executor)
+      {
+         executor.tasks.fetch_add(1, std::memory_order_acq_rel);
+      }
+
+      ~promise_type()
+      {
+         executor.tasks.fetch_sub(1, std::memory_order_acq_rel);
+      }
+
+      Task get_return_object() noexcept
+      {
+         return Task(true);
+      }
+
+      // the first run happens on the executor
+      auto initial_suspend() noexcept
+      {
+         struct Schedule
+         {
+            promise_type& promise;
+
+            bool await_ready() const noexcept { return false; }
+
+            void await_suspend(std::coroutine_handle<promise_type> coroutine) noexcept
+            {
+               promise.handle = coroutine;
+               promise.executor.post(promise);
+            }
+
+            void await_resume() const noexcept {}
+         };
+
+         return Schedule{*this};
+      }
+
+      std::suspend_never final_suspend() noexcept
+      {
+         return {};
+      }
+
+      void return_void() noexcept
+      {
+      }
+
+      void unhandled_exception() noexcept
+      {
+         std::terminate();
+      }
+
+      Executor&   executor;
+   };
+
+   /** Returns true if the coroutine was started
+    */
+   explicit operator bool() const noexcept
+   {
+      return started;
+   }
+
+private:
+
+   explicit Task(bool started) noexcept :
+      started(started)
+   {
+   }
+
+   bool started;
+};
+
+/** Base of the awaiters of the asynchronous requests
+ */
+class Request : public Resumable
+{
+public:
+
+   bool await_ready() const noexcept
+   {
+      return false;
+   }
+
+protected:
+
+   explicit Request(Executor& executor) noexcept :
+      executor(executor)
+   {
+   }
+
+   /*
+    * Suspends if the request was queued; the callback may run on another
+    * thread before the request function returns
+    */
+   bool suspend(std::coroutine_handle<> coroutine, enum LB_STATUS (* submit)(Request* request)) noexcept
+   {
+      handle = coroutine;
+
+      const enum LB_STATUS queued = submit(this);
+      if (LB_OK != queued)
+      {
+         status = queued;
+         return false;
+      }
+
+      return true;
+   }
+
+   static void onComplete(void* context, enum LB_STATUS status) noexcept
+   {
+      Request* request = static_cast<Request*>(context);
+
+      request->status = status;
+      request->executor.post(*request);
+   }
+
+   Executor&         executor;
+   enum LB_STATUS    status = LB_OK;
+};
+
+/** Outcome of a characteristic read
+ */
+struct Value
+{
+   enum LB_STATUS    status;
+   uint8_t           length;
+   uint8_t           data[UINT8_MAX];
+};
+
+/** A connected device, with its requests resumed by an executor
+ */
+class Device
+{
+public:
+
+   Device() noexcept = default;
+
+   Device(Executor& executor, LB_Device* device) noexcept :
+      executor(&executor),
+      device(device)
+   {
+   }
+
+   LB_Device* get() const noexcept
+   {
+      return device;
+   }
+
+   /** Reads a characteristic value
+    *
+    * @param attributeHandle is the handle of the attribute
+    * @param priority is the scheduling class of the request
+    * @return an awaiter producing a Value
+    */
+   auto read(uint16_t attributeHandle, enum LB_Priority priority = LB_PRIORITY_NORMAL) const noexcept
+   {
+      class Read : public Request
+      {
+      public:
+
+         Read(Executor& executor, LB_Device* device, uint16_t attributeHandle, enum LB_Priority priority) noexcept :
+            Request(executor),
+            device(device),
+            attributeHandle(attributeHandle),
+            priority(priority)
+         {
+         }
+
+         bool await_suspend(std::coroutine_handle<> coroutine) noexcept
+         {
+            return suspend(coroutine, [](Request* request) noexcept
+                  {
+                     Read* read = static_cast<Read*>(request);
+                     return lb_readCharValueAsync(read->device, read->attributeHandle, read->value.data, UINT8_MAX,
+                           &read->value.length, read->priority, onComplete, read);
+                  });
+         }
+
+         // the awaiter is a temporary, gone after the co_await expression
+         Value await_resume() noexcept
+         {
+            value.status = status;
+            return value;
+         }
+
+      private:
+
+         LB_Device*        device;
+         uint16_t          attributeHandle;
+         enum LB_Priority  priority;
+         Value             value{};
+      };
+
+      return Read(*executor, device, attributeHandle, priority);
+   }
+
+   /** Writes a characteristic value
+    *
+    * @note The value must stay valid until the write completes.
+    *
+    * @param attributeHandle is the handle of the attribute
+    * @param attributeValue is the new value of the attribute
+    * @param attributeLength is the size of the new value
+    * @param priority is the scheduling class of the request
+    * @return an awaiter producing the status
+    */
+   auto write(uint16_t attributeHandle, const uint8_t* attributeValue, uint8_t attributeLength, enum LB_Priority priority = LB_PRIORITY_CONTROL) const noexcept
+   {
+      class Write : public Request
+      {
+      public:
+
+         Write(Executor& executor, LB_Device* device, uint16_t attributeHandle, const uint8_t* attributeValue, uint8_t attributeLength, enum LB_Priority priority) noexcept :
+            Request(executor),
+            device(device),
+            attributeHandle(attributeHandle),
+            attributeValue(attributeValue),
+            attributeLength(attributeLength),
+            priority(priority)
+         {
+         }
+
+         bool await_suspend(std::coroutine_handle<> coroutine) noexcept
+         {
+            return suspend(coroutine, [](Request* request) noexcept
+                  {
+                     Write* write = static_cast<Write*>(request);
+                     return lb_writeCharValueAsync(write->device, write->attributeHandle, write->attributeValue, write->attributeLength,
+                           write->priority, onComplete, write);
+                  });
+         }
+
+         enum LB_STATUS await_resume() const noexcept
+         {
+            return status;
+         }
+
+      private:
+
+         LB_Device*        device;
+         uint16_t          attributeHandle;
+         const uint8_t*    attributeValue;
+         uint8_t           attributeLength;
+         enum LB_Priority  priority;
+      };
+
+      return Write(*executor, device, attributeHandle, attributeValue, attributeLength, priority);
+   }
+
+   /** Enumerates the primary services
+    *
+    * @return an awaiter producing the status
+    */
+   auto discover() const noexcept
+   {
+      class Discover : public Request
+      {
+      public:
+
+         Discover(Executor& executor, LB_Device* device) noexcept :
+            Request(executor),
+            device(device)
+         {
+         }
+
+         bool await_suspend(std::coroutine_handle<> coroutine) noexcept
+         {
+            return suspend(coroutine, [](Request* request) noexcept
+                  {
+                     Discover* discover = static_cast<Discover*>(request);
+                     return lb_startServiceDiscoveryAsync(discover->device, onComplete, discover);
+                  });
+         }
+
+         enum LB_STATUS await_resume() const noexcept
+         {
+            return status;
+         }
+
+      private:
+
+         LB_Device*        device;
+      };
+
+      return Discover(*executor, device);
+   }
+
+private:
+
+   Executor*   executor = nullptr;
+   LB_Device*  device   = nullptr;
+};
+
+/** A Bluetooth controller, with its requests resumed by an executor
+ */
+class Controller
+{
+public:
+
+   Controller(Executor& executor, LB_Controller* controller) noexcept :
+      executor(executor),
+      controller(controller)
+   {
+   }
+
+   LB_Controller* get() const noexcept
+   {
+      return controller;
+   }
+
+   /** Connects to a device
+    *
+    * The controller establishes one connection at a time, so the connection
+    * is made by the blocking function, on a library worker thread.
+    *
+    * @param address is the device address; it must stay valid until the
+    * connection completes
+    * @return an awaiter producing the status and the device
+    */
+   auto connect(const uint8_t* address) noexcept
+   {
+      class Connect : public Request
+      {
+      public:
+
+         Connect(Executor& executor, LB_Controller* controller, const uint8_t* address) noexcept :
+            Request(executor),
+            controller(controller),
+            address(address)
+         {
+         }
+
+         bool await_suspend(std::coroutine_handle<> coroutine) noexcept
+         {
+            return suspend(coroutine, [](Request* request) noexcept
+                  {
+                     return os_executeLater(0, connect, request) ? LB_OK : LB_FAILURE;
+                  });
+         }
+
+         std::pair<enum LB_STATUS, Device> await_resume() const noexcept
+         {
+            if (LB_OK != status)
+            {
+               return { status, Device() };
+            }
+            return { status, Device(executor, device) };
+         }
+
+      private:
+
+         static void connect(void* arg) noexcept
+         {
+            Connect* self = static_cast<Connect*>(arg);
+
+            const enum LB_STATUS status = lb_openDeviceConnection(self->controller, self->address, &self->device);
+            onComplete(self, status);
+         }
+
+         LB_Controller*    controller;
+         const uint8_t*    address;
+         LB_Device*        device = nullptr;
+      };
+
+      return Connect(executor, controller, address);
+   }
+
+private:
+
+   Executor&         executor;
+   LB_Controller*    controller;
+};
+
+} // namespace lightblue
+
+/** @}
+ *
+ * @}
+ */
+
+#endif // __LIGHTBLUE_HPP__
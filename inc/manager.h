@@ -0,0 +1,131 @@
+/**
+ * @file manager.h
+ * @brief Management of several Bluetooth controllers
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+#ifndef __MANAGER_H__
+#define __MANAGER_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <commands.h>
+
+/** @addtogroup lightBLUE lightBLUE
+ *
+ * @{
+ *
+ * @addtogroup lightBLUE_manager Controller Manager
+ *
+ * @{
+ */
+
+/** Opaque structure representing a set of controllers
+ */
+struct LB_Manager;
+
+/** State of a managed controller
+ */
+struct LB_ManagedController
+{
+   struct LB_Controller*   controller;
+   const char*             portName;
+   uint32_t                connections;         /**< devices connected */
+   uint32_t                pendingConnections;  /**< connections being established by the manager */
+   uint32_t                maxConnections;      /**< connections supported with the controller configuration */
+};
+
+/** Connects to several controllers and initializes them concurrently
+ *
+ * Each controller is reset, identified and initialized as with lb_connect,
+ * lb_setControllerConfig, lb_initializeHCI and lb_configureAsCentral, on a
+ * library worker thread. When the library was initialized with
+ * lb_initializePolled, the controllers are initialized one after the other,
+ * on the calling thread.
+ *
+ * Controllers that fail to initialize are disconnected and left out.
+ *
+ * @param portNames are the names of the serial ports
+ * @param portCount is the number of ports
+ * @param config is the configuration applied to all the controllers; NULL
+ *    keeps the default configuration
+ * @return the manager, or 0 if no controller could be initialized
+ */
+struct LB_Manager* lb_createManager(const char* const* portNames, uint32_t portCount, const struct LB_ControllerConfig* config);
+
+/** Connects to the controllers on all the serial ports matching a pattern
+ *
+ * @param pattern selects the ports, as in io_enumerateSerialPorts
+ * @param config is the configuration applied to all the controllers; NULL
+ *    keeps the default configuration
+ * @return the manager, or 0 if no controller could be initialized
+ *
+ * @see lb_createManager
+ */
+struct LB_Manager* lb_createManagerForPorts(const char* pattern, const struct LB_ControllerConfig* config);
+
+/** Disconnects from all the managed controllers and releases the manager
+ *
+ * @param manager is the manager
+ */
+void lb_destroyManager(struct LB_Manager* manager);
+
+/** Returns the number of managed controllers
+ *
+ * @param manager is the manager
+ */
+uint32_t lb_getManagedControllerCount(struct LB_Manager* manager);
+
+/** Retrieves the state of a managed controller
+ *
+ * The controller can be used with the rest of the library; connections
+ * opened on it directly count towards its load.
+ *
+ * @param manager is the manager
+ * @param index identifies the controller, from 0 to the controller count
+ * @param[out] state receives the state
+ * @return true on success, false if the index is out of range
+ */
+bool lb_getManagedController(struct LB_Manager* manager, uint32_t index, struct LB_ManagedController* state);
+
+/** Creates a connection to a device on the least loaded controller
+ *
+ * The load of a controller is the number of its connected devices and of
+ * the connections being established on it, relative to the number of
+ * connections it supports. Connections to different controllers are
+ * established concurrently.
+ *
+ * @param manager is the manager
+ * @param address is the 6-byte Bluetooth address of the device
+ * @param parameters are the requested connection parameters; NULL selects
+ *    LB_CONNECTION_PROFILE_DEFAULT
+ * @param[out] device will contain the device reference
+ * @return status; LB_CONNECTION_LIMIT_REACHED if all the controllers are
+ *    fully loaded
+ */
+enum LB_STATUS lb_openManagedDeviceConnection(struct LB_Manager* manager, const uint8_t* address, const struct LB_ConnectionParameters* parameters, struct LB_Device** device);
+
+/** @}
+ *
+ * @}
+ */
+
+#endif // __MANAGER_H__
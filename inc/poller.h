@@ -0,0 +1,165 @@
+/**
+ * @file poller.h
+ * @brief Periodic characteristic reads across devices and controllers
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+#ifndef __POLLER_H__
+#define __POLLER_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <commands.h>
+
+/** @addtogroup lightBLUE lightBLUE
+ *
+ * @{
+ *
+ * @addtogroup lightBLUE_poller Polling Scheduler
+ *
+ * @{
+ */
+
+/** Opaque structure representing a polling scheduler
+ */
+struct LB_Poller;
+
+/** Opaque structure representing a periodic read
+ */
+struct LB_PollJob;
+
+/** Called with the result of each periodic read, on a poller worker thread
+ *
+ * @param context is the job context
+ * @param device is the device that was read
+ * @param attributeHandle is the characteristic value handle
+ * @param status is the read status; the value is empty unless it is LB_OK
+ * @param attributeValue contains the value
+ * @param attributeLength is the length of the value
+ * @param timestamp_ms is the time the read completed, from os_getTime_ms
+ */
+typedef void (* LB_PollDecoder)(void* context, struct LB_Device* device, uint16_t attributeHandle, enum LB_STATUS status, const uint8_t* attributeValue, uint8_t attributeLength, uint64_t timestamp_ms);
+
+/** Called when a read completes after its deadline, or is skipped because
+ * the previous read of the same job overran the period
+ *
+ * @param context is the job context
+ * @param device is the device
+ * @param attributeHandle is the characteristic value handle
+ * @param deadline_ms is the deadline that was missed
+ * @param completed_ms is the time the late read completed, or 0 for a skipped read
+ */
+typedef void (* LB_MissedDeadlineHandler)(void* context, struct LB_Device* device, uint16_t attributeHandle, uint64_t deadline_ms, uint64_t completed_ms);
+
+/** Poller configuration
+ */
+struct LB_PollerConfig
+{
+   uint32_t workerCount;                  /**< reads in progress at the same time, across all controllers */
+   uint32_t maxReadsPerController;        /**< reads in progress at the same time on one controller; 0 means no limit */
+};
+
+/** Periodic read configuration
+ */
+struct LB_PollJobConfig
+{
+   struct LB_Device*    device;           /**< the connected device */
+   uint16_t             attributeHandle;  /**< the characteristic value handle */
+   uint32_t             period_ms;        /**< time between reads */
+   uint32_t             deadline_ms;      /**< maximum time from the scheduled start to the completion of a read; 0 selects the period */
+   uint32_t             offset_ms;        /**< delay of the first read, to spread jobs with the same period */
+   LB_PollDecoder       decoder;          /**< receives the values */
+   LB_MissedDeadlineHandler onMissedDeadline;   /**< optional */
+   void*                context;          /**< passed to the handlers */
+};
+
+/** Periodic read statistics
+ */
+struct LB_PollStatistics
+{
+   uint64_t reads;                        /**< completed reads, successful or not */
+   uint64_t failures;                     /**< reads that did not return LB_OK */
+   uint64_t missedDeadlines;              /**< late or skipped reads */
+   uint64_t totalStartDelay_ms;           /**< sum of the delays between the scheduled and the actual start of the reads */
+   uint32_t maxStartDelay_ms;             /**< largest delay between the scheduled and the actual start of a read */
+};
+
+/** Creates a poller and starts its worker threads
+ *
+ * Due reads are started in earliest deadline first order, with at most one
+ * read in progress per device and at most maxReadsPerController reads in
+ * progress per controller.
+ *
+ * Not available when the library was initialized with lb_initializePolled.
+ *
+ * @param config is the poller configuration
+ * @return the poller, or 0 on failure
+ */
+struct LB_Poller* lb_createPoller(const struct LB_PollerConfig* config);
+
+/** Stops the workers, waiting for the reads in progress, and releases all
+ * the jobs
+ *
+ * @param poller is the poller
+ */
+void lb_destroyPoller(struct LB_Poller* poller);
+
+/** Registers a periodic read
+ *
+ * @param poller is the poller
+ * @param config is the read configuration
+ * @param[out] job receives the job
+ * @return status
+ */
+enum LB_STATUS lb_addPollJob(struct LB_Poller* poller, const struct LB_PollJobConfig* config, struct LB_PollJob** job);
+
+/** Unregisters a periodic read, waiting for a read in progress to complete
+ *
+ * @note Must not be called from the job handlers.
+ *
+ * @param job is the job
+ */
+void lb_removePollJob(struct LB_PollJob* job);
+
+/** Removes all the jobs reading from a device, for instance before the
+ * device connection is closed
+ *
+ * @note Must not be called from the job handlers.
+ *
+ * @param poller is the poller
+ * @param device is the device
+ * @return the number of jobs removed
+ */
+uint32_t lb_removeDevicePollJobs(struct LB_Poller* poller, struct LB_Device* device);
+
+/** Copies the statistics of a job
+ *
+ * @param job is the job
+ * @param[out] statistics receives the statistics
+ */
+void lb_getPollStatistics(struct LB_PollJob* job, struct LB_PollStatistics* statistics);
+
+/** @}
+ *
+ * @}
+ */
+
+#endif // __POLLER_H__
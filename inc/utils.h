@@ -52,7 +52,7 @@ void utl_printAddress(const uint8_t* address);
 /** Prints a Bluetooth UUID in hexadecimal on stdout
  *
  * @param buffer contains the UUID
- * @param length indicates the size of UUID (2 or 16 bytes)
+ * @param length indicates the size of UUID (2, 4 or 16 bytes)
  */
 void utl_printUUID(const uint8_t* buffer, uint8_t length);
 
@@ -1,12 +1,17 @@
 CC:=gcc
+CXX:=g++
 LD:=gcc
 
 CFLAGS:=-std=c11 -Wall -Og -g -MMD -Wmissing-prototypes -Werror
+CXXFLAGS:=-std=c++20 -Wall -Og -g -MMD -Werror
 LFLAGS:=-g
 
 %.o: %.c
 	$(CC) $(CFLAGS) -c -o $@ $<
 
+%.o: %.cpp
+	$(CXX) $(CXXFLAGS) -c -o $@ $<
+
 %.i: %.c
 	$(CC) $(CFLAGS) -E -o $@ $<
 
@@ -0,0 +1,252 @@
+/**
+ * @file lb_client.h
+ * @brief Client interface to controllers shared by the lightblued daemon
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+#ifndef __LB_CLIENT_H__
+#define __LB_CLIENT_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <commands.h>
+
+/** @addtogroup lightBLUE lightBLUE
+ *
+ * @{
+ *
+ * @addtogroup lightBLUE_client Daemon Client Interface
+ *
+ * The lightblued daemon owns the Bluetooth controllers and lets several
+ * processes use them at the same time. Commands mirror the device
+ * interface of the library; devices are named by numeric identifiers,
+ * assigned by the daemon, which are valid in every client.
+ *
+ * Advertisements, notifications and the other library events are written
+ * once by the daemon to a ring in shared memory, which every client maps
+ * read-only and reads at its own pace. A client that falls behind by more
+ * than the size of the ring loses the oldest events.
+ *
+ * The functions may be called from several threads; the event functions
+ * must be called from one thread at a time.
+ *
+ * @{
+ */
+
+/** Opaque connection to the daemon
+ */
+struct LBC_Client;
+
+/** Kinds of events published by the daemon
+ */
+enum LBC_EventType
+{
+   LBC_EVENT_PADDING,                  /**< fills the end of the ring; never returned */
+   LBC_EVENT_ADVERTISEMENT,            /**< advertisement report; address, rssi, data */
+   LBC_EVENT_DISCOVERY_COMPLETE,       /**< a discovery interval completed on the controller */
+   LBC_EVENT_DISCONNECTED,             /**< device disconnected; status is the HCI reason */
+   LBC_EVENT_PRIMARY_SERVICE,          /**< primary service; attributeHandle, endHandle, UUID in data */
+   LBC_EVENT_NOTIFICATION,             /**< attribute notification; attributeHandle, status, value in data */
+};
+
+/** An event, as stored in the shared ring
+ */
+struct LBC_Event
+{
+   uint32_t size;                      /**< size of the record in the ring, including the data */
+   uint16_t type;                      /**< an LBC_EventType */
+   uint16_t controller;                /**< index of the controller in the daemon */
+   uint32_t device;                    /**< device identifier, for device events */
+   uint16_t attributeHandle;
+   uint16_t endHandle;
+   uint64_t timestamp_ms;              /**< daemon time stamp, from os_getTime_ms */
+   uint8_t  address[6];                /**< advertiser address */
+   int8_t   rssi;
+   uint8_t  status;
+   uint8_t  length;                    /**< size of the data */
+   uint8_t  reserved[7];
+   uint8_t  data[];
+};
+
+/** A device connected through the daemon
+ */
+struct LBC_DeviceInfo
+{
+   uint32_t device;                    /**< device identifier */
+   uint32_t controller;                /**< index of the controller in the daemon */
+   uint8_t  address[6];
+   uint8_t  reserved[2];
+};
+
+/** Connects to the daemon and maps its event ring
+ *
+ * Only the events published after the connection are returned.
+ *
+ * @param socketPath is the endpoint the daemon listens on
+ * @return the client, or 0 on failure
+ */
+struct LBC_Client* lbc_connect(const char* socketPath);
+
+/** Disconnects from the daemon
+ *
+ * The discoveries started by the client are stopped; its device
+ * connections stay open until they are closed by some client.
+ *
+ * @param client is the client
+ */
+void lbc_disconnect(struct LBC_Client* client);
+
+/** Returns the number of controllers owned by the daemon
+ *
+ * @param client is the client
+ */
+uint32_t lbc_getControllerCount(struct LBC_Client* client);
+
+/** Starts discovering devices on a controller, until stopped
+ *
+ * The discovery is shared: it runs while any client has it started, and
+ * all the clients see the advertisements.
+ *
+ * @param client is the client
+ * @param controller is the index of the controller
+ * @return status
+ */
+enum LB_STATUS lbc_startDeviceDiscovery(struct LBC_Client* client, uint32_t controller);
+
+/** Stops the discovery started by this client on a controller
+ *
+ * @param client is the client
+ * @param controller is the index of the controller
+ * @return status
+ */
+enum LB_STATUS lbc_stopDeviceDiscovery(struct LBC_Client* client, uint32_t controller);
+
+/** Creates a connection to a device, on the least loaded controller
+ *
+ * @param client is the client
+ * @param address is the 6-byte Bluetooth address of the device
+ * @param[out] device will contain the device identifier
+ * @return status
+ */
+enum LB_STATUS lbc_openDeviceConnection(struct LBC_Client* client, const uint8_t* address, uint32_t* device);
+
+/** Closes a connection to a device
+ *
+ * @param client is the client
+ * @param device is the device identifier
+ * @return status
+ */
+enum LB_STATUS lbc_closeDeviceConnection(struct LBC_Client* client, uint32_t device);
+
+/** Lists the devices connected through the daemon, by any client
+ *
+ * @param client is the client
+ * @param[out] devices receives the devices
+ * @param capacity is the number of elements in devices
+ * @return the number of devices copied
+ */
+uint32_t lbc_getConnectedDevices(struct LBC_Client* client, struct LBC_DeviceInfo* devices, uint32_t capacity);
+
+/** Starts enumerating the primary services on a connected device
+ *
+ * The services are published as LBC_EVENT_PRIMARY_SERVICE events.
+ *
+ * @param client is the client
+ * @param device is the device identifier
+ * @return status
+ */
+enum LB_STATUS lbc_startServiceDiscovery(struct LBC_Client* client, uint32_t device);
+
+/** Sets the value of a character attribute on a connected device
+ *
+ * @param client is the client
+ * @param device is the device identifier
+ * @param attributeHandle is the handle of the attribute
+ * @param attributeValue is the new value of the attribute
+ * @param attributeLength is the size of the new value
+ * @return status
+ */
+enum LB_STATUS lbc_writeCharValue(struct LBC_Client* client, uint32_t device, uint16_t attributeHandle, const uint8_t* attributeValue, uint8_t attributeLength);
+
+/** Sets the value of a character attribute, without waiting for a response
+ *
+ * @param client is the client
+ * @param device is the device identifier
+ * @param attributeHandle is the handle of the attribute
+ * @param attributeValue is the new value of the attribute
+ * @param attributeLength is the size of the new value
+ * @return status
+ */
+enum LB_STATUS lbc_writeCharValueWithoutResponse(struct LBC_Client* client, uint32_t device, uint16_t attributeHandle, const uint8_t* attributeValue, uint8_t attributeLength);
+
+/** Retrieves the value of a character attribute on a connected device
+ *
+ * @param client is the client
+ * @param device is the device identifier
+ * @param attributeHandle is the handle of the attribute
+ * @param[out] attributeValue will receive the value of the attribute
+ * @param attributeCapacity is the size of the attribute value buffer
+ * @param[out] attributeLength is the size of the value
+ * @return status
+ */
+enum LB_STATUS lbc_readCharValue(struct LBC_Client* client, uint32_t device, uint16_t attributeHandle, uint8_t* attributeValue, uint8_t attributeCapacity, uint8_t* attributeLength);
+
+/** Returns the oldest event not consumed yet, in place in the shared ring
+ *
+ * Nothing is copied: the event may be overwritten by the daemon while it is
+ * being read, which lbc_consumeEvent detects.
+ *
+ * @param client is the client
+ * @return the event, or NULL if there is none
+ */
+const struct LBC_Event* lbc_peekEvent(struct LBC_Client* client);
+
+/** Moves past the event returned by lbc_peekEvent
+ *
+ * @param client is the client
+ * @return true if the event was intact; false if the daemon overwrote it
+ *    while it was being read, in which case the events lost are counted as
+ *    an overrun and reading resumes with the oldest intact event
+ */
+bool lbc_consumeEvent(struct LBC_Client* client);
+
+/** Waits until an event is available
+ *
+ * @param client is the client
+ * @param timeout_ms is the maximum amount of time to wait
+ * @return true if an event is available, false if the time out elapsed or
+ *    the daemon went away
+ */
+bool lbc_waitForEvents(struct LBC_Client* client, uint32_t timeout_ms);
+
+/** Returns the number of times the client fell behind and lost events
+ *
+ * @param client is the client
+ */
+uint32_t lbc_getOverrunCount(struct LBC_Client* client);
+
+/** @}
+ *
+ * @}
+ */
+
+#endif // __LB_CLIENT_H__
+
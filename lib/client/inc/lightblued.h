@@ -0,0 +1,148 @@
+/**
+ * @file lightblued.h
+ * @brief Protocol between the lightblued daemon and its clients
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+#ifndef __LIGHTBLUED_H__
+#define __LIGHTBLUED_H__
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include <lb_client.h>
+
+/*
+ * A client opens two connections to the daemon: commands are sent on the
+ * first one, each request being answered by a response, and the second one
+ * is used to wait for events. Both start with a LBD_HELLO request naming
+ * the role of the connection.
+ *
+ * Events are written to a single ring, in a file mapped by the daemon for
+ * writing and by the clients read-only. The head counts the bytes ever
+ * written to the ring; each client keeps its own read position, so the
+ * daemon does not track readers and a slow client cannot hold it back.
+ *
+ * Records are 8-byte aligned and never wrap around the end of the ring: a
+ * padding record fills the space left at the end instead. Before writing,
+ * the daemon advances claimed past the bytes it is about to overwrite; it
+ * then writes the records and advances head to publish them. A record read
+ * at position p is intact if, after reading it, claimed has not moved past
+ * p + capacity.
+ */
+
+#define LBD_PROTOCOL_VERSION     1
+
+#define LBD_RING_MAGIC           0x4752424cu          // "LBRG"
+#define LBD_RING_VERSION         1
+#define LBD_RING_HEADER_SIZE     64
+#define LBD_RING_ALIGNMENT       8
+
+#define LBD_MAX_RECORD           ((sizeof(struct LBC_Event) + UINT8_MAX + LBD_RING_ALIGNMENT - 1) & ~(size_t) (LBD_RING_ALIGNMENT - 1))
+#define LBD_MAX_PATH             260
+#define LBD_MAX_DEVICES          64
+
+enum LBD_Role
+{
+   LBD_ROLE_COMMANDS,
+   LBD_ROLE_EVENTS,
+};
+
+enum LBD_Command
+{
+   LBD_HELLO,                          // version, role
+   LBD_START_DISCOVERY,                // controller
+   LBD_STOP_DISCOVERY,                 // controller
+   LBD_OPEN_CONNECTION,                // address
+   LBD_CLOSE_CONNECTION,               // device
+   LBD_GET_DEVICES,
+   LBD_DISCOVER_SERVICES,              // device
+   LBD_WRITE,                          // device, attributeHandle, length, value
+   LBD_WRITE_WITHOUT_RESPONSE,         // device, attributeHandle, length, value
+   LBD_READ,                           // device, attributeHandle, length is the capacity
+   LBD_WAIT,                           // cursor; events connection only
+};
+
+/*
+ * Shared ring header; the records start LBD_RING_HEADER_SIZE bytes into
+ * the file
+ */
+struct LBD_RingHeader
+{
+   uint32_t             magic;
+   uint32_t             version;
+   uint32_t             capacity;      // size of the record area, a power of two
+   uint32_t             reserved;
+   _Atomic uint32_t     head;          // bytes published since the ring was created, modulo 2^32
+   _Atomic uint32_t     claimed;       // end of the bytes being written, head when idle
+};
+
+struct LBD_Request
+{
+   uint32_t command;                   // an LBD_Command
+   uint32_t version;
+   uint32_t role;                      // an LBD_Role
+   uint32_t controller;
+   uint32_t device;
+   uint32_t cursor;                    // client read position
+   uint16_t attributeHandle;
+   uint8_t  address[6];
+   uint8_t  length;
+   uint8_t  value[UINT8_MAX];
+};
+
+struct LBD_Response
+{
+   uint32_t status;                    // an LB_STATUS
+   union
+   {
+      struct
+      {
+         uint32_t controllerCount;
+         char     ringPath[LBD_MAX_PATH];
+      } hello;
+
+      struct
+      {
+         uint32_t device;
+      } open;
+
+      struct
+      {
+         uint32_t count;
+         struct LBC_DeviceInfo device[LBD_MAX_DEVICES];
+      } devices;
+
+      struct
+      {
+         uint8_t  length;
+         uint8_t  value[UINT8_MAX];
+      } read;
+   };
+};
+
+/*
+ * Sent on the events connection, in response to LBD_WAIT, once the head
+ * differs from the cursor
+ */
+#define LBD_DOORBELL             0x01
+
+#endif // __LIGHTBLUED_H__
+
@@ -0,0 +1,426 @@
+/**
+ * @file lb_client.c
+ * @brief Client side of the lightblued protocol
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <osal_core.h>
+#include <osal_file.h>
+#include <osal_ipc.h>
+
+#include <lb_client.h>
+#include <lightblued.h>
+
+struct LBC_Client
+{
+   // commands are answered in order, so one is in flight at a time
+   struct os_ipcConnection*      commands;
+   struct os_lock*               commandLock;
+   uint32_t                      controllerCount;
+
+   struct os_ipcConnection*      events;
+   bool                          waiting;    // a LBD_WAIT has not been answered yet
+
+   struct os_mappedFile*         ringFile;
+   const struct LBD_RingHeader*  ring;
+   const uint8_t*                records;
+   uint32_t                      capacity;
+
+   uint32_t                      cursor;
+   uint32_t                      overruns;
+};
+
+static bool sayHello(struct os_ipcConnection* connection, enum LBD_Role role, struct LBD_Response* response)
+{
+   struct LBD_Request request;
+   memset(&request, 0, sizeof(request));
+   request.command = LBD_HELLO;
+   request.version = LBD_PROTOCOL_VERSION;
+   request.role    = role;
+
+   return os_sendIpc(connection, &request, sizeof(request)) &&
+          os_receiveIpc(connection, response, sizeof(*response)) &&
+          (LB_OK == response->status);
+}
+
+static bool mapRing(struct LBC_Client* client, const char* path)
+{
+   client->ringFile = os_mapFile(path, 0, false);
+   if (! client->ringFile)
+   {
+      return false;
+   }
+
+   uint64_t size = os_getMappedSize(client->ringFile);
+   if (size < LBD_RING_HEADER_SIZE)
+   {
+      return false;
+   }
+
+   client->ring     = os_getMappedAddress(client->ringFile);
+   client->records  = (const uint8_t*) client->ring + LBD_RING_HEADER_SIZE;
+   client->capacity = client->ring->capacity;
+
+   return (LBD_RING_MAGIC == client->ring->magic) &&
+          (LBD_RING_VERSION == client->ring->version) &&
+          (client->capacity >= 2 * LBD_MAX_RECORD) &&
+          (0 == (client->capacity & (client->capacity - 1))) &&
+          (size - LBD_RING_HEADER_SIZE >= client->capacity);
+}
+
+struct LBC_Client* lbc_connect(const char* socketPath)
+{
+   struct LBC_Client* client = calloc(1, sizeof(struct LBC_Client));
+   if (! client)
+   {
+      return NULL;
+   }
+
+   struct LBD_Response response;
+
+   client->commandLock = os_createLock();
+   client->commands    = os_connectIpc(socketPath);
+
+   if (! (client->commandLock && client->commands && sayHello(client->commands, LBD_ROLE_COMMANDS, &response)))
+   {
+      lbc_disconnect(client);
+      return NULL;
+   }
+
+   client->controllerCount = response.hello.controllerCount;
+   response.hello.ringPath[LBD_MAX_PATH - 1] = 0;
+
+   if (! mapRing(client, response.hello.ringPath))
+   {
+      lbc_disconnect(client);
+      return NULL;
+   }
+
+   client->events = os_connectIpc(socketPath);
+   if (! (client->events && sayHello(client->events, LBD_ROLE_EVENTS, &response)))
+   {
+      lbc_disconnect(client);
+      return NULL;
+   }
+
+   client->cursor = atomic_load_explicit(&client->ring->head, memory_order_acquire);
+
+   return client;
+}
+
+void lbc_disconnect(struct LBC_Client* client)
+{
+   if (client)
+   {
+      // the daemon stops the discoveries of the client when it goes away
+      os_closeIpc(client->events);
+      os_closeIpc(client->commands);
+      os_unmapFile(client->ringFile);
+      os_destroyLock(client->commandLock);
+      free(client);
+   }
+}
+
+uint32_t lbc_getControllerCount(struct LBC_Client* client)
+{
+   return client->controllerCount;
+}
+
+static enum LB_STATUS execute(struct LBC_Client* client, const struct LBD_Request* request, struct LBD_Response* response)
+{
+   os_lock(client->commandLock);
+
+   bool done = os_sendIpc(client->commands, request, sizeof(*request)) &&
+               os_receiveIpc(client->commands, response, sizeof(*response));
+
+   os_unlock(client->commandLock);
+
+   // without the daemon, its controllers are out of reach
+   return done ? (enum LB_STATUS) response->status : LB_CONTROLLER_NOT_CONNECTED;
+}
+
+static enum LB_STATUS executeSimple(struct LBC_Client* client, enum LBD_Command command, uint32_t controller, uint32_t device)
+{
+   struct LBD_Request  request;
+   struct LBD_Response response;
+
+   memset(&request, 0, sizeof(request));
+   request.command    = command;
+   request.controller = controller;
+   request.device     = device;
+
+   return execute(client, &request, &response);
+}
+
+enum LB_STATUS lbc_startDeviceDiscovery(struct LBC_Client* client, uint32_t controller)
+{
+   return executeSimple(client, LBD_START_DISCOVERY, controller, 0);
+}
+
+enum LB_STATUS lbc_stopDeviceDiscovery(struct LBC_Client* client, uint32_t controller)
+{
+   return executeSimple(client, LBD_STOP_DISCOVERY, controller, 0);
+}
+
+enum LB_STATUS lbc_openDeviceConnection(struct LBC_Client* client, const uint8_t* address, uint32_t* device)
+{
+   struct LBD_Request  request;
+   struct LBD_Response response;
+
+   memset(&request, 0, sizeof(request));
+   request.command = LBD_OPEN_CONNECTION;
+   memcpy(request.address, address, sizeof(request.address));
+
+   enum LB_STATUS status = execute(client, &request, &response);
+   if (LB_OK == status)
+   {
+      *device = response.open.device;
+   }
+
+   return status;
+}
+
+enum LB_STATUS lbc_closeDeviceConnection(struct LBC_Client* client, uint32_t device)
+{
+   return executeSimple(client, LBD_CLOSE_CONNECTION, 0, device);
+}
+
+uint32_t lbc_getConnectedDevices(struct LBC_Client* client, struct LBC_DeviceInfo* devices, uint32_t capacity)
+{
+   struct LBD_Request  request;
+   struct LBD_Response response;
+
+   memset(&request, 0, sizeof(request));
+   request.command = LBD_GET_DEVICES;
+
+   if (LB_OK != execute(client, &request, &response))
+   {
+      return 0;
+   }
+
+   uint32_t count = response.devices.count;
+   if (count > LBD_MAX_DEVICES)
+   {
+      count = LBD_MAX_DEVICES;
+   }
+
+   if (count > capacity)
+   {
+      count = capacity;
+   }
+
+   memcpy(devices, response.devices.device, count * sizeof(struct LBC_DeviceInfo));
+
+   return count;
+}
+
+enum LB_STATUS lbc_startServiceDiscovery(struct LBC_Client* client, uint32_t device)
+{
+   return executeSimple(client, LBD_DISCOVER_SERVICES, 0, device);
+}
+
+static enum LB_STATUS writeValue(struct LBC_Client* client, enum LBD_Command command, uint32_t device, uint16_t attributeHandle, const uint8_t* attributeValue, uint8_t attributeLength)
+{
+   struct LBD_Request  request;
+   struct LBD_Response response;
+
+   memset(&request, 0, sizeof(request));
+   request.command         = command;
+   request.device          = device;
+   request.attributeHandle = attributeHandle;
+   request.length          = attributeLength;
+   memcpy(request.value, attributeValue, attributeLength);
+
+   return execute(client, &request, &response);
+}
+
+enum LB_STATUS lbc_writeCharValue(struct LBC_Client* client, uint32_t device, uint16_t attributeHandle, const uint8_t* attributeValue, uint8_t attributeLength)
+{
+   return writeValue(client, LBD_WRITE, device, attributeHandle, attributeValue, attributeLength);
+}
+
+enum LB_STATUS lbc_writeCharValueWithoutResponse(struct LBC_Client* client, uint32_t device, uint16_t attributeHandle, const uint8_t* attributeValue, uint8_t attributeLength)
+{
+   return writeValue(client, LBD_WRITE_WITHOUT_RESPONSE, device, attributeHandle, attributeValue, attributeLength);
+}
+
+enum LB_STATUS lbc_readCharValue(struct LBC_Client* client, uint32_t device, uint16_t attributeHandle, uint8_t* attributeValue, uint8_t attributeCapacity, uint8_t* attributeLength)
+{
+   struct LBD_Request  request;
+   struct LBD_Response response;
+
+   memset(&request, 0, sizeof(request));
+   request.command         = LBD_READ;
+   request.device          = device;
+   request.attributeHandle = attributeHandle;
+   request.length          = attributeCapacity;
+
+   enum LB_STATUS status = execute(client, &request, &response);
+   if (LB_OK == status)
+   {
+      uint8_t length = response.read.length;
+      if (length > attributeCapacity)
+      {
+         length = attributeCapacity;
+      }
+
+      memcpy(attributeValue, response.read.value, length);
+      *attributeLength = length;
+   }
+
+   return status;
+}
+
+/*
+ * The daemon may have started overwriting the record at the cursor; the
+ * fence orders the reads of the record before the read of the claimed end,
+ * which the daemon moves before writing
+ */
+static bool isIntact(const struct LBC_Client* client)
+{
+   atomic_thread_fence(memory_order_acquire);
+   uint32_t claimed = atomic_load_explicit(&client->ring->claimed, memory_order_relaxed);
+
+   return (uint32_t) (claimed - client->cursor) <= client->capacity;
+}
+
+/*
+ * Record boundaries cannot be found in the middle of the ring, so reading
+ * resumes with the next event published
+ */
+static void skipLostEvents(struct LBC_Client* client)
+{
+   client->cursor = atomic_load_explicit(&client->ring->head, memory_order_acquire);
+   client->overruns ++;
+}
+
+static const struct LBC_Event* eventAtCursor(const struct LBC_Client* client)
+{
+   return (const struct LBC_Event*) (client->records + (client->cursor & (client->capacity - 1)));
+}
+
+const struct LBC_Event* lbc_peekEvent(struct LBC_Client* client)
+{
+   for (;;)
+   {
+      uint32_t head = atomic_load_explicit(&client->ring->head, memory_order_acquire);
+      if (head == client->cursor)
+      {
+         return NULL;
+      }
+
+      if ((uint32_t) (head - client->cursor) > client->capacity)
+      {
+         skipLostEvents(client);
+         continue;
+      }
+
+      const struct LBC_Event* event = eventAtCursor(client);
+      if (LBC_EVENT_PADDING != event->type)
+      {
+         return event;
+      }
+
+      uint32_t size = event->size;
+      if (isIntact(client))
+      {
+         client->cursor += size;
+      }
+      else
+      {
+         skipLostEvents(client);
+      }
+   }
+}
+
+bool lbc_consumeEvent(struct LBC_Client* client)
+{
+   uint32_t size = eventAtCursor(client)->size;
+
+   if (! isIntact(client))
+   {
+      skipLostEvents(client);
+      return false;
+   }
+
+   client->cursor += size;
+
+   return true;
+}
+
+bool lbc_waitForEvents(struct LBC_Client* client, uint32_t timeout_ms)
+{
+   uint64_t deadline = os_getTime_ms() + timeout_ms;
+
+   for (;;)
+   {
+      if (lbc_peekEvent(client))
+      {
+         return true;
+      }
+
+      /*
+       * The daemon rings once the head moves past the cursor sent; a ring
+       * for events consumed meanwhile only causes another pass
+       */
+      if (! client->waiting)
+      {
+         struct LBD_Request request;
+         memset(&request, 0, sizeof(request));
+         request.command = LBD_WAIT;
+         request.cursor  = client->cursor;
+
+         if (! os_sendIpc(client->events, &request, sizeof(request)))
+         {
+            return false;
+         }
+
+         client->waiting = true;
+      }
+
+      uint64_t now = os_getTime_ms();
+      if (now >= deadline)
+      {
+         return false;
+      }
+
+      if (! os_waitForIpcData(client->events, (uint32_t) (deadline - now)))
+      {
+         return false;
+      }
+
+      uint8_t doorbell = 0;
+      if (! os_receiveIpc(client->events, &doorbell, sizeof(doorbell)))
+      {
+         return false;
+      }
+
+      client->waiting = false;
+   }
+}
+
+uint32_t lbc_getOverrunCount(struct LBC_Client* client)
+{
+   return client->overruns;
+}
@@ -44,6 +44,44 @@ int os_initialize(void);
  */
 void os_cleanup(void);
 
+/** Initialize the OS abstraction library without starting any thread
+ *
+ * The I/O completions and the timers, including the functions scheduled with
+ * os_executeLater, are then dispatched only by os_poll, on the calling
+ * thread, which must be the only thread using the library. The blocking
+ * functions keep calling os_poll while they wait, so they can be used on
+ * that thread, but not from io_on_dataReceived and the other I/O events.
+ * While a lock is held, the waits dispatch I/O completions only.
+ *
+ * @return 0 on success
+ */
+int os_initializePolled(void);
+
+/** Returns true if the library was initialized with os_initializePolled
+ */
+bool os_isPolled(void);
+
+/** Dispatches the pending I/O completions and the expired timers on the
+ * calling thread; polled mode only
+ *
+ * @param timeout_ms is the maximum amount of time to wait for an I/O
+ * completion when nothing is pending; waits end earlier when a timer expires
+ * @return the number of completions and timers dispatched
+ *
+ * @see os_getNextTimeout_ms
+ * @see io_getPollFd
+ */
+int os_poll(uint32_t timeout_ms);
+
+/** Returns the delay until the next timer expires
+ *
+ * An application running its own event loop waits no longer than this before
+ * calling os_poll again.
+ *
+ * @return the delay, 0 if timers are due, or UINT32_MAX if none is running
+ */
+uint32_t os_getNextTimeout_ms(void);
+
 /** Event invoked by the runtime when the user interrupts the application
  * (using Ctrl-C for instance)
  *
@@ -65,7 +103,55 @@ void os_sleep_ms(uint32_t duration_ms);
  */
 void os_waitForKeyboardInterrupt(void);
 
-//void os_executeLater(uint32_t interval_ms, void (* func)(void* arg), void* arg);
+/** Returns a monotonic time stamp
+ *
+ * @return the number of milliseconds elapsed since an arbitrary point in time
+ */
+uint64_t os_getTime_ms(void);
+
+/** Schedules a function to be called once, after a delay
+ *
+ * The function is invoked on a library worker thread, and it is allowed to
+ * block.
+ *
+ * @param interval_ms is the delay before calling the function
+ * @param func is the function to be called
+ * @param arg is passed unchanged to the function
+ * @return true if the call was scheduled
+ */
+bool os_executeLater(uint32_t interval_ms, void (* func)(void* arg), void* arg);
+
+/** Opaque timer object
+ */
+struct os_timer;
+
+/** Starts a timer calling a function once or periodically
+ *
+ * All the timers of the process, including the ones started by
+ * os_executeLater, share one timer wheel with a 1 ms tick: starting,
+ * stopping and expiring a timer take constant time regardless of the
+ * number of timers.
+ *
+ * The function is invoked on a library worker thread, and it is allowed to
+ * block. A periodic timer is not invoked again before the previous call
+ * returns; periods that elapse meanwhile are skipped.
+ *
+ * @param delay_ms is the delay before the first call
+ * @param period_ms is the interval between calls, or 0 for a single call
+ * @param func is the function to be called
+ * @param arg is passed unchanged to the function
+ * @return the timer, or NULL on failure
+ */
+struct os_timer* os_startTimer(uint32_t delay_ms, uint32_t period_ms, void (* func)(void* arg), void* arg);
+
+/** Stops a timer and releases it
+ *
+ * Waits for a call in progress to return, unless invoked from the timer
+ * function itself.
+ *
+ * @param timer is the timer
+ */
+void os_stopTimer(struct os_timer* timer);
 
 /** @}
  *
@@ -142,11 +228,131 @@ void os_signalCondition(struct os_condition* cond, void* status);
  *
  * @param cond is the condition object
  * @param timeout_ms is the maximum amount of time to wait for the signal
- * @param status is a user pointer sent from the signaling thread
+ * @param status receives the user pointer sent from the signaling thread;
+ * may be NULL
  * @return true if the condition was signaled, false if timeout occurred
  */
 bool os_waitForCondition(struct os_condition* cond, uint32_t timeout_ms, void** status);
 
+/** Opaque condition variable, waited on with a lock held
+ *
+ * Unlike a condition object, it has no state: the waiters check their
+ * predicate under the lock, so a wakeup cannot be lost between the check
+ * and the wait.
+ */
+struct os_conditionVariable;
+
+/** Creates a condition variable
+ *
+ * @return the condition variable
+ */
+struct os_conditionVariable* os_createConditionVariable(void);
+
+/** Destroys a condition variable; nobody may be waiting on it
+ *
+ * @param cv is the condition variable
+ */
+void os_destroyConditionVariable(struct os_conditionVariable* cv);
+
+/** Releases the lock and blocks until the condition variable is woken;
+ * the lock is taken again before returning
+ *
+ * @param cv is the condition variable
+ * @param lock is the lock held by the caller
+ * @param timeout_ms is the maximum amount of time to wait
+ * @return false if the timeout occurred; the caller checks its predicate
+ * either way
+ */
+bool os_sleepConditionVariable(struct os_conditionVariable* cv, struct os_lock* lock, uint32_t timeout_ms);
+
+/** Wakes all the threads sleeping on the condition variable
+ *
+ * @param cv is the condition variable
+ */
+void os_wakeAllConditionVariable(struct os_conditionVariable* cv);
+
+/** @}
+ *
+ * @defgroup OSAL_Completion Completions
+ *
+ * A completion is a one-shot event with a single waiter. Every use starts by
+ * arming it, which returns a ticket; signals carrying an older ticket are
+ * ignored, so a late signal for an abandoned wait cannot complete the next
+ * one.
+ *
+ * Completions are taken from a pool allocated up front, and they do not own
+ * any kernel object: acquiring and releasing one costs neither heap
+ * allocations nor system calls.
+ *
+ * @{
+ */
+
+/** Opaque completion object
+ */
+struct os_completion;
+
+/** Opaque completion pool
+ */
+struct os_completionPool;
+
+/** Creates a pool of completions
+ *
+ * @param capacity is the number of completions in the pool
+ * @return the pool, or NULL on failure
+ */
+struct os_completionPool* os_createCompletionPool(uint32_t capacity);
+
+/** Destroys a pool; all its completions must have been released
+ *
+ * @param pool is the completion pool
+ */
+void os_destroyCompletionPool(struct os_completionPool* pool);
+
+/** Takes a completion from a pool
+ *
+ * @param pool is the completion pool
+ * @return the completion, or NULL if the pool is exhausted
+ */
+struct os_completion* os_acquireCompletion(struct os_completionPool* pool);
+
+/** Returns a completion to its pool
+ *
+ * @param completion is the completion
+ */
+void os_releaseCompletion(struct os_completion* completion);
+
+/** Prepares a completion for a new wait
+ *
+ * Any earlier signal is discarded, and tickets returned by earlier calls
+ * become stale.
+ *
+ * @param completion is the completion
+ * @return the ticket to be passed to the signaling and the waiting thread
+ */
+uint32_t os_armCompletion(struct os_completion* completion);
+
+/** Signals a completion
+ *
+ * @param completion is the completion
+ * @param ticket identifies the wait being completed
+ * @param status is a user pointer, which will be passed to the waiting thread
+ * @return true if the completion was signaled, false if the ticket is stale
+ * or the wait was already signaled
+ */
+bool os_signalCompletion(struct os_completion* completion, uint32_t ticket, void* status);
+
+/** Blocks the current thread until the completion is signaled
+ *
+ * @param completion is the completion
+ * @param ticket identifies the wait, as returned by os_armCompletion
+ * @param timeout_ms is the maximum amount of time to wait for the signal
+ * @param status receives the user pointer sent from the signaling thread;
+ * may be NULL
+ * @return true if the completion was signaled, false if timeout occurred or
+ * the completion was armed again
+ */
+bool os_waitForCompletion(struct os_completion* completion, uint32_t ticket, uint32_t timeout_ms, void** status);
+
 /** @}
  *
  * @}
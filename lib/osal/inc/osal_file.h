@@ -0,0 +1,93 @@
+/**
+ * @file osal_file.h
+ * @brief Memory mapped files
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of serial_base library
+ */
+
+#ifndef __OSAL_FILE_H__
+#define __OSAL_FILE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** @addtogroup OSAL OS Abstraction layer
+ *
+ * @{
+ *
+ * @defgroup OSAL_file Memory Mapped Files
+ *
+ * @{
+ */
+
+/** Opaque structure representing a file mapped in memory
+ */
+struct os_mappedFile;
+
+/** Maps a whole file in memory.
+ *
+ * A writable mapping creates the file if it does not exist and extends it
+ * to size bytes; the file content is preserved otherwise. A read-only
+ * mapping requires an existing file and ignores size.
+ *
+ * Other processes may map the same file read-only while it is mapped for
+ * writing.
+ *
+ * @param path is the file name
+ * @param size is the size of a writable mapping, in bytes
+ * @param writable selects a read-write mapping
+ * @return the mapped file, or 0 on failure
+ */
+struct os_mappedFile* os_mapFile(const char* path, uint64_t size, bool writable);
+
+/** Unmaps the file, writing modified pages back first
+ *
+ * @param file is the mapped file
+ */
+void os_unmapFile(struct os_mappedFile* file);
+
+/** Retrieves the address where the file is mapped
+ *
+ * @param file is the mapped file
+ * @return the address of the first byte of the file
+ */
+void* os_getMappedAddress(struct os_mappedFile* file);
+
+/** Retrieves the size of the mapping
+ *
+ * @param file is the mapped file
+ * @return the size, in bytes
+ */
+uint64_t os_getMappedSize(struct os_mappedFile* file);
+
+/** Starts writing the modified pages of a range back to the file
+ *
+ * @param file is the mapped file
+ * @param offset is the first byte of the range
+ * @param length is the length of the range; 0 flushes up to the end of the file
+ * @return true if the write back was started
+ */
+bool os_flushMappedFile(struct os_mappedFile* file, uint64_t offset, uint64_t length);
+
+/** @}
+ *
+ * @}
+ */
+
+#endif // __OSAL_FILE_H__
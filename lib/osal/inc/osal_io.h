@@ -56,6 +56,19 @@ void* io_getUserPtr(struct io_channel* channel);
  */
 void io_closePort(struct io_channel* channel);
 
+/** Returns the OS object signaled when data has been received on a channel
+ *
+ * An application running its own event loop waits on it along with its own
+ * objects, and calls os_poll when it is signaled. On Windows this is an
+ * event HANDLE, to be used with WaitForMultipleObjects or
+ * RegisterWaitForSingleObject.
+ *
+ * @param channel is the i/o channel
+ * @return the handle, or -1 if the library was not initialized with
+ * os_initializePolled
+ */
+intptr_t io_getPollFd(struct io_channel* channel);
+
 /** Sends data on a channel, asynchronously
  *
  * @note The buffer must not be freed or changed until io_on_transmissionComplete is
@@ -0,0 +1,140 @@
+/**
+ * @file osal_ipc.h
+ * @brief Local inter-process communication channels
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of serial_base library
+ */
+
+#ifndef __OSAL_IPC_H__
+#define __OSAL_IPC_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** @addtogroup OSAL OS Abstraction layer
+ *
+ * @{
+ *
+ * @defgroup OSAL_ipc Local IPC Channels
+ *
+ * Reliable, ordered byte streams between processes on the same machine,
+ * named by a file system path. All the calls block the calling thread.
+ *
+ * @{
+ */
+
+/** Opaque structure representing a listening endpoint
+ */
+struct os_ipcServer;
+
+/** Opaque structure representing a connected channel
+ */
+struct os_ipcConnection;
+
+/** Creates an endpoint accepting connections at a path
+ *
+ * A stale endpoint left at the same path by a process that exited is
+ * removed first.
+ *
+ * @param path is the endpoint name
+ * @return the server, or 0 on failure
+ */
+struct os_ipcServer* os_createIpcServer(const char* path);
+
+/** Waits for a client to connect
+ *
+ * @param server is the server
+ * @return the new connection, or 0 if the server was stopped
+ */
+struct os_ipcConnection* os_acceptIpcConnection(struct os_ipcServer* server);
+
+/** Stops accepting connections
+ *
+ * A thread blocked in os_acceptIpcConnection returns, and subsequent calls
+ * fail immediately. The connections already accepted are not affected.
+ *
+ * @param server is the server
+ */
+void os_stopIpcServer(struct os_ipcServer* server);
+
+/** Stops the server if needed, removes the endpoint and releases the server
+ *
+ * No thread may be using the server anymore.
+ *
+ * @param server is the server
+ */
+void os_destroyIpcServer(struct os_ipcServer* server);
+
+/** Connects to a server
+ *
+ * @param path is the endpoint name
+ * @return the connection, or 0 on failure
+ */
+struct os_ipcConnection* os_connectIpc(const char* path);
+
+/** Sends data on a connection
+ *
+ * @param connection is the connection
+ * @param buffer contains the data
+ * @param length is the amount of data
+ * @return true if all the data was sent
+ */
+bool os_sendIpc(struct os_ipcConnection* connection, const void* buffer, uint32_t length);
+
+/** Receives an exact amount of data from a connection
+ *
+ * @param connection is the connection
+ * @param buffer receives the data
+ * @param length is the amount of data to wait for
+ * @return true if all the data was received, false if the connection was
+ * closed or shut down first
+ */
+bool os_receiveIpc(struct os_ipcConnection* connection, void* buffer, uint32_t length);
+
+/** Waits until data can be received from a connection
+ *
+ * @param connection is the connection
+ * @param timeout_ms is the maximum amount of time to wait
+ * @return true if os_receiveIpc will not block, which is also the case when
+ * the connection was closed by the peer
+ */
+bool os_waitForIpcData(struct os_ipcConnection* connection, uint32_t timeout_ms);
+
+/** Shuts a connection down in both directions
+ *
+ * Threads blocked sending or receiving on the connection return, and the
+ * peer sees the connection closed. The connection must still be closed.
+ *
+ * @param connection is the connection
+ */
+void os_shutdownIpc(struct os_ipcConnection* connection);
+
+/** Closes a connection and releases it
+ *
+ * @param connection is the connection
+ */
+void os_closeIpc(struct os_ipcConnection* connection);
+
+/** @}
+ *
+ * @}
+ */
+
+#endif // __OSAL_IPC_H__
+
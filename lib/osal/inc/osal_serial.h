@@ -50,6 +50,19 @@ struct io_channel;
  */
 struct io_channel* io_openSerialPort(const char* portName, uint32_t baudRate, void* userPtr);
 
+/** Lists the serial ports present on the system
+ *
+ * The pattern is a port name where a single '*' stands for any sequence of
+ * characters, for instance "COM*".
+ *
+ * @param pattern selects the ports
+ * @param func is called with the name of each matching port, which can be
+ * passed to io_openSerialPort
+ * @param arg is passed unchanged to the function
+ * @return the number of matching ports
+ */
+uint32_t io_enumerateSerialPorts(const char* pattern, void (* func)(void* arg, const char* portName), void* arg);
+
 /** @}
  *
  * @}
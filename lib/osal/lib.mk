@@ -21,6 +21,7 @@ OSAL_PATH:=$(dir $(lastword $(MAKEFILE_LIST)))
 
 ifeq ($(OS),Windows_NT)
 	LIBS_CFLAGS+=-D_WIN32_WINNT=_WIN32_WINNT_WIN8
+	LIBS_LDLIBS+=-lws2_32
 endif
 
 LIBS_CFLAGS+=-I$(OSAL_PATH)inc
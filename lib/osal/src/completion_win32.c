@@ -0,0 +1,254 @@
+/**
+ * @file completion_win32.c
+ * @brief Pooled one-shot completions for Win32 API
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of lightBLUE OSAL library
+ */
+
+/**
+ * @privatesection
+ */
+
+#include <assert.h>
+#include <malloc.h>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include <osal_core.h>
+
+#include "osal_priv.h"
+
+/*
+ * The slim reader/writer lock and the condition variable are plain memory;
+ * the kernel is only entered to block and to wake a blocked waiter.
+ */
+struct os_completion
+{
+   SRWLOCK                    lock;
+   CONDITION_VARIABLE         signaled;
+
+   // ticket of the current wait; never 0, so callers can use 0 as 'none'
+   uint32_t                   generation;
+   bool                       isSignaled;
+   void*                      status;
+
+   struct os_completionPool*  pool;
+   struct os_completion*      nextFree;
+};
+
+struct os_completionPool
+{
+   SRWLOCK                    lock;
+   struct os_completion*      free;
+   uint32_t                   capacity;
+   uint32_t                   available;
+   struct os_completion       completion[];
+};
+
+struct os_completionPool* os_createCompletionPool(uint32_t capacity)
+{
+   struct os_completionPool* pool = malloc(sizeof(struct os_completionPool) + capacity * sizeof(struct os_completion));
+   if (! pool)
+   {
+      return NULL;
+   }
+
+   InitializeSRWLock(&pool->lock);
+   pool->free      = NULL;
+   pool->capacity  = capacity;
+   pool->available = capacity;
+
+   for (uint32_t ii = capacity; ii > 0; ii --)
+   {
+      struct os_completion* completion = &pool->completion[ii - 1];
+
+      InitializeSRWLock(&completion->lock);
+      InitializeConditionVariable(&completion->signaled);
+      completion->generation = 1;
+      completion->isSignaled = false;
+      completion->status     = NULL;
+      completion->pool       = pool;
+      completion->nextFree   = pool->free;
+
+      pool->free = completion;
+   }
+
+   return pool;
+}
+
+void os_destroyCompletionPool(struct os_completionPool* pool)
+{
+   if (pool)
+   {
+      assert(pool->available == pool->capacity);
+      free(pool);
+   }
+}
+
+struct os_completion* os_acquireCompletion(struct os_completionPool* pool)
+{
+   assert(pool);
+
+   AcquireSRWLockExclusive(&pool->lock);
+
+   struct os_completion* completion = pool->free;
+   if (completion)
+   {
+      pool->free = completion->nextFree;
+      pool->available --;
+
+      completion->nextFree = NULL;
+   }
+
+   ReleaseSRWLockExclusive(&pool->lock);
+
+   return completion;
+}
+
+void os_releaseCompletion(struct os_completion* completion)
+{
+   if (! completion)
+   {
+      return;
+   }
+
+   /*
+    * invalidate the last ticket, so signals arriving after the release
+    * cannot reach the next owner
+    */
+   os_armCompletion(completion);
+
+   struct os_completionPool* pool = completion->pool;
+
+   AcquireSRWLockExclusive(&pool->lock);
+
+   completion->nextFree = pool->free;
+   pool->free = completion;
+   pool->available ++;
+
+   ReleaseSRWLockExclusive(&pool->lock);
+}
+
+uint32_t os_armCompletion(struct os_completion* completion)
+{
+   assert(completion);
+
+   AcquireSRWLockExclusive(&completion->lock);
+
+   completion->generation ++;
+   if (0 == completion->generation)
+   {
+      completion->generation = 1;
+   }
+
+   completion->isSignaled = false;
+   completion->status     = NULL;
+
+   const uint32_t ticket = completion->generation;
+
+   ReleaseSRWLockExclusive(&completion->lock);
+
+   return ticket;
+}
+
+bool os_signalCompletion(struct os_completion* completion, uint32_t ticket, void* status)
+{
+   assert(completion);
+
+   AcquireSRWLockExclusive(&completion->lock);
+
+   const bool accepted = (ticket == completion->generation) && (! completion->isSignaled);
+   if (accepted)
+   {
+      completion->isSignaled = true;
+      completion->status     = status;
+   }
+
+   ReleaseSRWLockExclusive(&completion->lock);
+
+   if (accepted)
+   {
+      WakeConditionVariable(&completion->signaled);
+   }
+
+   return accepted;
+}
+
+struct pendingWait
+{
+   struct os_completion*      completion;
+   uint32_t                   ticket;
+};
+
+static bool isWaitOver(void* arg)
+{
+   const struct pendingWait* wait = (const struct pendingWait*) arg;
+
+   AcquireSRWLockShared(&wait->completion->lock);
+   const bool over = (wait->ticket != wait->completion->generation) || wait->completion->isSignaled;
+   ReleaseSRWLockShared(&wait->completion->lock);
+
+   return over;
+}
+
+bool os_waitForCompletion(struct os_completion* completion, uint32_t ticket, uint32_t timeout_ms, void** status)
+{
+   assert(completion);
+
+   if (os_isPolled())
+   {
+      // the signal can only come from the calls made by os_poll
+      struct pendingWait wait = { completion, ticket };
+      os_pollUntil(isWaitOver, &wait, timeout_ms);
+      timeout_ms = 0;
+   }
+
+   const ULONGLONG deadline = GetTickCount64() + timeout_ms;
+
+   AcquireSRWLockExclusive(&completion->lock);
+
+   while ((ticket == completion->generation) && (! completion->isSignaled))
+   {
+      DWORD remaining_ms = INFINITE;
+
+      if (INFINITE != timeout_ms)
+      {
+         const ULONGLONG now = GetTickCount64();
+         if (now >= deadline)
+         {
+            break;
+         }
+
+         remaining_ms = (DWORD) (deadline - now);
+      }
+
+      SleepConditionVariableSRW(&completion->signaled, &completion->lock, remaining_ms, 0);
+   }
+
+   const bool signaled = (ticket == completion->generation) && completion->isSignaled;
+   if (signaled && status)
+   {
+      *status = completion->status;
+   }
+
+   ReleaseSRWLockExclusive(&completion->lock);
+
+   return signaled;
+}
@@ -33,6 +33,8 @@
 
 #include <osal_core.h>
 
+#include "osal_priv.h"
+
 struct os_condition
 {
    HANDLE handle;
@@ -81,14 +83,32 @@ void os_signalCondition(struct os_condition* cond, void* status)
    SetEvent(cond->handle);
 }
 
+static bool isSignaled(void* arg)
+{
+   struct os_condition* cond = (struct os_condition*) arg;
+
+   return WAIT_OBJECT_0 == WaitForSingleObject(cond->handle, 0);
+}
+
 bool os_waitForCondition(struct os_condition* cond, uint32_t timeout_ms, void** status)
 {
    assert(cond);
+
+   if (os_isPolled())
+   {
+      // the signal can only come from the calls made by os_poll
+      os_pollUntil(isSignaled, cond, timeout_ms);
+      timeout_ms = 0;
+   }
+
    DWORD ret = WaitForSingleObject(cond->handle, timeout_ms);
 
    if (WAIT_OBJECT_0 == ret)
    {
-      *status = cond->status;
+      if (status)
+      {
+         *status = cond->status;
+      }
       return true;
    }
    else
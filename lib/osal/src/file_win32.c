@@ -0,0 +1,158 @@
+/**
+ * @file file_win32.c
+ * @brief Memory mapped file support for Win32 API
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of lightBLUE OSAL library
+ */
+
+/**
+ * @privatesection
+ */
+
+#include <assert.h>
+#include <malloc.h>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include <osal_file.h>
+
+struct os_mappedFile
+{
+   HANDLE   file;
+   HANDLE   mapping;
+   uint8_t* address;
+   uint64_t size;
+};
+
+struct os_mappedFile* os_mapFile(const char* path, uint64_t size, bool writable)
+{
+   struct os_mappedFile* mappedFile = malloc(sizeof(struct os_mappedFile));
+   if (! mappedFile)
+   {
+      return 0;
+   }
+
+   mappedFile->file = CreateFileA(
+         path,
+         writable ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ,
+         writable ? FILE_SHARE_READ : (FILE_SHARE_READ | FILE_SHARE_WRITE),
+         0,
+         writable ? OPEN_ALWAYS : OPEN_EXISTING,
+         FILE_ATTRIBUTE_NORMAL,
+         0);
+
+   if (INVALID_HANDLE_VALUE == mappedFile->file)
+   {
+      free(mappedFile);
+      return 0;
+   }
+
+   LARGE_INTEGER fileSize;
+   if (! GetFileSizeEx(mappedFile->file, &fileSize))
+   {
+      CloseHandle(mappedFile->file);
+      free(mappedFile);
+      return 0;
+   }
+
+   if (writable && ((uint64_t) fileSize.QuadPart < size))
+   {
+      /* reserve all the space now, so running out of disk is detected here
+       * rather than as an exception when a page is first written
+       */
+      LARGE_INTEGER end;
+      end.QuadPart = (LONGLONG) size;
+      if ((! SetFilePointerEx(mappedFile->file, end, 0, FILE_BEGIN)) || (! SetEndOfFile(mappedFile->file)))
+      {
+         CloseHandle(mappedFile->file);
+         free(mappedFile);
+         return 0;
+      }
+      fileSize = end;
+   }
+
+   mappedFile->size = (uint64_t) fileSize.QuadPart;
+   if (0 == mappedFile->size)
+   {
+      CloseHandle(mappedFile->file);
+      free(mappedFile);
+      return 0;
+   }
+
+   mappedFile->mapping = CreateFileMappingA(mappedFile->file, 0, writable ? PAGE_READWRITE : PAGE_READONLY, 0, 0, 0);
+   if (! mappedFile->mapping)
+   {
+      CloseHandle(mappedFile->file);
+      free(mappedFile);
+      return 0;
+   }
+
+   mappedFile->address = MapViewOfFile(mappedFile->mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, (size_t) mappedFile->size);
+   if (! mappedFile->address)
+   {
+      CloseHandle(mappedFile->mapping);
+      CloseHandle(mappedFile->file);
+      free(mappedFile);
+      return 0;
+   }
+
+   return mappedFile;
+}
+
+void os_unmapFile(struct os_mappedFile* file)
+{
+   if (file)
+   {
+      FlushViewOfFile(file->address, 0);
+      UnmapViewOfFile(file->address);
+      CloseHandle(file->mapping);
+      CloseHandle(file->file);
+      free(file);
+   }
+}
+
+void* os_getMappedAddress(struct os_mappedFile* file)
+{
+   assert(file);
+   return file->address;
+}
+
+uint64_t os_getMappedSize(struct os_mappedFile* file)
+{
+   assert(file);
+   return file->size;
+}
+
+bool os_flushMappedFile(struct os_mappedFile* file, uint64_t offset, uint64_t length)
+{
+   assert(file);
+
+   if (offset >= file->size)
+   {
+      return false;
+   }
+
+   if ((0 == length) || (length > file->size - offset))
+   {
+      length = file->size - offset;
+   }
+
+   return FlushViewOfFile(file->address + offset, (size_t) length);
+}
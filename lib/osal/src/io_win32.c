@@ -28,10 +28,13 @@
 #include <assert.h>
 #include <stdio.h>
 #include <malloc.h>
+#include <string.h>
 
 #include <osal_core.h>
 #include <osal_serial.h>
 
+#include "osal_priv.h"
+
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #include <process.h>
@@ -40,6 +43,9 @@
 
 static volatile bool interrupted = false;
 
+// no I/O thread; the completions are dispatched by os_poll
+static bool polled = false;
+
 static HANDLE sleepPort = INVALID_HANDLE_VALUE;
 static HANDLE completionPort = INVALID_HANDLE_VALUE;
 static HANDLE shutdownCompletePort = INVALID_HANDLE_VALUE;
@@ -56,6 +62,11 @@ static BOOL WINAPI consoleHandler(DWORD dwType)
          os_on_shutdownRequested();
          //PostQueuedCompletionStatus(completionPort, 0, THREAD_SHUTDOWN_KEY, NULL);
          PostQueuedCompletionStatus(sleepPort, 0, THREAD_SHUTDOWN_KEY, NULL);
+         if (polled)
+         {
+            // wakes up os_poll
+            PostQueuedCompletionStatus(completionPort, 0, THREAD_SHUTDOWN_KEY, NULL);
+         }
          break;
 
       default:
@@ -78,6 +89,9 @@ struct io_channel
    OVERLAPPED  readOverlapped;
    uint8_t     buffer[256];
 
+   // signaled when a read completes; only used in polled mode
+   HANDLE      readEvent;
+
    OVERLAPPED  writeOverlapped;
 
    SRWLOCK              writeVariablesLock;
@@ -97,102 +111,110 @@ void __attribute__((weak)) io_on_transmissionComplete(struct io_channel* channel
 {
 }
 
-static void ioThreadHandler(void* argument)
+/*
+ * Dispatches one completion packet; returns 1 if a packet was dispatched,
+ * 0 on timeout or error, and -1 for the shutdown packet
+ */
+static int dispatchCompletion(DWORD timeout_ms)
 {
-   (void) argument;
+   DWORD byteCount = 0;
+   ULONG_PTR key = NULL;
+   LPOVERLAPPED overlappedPtr;
 
-   while (true)
+   BOOL successful = GetQueuedCompletionStatus(completionPort, &byteCount, &key, &overlappedPtr, timeout_ms);
+   if (! successful)
    {
-      DWORD byteCount = 0;
-      ULONG_PTR key = NULL;
-      LPOVERLAPPED overlappedPtr;
+      DWORD err = GetLastError();
+      if ((ioDebugLevel > 1000) && (WAIT_TIMEOUT != err))
+      {
+         printf("!! io thread: GetQueuedCompletionStatus error: %lu\n", err);
+         fflush(stdout);
+      }
+      return 0;
+   }
 
-      BOOL successful = GetQueuedCompletionStatus(completionPort, &byteCount, &key, &overlappedPtr, INFINITE);
-      if (successful)
+   if (THREAD_SHUTDOWN_KEY == key)
+   {
+      assert(NULL == overlappedPtr);
+      if (ioDebugLevel > 1000)
       {
-         if (THREAD_SHUTDOWN_KEY == key)
-         {
-            assert(NULL == overlappedPtr);
-            if (ioDebugLevel > 1000)
-            {
-               puts("I/O Thread interrupted");
-            }
-            break;
-         }
-         else
-         {
-            struct io_channel* channel = (struct io_channel*) key;
+         puts("I/O Thread interrupted");
+      }
+      return -1;
+   }
 
-            if (&channel->readOverlapped == overlappedPtr)
-            {
-               if (byteCount)
-               {
-                  if (ioDebugLevel > 1000)
-                  {
-                     printf("& Read %lu bytes\n", byteCount);
-                     fflush(stdout);
-                  }
-                  assert(sizeof(channel->buffer) >= byteCount);
-
-                  io_on_dataReceived(channel, channel->buffer, byteCount);
-               }
-
-               memset(&channel->readOverlapped, 0, sizeof(channel->readOverlapped));
-
-               DWORD bytesRead = 0;
-               BOOL restartRead = ReadFile(channel->serialHandle, channel->buffer, sizeof(channel->buffer), &bytesRead, &channel->readOverlapped);
-               if (! restartRead)
-               {
-                  DWORD err = GetLastError();
-                  if (ERROR_IO_PENDING != err)
-                  {
-                     if (ioDebugLevel)
-                     {
-                        printf("!! ReadFile error code: %lu\n", err);
-                     }
-                  }
-               }
-               else
-               {
-                  if (ioDebugLevel)
-                  {
-                     printf("!! ReadFile success! Received %lu bytes.\n", bytesRead);
-                  }
-               }
-            }
-            else
-            {
-               assert(&channel->writeOverlapped == overlappedPtr);
-               if (ioDebugLevel > 1000)
-               {
-                  printf("& Wrote %lu bytes\n", byteCount);
-                  fflush(stdout);
-               }
+   struct io_channel* channel = (struct io_channel*) key;
 
-               AcquireSRWLockExclusive(&channel->writeVariablesLock);
+   if (&channel->readOverlapped == overlappedPtr)
+   {
+      if (byteCount)
+      {
+         if (ioDebugLevel > 1000)
+         {
+            printf("& Read %lu bytes\n", byteCount);
+            fflush(stdout);
+         }
+         assert(sizeof(channel->buffer) >= byteCount);
 
-               channel->writeCompleted += byteCount;
-               if (channel->writeCompleted == channel->writeScheduled)
-               {
-                  io_on_transmissionComplete(channel);
+         io_on_dataReceived(channel, channel->buffer, byteCount);
+      }
 
-                  WakeConditionVariable(&channel->allWritesHaveCompleted);
-               }
+      memset(&channel->readOverlapped, 0, sizeof(channel->readOverlapped));
+      channel->readOverlapped.hEvent = channel->readEvent;
 
-               ReleaseSRWLockExclusive(&channel->writeVariablesLock);
+      DWORD bytesRead = 0;
+      BOOL restartRead = ReadFile(channel->serialHandle, channel->buffer, sizeof(channel->buffer), &bytesRead, &channel->readOverlapped);
+      if (! restartRead)
+      {
+         DWORD err = GetLastError();
+         if (ERROR_IO_PENDING != err)
+         {
+            if (ioDebugLevel)
+            {
+               printf("!! ReadFile error code: %lu\n", err);
             }
          }
       }
       else
       {
-         DWORD err = GetLastError();
-         if (ioDebugLevel > 1000)
+         if (ioDebugLevel)
          {
-            printf("!! io thread: GetQueuedCompletionStatus error: %lu\n", err);
-            fflush(stdout);
+            printf("!! ReadFile success! Received %lu bytes.\n", bytesRead);
          }
       }
    }
+   else
+   {
+      assert(&channel->writeOverlapped == overlappedPtr);
+      if (ioDebugLevel > 1000)
+      {
+         printf("& Wrote %lu bytes\n", byteCount);
+         fflush(stdout);
+      }
+
+      AcquireSRWLockExclusive(&channel->writeVariablesLock);
+
+      channel->writeCompleted += byteCount;
+      if (channel->writeCompleted == channel->writeScheduled)
+      {
+         io_on_transmissionComplete(channel);
+
+         WakeConditionVariable(&channel->allWritesHaveCompleted);
+      }
+
+      ReleaseSRWLockExclusive(&channel->writeVariablesLock);
+   }
+
+   return 1;
+}
+
+static void ioThreadHandler(void* argument)
+{
+   (void) argument;
+
+   while (dispatchCompletion(INFINITE) >= 0)
+   {
+   }
 
    PostQueuedCompletionStatus(shutdownCompletePort, 0, THREAD_SHUTDOWN_KEY, NULL);
 
@@ -201,8 +223,10 @@ static void ioThreadHandler(void* argument)
 
 static uintptr_t ioThreadId = -1;
 
-int os_initialize(void)
+static int initialize(bool noThreads)
 {
+   polled = noThreads;
+
    completionPort = CreateIoCompletionPort(
          INVALID_HANDLE_VALUE,            // file handle
          NULL,                            // existing completion port
@@ -245,18 +269,106 @@ int os_initialize(void)
       return -2;
    }
 
-   ioThreadId = _beginthread(ioThreadHandler, 0, NULL);
-   if (-1L == ioThreadId)
+   if (! polled)
+   {
+      ioThreadId = _beginthread(ioThreadHandler, 0, NULL);
+      if (-1L == ioThreadId)
+      {
+         return -3;
+      }
+   }
+
+   if (os_initializeTimers(polled) < 0)
    {
-      return -3;
+      return -4;
    }
 
    return 0;
 }
 
+int os_initialize(void)
+{
+   return initialize(false);
+}
+
+int os_initializePolled(void)
+{
+   return initialize(true);
+}
+
+bool os_isPolled(void)
+{
+   return polled;
+}
+
+int os_poll(uint32_t timeout_ms)
+{
+   assert(polled);
+
+   // a wait under a lock only lets the I/O through
+   const bool runTimers = ! os_holdsLocks();
+
+   int count = runTimers ? os_runTimers() : 0;
+
+   DWORD wait_ms = 0;
+   if (0 == count)
+   {
+      const uint32_t timerTimeout_ms = runTimers ? os_getNextTimeout_ms() : UINT32_MAX;
+      wait_ms = (timerTimeout_ms < timeout_ms) ? timerTimeout_ms : timeout_ms;
+   }
+
+   // drain the port; only the first call may block
+   while (0 < dispatchCompletion(wait_ms))
+   {
+      count ++;
+      wait_ms = 0;
+   }
+
+   if (runTimers)
+   {
+      count += os_runTimers();
+   }
+
+   return count;
+}
+
+bool os_pollUntil(bool (* isDone)(void* arg), void* arg, uint32_t timeout_ms)
+{
+   const uint64_t deadline = os_getTime_ms() + timeout_ms;
+
+   while (! isDone(arg))
+   {
+      uint32_t remaining_ms = INFINITE;
+
+      if (INFINITE != timeout_ms)
+      {
+         const uint64_t now = os_getTime_ms();
+         if (now >= deadline)
+         {
+            return false;
+         }
+
+         remaining_ms = (uint32_t) (deadline - now);
+      }
+
+      os_poll(remaining_ms);
+   }
+
+   return true;
+}
+
 void os_cleanup(void)
 {
-   PostQueuedCompletionStatus(completionPort, 0, THREAD_SHUTDOWN_KEY, NULL);
+   os_cleanupTimers();
+
+   if (polled)
+   {
+      PostQueuedCompletionStatus(shutdownCompletePort, 0, THREAD_SHUTDOWN_KEY, NULL);
+   }
+   else
+   {
+      PostQueuedCompletionStatus(completionPort, 0, THREAD_SHUTDOWN_KEY, NULL);
+   }
    PostQueuedCompletionStatus(sleepPort, 0, THREAD_SHUTDOWN_KEY, NULL);
 
    // wait until all threads are shut down
@@ -431,6 +543,13 @@ struct io_channel* io_openSerialPort(const char* portName, uint32_t baudRate, vo
    InitializeSRWLock(&channel->writeVariablesLock);
    InitializeConditionVariable(&channel->allWritesHaveCompleted);
 
+   if (polled)
+   {
+      // manual-reset; ReadFile resets it when the next read starts
+      channel->readEvent = CreateEvent(NULL, true, false, NULL);
+      channel->readOverlapped.hEvent = channel->readEvent;
+   }
+
    // kickstart the read
    DWORD bytesRead = 0;
    BOOL startRead = ReadFile(channel->serialHandle, channel->buffer, sizeof(channel->buffer), &bytesRead, &channel->readOverlapped);
@@ -481,22 +600,120 @@ done:
    return channel;
 }
 
+static bool matchesPattern(const char* name, const char* pattern)
+{
+   const char* star = strchr(pattern, '*');
+   if (! star)
+   {
+      return 0 == strcmp(name, pattern);
+   }
+
+   const size_t prefixLength = (size_t) (star - pattern);
+   const size_t suffixLength = strlen(star + 1);
+   const size_t nameLength   = strlen(name);
+
+   return (nameLength >= prefixLength + suffixLength) &&
+      (0 == strncmp(name, pattern, prefixLength)) &&
+      (0 == strcmp(name + nameLength - suffixLength, star + 1));
+}
+
+uint32_t io_enumerateSerialPorts(const char* pattern, void (* func)(void* arg, const char* portName), void* arg)
+{
+   // the DOS device names, each null-terminated, followed by an empty one
+   DWORD size = 16 * 1024;
+   char* names = NULL;
+
+   while (true)
+   {
+      names = (char*) malloc(size);
+      if (! names)
+      {
+         return 0;
+      }
+
+      if (QueryDosDeviceA(NULL, names, size))
+      {
+         break;
+      }
+
+      free(names);
+      names = NULL;
+
+      if ((ERROR_INSUFFICIENT_BUFFER != GetLastError()) || (size >= 1024 * 1024))
+      {
+         return 0;
+      }
+
+      size *= 2;
+   }
+
+   uint32_t count = 0;
+
+   for (const char* name = names; *name; name += strlen(name) + 1)
+   {
+      if ((0 == strncmp(name, "COM", 3)) && matchesPattern(name, pattern))
+      {
+         func(arg, name);
+         count ++;
+      }
+   }
+
+   free(names);
+
+   return count;
+}
+
 void io_closePort(struct io_channel* channel)
 {
    if (channel)
    {
       CloseHandle(channel->serialHandle);
+      if (channel->readEvent)
+      {
+         CloseHandle(channel->readEvent);
+      }
       free(channel);
    }
 }
 
+intptr_t io_getPollFd(struct io_channel* channel)
+{
+   assert(channel);
+
+   if (! channel->readEvent)
+   {
+      return -1;
+   }
+
+   return (intptr_t) channel->readEvent;
+}
+
 bool os_interrupted(void)
 {
    return interrupted;
 }
 
+static bool never(void* arg)
+{
+   (void) arg;
+   return false;
+}
+
 void os_sleep_ms(uint32_t duration_ms)
 {
+   if (polled)
+   {
+      if (0 == duration_ms)
+      {
+         os_poll(0);
+      }
+      else
+      {
+         os_pollUntil(never, NULL, duration_ms);
+      }
+      return;
+   }
+
    DWORD byteCount = 0;
    ULONG_PTR key = NULL;
    LPOVERLAPPED overlappedPtr;
@@ -539,8 +756,25 @@ void io_sendData(struct io_channel* channel, const uint8_t* buffer, uint32_t len
    }
 }
 
+static bool allWritesHaveCompleted(void* arg)
+{
+   struct io_channel* channel = (struct io_channel*) arg;
+
+   AcquireSRWLockShared(&channel->writeVariablesLock);
+   const bool completed = (channel->writeCompleted == channel->writeScheduled);
+   ReleaseSRWLockShared(&channel->writeVariablesLock);
+
+   return completed;
+}
+
 void io_waitForTransmitComplete(struct io_channel* channel)
 {
+   if (polled)
+   {
+      os_pollUntil(allWritesHaveCompleted, channel, INFINITE);
+      return;
+   }
+
    AcquireSRWLockExclusive(&channel->writeVariablesLock);
    while (channel->writeCompleted != channel->writeScheduled)
    {
@@ -557,8 +791,20 @@ void __attribute__((weak)) os_on_shutdownRequested(void)
 {
 }
 
+static bool isInterrupted(void* arg)
+{
+   (void) arg;
+   return interrupted;
+}
+
 void os_waitForKeyboardInterrupt(void)
 {
+   if (polled)
+   {
+      os_pollUntil(isInterrupted, NULL, INFINITE);
+      return;
+   }
+
    DWORD byteCount = 0;
    ULONG_PTR key = NULL;
    LPOVERLAPPED overlappedPtr;
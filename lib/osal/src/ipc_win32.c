@@ -0,0 +1,297 @@
+/**
+ * @file ipc_win32.c
+ * @brief Local IPC channels for Win32 API, over AF_UNIX sockets
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of lightBLUE OSAL library
+ */
+
+/**
+ * @privatesection
+ */
+
+#include <assert.h>
+#include <malloc.h>
+#include <string.h>
+
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#include <afunix.h>
+#include <windows.h>
+
+#include <osal_ipc.h>
+
+struct os_ipcServer
+{
+   SOCKET         socket;
+   volatile LONG  stopped;
+   char           path[sizeof(((struct sockaddr_un*) 0)->sun_path)];
+};
+
+struct os_ipcConnection
+{
+   SOCKET         socket;
+   volatile LONG  shutDown;
+};
+
+/*
+ * Every server and connection holds a reference on Winsock, released when
+ * it is destroyed
+ */
+static bool startWinsock(void)
+{
+   WSADATA wsaData;
+   return 0 == WSAStartup(MAKEWORD(2, 2), &wsaData);
+}
+
+static bool setAddress(struct sockaddr_un* address, const char* path)
+{
+   size_t length = strlen(path);
+   if ((0 == length) || (length >= sizeof(address->sun_path)))
+   {
+      return false;
+   }
+
+   memset(address, 0, sizeof(*address));
+   address->sun_family = AF_UNIX;
+   memcpy(address->sun_path, path, length);
+
+   return true;
+}
+
+static struct os_ipcConnection* createConnection(SOCKET s)
+{
+   struct os_ipcConnection* connection = malloc(sizeof(struct os_ipcConnection));
+   if (! connection)
+   {
+      closesocket(s);
+      WSACleanup();
+      return 0;
+   }
+
+   connection->socket   = s;
+   connection->shutDown = 0;
+
+   return connection;
+}
+
+struct os_ipcServer* os_createIpcServer(const char* path)
+{
+   struct sockaddr_un address;
+   if (! setAddress(&address, path))
+   {
+      return 0;
+   }
+
+   struct os_ipcServer* server = malloc(sizeof(struct os_ipcServer));
+   if (! server)
+   {
+      return 0;
+   }
+
+   if (! startWinsock())
+   {
+      free(server);
+      return 0;
+   }
+
+   strcpy(server->path, address.sun_path);
+   server->stopped = 0;
+
+   // the socket file outlives the process that created it, and blocks bind
+   DeleteFileA(server->path);
+
+   server->socket = socket(AF_UNIX, SOCK_STREAM, 0);
+   if (INVALID_SOCKET == server->socket)
+   {
+      WSACleanup();
+      free(server);
+      return 0;
+   }
+
+   if ((SOCKET_ERROR == bind(server->socket, (struct sockaddr*) &address, sizeof(address))) ||
+       (SOCKET_ERROR == listen(server->socket, SOMAXCONN)))
+   {
+      closesocket(server->socket);
+      WSACleanup();
+      free(server);
+      return 0;
+   }
+
+   return server;
+}
+
+struct os_ipcConnection* os_acceptIpcConnection(struct os_ipcServer* server)
+{
+   assert(server);
+
+   if (server->stopped)
+   {
+      return 0;
+   }
+
+   SOCKET s = accept(server->socket, 0, 0);
+   if (INVALID_SOCKET == s)
+   {
+      return 0;
+   }
+
+   if (server->stopped || (! startWinsock()))
+   {
+      closesocket(s);
+      return 0;
+   }
+
+   return createConnection(s);
+}
+
+void os_stopIpcServer(struct os_ipcServer* server)
+{
+   assert(server);
+
+   if (0 == InterlockedExchange(&server->stopped, 1))
+   {
+      // fails the accept blocked on the socket
+      closesocket(server->socket);
+   }
+}
+
+void os_destroyIpcServer(struct os_ipcServer* server)
+{
+   if (server)
+   {
+      os_stopIpcServer(server);
+      DeleteFileA(server->path);
+      WSACleanup();
+      free(server);
+   }
+}
+
+struct os_ipcConnection* os_connectIpc(const char* path)
+{
+   struct sockaddr_un address;
+   if (! setAddress(&address, path))
+   {
+      return 0;
+   }
+
+   if (! startWinsock())
+   {
+      return 0;
+   }
+
+   SOCKET s = socket(AF_UNIX, SOCK_STREAM, 0);
+   if (INVALID_SOCKET == s)
+   {
+      WSACleanup();
+      return 0;
+   }
+
+   if (SOCKET_ERROR == connect(s, (struct sockaddr*) &address, sizeof(address)))
+   {
+      closesocket(s);
+      WSACleanup();
+      return 0;
+   }
+
+   return createConnection(s);
+}
+
+bool os_sendIpc(struct os_ipcConnection* connection, const void* buffer, uint32_t length)
+{
+   assert(connection);
+
+   const char* data = buffer;
+   while (length && (! connection->shutDown))
+   {
+      int sent = send(connection->socket, data, (int) length, 0);
+      if (sent <= 0)
+      {
+         return false;
+      }
+
+      data   += sent;
+      length -= (uint32_t) sent;
+   }
+
+   return 0 == length;
+}
+
+bool os_receiveIpc(struct os_ipcConnection* connection, void* buffer, uint32_t length)
+{
+   assert(connection);
+
+   char* data = buffer;
+   while (length && (! connection->shutDown))
+   {
+      int received = recv(connection->socket, data, (int) length, 0);
+      if (received <= 0)
+      {
+         return false;
+      }
+
+      data   += received;
+      length -= (uint32_t) received;
+   }
+
+   return 0 == length;
+}
+
+bool os_waitForIpcData(struct os_ipcConnection* connection, uint32_t timeout_ms)
+{
+   assert(connection);
+
+   if (connection->shutDown)
+   {
+      return true;
+   }
+
+   fd_set readable;
+   FD_ZERO(&readable);
+   FD_SET(connection->socket, &readable);
+
+   struct timeval timeout;
+   timeout.tv_sec  = (long) (timeout_ms / 1000);
+   timeout.tv_usec = (long) ((timeout_ms % 1000) * 1000);
+
+   // an error reports the socket ready, so the following receive fails
+   return 0 != select(0, &readable, 0, 0, (INFINITE == timeout_ms) ? 0 : &timeout);
+}
+
+void os_shutdownIpc(struct os_ipcConnection* connection)
+{
+   assert(connection);
+
+   if (0 == InterlockedExchange(&connection->shutDown, 1))
+   {
+      shutdown(connection->socket, SD_BOTH);
+
+      // shutdown does not wake a receive already blocked on the socket
+      CancelIoEx((HANDLE) connection->socket, 0);
+   }
+}
+
+void os_closeIpc(struct os_ipcConnection* connection)
+{
+   if (connection)
+   {
+      closesocket(connection->socket);
+      WSACleanup();
+      free(connection);
+   }
+}
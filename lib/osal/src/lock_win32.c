@@ -33,11 +33,24 @@
 
 #include <osal_core.h>
 
+#include "osal_priv.h"
+
 struct os_lock
 {
    SRWLOCK handle;
 };
 
+/*
+ * In polled mode all the locks are taken on the polling thread; a timer
+ * function run by a wait nested under a lock could try to take it again
+ */
+static uint32_t locksHeld = 0;
+
+bool os_holdsLocks(void)
+{
+   return 0 != locksHeld;
+}
+
 struct os_lock* os_createLock(void)
 {
    struct os_lock* lock = malloc(sizeof(struct os_lock));
@@ -60,11 +73,88 @@ void os_lock(struct os_lock* lock)
 {
    assert(lock);
    AcquireSRWLockExclusive(&lock->handle);
+
+   if (os_isPolled())
+   {
+      locksHeld ++;
+   }
 }
 
 void os_unlock(struct os_lock* lock)
 {
    assert(lock);
+   if (os_isPolled())
+   {
+      locksHeld --;
+   }
+
    ReleaseSRWLockExclusive(&lock->handle);
 }
 
+struct os_conditionVariable
+{
+   CONDITION_VARIABLE   handle;
+
+   // changed by every wakeup, for the waiters in polled mode
+   volatile LONG        generation;
+};
+
+struct os_conditionVariable* os_createConditionVariable(void)
+{
+   struct os_conditionVariable* cv = malloc(sizeof(struct os_conditionVariable));
+   if (cv)
+   {
+      InitializeConditionVariable(&cv->handle);
+      cv->generation = 0;
+   }
+   return cv;
+}
+
+void os_destroyConditionVariable(struct os_conditionVariable* cv)
+{
+   if (cv)
+   {
+      free(cv);
+   }
+}
+
+struct pendingWake
+{
+   struct os_conditionVariable*  cv;
+   LONG                          generation;
+};
+
+static bool isWoken(void* arg)
+{
+   const struct pendingWake* wake = (const struct pendingWake*) arg;
+
+   return wake->generation != wake->cv->generation;
+}
+
+bool os_sleepConditionVariable(struct os_conditionVariable* cv, struct os_lock* lock, uint32_t timeout_ms)
+{
+   assert(cv);
+   assert(lock);
+
+   if (os_isPolled())
+   {
+      // the wakeup can only come from the calls made by os_poll, which may take the lock
+      struct pendingWake wake = { cv, cv->generation };
+
+      os_unlock(lock);
+      const bool woken = os_pollUntil(isWoken, &wake, timeout_ms);
+      os_lock(lock);
+
+      return woken;
+   }
+
+   return SleepConditionVariableSRW(&cv->handle, &lock->handle, timeout_ms, 0);
+}
+
+void os_wakeAllConditionVariable(struct os_conditionVariable* cv)
+{
+   assert(cv);
+
+   InterlockedIncrement(&cv->generation);
+   WakeAllConditionVariable(&cv->handle);
+}
@@ -0,0 +1,56 @@
+/**
+ * @file osal_priv.h
+ * @brief OSAL internal interfaces
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of lightBLUE OSAL library
+ */
+
+#ifndef __OSAL_PRIV_H__
+#define __OSAL_PRIV_H__
+
+/**
+ * @privatesection
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Timer wheel, started and stopped with the library; in polled mode it has
+ * no thread, and os_runTimers calls the expired timers
+ */
+int os_initializeTimers(bool polled);
+
+void os_cleanupTimers(void);
+
+int os_runTimers(void);
+
+/*
+ * True if the polling thread holds an os_lock; os_poll then leaves the
+ * timers for later
+ */
+bool os_holdsLocks(void);
+
+/*
+ * In polled mode, runs os_poll until the predicate holds or the timeout
+ * elapses; returns the last value of the predicate
+ */
+bool os_pollUntil(bool (* isDone)(void* arg), void* arg, uint32_t timeout_ms);
+
+#endif // __OSAL_PRIV_H__
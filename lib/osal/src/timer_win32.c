@@ -0,0 +1,566 @@
+/**
+ * @file timer_win32.c
+ * @brief Timer support for Win32 API
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of lightBLUE OSAL library
+ */
+
+/**
+ * @privatesection
+ */
+
+#include <assert.h>
+#include <malloc.h>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <process.h>
+
+#include <osal_core.h>
+
+#include "osal_priv.h"
+
+/*
+ * Hierarchical timer wheel: four levels of 256 slots, with 1 ms ticks at
+ * the first level. A timer is placed at the level matching its remaining
+ * time; when the lower level wraps around, the next slot of the upper level
+ * is redistributed to the lower levels. Each tick touches one slot.
+ */
+#define WHEEL_LEVELS       4
+#define WHEEL_BITS         8
+#define WHEEL_SLOTS        (1u << WHEEL_BITS)
+#define WHEEL_MASK         (WHEEL_SLOTS - 1)
+
+struct os_timer
+{
+   struct os_timer*     next;
+   struct os_timer**    pprev;
+
+   uint64_t             expiry_ms;
+   uint32_t             period_ms;
+
+   void                 (* func)(void* arg);
+   void*                arg;
+
+   bool                 armed;
+   bool                 running;
+   bool                 stopped;
+   bool                 autoRelease;
+
+   DWORD                runningThread;
+};
+
+static struct
+{
+   SRWLOCK              lock;
+   CONDITION_VARIABLE   callbackReturned;
+
+   HANDLE               wakeup;
+   HANDLE               stopped;
+   bool                 shutdown;
+
+   // no wheel thread: expired timers wait in the ready list for os_poll
+   bool                 polled;
+   struct os_timer*     ready;
+   struct os_timer**    readyTail;
+
+   // last tick processed, and the tick the wheel thread sleeps until
+   uint64_t             tick_ms;
+   uint64_t             wakeTick_ms;
+
+   uint32_t             armedCount;
+
+   struct os_timer*     slot[WHEEL_LEVELS][WHEEL_SLOTS];
+} wheel;
+
+uint64_t os_getTime_ms(void)
+{
+   return GetTickCount64();
+}
+
+static void linkTimer(struct os_timer* timer)
+{
+   uint64_t delta = (timer->expiry_ms > wheel.tick_ms) ? (timer->expiry_ms - wheel.tick_ms) : 0;
+
+   uint32_t level = 0;
+   while ((level < WHEEL_LEVELS - 1) && (delta >> (WHEEL_BITS * (level + 1))))
+   {
+      level ++;
+   }
+
+   struct os_timer** head = &wheel.slot[level][(timer->expiry_ms >> (WHEEL_BITS * level)) & WHEEL_MASK];
+
+   timer->next = *head;
+   if (timer->next)
+   {
+      timer->next->pprev = &timer->next;
+   }
+   *head = timer;
+   timer->pprev = head;
+}
+
+static void unlinkTimer(struct os_timer* timer)
+{
+   *timer->pprev = timer->next;
+   if (timer->next)
+   {
+      timer->next->pprev = timer->pprev;
+   }
+
+   if (wheel.readyTail == &timer->next)
+   {
+      wheel.readyTail = timer->pprev;
+   }
+
+   timer->next = NULL;
+   timer->pprev = NULL;
+}
+
+/*
+ * Called with the lock held
+ */
+static void armTimer(struct os_timer* timer, uint64_t expiry_ms)
+{
+   if (expiry_ms <= wheel.tick_ms)
+   {
+      expiry_ms = wheel.tick_ms + 1;
+   }
+
+   timer->expiry_ms = expiry_ms;
+   timer->armed = true;
+   wheel.armedCount ++;
+
+   linkTimer(timer);
+
+   if (expiry_ms < wheel.wakeTick_ms)
+   {
+      wheel.wakeTick_ms = expiry_ms;
+      SetEvent(wheel.wakeup);
+   }
+}
+
+static void disarmTimer(struct os_timer* timer)
+{
+   unlinkTimer(timer);
+   timer->armed = false;
+   wheel.armedCount --;
+}
+
+static void CALLBACK runTimer(PTP_CALLBACK_INSTANCE instance, PVOID context)
+{
+   (void) instance;
+
+   struct os_timer* timer = (struct os_timer*) context;
+
+   AcquireSRWLockExclusive(&wheel.lock);
+   timer->runningThread = GetCurrentThreadId();
+   ReleaseSRWLockExclusive(&wheel.lock);
+
+   timer->func(timer->arg);
+
+   AcquireSRWLockExclusive(&wheel.lock);
+
+   timer->running = false;
+   timer->runningThread = 0;
+
+   bool release = false;
+
+   if (timer->stopped)
+   {
+      // stopped from its own function, or by a thread waiting for it
+      release = timer->autoRelease;
+      WakeAllConditionVariable(&wheel.callbackReturned);
+   }
+   else if (timer->period_ms)
+   {
+      uint64_t next_ms = timer->expiry_ms + timer->period_ms;
+      if (next_ms <= wheel.tick_ms)
+      {
+         next_ms += ((wheel.tick_ms - next_ms) / timer->period_ms + 1) * timer->period_ms;
+      }
+      armTimer(timer, next_ms);
+   }
+   else
+   {
+      release = timer->autoRelease;
+   }
+
+   ReleaseSRWLockExclusive(&wheel.lock);
+
+   if (release)
+   {
+      free(timer);
+   }
+}
+
+/*
+ * Moves the timers of an upper level slot to the lower levels
+ */
+static void cascade(uint32_t level, uint32_t index)
+{
+   struct os_timer* timer = wheel.slot[level][index];
+   wheel.slot[level][index] = NULL;
+
+   while (timer)
+   {
+      struct os_timer* next = timer->next;
+      linkTimer(timer);
+      timer = next;
+   }
+}
+
+/*
+ * Appends an expired timer to the ready list; it stays armed until os_poll
+ * takes it, so it can still be stopped
+ */
+static void queueReadyTimer(struct os_timer* timer)
+{
+   timer->next  = NULL;
+   timer->pprev = wheel.readyTail;
+
+   *wheel.readyTail = timer;
+   wheel.readyTail  = &timer->next;
+}
+
+static void dispatchTimer(struct os_timer* timer)
+{
+   if (wheel.polled)
+   {
+      queueReadyTimer(timer);
+      return;
+   }
+
+   timer->armed = false;
+   wheel.armedCount --;
+
+   timer->running = true;
+
+   if (! TrySubmitThreadpoolCallback(runTimer, timer, NULL))
+   {
+      // try again on the next tick
+      timer->running = false;
+      armTimer(timer, wheel.tick_ms + 1);
+   }
+}
+
+/*
+ * Processes the ticks up to now; called with the lock held
+ */
+static void advanceWheel(uint64_t now_ms)
+{
+   if (0 == wheel.armedCount)
+   {
+      wheel.tick_ms = now_ms;
+      return;
+   }
+
+   while (wheel.tick_ms < now_ms)
+   {
+      wheel.tick_ms ++;
+
+      for (uint32_t level = 1; level < WHEEL_LEVELS; level ++)
+      {
+         if (wheel.tick_ms & ((1ull << (WHEEL_BITS * level)) - 1))
+         {
+            break;
+         }
+
+         cascade(level, (wheel.tick_ms >> (WHEEL_BITS * level)) & WHEEL_MASK);
+      }
+
+      struct os_timer** head = &wheel.slot[0][wheel.tick_ms & WHEEL_MASK];
+      while (*head)
+      {
+         struct os_timer* timer = *head;
+         assert(timer->expiry_ms == wheel.tick_ms);
+
+         unlinkTimer(timer);
+         dispatchTimer(timer);
+      }
+   }
+}
+
+/*
+ * The next tick with expiring timers, or the next cascade, whichever is
+ * earlier
+ */
+static uint64_t getNextTick(void)
+{
+   if (0 == wheel.armedCount)
+   {
+      return UINT64_MAX;
+   }
+
+   uint64_t tick_ms = wheel.tick_ms + 1;
+
+   while ((! wheel.slot[0][tick_ms & WHEEL_MASK]) && (tick_ms & WHEEL_MASK))
+   {
+      tick_ms ++;
+   }
+
+   return tick_ms;
+}
+
+static void wheelThreadHandler(void* argument)
+{
+   (void) argument;
+
+   AcquireSRWLockExclusive(&wheel.lock);
+
+   while (! wheel.shutdown)
+   {
+      uint64_t now_ms = os_getTime_ms();
+
+      advanceWheel(now_ms);
+
+      wheel.wakeTick_ms = getNextTick();
+
+      DWORD wait_ms = INFINITE;
+      if (UINT64_MAX != wheel.wakeTick_ms)
+      {
+         wait_ms = (wheel.wakeTick_ms > now_ms) ? (DWORD) (wheel.wakeTick_ms - now_ms) : 0;
+      }
+
+      ReleaseSRWLockExclusive(&wheel.lock);
+
+      WaitForSingleObject(wheel.wakeup, wait_ms);
+
+      AcquireSRWLockExclusive(&wheel.lock);
+   }
+
+   ReleaseSRWLockExclusive(&wheel.lock);
+
+   SetEvent(wheel.stopped);
+}
+
+int os_initializeTimers(bool polled)
+{
+   InitializeSRWLock(&wheel.lock);
+   InitializeConditionVariable(&wheel.callbackReturned);
+
+   wheel.shutdown    = false;
+   wheel.polled      = polled;
+   wheel.ready       = NULL;
+   wheel.readyTail   = &wheel.ready;
+   wheel.tick_ms     = os_getTime_ms();
+   wheel.wakeTick_ms = UINT64_MAX;
+   wheel.armedCount  = 0;
+
+   // auto-reset
+   wheel.wakeup  = CreateEvent(NULL, false, false, NULL);
+   wheel.stopped = CreateEvent(NULL, true, false, NULL);
+
+   if ((! wheel.wakeup) || (! wheel.stopped))
+   {
+      return -1;
+   }
+
+   if (polled)
+   {
+      return 0;
+   }
+
+   if (-1L == (intptr_t) _beginthread(wheelThreadHandler, 0, NULL))
+   {
+      return -1;
+   }
+
+   return 0;
+}
+
+static void releasePendingTimers(struct os_timer* timer)
+{
+   while (timer)
+   {
+      struct os_timer* next = timer->next;
+      timer->armed = false;
+      timer->next = NULL;
+      timer->pprev = NULL;
+      if (timer->autoRelease)
+      {
+         free(timer);
+      }
+      timer = next;
+   }
+}
+
+void os_cleanupTimers(void)
+{
+   AcquireSRWLockExclusive(&wheel.lock);
+   wheel.shutdown = true;
+   SetEvent(wheel.wakeup);
+   ReleaseSRWLockExclusive(&wheel.lock);
+
+   if (! wheel.polled)
+   {
+      WaitForSingleObject(wheel.stopped, INFINITE);
+   }
+
+   // release the pending one-shot calls; the other timers belong to their owners
+   for (uint32_t level = 0; level < WHEEL_LEVELS; level ++)
+   {
+      for (uint32_t index = 0; index < WHEEL_SLOTS; index ++)
+      {
+         releasePendingTimers(wheel.slot[level][index]);
+         wheel.slot[level][index] = NULL;
+      }
+   }
+
+   releasePendingTimers(wheel.ready);
+   wheel.ready     = NULL;
+   wheel.readyTail = &wheel.ready;
+
+   wheel.armedCount = 0;
+
+   CloseHandle(wheel.wakeup);
+   CloseHandle(wheel.stopped);
+}
+
+int os_runTimers(void)
+{
+   int count = 0;
+
+   AcquireSRWLockExclusive(&wheel.lock);
+
+   advanceWheel(os_getTime_ms());
+
+   /*
+    * the functions may block, running os_poll again; each call takes the
+    * head of the list afresh
+    */
+   while (wheel.ready)
+   {
+      struct os_timer* timer = wheel.ready;
+
+      disarmTimer(timer);
+      timer->running = true;
+
+      ReleaseSRWLockExclusive(&wheel.lock);
+
+      runTimer(NULL, timer);
+      count ++;
+
+      AcquireSRWLockExclusive(&wheel.lock);
+   }
+
+   ReleaseSRWLockExclusive(&wheel.lock);
+
+   return count;
+}
+
+uint32_t os_getNextTimeout_ms(void)
+{
+   uint32_t timeout_ms = UINT32_MAX;
+
+   AcquireSRWLockExclusive(&wheel.lock);
+
+   if (wheel.ready)
+   {
+      timeout_ms = 0;
+   }
+   else
+   {
+      const uint64_t tick_ms = getNextTick();
+      if (UINT64_MAX != tick_ms)
+      {
+         const uint64_t now_ms = os_getTime_ms();
+         if (tick_ms <= now_ms)
+         {
+            timeout_ms = 0;
+         }
+         else if (tick_ms - now_ms < UINT32_MAX)
+         {
+            timeout_ms = (uint32_t) (tick_ms - now_ms);
+         }
+      }
+   }
+
+   ReleaseSRWLockExclusive(&wheel.lock);
+
+   return timeout_ms;
+}
+
+static struct os_timer* startTimer(uint32_t delay_ms, uint32_t period_ms, void (* func)(void* arg), void* arg, bool autoRelease)
+{
+   assert(func);
+
+   struct os_timer* timer = calloc(1, sizeof(struct os_timer));
+   if (! timer)
+   {
+      return NULL;
+   }
+
+   timer->period_ms   = period_ms;
+   timer->func        = func;
+   timer->arg         = arg;
+   timer->autoRelease = autoRelease;
+
+   AcquireSRWLockExclusive(&wheel.lock);
+   armTimer(timer, os_getTime_ms() + delay_ms);
+   ReleaseSRWLockExclusive(&wheel.lock);
+
+   return timer;
+}
+
+bool os_executeLater(uint32_t interval_ms, void (* func)(void* arg), void* arg)
+{
+   return NULL != startTimer(interval_ms, 0, func, arg, true);
+}
+
+struct os_timer* os_startTimer(uint32_t delay_ms, uint32_t period_ms, void (* func)(void* arg), void* arg)
+{
+   return startTimer(delay_ms, period_ms, func, arg, false);
+}
+
+void os_stopTimer(struct os_timer* timer)
+{
+   if (! timer)
+   {
+      return;
+   }
+
+   AcquireSRWLockExclusive(&wheel.lock);
+
+   timer->stopped = true;
+
+   if (timer->armed)
+   {
+      disarmTimer(timer);
+   }
+
+   if (timer->running)
+   {
+      if (timer->runningThread == GetCurrentThreadId())
+      {
+         // released when the function returns
+         timer->autoRelease = true;
+         ReleaseSRWLockExclusive(&wheel.lock);
+         return;
+      }
+
+      while (timer->running)
+      {
+         SleepConditionVariableSRW(&wheel.callbackReturned, &wheel.lock, INFINITE, 0);
+      }
+   }
+
+   ReleaseSRWLockExclusive(&wheel.lock);
+
+   free(timer);
+}
@@ -0,0 +1,90 @@
+/**
+ * @file test_completion.c
+ * @brief Exercises pooled completions
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of serial_base library
+ */
+
+#include <assert.h>
+#include <stddef.h>
+
+#include <osal_core.h>
+
+struct signal
+{
+   struct os_completion*   completion;
+   uint32_t                ticket;
+};
+
+static void signalLater(void* arg)
+{
+   struct signal* signal = (struct signal*) arg;
+
+   os_signalCompletion(signal->completion, signal->ticket, signal);
+}
+
+int main(void)
+{
+   os_initialize();
+
+   struct os_completionPool* pool = os_createCompletionPool(2);
+
+   struct os_completion* first  = os_acquireCompletion(pool);
+   struct os_completion* second = os_acquireCompletion(pool);
+   assert(first && second);
+   assert(NULL == os_acquireCompletion(pool));
+
+   void* status = NULL;
+
+   // nobody signals
+   uint32_t ticket = os_armCompletion(first);
+   assert(! os_waitForCompletion(first, ticket, 100, &status));
+
+   // a signal for the abandoned wait does not complete the next one
+   const uint32_t staleTicket = ticket;
+   ticket = os_armCompletion(first);
+   assert(! os_signalCompletion(first, staleTicket, NULL));
+   assert(! os_waitForCompletion(first, ticket, 100, &status));
+
+   // signaled before the wait
+   assert(os_signalCompletion(first, ticket, &status));
+   assert(! os_signalCompletion(first, ticket, NULL));
+   assert(os_waitForCompletion(first, ticket, 0, &status));
+   assert(&status == status);
+
+   // signaled from another thread
+   struct signal signal = { second, os_armCompletion(second) };
+   assert(os_executeLater(50, signalLater, &signal));
+   assert(os_waitForCompletion(second, signal.ticket, 5000, &status));
+   assert(&signal == status);
+
+   // a released completion ignores the tickets of its previous owner
+   os_releaseCompletion(second);
+   struct os_completion* reused = os_acquireCompletion(pool);
+   assert(reused == second);
+   assert(! os_signalCompletion(reused, signal.ticket, NULL));
+
+   os_releaseCompletion(reused);
+   os_releaseCompletion(first);
+   os_destroyCompletionPool(pool);
+
+   os_cleanup();
+
+   return 0;
+}
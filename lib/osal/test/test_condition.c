@@ -39,6 +39,18 @@ int main(void)
 
    os_destroyCondition(cond);
 
+   struct os_lock* lock = os_createLock();
+   struct os_conditionVariable* cv = os_createConditionVariable();
+
+   os_lock(lock);
+   bool woken = os_sleepConditionVariable(cv, lock, 100);
+   os_unlock(lock);
+
+   assert(false == woken);
+
+   os_destroyConditionVariable(cv);
+   os_destroyLock(lock);
+
    os_cleanup();
 
    return 0;
@@ -0,0 +1,136 @@
+/**
+ * @file test_ipc.c
+ * @brief Exercises the local IPC channels
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of serial_base library
+ */
+
+#include <assert.h>
+#include <stddef.h>
+
+#include <osal_core.h>
+#include <osal_ipc.h>
+
+#define SOCKET_PATH        "test_ipc.sock"
+#define MESSAGE_COUNT      1000
+
+static struct os_condition* clientDone;
+static struct os_condition* acceptDone;
+
+/*
+ * Sends numbered messages and checks they come back; the server then shuts
+ * the connection down, which ends the last receive
+ */
+static void runClient(void* arg)
+{
+   (void) arg;
+
+   struct os_ipcConnection* connection = os_connectIpc(SOCKET_PATH);
+   assert(connection);
+
+   for (uint32_t ii = 0; ii < MESSAGE_COUNT; ii ++)
+   {
+      bool sent = os_sendIpc(connection, &ii, sizeof(ii));
+      assert(sent);
+
+      uint32_t echo = 0;
+      bool received = os_receiveIpc(connection, &echo, sizeof(echo));
+      assert(received);
+      assert(ii == echo);
+   }
+
+   uint32_t value = 0;
+   bool received = os_receiveIpc(connection, &value, sizeof(value));
+   assert(! received);
+
+   os_closeIpc(connection);
+
+   os_signalCondition(clientDone, NULL);
+}
+
+static void acceptStopped(void* arg)
+{
+   struct os_ipcConnection* connection = os_acceptIpcConnection(arg);
+   os_signalCondition(acceptDone, connection);
+}
+
+int main(void)
+{
+   int status = os_initialize();
+   assert(0 == status);
+
+   clientDone = os_createCondition();
+   acceptDone = os_createCondition();
+
+   struct os_ipcServer* server = os_createIpcServer(SOCKET_PATH);
+   assert(server);
+
+   bool scheduled = os_executeLater(0, runClient, NULL);
+   assert(scheduled);
+
+   struct os_ipcConnection* connection = os_acceptIpcConnection(server);
+   assert(connection);
+
+   for (uint32_t ii = 0; ii < MESSAGE_COUNT; ii ++)
+   {
+      bool ready = os_waitForIpcData(connection, 1000);
+      assert(ready);
+
+      uint32_t value = 0;
+      bool received = os_receiveIpc(connection, &value, sizeof(value));
+      assert(received);
+      assert(ii == value);
+
+      bool sent = os_sendIpc(connection, &value, sizeof(value));
+      assert(sent);
+   }
+
+   // the client is now waiting for a message that never comes
+   assert(! os_waitForIpcData(connection, 50));
+
+   os_shutdownIpc(connection);
+
+   bool signaled = os_waitForCondition(clientDone, 1000, NULL);
+   assert(signaled);
+
+   os_closeIpc(connection);
+
+   // stopping the server wakes the thread blocked accepting connections
+   scheduled = os_executeLater(0, acceptStopped, server);
+   assert(scheduled);
+
+   os_sleep_ms(50);
+   os_stopIpcServer(server);
+
+   void* accepted = server;
+   signaled = os_waitForCondition(acceptDone, 1000, &accepted);
+   assert(signaled);
+   assert(NULL == accepted);
+
+   assert(NULL == os_acceptIpcConnection(server));
+
+   os_destroyIpcServer(server);
+
+   os_destroyCondition(acceptDone);
+   os_destroyCondition(clientDone);
+
+   os_cleanup();
+
+   return 0;
+}
@@ -0,0 +1,131 @@
+/**
+ * @file test_poll.c
+ * @brief Test the single-threaded polled mode
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of serial_base library
+ */
+
+#include <assert.h>
+#include <stddef.h>
+
+#include <osal_core.h>
+
+#define ONE_SHOT_COUNT     100
+
+static uint32_t oneShotCalls;
+static uint32_t periodicCalls;
+
+static struct os_condition* allCalled;
+static struct os_completion* nestedDone;
+static uint32_t nestedTicket;
+static bool nestedReturned;
+
+static void oneShot(void* arg)
+{
+   (void) arg;
+
+   if (ONE_SHOT_COUNT == ++ oneShotCalls)
+   {
+      os_signalCondition(allCalled, NULL);
+   }
+}
+
+static void periodic(void* arg)
+{
+   (void) arg;
+   periodicCalls ++;
+}
+
+static void signalNested(void* arg)
+{
+   (void) arg;
+   os_signalCompletion(nestedDone, nestedTicket, NULL);
+}
+
+/*
+ * Blocks in a timer function; the wait runs the other timers
+ */
+static void waitNested(void* arg)
+{
+   (void) arg;
+
+   nestedTicket = os_armCompletion(nestedDone);
+   os_executeLater(10, signalNested, NULL);
+
+   bool signaled = os_waitForCompletion(nestedDone, nestedTicket, 1000, NULL);
+   assert(signaled);
+
+   nestedReturned = true;
+}
+
+int main(void)
+{
+   int status = os_initializePolled();
+   assert(0 == status);
+   assert(os_isPolled());
+
+   assert(UINT32_MAX == os_getNextTimeout_ms());
+
+   allCalled = os_createCondition();
+
+   for (uint32_t ii = 0; ii < ONE_SHOT_COUNT; ii ++)
+   {
+      bool scheduled = os_executeLater(ii % 50, oneShot, NULL);
+      assert(scheduled);
+   }
+
+   // nothing runs until the application polls
+   assert(0 == oneShotCalls);
+   assert(os_getNextTimeout_ms() <= 50);
+
+   // the wait polls
+   bool signaled = os_waitForCondition(allCalled, 1000, NULL);
+   assert(signaled);
+   assert(ONE_SHOT_COUNT == oneShotCalls);
+
+   struct os_timer* timer = os_startTimer(0, 50, periodic, NULL);
+
+   uint64_t deadline = os_getTime_ms() + 500;
+   while (os_getTime_ms() < deadline)
+   {
+      uint32_t timeout_ms = os_getNextTimeout_ms();
+      os_poll((timeout_ms < 100) ? timeout_ms : 100);
+   }
+
+   os_stopTimer(timer);
+   assert((periodicCalls >= 8) && (periodicCalls <= 12));
+
+   struct os_completionPool* pool = os_createCompletionPool(1);
+   nestedDone = os_acquireCompletion(pool);
+
+   os_executeLater(0, waitNested, NULL);
+   while (! nestedReturned)
+   {
+      os_poll(100);
+   }
+
+   os_releaseCompletion(nestedDone);
+   os_destroyCompletionPool(pool);
+
+   os_destroyCondition(allCalled);
+
+   os_cleanup();
+
+   return 0;
+}
@@ -0,0 +1,94 @@
+/**
+ * @file test_timer.c
+ * @brief Test the timer implementation
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of serial_base library
+ */
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include <osal_core.h>
+
+#define ONE_SHOT_COUNT     1000
+
+static atomic_uint oneShotCalls;
+static atomic_uint periodicCalls;
+
+static struct os_condition* allCalled;
+
+static void oneShot(void* arg)
+{
+   (void) arg;
+
+   if (ONE_SHOT_COUNT == atomic_fetch_add(&oneShotCalls, 1) + 1)
+   {
+      os_signalCondition(allCalled, NULL);
+   }
+}
+
+static void periodic(void* arg)
+{
+   (void) arg;
+   atomic_fetch_add(&periodicCalls, 1);
+}
+
+static void neverCalled(void* arg)
+{
+   (void) arg;
+   assert(false);
+}
+
+int main(void)
+{
+   os_initialize();
+
+   allCalled = os_createCondition();
+
+   for (uint32_t ii = 0; ii < ONE_SHOT_COUNT; ii ++)
+   {
+      bool scheduled = os_executeLater(ii % 500, oneShot, NULL);
+      assert(scheduled);
+   }
+
+   struct os_timer* cancelled = os_startTimer(100, 0, neverCalled, NULL);
+   os_stopTimer(cancelled);
+
+   struct os_timer* timer = os_startTimer(0, 50, periodic, NULL);
+
+   void* msg = NULL;
+   bool signaled = os_waitForCondition(allCalled, 2000, &msg);
+   assert(signaled);
+
+   os_sleep_ms(500);
+   os_stopTimer(timer);
+
+   unsigned calls = atomic_load(&periodicCalls);
+   assert((calls >= 15) && (calls <= 25));
+
+   os_sleep_ms(200);
+   assert(calls == atomic_load(&periodicCalls));
+
+   os_destroyCondition(allCalled);
+
+   os_cleanup();
+
+   return 0;
+}
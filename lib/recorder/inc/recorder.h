@@ -0,0 +1,184 @@
+/**
+ * @file recorder.h
+ * @brief Memory mapped columnar recorder for sensor samples
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+#ifndef __RECORDER_H__
+#define __RECORDER_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define RECORDER_MAX_SERIES         32
+#define RECORDER_MAX_COLUMNS        12
+#define RECORDER_NAME_LENGTH        24
+
+/*
+ * A recording is a preallocated file, mapped in memory, holding any number
+ * of series. A series is the sequence of samples of one kind coming from
+ * one device; every sample has a timestamp and a fixed set of columns.
+ *
+ * The file is divided in fixed size blocks. Each data block holds the
+ * samples of a single series, stored column by column: first all the
+ * timestamps, then all the values of the first column, and so on. Every
+ * few data blocks there is an index block listing the series and the time
+ * range of the data blocks that follow it, so the samples in a time range
+ * can be found without reading the data.
+ *
+ * Samples become visible to readers, including readers in other processes,
+ * as soon as they are appended.
+ */
+struct Recorder;
+struct Recorder_Series;
+struct Recorder_Reader;
+
+enum Recorder_ColumnType
+{
+   RECORDER_FLOAT32,
+   RECORDER_INT32,
+   RECORDER_BYTES,                     // fixed width byte string
+};
+
+struct Recorder_Column
+{
+   const char*                name;
+   enum Recorder_ColumnType   type;
+   uint32_t                   width;   // bytes per value, for RECORDER_BYTES only
+};
+
+/*
+ * Opens a recording, creating or extending the file to size bytes. If the
+ * file already holds a recording, new samples are added after the existing
+ * ones.
+ */
+struct Recorder* Recorder_open(const char* path, uint64_t size);
+
+/*
+ * Writes all the samples to the disk and closes the recording
+ */
+void Recorder_close(struct Recorder* recorder);
+
+/*
+ * Starts writing the samples appended since the last flush to the disk
+ */
+bool Recorder_flush(struct Recorder* recorder);
+
+/*
+ * Adds a series, or returns the existing series with the same address and
+ * name; the columns of an existing series must match
+ */
+struct Recorder_Series* Recorder_addSeries(struct Recorder* recorder, const uint8_t* address, const char* name, const struct Recorder_Column* columns, uint32_t columnCount);
+
+/*
+ * Appends one sample; value[i] points to the value of column i.
+ *
+ * The timestamps of a series must not decrease. Returns false if the
+ * sample is out of order or the file is full.
+ */
+bool Recorder_appendSample(struct Recorder_Series* series, uint64_t timestamp_ms, const void* const* value);
+
+/*
+ * Appends count samples; column[i] points to the count values of column i.
+ * Returns the number of samples appended.
+ */
+uint32_t Recorder_appendSamples(struct Recorder_Series* series, uint32_t count, const uint64_t* timestamp_ms, const void* const* column);
+
+/*
+ * A series recording the values of a characteristic, for instance from
+ * lb_on_receivedNotification. The series is named "char-<handle>", with an
+ * int32 "length" column and a maxLength bytes "value" column.
+ */
+struct Recorder_Series* Recorder_addCharacteristicSeries(struct Recorder* recorder, const uint8_t* address, uint16_t attributeHandle, uint32_t maxLength);
+
+bool Recorder_appendCharacteristicValue(struct Recorder_Series* series, uint64_t timestamp_ms, const uint8_t* attributeValue, uint32_t attributeLength);
+
+/*
+ * Reader interface; a reader must be used by one thread at a time
+ */
+struct Recorder_SeriesInfo
+{
+   uint8_t     address[6];
+   char        name[RECORDER_NAME_LENGTH];
+
+   uint32_t    columnCount;
+   struct
+   {
+      char                       name[RECORDER_NAME_LENGTH];
+      enum Recorder_ColumnType   type;
+      uint32_t                   width;
+   } column[RECORDER_MAX_COLUMNS];
+
+   uint64_t    sampleCount;
+   uint64_t    first_ms;
+   uint64_t    last_ms;
+};
+
+/*
+ * Consecutive samples from one data block; column[i] points to count values
+ * of column i, each column[i].width bytes wide. The pointers are valid
+ * until the reader is closed.
+ */
+struct Recorder_Span
+{
+   uint32_t          count;
+   const uint64_t*   timestamp_ms;
+   const void*       column[RECORDER_MAX_COLUMNS];
+};
+
+/*
+ * Position of a time range query; the fields are private
+ */
+struct Recorder_Cursor
+{
+   struct Recorder_Reader* reader;
+   uint32_t    series;
+   uint32_t    position;
+   uint32_t    sample;
+   uint64_t    from_ms;
+   uint64_t    to_ms;
+};
+
+struct Recorder_Reader* Recorder_openReader(const char* path);
+
+void Recorder_closeReader(struct Recorder_Reader* reader);
+
+uint32_t Recorder_getSeriesCount(struct Recorder_Reader* reader);
+
+bool Recorder_getSeriesInfo(struct Recorder_Reader* reader, uint32_t series, struct Recorder_SeriesInfo* info);
+
+/*
+ * Returns the index of the series with the given address and name, or -1
+ */
+int32_t Recorder_findSeries(struct Recorder_Reader* reader, const uint8_t* address, const char* name);
+
+/*
+ * Positions the cursor on the first sample of the series with a timestamp
+ * in [from_ms, to_ms]; samples appended after this call are also found
+ */
+bool Recorder_seek(struct Recorder_Reader* reader, uint32_t series, uint64_t from_ms, uint64_t to_ms, struct Recorder_Cursor* cursor);
+
+/*
+ * Returns the next samples in the range, without copying; returns false
+ * when the range is exhausted
+ */
+bool Recorder_next(struct Recorder_Cursor* cursor, struct Recorder_Span* span);
+
+#endif // __RECORDER_H__
@@ -0,0 +1,28 @@
+# @file lib.mk
+# @brief Sensor recorder library makefile fragment
+# @author Florin Iucha <florin@signbit.net>
+# @copyright Apache License, Version 2.0
+
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# This file is part of LightBLUE Bluetooth Smart Library
+
+RECORDER_PATH:=$(dir $(lastword $(MAKEFILE_LIST)))
+
+LIBS_CFLAGS+=-I$(RECORDER_PATH)inc
+RECORDER_SOURCES:=$(wildcard $(RECORDER_PATH)src/*.c)
+
+LIBS_SOURCES+=$(RECORDER_SOURCES)
+LIBS_OBJECTS+=$(notdir $(RECORDER_SOURCES:.c=.o))
+LIBS_VPATH+=$(RECORDER_PATH)src
+
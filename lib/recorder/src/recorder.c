@@ -0,0 +1,474 @@
+/**
+ * @file recorder.c
+ * @brief Recording writer
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <osal_core.h>
+#include <osal_file.h>
+
+#include "recorder_priv.h"
+
+// longest characteristic value, limited by the ATT attribute length
+#define MAX_CHARACTERISTIC_LENGTH   255
+
+struct Recorder_Series
+{
+   struct Recorder*              recorder;
+   uint16_t                      index;
+   const struct rec_seriesDescriptor*  descriptor;
+
+   // the data block being filled, if any
+   uint8_t*                      block;
+   uint32_t                      dataBlock;
+   struct rec_indexEntry*        entry;
+   uint32_t                      count;
+
+   uint64_t                      last_ms;
+};
+
+struct Recorder
+{
+   struct os_mappedFile*   file;
+   uint8_t*                base;
+   struct rec_fileHeader*  header;
+
+   struct os_lock*         lock;
+
+   // lowest data block written since the last flush
+   uint32_t                flushFrom;
+
+   struct Recorder_Series  series[RECORDER_MAX_SERIES];
+};
+
+static uint32_t getColumnWidth(const struct Recorder_Column* column)
+{
+   switch (column->type)
+   {
+      case RECORDER_FLOAT32:
+      case RECORDER_INT32:
+         return 4;
+
+      case RECORDER_BYTES:
+         return column->width;
+
+      default:
+         return 0;
+   }
+}
+
+static bool isValidHeader(const struct rec_fileHeader* header, uint32_t blockCount)
+{
+   return (RECORDER_FILE_MAGIC == header->magic) &&
+      (RECORDER_FORMAT_VERSION == header->version) &&
+      (RECORDER_BLOCK_SIZE == header->blockSize) &&
+      (RECORDER_INDEX_INTERVAL == header->indexInterval) &&
+      (header->blockCount <= blockCount) &&
+      (atomic_load(&header->dataBlocksUsed) <= header->dataBlockCount) &&
+      (atomic_load(&header->seriesCount) <= RECORDER_MAX_SERIES);
+}
+
+/*
+ * Picks up the series of an existing recording; new samples go to new
+ * data blocks, after the last timestamp recorded for each series
+ */
+static void loadSeries(struct Recorder* recorder)
+{
+   struct rec_fileHeader* header = recorder->header;
+   uint32_t seriesCount = atomic_load(&header->seriesCount);
+
+   for (uint32_t ss = 0; ss < seriesCount; ss ++)
+   {
+      recorder->series[ss].descriptor = &header->series[ss];
+   }
+
+   uint32_t dataBlocksUsed = atomic_load(&header->dataBlocksUsed);
+   for (uint32_t dd = 0; dd < dataBlocksUsed; dd ++)
+   {
+      const struct rec_indexEntry* entry = (const struct rec_indexEntry*) (recorder->base + rec_getIndexEntryOffset(dd));
+      if ((entry->series < seriesCount) && atomic_load(&entry->count))
+      {
+         recorder->series[entry->series].last_ms = atomic_load(&entry->last_ms);
+      }
+   }
+
+   recorder->flushFrom = dataBlocksUsed;
+}
+
+struct Recorder* Recorder_open(const char* path, uint64_t size)
+{
+   struct Recorder* recorder = calloc(1, sizeof(struct Recorder));
+   if (! recorder)
+   {
+      return 0;
+   }
+
+   recorder->lock = os_createLock();
+   recorder->file = os_mapFile(path, size, true);
+
+   if ((! recorder->lock) || (! recorder->file))
+   {
+      goto failed;
+   }
+
+   uint64_t blockCount = os_getMappedSize(recorder->file) / RECORDER_BLOCK_SIZE;
+   if (blockCount > UINT32_MAX)
+   {
+      blockCount = UINT32_MAX;
+   }
+
+   if (0 == rec_getDataBlockCount((uint32_t) blockCount))
+   {
+      goto failed;
+   }
+
+   recorder->base = os_getMappedAddress(recorder->file);
+   recorder->header = (struct rec_fileHeader*) recorder->base;
+
+   struct rec_fileHeader* header = recorder->header;
+
+   if (isValidHeader(header, (uint32_t) blockCount))
+   {
+      // the file may have been extended
+      header->blockCount = (uint32_t) blockCount;
+      header->dataBlockCount = rec_getDataBlockCount(header->blockCount);
+   }
+   else
+   {
+      memset(header, 0, RECORDER_BLOCK_SIZE);
+
+      header->magic = RECORDER_FILE_MAGIC;
+      header->version = RECORDER_FORMAT_VERSION;
+      header->blockSize = RECORDER_BLOCK_SIZE;
+      header->indexInterval = RECORDER_INDEX_INTERVAL;
+      header->blockCount = (uint32_t) blockCount;
+      header->dataBlockCount = rec_getDataBlockCount(header->blockCount);
+      atomic_store(&header->dataBlocksUsed, 0);
+      atomic_store(&header->seriesCount, 0);
+   }
+
+   for (uint32_t ss = 0; ss < RECORDER_MAX_SERIES; ss ++)
+   {
+      recorder->series[ss].recorder = recorder;
+      recorder->series[ss].index = (uint16_t) ss;
+   }
+
+   loadSeries(recorder);
+
+   return recorder;
+
+failed:
+
+   os_unmapFile(recorder->file);
+   os_destroyLock(recorder->lock);
+   free(recorder);
+
+   return 0;
+}
+
+void Recorder_close(struct Recorder* recorder)
+{
+   if (recorder)
+   {
+      os_unmapFile(recorder->file);
+      os_destroyLock(recorder->lock);
+      free(recorder);
+   }
+}
+
+bool Recorder_flush(struct Recorder* recorder)
+{
+   os_lock(recorder->lock);
+
+   uint32_t from = recorder->flushFrom;
+   uint32_t to = atomic_load_explicit(&recorder->header->dataBlocksUsed, memory_order_relaxed);
+
+   // the blocks being filled will be written again
+   uint32_t next = to;
+   uint32_t seriesCount = atomic_load_explicit(&recorder->header->seriesCount, memory_order_relaxed);
+   for (uint32_t ss = 0; ss < seriesCount; ss ++)
+   {
+      const struct Recorder_Series* series = &recorder->series[ss];
+      if (series->block && (series->dataBlock < next))
+      {
+         next = series->dataBlock;
+      }
+   }
+   recorder->flushFrom = next;
+
+   os_unlock(recorder->lock);
+
+   bool flushed = os_flushMappedFile(recorder->file, 0, RECORDER_BLOCK_SIZE);
+
+   if (from < to)
+   {
+      uint64_t start = rec_getIndexBlockOffset(from);
+      uint64_t end = rec_getDataBlockOffset(to - 1) + RECORDER_BLOCK_SIZE;
+
+      flushed = os_flushMappedFile(recorder->file, start, end - start) && flushed;
+   }
+
+   return flushed;
+}
+
+static bool isSameColumn(const struct rec_columnDescriptor* descriptor, const struct Recorder_Column* column)
+{
+   return (descriptor->type == (uint32_t) column->type) &&
+      (descriptor->width == getColumnWidth(column)) &&
+      (0 == strncmp(descriptor->name, column->name, RECORDER_NAME_LENGTH));
+}
+
+struct Recorder_Series* Recorder_addSeries(struct Recorder* recorder, const uint8_t* address, const char* name, const struct Recorder_Column* columns, uint32_t columnCount)
+{
+   if ((! name) || (RECORDER_NAME_LENGTH <= strlen(name)) ||
+         (0 == columnCount) || (RECORDER_MAX_COLUMNS < columnCount))
+   {
+      return 0;
+   }
+
+   uint32_t rowWidth = sizeof(uint64_t);
+   for (uint32_t cc = 0; cc < columnCount; cc ++)
+   {
+      uint32_t width = getColumnWidth(&columns[cc]);
+      if ((! columns[cc].name) || (RECORDER_NAME_LENGTH <= strlen(columns[cc].name)) ||
+            (0 == width) || (RECORDER_BLOCK_SIZE <= width))
+      {
+         return 0;
+      }
+      rowWidth += width;
+   }
+
+   // each column is aligned to 8 bytes
+   uint32_t capacity = (RECORDER_BLOCK_SIZE - RECORDER_DATA_HEADER - 8 * columnCount) / rowWidth;
+   if (0 == capacity)
+   {
+      return 0;
+   }
+
+   struct Recorder_Series* series = 0;
+   struct rec_fileHeader* header = recorder->header;
+
+   os_lock(recorder->lock);
+
+   uint32_t seriesCount = atomic_load_explicit(&header->seriesCount, memory_order_relaxed);
+
+   for (uint32_t ss = 0; ss < seriesCount; ss ++)
+   {
+      const struct rec_seriesDescriptor* descriptor = &header->series[ss];
+      if ((0 == memcmp(descriptor->address, address, sizeof(descriptor->address))) &&
+            (0 == strncmp(descriptor->name, name, RECORDER_NAME_LENGTH)))
+      {
+         bool matches = (descriptor->columnCount == columnCount);
+         for (uint32_t cc = 0; matches && (cc < columnCount); cc ++)
+         {
+            matches = isSameColumn(&descriptor->column[cc], &columns[cc]);
+         }
+
+         series = matches ? &recorder->series[ss] : 0;
+         goto done;
+      }
+   }
+
+   if (RECORDER_MAX_SERIES == seriesCount)
+   {
+      goto done;
+   }
+
+   struct rec_seriesDescriptor* descriptor = &header->series[seriesCount];
+   memset(descriptor, 0, sizeof(*descriptor));
+
+   memcpy(descriptor->address, address, sizeof(descriptor->address));
+   strcpy(descriptor->name, name);
+   descriptor->columnCount = (uint16_t) columnCount;
+   descriptor->capacity = capacity;
+
+   uint32_t offset = RECORDER_DATA_HEADER + capacity * sizeof(uint64_t);
+   for (uint32_t cc = 0; cc < columnCount; cc ++)
+   {
+      struct rec_columnDescriptor* column = &descriptor->column[cc];
+
+      strcpy(column->name, columns[cc].name);
+      column->type = columns[cc].type;
+      column->width = getColumnWidth(&columns[cc]);
+      column->offset = offset;
+
+      offset += (column->width * capacity + 7) & ~7u;
+   }
+
+   series = &recorder->series[seriesCount];
+   series->descriptor = descriptor;
+
+   atomic_store_explicit(&header->seriesCount, seriesCount + 1, memory_order_release);
+
+done:
+
+   os_unlock(recorder->lock);
+
+   return series;
+}
+
+/*
+ * Allocates the next data block to the series; called with the lock held
+ */
+static bool startDataBlock(struct Recorder_Series* series, uint64_t timestamp_ms)
+{
+   struct Recorder* recorder = series->recorder;
+   struct rec_fileHeader* header = recorder->header;
+
+   uint32_t dataBlock = atomic_load_explicit(&header->dataBlocksUsed, memory_order_relaxed);
+   if (dataBlock >= header->dataBlockCount)
+   {
+      series->block = 0;
+      return false;
+   }
+
+   if (0 == dataBlock % RECORDER_INDEX_INTERVAL)
+   {
+      struct rec_indexBlock* index = (struct rec_indexBlock*) (recorder->base + rec_getIndexBlockOffset(dataBlock));
+      memset(index, 0, sizeof(*index));
+      index->magic = RECORDER_INDEX_MAGIC;
+      index->firstDataBlock = dataBlock;
+   }
+
+   struct rec_indexEntry* entry = (struct rec_indexEntry*) (recorder->base + rec_getIndexEntryOffset(dataBlock));
+   entry->first_ms = timestamp_ms;
+   entry->series = series->index;
+   atomic_store_explicit(&entry->last_ms, timestamp_ms, memory_order_relaxed);
+   atomic_store_explicit(&entry->count, 0, memory_order_relaxed);
+
+   uint8_t* block = recorder->base + rec_getDataBlockOffset(dataBlock);
+
+   struct rec_dataBlockHeader* blockHeader = (struct rec_dataBlockHeader*) block;
+   memset(blockHeader, 0, RECORDER_DATA_HEADER);
+   blockHeader->magic = RECORDER_DATA_MAGIC;
+   blockHeader->dataBlock = dataBlock;
+   blockHeader->series = series->index;
+
+   atomic_store_explicit(&header->dataBlocksUsed, dataBlock + 1, memory_order_release);
+
+   series->block = block;
+   series->dataBlock = dataBlock;
+   series->entry = entry;
+   series->count = 0;
+
+   return true;
+}
+
+uint32_t Recorder_appendSamples(struct Recorder_Series* series, uint32_t count, const uint64_t* timestamp_ms, const void* const* column)
+{
+   struct Recorder* recorder = series->recorder;
+   const struct rec_seriesDescriptor* descriptor = series->descriptor;
+
+   uint32_t appended = 0;
+
+   os_lock(recorder->lock);
+
+   while ((appended < count) && (timestamp_ms[appended] >= series->last_ms))
+   {
+      if (((! series->block) || (series->count == descriptor->capacity)) &&
+            (! startDataBlock(series, timestamp_ms[appended])))
+      {
+         break;
+      }
+
+      uint32_t run = descriptor->capacity - series->count;
+      if (run > count - appended)
+      {
+         run = count - appended;
+      }
+
+      for (uint32_t ii = 1; ii < run; ii ++)
+      {
+         if (timestamp_ms[appended + ii] < timestamp_ms[appended + ii - 1])
+         {
+            run = ii;
+            break;
+         }
+      }
+
+      uint64_t* timestamps = (uint64_t*) (series->block + RECORDER_DATA_HEADER);
+      memcpy(timestamps + series->count, timestamp_ms + appended, run * sizeof(uint64_t));
+
+      for (uint32_t cc = 0; cc < descriptor->columnCount; cc ++)
+      {
+         uint32_t width = descriptor->column[cc].width;
+         memcpy(series->block + descriptor->column[cc].offset + series->count * width,
+               (const uint8_t*) column[cc] + appended * width,
+               run * width);
+      }
+
+      series->count += run;
+      series->last_ms = timestamp_ms[appended + run - 1];
+      appended += run;
+
+      atomic_store_explicit(&series->entry->last_ms, series->last_ms, memory_order_relaxed);
+      atomic_store_explicit(&series->entry->count, series->count, memory_order_release);
+   }
+
+   os_unlock(recorder->lock);
+
+   return appended;
+}
+
+bool Recorder_appendSample(struct Recorder_Series* series, uint64_t timestamp_ms, const void* const* value)
+{
+   return 1 == Recorder_appendSamples(series, 1, &timestamp_ms, value);
+}
+
+struct Recorder_Series* Recorder_addCharacteristicSeries(struct Recorder* recorder, const uint8_t* address, uint16_t attributeHandle, uint32_t maxLength)
+{
+   if ((0 == maxLength) || (MAX_CHARACTERISTIC_LENGTH < maxLength))
+   {
+      return 0;
+   }
+
+   char name[RECORDER_NAME_LENGTH];
+   snprintf(name, sizeof(name), "char-0x%04x", attributeHandle);
+
+   const struct Recorder_Column columns[] =
+   {
+      { .name = "length", .type = RECORDER_INT32 },
+      { .name = "value",  .type = RECORDER_BYTES, .width = maxLength },
+   };
+
+   return Recorder_addSeries(recorder, address, name, columns, 2);
+}
+
+bool Recorder_appendCharacteristicValue(struct Recorder_Series* series, uint64_t timestamp_ms, const uint8_t* attributeValue, uint32_t attributeLength)
+{
+   uint32_t maxLength = series->descriptor->column[1].width;
+   if (attributeLength > maxLength)
+   {
+      attributeLength = maxLength;
+   }
+
+   int32_t length = (int32_t) attributeLength;
+
+   uint8_t value[MAX_CHARACTERISTIC_LENGTH] = { 0 };
+   memcpy(value, attributeValue, attributeLength);
+
+   const void* const values[] = { &length, value };
+
+   return Recorder_appendSample(series, timestamp_ms, values);
+}
@@ -0,0 +1,161 @@
+/**
+ * @file recorder_priv.h
+ * @brief Recording file layout
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+#ifndef __RECORDER_PRIV_H__
+#define __RECORDER_PRIV_H__
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "recorder.h"
+
+/*
+ * File layout, in blocks of RECORDER_BLOCK_SIZE bytes:
+ *
+ *    header | index | data x RECORDER_INDEX_INTERVAL | index | data ...
+ *
+ * The index block lists the series and time range of each of the data
+ * blocks following it. Data blocks are numbered in allocation order,
+ * skipping the header and the index blocks.
+ *
+ * Multi-byte values use the byte order of the host.
+ */
+#define RECORDER_FILE_MAGIC         0x5243424cu    // "LBCR"
+#define RECORDER_INDEX_MAGIC        0x5844424cu    // "LBDX"
+#define RECORDER_DATA_MAGIC         0x5444424cu    // "LBDT"
+
+#define RECORDER_FORMAT_VERSION     1
+
+#define RECORDER_BLOCK_SIZE         16384u
+#define RECORDER_INDEX_INTERVAL     255u
+
+// data block header; the timestamp column follows it
+#define RECORDER_DATA_HEADER        64u
+
+struct rec_columnDescriptor
+{
+   char        name[RECORDER_NAME_LENGTH];
+   uint32_t    type;
+   uint32_t    width;
+   uint32_t    offset;                 // from the start of the data block
+};
+
+struct rec_seriesDescriptor
+{
+   uint8_t     address[6];
+   uint16_t    columnCount;
+   char        name[RECORDER_NAME_LENGTH];
+   uint32_t    capacity;               // samples per data block
+   uint32_t    reserved;
+
+   struct rec_columnDescriptor column[RECORDER_MAX_COLUMNS];
+};
+
+struct rec_fileHeader
+{
+   uint32_t    magic;
+   uint32_t    version;
+   uint32_t    blockSize;
+   uint32_t    indexInterval;
+
+   uint32_t    blockCount;
+   uint32_t    dataBlockCount;
+
+   /* published with release semantics, after the block or the series
+    * descriptor has been written
+    */
+   _Atomic uint32_t  dataBlocksUsed;
+   _Atomic uint32_t  seriesCount;
+
+   struct rec_seriesDescriptor series[RECORDER_MAX_SERIES];
+};
+
+struct rec_indexEntry
+{
+   uint64_t    first_ms;
+   _Atomic uint64_t  last_ms;
+
+   /* published with release semantics, after the samples have been
+    * written to the data block
+    */
+   _Atomic uint32_t  count;
+   uint16_t    series;
+   uint16_t    reserved;
+};
+
+struct rec_indexBlock
+{
+   uint32_t    magic;
+   uint32_t    firstDataBlock;
+   uint8_t     reserved[56];
+
+   struct rec_indexEntry entry[RECORDER_INDEX_INTERVAL];
+};
+
+struct rec_dataBlockHeader
+{
+   uint32_t    magic;
+   uint32_t    dataBlock;
+   uint16_t    series;
+   uint16_t    reserved;
+};
+
+_Static_assert(sizeof(struct rec_fileHeader) <= RECORDER_BLOCK_SIZE, "file header does not fit in a block");
+_Static_assert(sizeof(struct rec_indexBlock) <= RECORDER_BLOCK_SIZE, "index does not fit in a block");
+_Static_assert(sizeof(struct rec_dataBlockHeader) <= RECORDER_DATA_HEADER, "data block header too large");
+
+static inline uint64_t rec_getIndexBlockOffset(uint32_t dataBlock)
+{
+   uint64_t group = dataBlock / RECORDER_INDEX_INTERVAL;
+   return (1 + group * (RECORDER_INDEX_INTERVAL + 1)) * (uint64_t) RECORDER_BLOCK_SIZE;
+}
+
+static inline uint64_t rec_getDataBlockOffset(uint32_t dataBlock)
+{
+   return rec_getIndexBlockOffset(dataBlock) + (1 + dataBlock % RECORDER_INDEX_INTERVAL) * (uint64_t) RECORDER_BLOCK_SIZE;
+}
+
+static inline uint64_t rec_getIndexEntryOffset(uint32_t dataBlock)
+{
+   return rec_getIndexBlockOffset(dataBlock) +
+      offsetof(struct rec_indexBlock, entry) + (dataBlock % RECORDER_INDEX_INTERVAL) * sizeof(struct rec_indexEntry);
+}
+
+/*
+ * Number of data blocks in a file of blockCount blocks
+ */
+static inline uint32_t rec_getDataBlockCount(uint32_t blockCount)
+{
+   if (blockCount < 3)
+   {
+      return 0;
+   }
+
+   uint32_t groups = (blockCount - 1) / (RECORDER_INDEX_INTERVAL + 1);
+   uint32_t remainder = (blockCount - 1) % (RECORDER_INDEX_INTERVAL + 1);
+
+   return groups * RECORDER_INDEX_INTERVAL + (remainder ? (remainder - 1) : 0);
+}
+
+#endif // __RECORDER_PRIV_H__
@@ -0,0 +1,388 @@
+/**
+ * @file recorder_reader.c
+ * @brief Recording reader
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <osal_file.h>
+
+#include "recorder_priv.h"
+
+/*
+ * Data blocks of one series, in time order
+ */
+struct blockList
+{
+   uint32_t*   dataBlock;
+   uint32_t    count;
+   uint32_t    capacity;
+};
+
+struct Recorder_Reader
+{
+   struct os_mappedFile*         file;
+   const uint8_t*                base;
+   const struct rec_fileHeader*  header;
+
+   // data blocks present in the mapping
+   uint32_t                      dataBlockCount;
+
+   // data blocks already added to the lists
+   uint32_t                      scanned;
+
+   struct blockList              series[RECORDER_MAX_SERIES];
+};
+
+static inline const struct rec_indexEntry* getIndexEntry(const struct Recorder_Reader* reader, uint32_t dataBlock)
+{
+   return (const struct rec_indexEntry*) (reader->base + rec_getIndexEntryOffset(dataBlock));
+}
+
+static inline const uint8_t* getDataBlock(const struct Recorder_Reader* reader, uint32_t dataBlock)
+{
+   return reader->base + rec_getDataBlockOffset(dataBlock);
+}
+
+static bool addBlock(struct blockList* list, uint32_t dataBlock)
+{
+   if (list->count == list->capacity)
+   {
+      uint32_t capacity = list->capacity ? (list->capacity * 2) : 64;
+      uint32_t* blocks = realloc(list->dataBlock, capacity * sizeof(uint32_t));
+      if (! blocks)
+      {
+         return false;
+      }
+
+      list->dataBlock = blocks;
+      list->capacity = capacity;
+   }
+
+   list->dataBlock[list->count ++] = dataBlock;
+
+   return true;
+}
+
+/*
+ * Adds the data blocks allocated since the last call to the series lists,
+ * reading only the index blocks
+ */
+static void refresh(struct Recorder_Reader* reader)
+{
+   uint32_t dataBlocksUsed = atomic_load_explicit(&reader->header->dataBlocksUsed, memory_order_acquire);
+   if (dataBlocksUsed > reader->dataBlockCount)
+   {
+      dataBlocksUsed = reader->dataBlockCount;
+   }
+
+   uint32_t seriesCount = atomic_load_explicit(&reader->header->seriesCount, memory_order_acquire);
+
+   while (reader->scanned < dataBlocksUsed)
+   {
+      const struct rec_indexEntry* entry = getIndexEntry(reader, reader->scanned);
+
+      if ((entry->series < seriesCount) && (! addBlock(&reader->series[entry->series], reader->scanned)))
+      {
+         break;
+      }
+
+      reader->scanned ++;
+   }
+}
+
+struct Recorder_Reader* Recorder_openReader(const char* path)
+{
+   struct Recorder_Reader* reader = calloc(1, sizeof(struct Recorder_Reader));
+   if (! reader)
+   {
+      return 0;
+   }
+
+   reader->file = os_mapFile(path, 0, false);
+   if (! reader->file)
+   {
+      free(reader);
+      return 0;
+   }
+
+   uint64_t blockCount = os_getMappedSize(reader->file) / RECORDER_BLOCK_SIZE;
+   if (blockCount > UINT32_MAX)
+   {
+      blockCount = UINT32_MAX;
+   }
+
+   reader->base = os_getMappedAddress(reader->file);
+   reader->header = (const struct rec_fileHeader*) reader->base;
+   reader->dataBlockCount = rec_getDataBlockCount((uint32_t) blockCount);
+
+   const struct rec_fileHeader* header = reader->header;
+
+   if ((0 == reader->dataBlockCount) ||
+         (RECORDER_FILE_MAGIC != header->magic) ||
+         (RECORDER_FORMAT_VERSION != header->version) ||
+         (RECORDER_BLOCK_SIZE != header->blockSize) ||
+         (RECORDER_INDEX_INTERVAL != header->indexInterval))
+   {
+      os_unmapFile(reader->file);
+      free(reader);
+      return 0;
+   }
+
+   refresh(reader);
+
+   return reader;
+}
+
+void Recorder_closeReader(struct Recorder_Reader* reader)
+{
+   if (reader)
+   {
+      for (uint32_t ss = 0; ss < RECORDER_MAX_SERIES; ss ++)
+      {
+         free(reader->series[ss].dataBlock);
+      }
+
+      os_unmapFile(reader->file);
+      free(reader);
+   }
+}
+
+uint32_t Recorder_getSeriesCount(struct Recorder_Reader* reader)
+{
+   uint32_t seriesCount = atomic_load_explicit(&reader->header->seriesCount, memory_order_acquire);
+   return (seriesCount < RECORDER_MAX_SERIES) ? seriesCount : RECORDER_MAX_SERIES;
+}
+
+bool Recorder_getSeriesInfo(struct Recorder_Reader* reader, uint32_t series, struct Recorder_SeriesInfo* info)
+{
+   if (series >= Recorder_getSeriesCount(reader))
+   {
+      return false;
+   }
+
+   refresh(reader);
+
+   const struct rec_seriesDescriptor* descriptor = &reader->header->series[series];
+
+   memset(info, 0, sizeof(*info));
+
+   memcpy(info->address, descriptor->address, sizeof(info->address));
+   memcpy(info->name, descriptor->name, sizeof(info->name));
+   info->name[RECORDER_NAME_LENGTH - 1] = 0;
+
+   info->columnCount = descriptor->columnCount;
+   for (uint32_t cc = 0; cc < info->columnCount; cc ++)
+   {
+      memcpy(info->column[cc].name, descriptor->column[cc].name, sizeof(info->column[cc].name));
+      info->column[cc].name[RECORDER_NAME_LENGTH - 1] = 0;
+      info->column[cc].type = (enum Recorder_ColumnType) descriptor->column[cc].type;
+      info->column[cc].width = descriptor->column[cc].width;
+   }
+
+   const struct blockList* list = &reader->series[series];
+
+   for (uint32_t bb = 0; bb < list->count; bb ++)
+   {
+      const struct rec_indexEntry* entry = getIndexEntry(reader, list->dataBlock[bb]);
+      uint32_t count = atomic_load_explicit(&entry->count, memory_order_acquire);
+
+      if (count)
+      {
+         if (0 == info->sampleCount)
+         {
+            info->first_ms = entry->first_ms;
+         }
+
+         info->sampleCount += count;
+         info->last_ms = atomic_load_explicit(&entry->last_ms, memory_order_relaxed);
+      }
+   }
+
+   return true;
+}
+
+int32_t Recorder_findSeries(struct Recorder_Reader* reader, const uint8_t* address, const char* name)
+{
+   uint32_t seriesCount = Recorder_getSeriesCount(reader);
+
+   for (uint32_t ss = 0; ss < seriesCount; ss ++)
+   {
+      const struct rec_seriesDescriptor* descriptor = &reader->header->series[ss];
+      if ((0 == memcmp(descriptor->address, address, sizeof(descriptor->address))) &&
+            (0 == strncmp(descriptor->name, name, RECORDER_NAME_LENGTH)))
+      {
+         return (int32_t) ss;
+      }
+   }
+
+   return -1;
+}
+
+/*
+ * Index of the first timestamp not less than (or, if after is set,
+ * greater than) the given time
+ */
+static uint32_t findTimestamp(const uint64_t* timestamp_ms, uint32_t count, uint64_t time_ms, bool after)
+{
+   uint32_t low = 0;
+   uint32_t high = count;
+
+   while (low < high)
+   {
+      uint32_t middle = low + (high - low) / 2;
+      if ((timestamp_ms[middle] < time_ms) || (after && (timestamp_ms[middle] == time_ms)))
+      {
+         low = middle + 1;
+      }
+      else
+      {
+         high = middle;
+      }
+   }
+
+   return low;
+}
+
+bool Recorder_seek(struct Recorder_Reader* reader, uint32_t series, uint64_t from_ms, uint64_t to_ms, struct Recorder_Cursor* cursor)
+{
+   if ((series >= Recorder_getSeriesCount(reader)) || (from_ms > to_ms))
+   {
+      return false;
+   }
+
+   refresh(reader);
+
+   // first block ending at or after from_ms
+   const struct blockList* list = &reader->series[series];
+
+   uint32_t low = 0;
+   uint32_t high = list->count;
+
+   while (low < high)
+   {
+      uint32_t middle = low + (high - low) / 2;
+      const struct rec_indexEntry* entry = getIndexEntry(reader, list->dataBlock[middle]);
+      if (atomic_load_explicit(&entry->last_ms, memory_order_relaxed) < from_ms)
+      {
+         low = middle + 1;
+      }
+      else
+      {
+         high = middle;
+      }
+   }
+
+   // the last block may still receive samples
+   if ((low == list->count) && low)
+   {
+      low --;
+   }
+
+   cursor->reader = reader;
+   cursor->series = series;
+   cursor->position = low;
+   cursor->sample = 0;
+   cursor->from_ms = from_ms;
+   cursor->to_ms = to_ms;
+
+   return true;
+}
+
+bool Recorder_next(struct Recorder_Cursor* cursor, struct Recorder_Span* span)
+{
+   struct Recorder_Reader* reader = cursor->reader;
+   const struct blockList* list = &reader->series[cursor->series];
+   const struct rec_seriesDescriptor* descriptor = &reader->header->series[cursor->series];
+
+   while (true)
+   {
+      if (cursor->position >= list->count)
+      {
+         refresh(reader);
+         if (cursor->position >= list->count)
+         {
+            return false;
+         }
+      }
+
+      uint32_t dataBlock = list->dataBlock[cursor->position];
+      const struct rec_indexEntry* entry = getIndexEntry(reader, dataBlock);
+
+      if (entry->first_ms > cursor->to_ms)
+      {
+         return false;
+      }
+
+      uint32_t count = atomic_load_explicit(&entry->count, memory_order_acquire);
+      if (count > descriptor->capacity)
+      {
+         return false;
+      }
+
+      const uint8_t* block = getDataBlock(reader, dataBlock);
+      const uint64_t* timestamp_ms = (const uint64_t*) (block + RECORDER_DATA_HEADER);
+
+      uint32_t first = findTimestamp(timestamp_ms, count, cursor->from_ms, false);
+      if (first < cursor->sample)
+      {
+         first = cursor->sample;
+      }
+
+      if (first >= count)
+      {
+         // move on, unless the block may still receive samples
+         if ((cursor->position + 1 == list->count) && (count < descriptor->capacity))
+         {
+            refresh(reader);
+            if (cursor->position + 1 == list->count)
+            {
+               cursor->sample = count;
+               return false;
+            }
+         }
+
+         cursor->position ++;
+         cursor->sample = 0;
+         continue;
+      }
+
+      uint32_t last = findTimestamp(timestamp_ms, count, cursor->to_ms, true);
+      if (first >= last)
+      {
+         return false;
+      }
+
+      span->count = last - first;
+      span->timestamp_ms = timestamp_ms + first;
+
+      for (uint32_t cc = 0; cc < RECORDER_MAX_COLUMNS; cc ++)
+      {
+         span->column[cc] = (cc < descriptor->columnCount) ?
+            (block + descriptor->column[cc].offset + first * descriptor->column[cc].width) : 0;
+      }
+
+      cursor->sample = last;
+
+      return true;
+   }
+}
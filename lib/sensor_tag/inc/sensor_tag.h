@@ -29,10 +29,90 @@
 
 struct LB_Device;
 
+enum SensorTag_Sensor
+{
+   SENSOR_TAG_IR_TEMPERATURE,
+   SENSOR_TAG_HUMIDITY,
+   SENSOR_TAG_BAROMETER,
+   SENSOR_TAG_MOVEMENT,
+   SENSOR_TAG_OPTICAL,
+
+   SENSOR_TAG_SENSOR_COUNT,
+};
+
+/*
+ * Movement sensor configuration bits; the magnetometer axes are enabled
+ * together. Disabled axes read as 0.
+ */
+enum SensorTag_MovementAxes
+{
+   SENSOR_TAG_GYRO_Z                   = 0x01,
+   SENSOR_TAG_GYRO_Y                   = 0x02,
+   SENSOR_TAG_GYRO_X                   = 0x04,
+   SENSOR_TAG_ACCEL_Z                  = 0x08,
+   SENSOR_TAG_ACCEL_Y                  = 0x10,
+   SENSOR_TAG_ACCEL_X                  = 0x20,
+   SENSOR_TAG_MAG                      = 0x40,
+
+   SENSOR_TAG_GYRO                     = 0x07,
+   SENSOR_TAG_ACCEL                    = 0x38,
+   SENSOR_TAG_ALL_AXES                 = 0x7F,
+};
+
+enum SensorTag_AccelerometerRange
+{
+   SENSOR_TAG_ACCEL_RANGE_2G           = 0,
+   SENSOR_TAG_ACCEL_RANGE_4G           = 1,
+   SENSOR_TAG_ACCEL_RANGE_8G           = 2,
+   SENSOR_TAG_ACCEL_RANGE_16G          = 3,
+};
+
+struct SensorTag_SensorConfig
+{
+   bool        enable;
+   bool        notify;
+   uint32_t    period_ms;     // 0 selects the shortest period the sensor supports
+};
+
+struct SensorTag_MovementConfig
+{
+   uint8_t     axes;          // enum SensorTag_MovementAxes; 0 disables the sensor
+   bool        wakeOnMotion;  // sample only after motion is detected
+   enum SensorTag_AccelerometerRange accelRange;
+   bool        notify;
+   uint32_t    period_ms;
+};
+
+/*
+ * The period is set in 10 ms units, and clamped to what the sensor supports
+ */
+uint32_t SensorTag_getMinimumPeriod(enum SensorTag_Sensor sensor);
+
+bool SensorTag_setPeriod(struct LB_Device* device, enum SensorTag_Sensor sensor, uint32_t period_ms);
+
+bool SensorTag_enableNotifications(struct LB_Device* device, enum SensorTag_Sensor sensor, bool enable);
+
+/*
+ * Sets the period, then enables or disables the sensor and its notifications.
+ * For the movement sensor, all axes are enabled at 2 g.
+ */
+bool SensorTag_configureSensor(struct LB_Device* device, enum SensorTag_Sensor sensor, const struct SensorTag_SensorConfig* config);
+
+bool SensorTag_configureMovement(struct LB_Device* device, const struct SensorTag_MovementConfig* config);
+
 bool SensorTag_enableBarometer(struct LB_Device* device, bool enable);
 
+bool SensorTag_enableBarometerNotifications(struct LB_Device* device, bool enable);
+
 bool SensorTag_readBarometerData(struct LB_Device* device, float* temperature_C, unsigned* pressure_Pa);
 
+/*
+ * Handle of the sensor data characteristic, for reads scheduled elsewhere
+ */
+uint16_t SensorTag_getDataHandle(enum SensorTag_Sensor sensor);
+
+bool SensorTag_decodeBarometerData(const uint8_t* value, uint8_t length, float* temperature_C, unsigned* pressure_Pa);
+
 bool SensorTag_enableIMU(struct LB_Device* device, bool enable);
 
 bool SensorTag_enableIMUNotifications(struct LB_Device* device, bool enable);
@@ -0,0 +1,117 @@
+/**
+ * @file sensor_tag_fusion.h
+ * @brief TI CC2650 SensorTag orientation estimation
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+#ifndef __SENSOR_TAG_FUSION_H__
+#define __SENSOR_TAG_FUSION_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sensor_tag.h"
+#include "sensor_tag_stream.h"
+
+/*
+ * Orientation of the sensor frame relative to the Earth frame
+ * (x north, y west, z up)
+ */
+struct SensorTag_Quaternion
+{
+   float       w;
+   float       x;
+   float       y;
+   float       z;
+};
+
+/*
+ * Hard-iron offset and soft-iron scale, per magnetometer axis
+ */
+struct SensorTag_MagCalibration
+{
+   bool        valid;
+   float       offset_uT[3];
+   float       scale[3];
+};
+
+struct SensorTag_FusionConfig
+{
+   float       beta;             // accelerometer and magnetometer correction gain; 0 selects 0.1
+   float       zeta;             // gyro bias estimation gain; 0 selects 0.015
+
+   // nominal sample period; 0 uses the sample timestamps, which include
+   // the connection interval jitter
+   uint32_t    samplePeriod_ms;
+
+   enum SensorTag_AccelerometerRange accelRange;    // of raw samples
+
+   bool        useMagnetometer;
+};
+
+/*
+ * Madgwick gradient descent filter with gyro bias estimation. The
+ * magnetometer is used once calibrated, either explicitly or from the
+ * range of the readings seen while the tag is rotated.
+ *
+ * The state belongs to the caller, one per device; updates do not allocate.
+ * The fields are private.
+ */
+struct SensorTag_Fusion
+{
+   struct SensorTag_FusionConfig    config;
+
+   float       q[4];
+   float       gyroBias[3];         // rad/s
+
+   uint64_t    lastTimestamp_ms;
+   bool        started;
+
+   struct SensorTag_MagCalibration  magCalibration;
+   bool        autoCalibrate;
+   float       magMin[3];
+   float       magMax[3];
+};
+
+void SensorTag_initializeFusion(struct SensorTag_Fusion* fusion, const struct SensorTag_FusionConfig* config);
+
+/*
+ * Replaces the automatic calibration; an invalid one restarts it
+ */
+void SensorTag_setMagCalibration(struct SensorTag_Fusion* fusion, const struct SensorTag_MagCalibration* calibration);
+
+void SensorTag_getMagCalibration(const struct SensorTag_Fusion* fusion, struct SensorTag_MagCalibration* calibration);
+
+/*
+ * Processes one sample in physical units
+ */
+void SensorTag_updateFusion(struct SensorTag_Fusion* fusion, const float gyro_dps[3], const float accel_g[3], const float mag_uT[3], uint64_t timestamp_ms, struct SensorTag_Quaternion* orientation);
+
+/*
+ * Processes a raw sample, as returned by SensorTag_readIMUData
+ */
+void SensorTag_fuseIMUSample(struct SensorTag_Fusion* fusion, const struct threeDvector* gyro, const struct threeDvector* accel, const struct threeDvector* mag, uint64_t timestamp_ms, struct SensorTag_Quaternion* orientation);
+
+/*
+ * Processes a batch; orientation receives one quaternion per sample
+ */
+void SensorTag_fuseIMUBatch(struct SensorTag_Fusion* fusion, const struct SensorTag_IMUBatch* batch, struct SensorTag_Quaternion* orientation);
+
+#endif // __SENSOR_TAG_FUSION_H__
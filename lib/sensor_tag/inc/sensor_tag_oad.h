@@ -0,0 +1,110 @@
+/**
+ * @file sensor_tag_oad.h
+ * @brief TI CC2650 SensorTag over-the-air firmware download
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+#ifndef __SENSOR_TAG_OAD_H__
+#define __SENSOR_TAG_OAD_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <commands.h>
+
+struct LB_Controller;
+struct LB_Device;
+
+/*
+ * TI OAD profile: the client writes the image header to Image Identify
+ * (F000FFC1-0451-4000-B000-000000000000); the target then requests blocks
+ * with notifications on Image Block (F000FFC2-...), and the client writes
+ * each block, prefixed by its number, without response.
+ */
+
+#define SENSOR_TAG_OAD_BLOCK_SIZE      16
+
+// headers at the start of the image file, and sent to Image Identify
+#define SENSOR_TAG_OAD_IMAGE_HEADER_SIZE     16
+#define SENSOR_TAG_OAD_IDENTIFY_SIZE         12
+
+struct SensorTag_OADImage
+{
+   const uint8_t*    data;
+   uint32_t          length;        // multiple of the block size
+};
+
+struct SensorTag_OADConfig
+{
+   // value handles of the Image Identify and Image Block characteristics;
+   // their client configuration descriptors follow them
+   uint16_t          identifyHandle;
+   uint16_t          blockHandle;
+
+   // blocks sent ahead of the target requests; 1 waits for every request
+   uint16_t          window;
+
+   // connections to the target before giving up
+   uint16_t          maxAttempts;
+};
+
+struct SensorTag_OADProgress
+{
+   uint32_t          blockCount;
+   uint32_t          blocksRequested;     // highest block requested by the target
+   uint32_t          blocksSent;          // including retransmissions
+   uint32_t          retransmissions;
+   uint32_t          connections;
+};
+
+/*
+ * Downloads the image to a SensorTag running the OAD target, connecting
+ * as needed; after a disconnection, the download continues from the block
+ * the target requests. Returns when the target disconnected to boot the
+ * new image, or on failure.
+ *
+ * The application must forward notifications and disconnections to
+ * SensorTag_on_receivedNotification and SensorTag_on_disconnectedFromDevice.
+ */
+enum LB_STATUS SensorTag_updateFirmware(struct LB_Controller* controller, const uint8_t* address, const struct SensorTag_OADImage* image, const struct SensorTag_OADConfig* config, struct SensorTag_OADProgress* progress);
+
+struct SensorTag_OADJob
+{
+   struct LB_Controller*         controller;
+   uint8_t                       address[6];
+
+   enum LB_STATUS                status;
+   struct SensorTag_OADProgress  progress;
+};
+
+/*
+ * Runs the jobs, one at a time on each controller and in parallel across
+ * controllers. Returns the number of jobs that completed successfully.
+ */
+uint32_t SensorTag_updateFirmwareParallel(struct SensorTag_OADJob* jobs, uint32_t count, const struct SensorTag_OADImage* image, const struct SensorTag_OADConfig* config);
+
+/*
+ * Returns true if the notification belongs to a download in progress
+ */
+bool SensorTag_on_receivedNotification(struct LB_Device* device, uint16_t attributeHandle, const uint8_t* attributeValue, uint8_t attributeLength);
+
+void SensorTag_on_disconnectedFromDevice(struct LB_Device* device);
+
+#endif // __SENSOR_TAG_OAD_H__
@@ -0,0 +1,52 @@
+/**
+ * @file sensor_tag_record.h
+ * @brief TI CC2650 SensorTag sample recording
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+#ifndef __SENSOR_TAG_RECORD_H__
+#define __SENSOR_TAG_RECORD_H__
+
+#include <stdint.h>
+
+#include <recorder.h>
+
+#include "sensor_tag_stream.h"
+
+/*
+ * IMU series: "imu", with the float columns gyro_x, gyro_y, gyro_z (deg/s),
+ * accel_x, accel_y, accel_z (g) and mag_x, mag_y, mag_z (uT)
+ */
+struct Recorder_Series* SensorTag_addIMUSeries(struct Recorder* recorder, const uint8_t* address);
+
+/*
+ * Barometer series: "barometer", with the float columns temperature (C)
+ * and pressure (hPa)
+ */
+struct Recorder_Series* SensorTag_addBarometerSeries(struct Recorder* recorder, const uint8_t* address);
+
+/*
+ * Append the batch samples; return the number of samples recorded
+ */
+uint32_t SensorTag_recordIMUBatch(struct Recorder_Series* series, const struct SensorTag_IMUBatch* batch);
+
+uint32_t SensorTag_recordBarometerBatch(struct Recorder_Series* series, const struct SensorTag_BarometerBatch* batch);
+
+#endif // __SENSOR_TAG_RECORD_H__
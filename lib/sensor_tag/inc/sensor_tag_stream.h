@@ -0,0 +1,87 @@
+/**
+ * @file sensor_tag_stream.h
+ * @brief TI CC2650 SensorTag streaming sample batches
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+#ifndef __SENSOR_TAG_STREAM_H__
+#define __SENSOR_TAG_STREAM_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sensor_tag.h"
+
+#define SENSOR_TAG_BATCH_CAPACITY      64
+
+/*
+ * Samples are stored as one contiguous array per axis; index 0, 1 and 2
+ * of the first dimension are the x, y and z axes.
+ */
+struct SensorTag_IMUBatch
+{
+   uint32_t    count;
+   uint32_t    dropped;                // samples lost before this batch
+
+   uint64_t    timestamp_ms[SENSOR_TAG_BATCH_CAPACITY];
+
+   float       gyro_dps[3][SENSOR_TAG_BATCH_CAPACITY];
+   float       accel_g[3][SENSOR_TAG_BATCH_CAPACITY];
+   float       mag_uT[3][SENSOR_TAG_BATCH_CAPACITY];
+};
+
+struct SensorTag_BarometerBatch
+{
+   uint32_t    count;
+   uint32_t    dropped;
+
+   uint64_t    timestamp_ms[SENSOR_TAG_BATCH_CAPACITY];
+
+   float       temperature_C[SENSOR_TAG_BATCH_CAPACITY];
+   float       pressure_hPa[SENSOR_TAG_BATCH_CAPACITY];
+};
+
+/*
+ * Collects the IMU and barometer notifications of one SensorTag. The
+ * notification handler only stores the raw samples; they are converted
+ * a batch at a time when a consumer takes the batch. If the consumers
+ * fall behind, the oldest batches are dropped.
+ */
+struct SensorTag_Stream;
+
+struct SensorTag_Stream* SensorTag_createStream(struct LB_Device* device, enum SensorTag_AccelerometerRange accelRange);
+
+void SensorTag_destroyStream(struct SensorTag_Stream* stream);
+
+/*
+ * To be called from lb_on_receivedNotification; returns true if the
+ * notification is a sample for this stream
+ */
+bool SensorTag_on_streamNotification(struct SensorTag_Stream* stream, struct LB_Device* device, uint16_t attributeHandle, const uint8_t* attributeValue, uint8_t attributeLength);
+
+/*
+ * Waits for a full batch; after the timeout, returns the samples collected
+ * so far, if any
+ */
+bool SensorTag_getIMUBatch(struct SensorTag_Stream* stream, struct SensorTag_IMUBatch* batch, uint32_t timeout_ms);
+
+bool SensorTag_getBarometerBatch(struct SensorTag_Stream* stream, struct SensorTag_BarometerBatch* batch, uint32_t timeout_ms);
+
+#endif // __SENSOR_TAG_STREAM_H__
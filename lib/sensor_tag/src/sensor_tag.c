@@ -32,13 +32,143 @@
 
 #include "sensor_tag.h"
 
+#define PERIOD_UNIT_MS           10
+
+struct sensorHandles
+{
+   uint16_t    data;
+   uint16_t    notify;
+   uint16_t    config;
+   uint16_t    period;
+   uint8_t     minimumPeriod;    // in period units
+};
+
+static const struct sensorHandles sensorHandles[SENSOR_TAG_SENSOR_COUNT] =
+{
+   [SENSOR_TAG_IR_TEMPERATURE] = { 0x21, 0x22, 0x24, 0x26, 30 },
+   [SENSOR_TAG_HUMIDITY]       = { 0x29, 0x2A, 0x2C, 0x2E, 10 },
+   [SENSOR_TAG_BAROMETER]      = { 0x31, 0x32, 0x34, 0x36, 10 },
+   [SENSOR_TAG_MOVEMENT]       = { 0x39, 0x3A, 0x3C, 0x3E, 10 },
+   [SENSOR_TAG_OPTICAL]        = { 0x41, 0x42, 0x44, 0x46, 10 },
+};
+
+uint32_t SensorTag_getMinimumPeriod(enum SensorTag_Sensor sensor)
+{
+   assert(SENSOR_TAG_SENSOR_COUNT > sensor);
+   return sensorHandles[sensor].minimumPeriod * PERIOD_UNIT_MS;
+}
+
+bool SensorTag_setPeriod(struct LB_Device* device, enum SensorTag_Sensor sensor, uint32_t period_ms)
+{
+   assert(SENSOR_TAG_SENSOR_COUNT > sensor);
+
+   uint32_t period = period_ms / PERIOD_UNIT_MS;
+
+   if (period < sensorHandles[sensor].minimumPeriod)
+   {
+      period = sensorHandles[sensor].minimumPeriod;
+   }
+   else if (period > UINT8_MAX)
+   {
+      period = UINT8_MAX;
+   }
+
+   uint8_t periodArgument = (uint8_t) period;
+   return LB_OK == lb_writeCharValue(device, sensorHandles[sensor].period, &periodArgument, sizeof(periodArgument));
+}
+
+bool SensorTag_enableNotifications(struct LB_Device* device, enum SensorTag_Sensor sensor, bool enable)
+{
+   assert(SENSOR_TAG_SENSOR_COUNT > sensor);
+
+   uint8_t enableArgument[2] = { enable, 0 };
+   return LB_OK == lb_writeCharValue(device, sensorHandles[sensor].notify, enableArgument, sizeof(enableArgument));
+}
+
+static bool writeMovementConfig(struct LB_Device* device, uint16_t config)
+{
+   uint8_t configArgument[2] = { config & 0xFF, config >> 8 };
+   return LB_OK == lb_writeCharValue(device, sensorHandles[SENSOR_TAG_MOVEMENT].config, configArgument, sizeof(configArgument));
+}
+
+bool SensorTag_configureSensor(struct LB_Device* device, enum SensorTag_Sensor sensor, const struct SensorTag_SensorConfig* config)
+{
+   assert(SENSOR_TAG_SENSOR_COUNT > sensor);
+
+   if (SENSOR_TAG_MOVEMENT == sensor)
+   {
+      const struct SensorTag_MovementConfig movementConfig =
+      {
+         .axes       = config->enable ? SENSOR_TAG_ALL_AXES : 0,
+         .accelRange = SENSOR_TAG_ACCEL_RANGE_2G,
+         .notify     = config->notify,
+         .period_ms  = config->period_ms,
+      };
+
+      return SensorTag_configureMovement(device, &movementConfig);
+   }
+
+   if (config->enable && (! SensorTag_setPeriod(device, sensor, config->period_ms)))
+   {
+      return false;
+   }
+
+   uint8_t enableArgument = config->enable;
+   if (LB_OK != lb_writeCharValue(device, sensorHandles[sensor].config, &enableArgument, sizeof(enableArgument)))
+   {
+      return false;
+   }
+
+   return SensorTag_enableNotifications(device, sensor, config->enable && config->notify);
+}
+
+bool SensorTag_configureMovement(struct LB_Device* device, const struct SensorTag_MovementConfig* config)
+{
+   const bool enable = 0 != (config->axes & SENSOR_TAG_ALL_AXES);
+
+   if (enable && (! SensorTag_setPeriod(device, SENSOR_TAG_MOVEMENT, config->period_ms)))
+   {
+      return false;
+   }
+
+   uint16_t movementConfig = config->axes & SENSOR_TAG_ALL_AXES;
+
+   if (enable)
+   {
+      if (config->wakeOnMotion)
+      {
+         movementConfig |= 0x80;
+      }
+
+      movementConfig |= ((uint16_t) (config->accelRange & 0x03)) << 8;
+   }
+
+   if (! writeMovementConfig(device, movementConfig))
+   {
+      return false;
+   }
+
+   return SensorTag_enableNotifications(device, SENSOR_TAG_MOVEMENT, enable && config->notify);
+}
+
 bool SensorTag_enableBarometer(struct LB_Device* device, bool enable)
 {
    uint8_t enableArgument = enable;
-   return LB_OK == lb_writeCharValue(device, 0x34, &enableArgument, sizeof(enableArgument));
+   return LB_OK == lb_writeCharValue(device, sensorHandles[SENSOR_TAG_BAROMETER].config, &enableArgument, sizeof(enableArgument));
 }
 
-bool SensorTag_readBarometerData(struct LB_Device* device, float* temperature_C, unsigned* pressure_Pa)
+bool SensorTag_enableBarometerNotifications(struct LB_Device* device, bool enable)
+{
+   return SensorTag_enableNotifications(device, SENSOR_TAG_BAROMETER, enable);
+}
+
+uint16_t SensorTag_getDataHandle(enum SensorTag_Sensor sensor)
+{
+   assert(SENSOR_TAG_SENSOR_COUNT > sensor);
+   return sensorHandles[sensor].data;
+}
+
+bool SensorTag_decodeBarometerData(const uint8_t* value, uint8_t length, float* temperature_C, unsigned* pressure_Pa)
 {
    /*
     * data[2] = (temp >> 16) & 0xFF;
@@ -50,10 +180,7 @@ bool SensorTag_readBarometerData(struct LB_Device* device, float* temperature_C,
     * data[3] = press & 0xFF;
     */
 
-   uint8_t barometerData[6];
-   uint8_t dataLen = 0;
-
-   if (LB_OK != lb_readCharValue(device, 0x31, barometerData, sizeof(barometerData), &dataLen))
+   if (6 != length)
    {
       *temperature_C = 0;
       *pressure_Pa   = 0;
@@ -61,30 +188,39 @@ bool SensorTag_readBarometerData(struct LB_Device* device, float* temperature_C,
       return false;
    }
 
-   assert(sizeof(barometerData) == dataLen);
-
-   uint32_t scaledTemperature = barometerData[0] | (((uint32_t) barometerData[1]) << 8) | (((uint32_t) barometerData[2]) << 16);
+   uint32_t scaledTemperature = value[0] | (((uint32_t) value[1]) << 8) | (((uint32_t) value[2]) << 16);
 
    *temperature_C = scaledTemperature / 100.0f;
-   *pressure_Pa = barometerData[3] | (((uint32_t) barometerData[4]) << 8) | (((uint32_t) barometerData[5]) << 16);
+   *pressure_Pa = value[3] | (((uint32_t) value[4]) << 8) | (((uint32_t) value[5]) << 16);
 
    return true;
 }
 
-bool SensorTag_enableIMU(struct LB_Device* device, bool enable)
+bool SensorTag_readBarometerData(struct LB_Device* device, float* temperature_C, unsigned* pressure_Pa)
 {
-   uint8_t enableArgument[2] = { 0, 0 };
-   if (enable)
+   uint8_t barometerData[6];
+   uint8_t dataLen = 0;
+
+   if (LB_OK != lb_readCharValue(device, sensorHandles[SENSOR_TAG_BAROMETER].data, barometerData, sizeof(barometerData), &dataLen))
    {
-      enableArgument[0] = 0xFF;
+      *temperature_C = 0;
+      *pressure_Pa   = 0;
+
+      return false;
    }
-   return LB_OK == lb_writeCharValue(device, 0x3C, enableArgument, sizeof(enableArgument));
+
+   return SensorTag_decodeBarometerData(barometerData, dataLen, temperature_C, pressure_Pa);
+}
+
+bool SensorTag_enableIMU(struct LB_Device* device, bool enable)
+{
+   // all axes, with wake-on-motion, at 2 g
+   return writeMovementConfig(device, enable ? 0xFF : 0x00);
 }
 
 bool SensorTag_enableIMUNotifications(struct LB_Device* device, bool enable)
 {
-   uint8_t enableArgument[2] = { enable, 0 };
-   return LB_OK == lb_writeCharValue(device, 0x3A, enableArgument, sizeof(enableArgument));
+   return SensorTag_enableNotifications(device, SENSOR_TAG_MOVEMENT, enable);
 }
 
 bool SensorTag_readIMUData(struct LB_Device* device, struct threeDvector* gyro, struct threeDvector* accel, struct threeDvector* mag)
@@ -92,7 +228,7 @@ bool SensorTag_readIMUData(struct LB_Device* device, struct threeDvector* gyro,
    uint8_t rawData[18];
    uint8_t dataLen = 0;
 
-   if (LB_OK != lb_readCharValue(device, 0x39, rawData, sizeof(rawData), &dataLen))
+   if (LB_OK != lb_readCharValue(device, sensorHandles[SENSOR_TAG_MOVEMENT].data, rawData, sizeof(rawData), &dataLen))
    {
       memset(gyro, 0, sizeof(*gyro));
       memset(accel, 0, sizeof(*accel));
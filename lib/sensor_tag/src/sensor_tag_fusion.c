@@ -0,0 +1,343 @@
+/**
+ * @file sensor_tag_fusion.c
+ * @brief TI CC2650 SensorTag orientation estimation
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+/*
+ * Based on:
+ *    S. Madgwick, An efficient orientation filter for inertial and
+ *    inertial/magnetic sensor arrays, 2010
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "sensor_tag_fusion.h"
+
+#define DEFAULT_BETA                   0.1f
+#define DEFAULT_ZETA                   0.015f
+
+#define DEGREES_TO_RADIANS             0.017453293f
+
+// time steps outside this range are assumed to be gaps or duplicates
+#define MIN_TIME_STEP_S                0.001f
+#define MAX_TIME_STEP_S                0.5f
+
+// the Earth field is 25 to 65 uT; a rotation spans twice that on each axis
+#define MAG_CALIBRATION_MIN_SPAN_uT    40.0f
+
+void SensorTag_initializeFusion(struct SensorTag_Fusion* fusion, const struct SensorTag_FusionConfig* config)
+{
+   memset(fusion, 0, sizeof(*fusion));
+
+   fusion->config = *config;
+
+   if (0.0f >= fusion->config.beta)
+   {
+      fusion->config.beta = DEFAULT_BETA;
+   }
+
+   if (0.0f >= fusion->config.zeta)
+   {
+      fusion->config.zeta = DEFAULT_ZETA;
+   }
+
+   fusion->q[0] = 1.0f;
+
+   SensorTag_setMagCalibration(fusion, NULL);
+}
+
+void SensorTag_setMagCalibration(struct SensorTag_Fusion* fusion, const struct SensorTag_MagCalibration* calibration)
+{
+   if (calibration && calibration->valid)
+   {
+      fusion->magCalibration = *calibration;
+      fusion->autoCalibrate  = false;
+      return;
+   }
+
+   memset(&fusion->magCalibration, 0, sizeof(fusion->magCalibration));
+   fusion->autoCalibrate = true;
+
+   for (uint32_t ii = 0; ii < 3; ii ++)
+   {
+      fusion->magMin[ii] = INFINITY;
+      fusion->magMax[ii] = -INFINITY;
+   }
+}
+
+void SensorTag_getMagCalibration(const struct SensorTag_Fusion* fusion, struct SensorTag_MagCalibration* calibration)
+{
+   *calibration = fusion->magCalibration;
+}
+
+/*
+ * Tracks the extent of the readings; the hard-iron offset is the center,
+ * and the soft-iron scale equalizes the axis spans
+ */
+static void calibrateMagnetometer(struct SensorTag_Fusion* fusion, const float mag[3])
+{
+   bool spanned = true;
+
+   for (uint32_t ii = 0; ii < 3; ii ++)
+   {
+      fusion->magMin[ii] = fminf(fusion->magMin[ii], mag[ii]);
+      fusion->magMax[ii] = fmaxf(fusion->magMax[ii], mag[ii]);
+
+      spanned = spanned && ((fusion->magMax[ii] - fusion->magMin[ii]) >= MAG_CALIBRATION_MIN_SPAN_uT);
+   }
+
+   if (! spanned)
+   {
+      return;
+   }
+
+   float span[3];
+   float averageSpan = 0.0f;
+
+   for (uint32_t ii = 0; ii < 3; ii ++)
+   {
+      span[ii]     = fusion->magMax[ii] - fusion->magMin[ii];
+      averageSpan += span[ii] / 3.0f;
+   }
+
+   for (uint32_t ii = 0; ii < 3; ii ++)
+   {
+      fusion->magCalibration.offset_uT[ii] = (fusion->magMax[ii] + fusion->magMin[ii]) / 2.0f;
+      fusion->magCalibration.scale[ii]     = averageSpan / span[ii];
+   }
+
+   fusion->magCalibration.valid = true;
+}
+
+static float getTimeStep(struct SensorTag_Fusion* fusion, uint64_t timestamp_ms)
+{
+   float dt = fusion->config.samplePeriod_ms / 1000.0f;
+
+   if (0 == fusion->config.samplePeriod_ms)
+   {
+      dt = fusion->started ? ((float) (timestamp_ms - fusion->lastTimestamp_ms) / 1000.0f) : 0.0f;
+
+      if ((MIN_TIME_STEP_S > dt) || (MAX_TIME_STEP_S < dt))
+      {
+         dt = fusion->started ? MIN_TIME_STEP_S : 0.0f;
+      }
+   }
+
+   fusion->lastTimestamp_ms = timestamp_ms;
+   fusion->started          = true;
+
+   return dt;
+}
+
+/*
+ * Gradient of the error between the measured and the expected directions
+ * of gravity, and of the Earth field if m is not NULL
+ */
+static void computeGradient(const float q[4], const float a[3], const float* m, float s[4])
+{
+   const float q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+   const float ax = a[0], ay = a[1], az = a[2];
+
+   if (! m)
+   {
+      const float _2q0 = 2.0f * q0, _2q1 = 2.0f * q1, _2q2 = 2.0f * q2, _2q3 = 2.0f * q3;
+      const float _4q0 = 4.0f * q0, _4q1 = 4.0f * q1, _4q2 = 4.0f * q2;
+      const float _8q1 = 8.0f * q1, _8q2 = 8.0f * q2;
+      const float q0q0 = q0 * q0, q1q1 = q1 * q1, q2q2 = q2 * q2, q3q3 = q3 * q3;
+
+      s[0] = _4q0 * q2q2 + _2q2 * ax + _4q0 * q1q1 - _2q1 * ay;
+      s[1] = _4q1 * q3q3 - _2q3 * ax + 4.0f * q0q0 * q1 - _2q0 * ay - _4q1 + _8q1 * q1q1 + _8q1 * q2q2 + _4q1 * az;
+      s[2] = 4.0f * q0q0 * q2 + _2q0 * ax + _4q2 * q3q3 - _2q3 * ay - _4q2 + _8q2 * q1q1 + _8q2 * q2q2 + _4q2 * az;
+      s[3] = 4.0f * q1q1 * q3 - _2q1 * ax + 4.0f * q2q2 * q3 - _2q2 * ay;
+      return;
+   }
+
+   const float mx = m[0], my = m[1], mz = m[2];
+
+   const float _2q0mx = 2.0f * q0 * mx, _2q0my = 2.0f * q0 * my, _2q0mz = 2.0f * q0 * mz, _2q1mx = 2.0f * q1 * mx;
+   const float _2q0 = 2.0f * q0, _2q1 = 2.0f * q1, _2q2 = 2.0f * q2, _2q3 = 2.0f * q3;
+   const float _2q0q2 = 2.0f * q0 * q2, _2q2q3 = 2.0f * q2 * q3;
+   const float q0q0 = q0 * q0, q0q1 = q0 * q1, q0q2 = q0 * q2, q0q3 = q0 * q3;
+   const float q1q1 = q1 * q1, q1q2 = q1 * q2, q1q3 = q1 * q3;
+   const float q2q2 = q2 * q2, q2q3 = q2 * q3, q3q3 = q3 * q3;
+
+   // reference direction of the Earth field, in the Earth frame
+   const float hx = mx * q0q0 - _2q0my * q3 + _2q0mz * q2 + mx * q1q1 + _2q1 * my * q2 + _2q1 * mz * q3 - mx * q2q2 - mx * q3q3;
+   const float hy = _2q0mx * q3 + my * q0q0 - _2q0mz * q1 + _2q1mx * q2 - my * q1q1 + my * q2q2 + _2q2 * mz * q3 - my * q3q3;
+   const float _2bx = sqrtf(hx * hx + hy * hy);
+   const float _2bz = -_2q0mx * q2 + _2q0my * q1 + mz * q0q0 + _2q1mx * q3 - mz * q1q1 + _2q2 * my * q3 - mz * q2q2 + mz * q3q3;
+   const float _4bx = 2.0f * _2bx;
+   const float _4bz = 2.0f * _2bz;
+
+   const float fgx = 2.0f * q1q3 - _2q0q2 - ax;
+   const float fgy = 2.0f * q0q1 + _2q2q3 - ay;
+   const float fgz = 1.0f - 2.0f * q1q1 - 2.0f * q2q2 - az;
+   const float fbx = _2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx;
+   const float fby = _2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my;
+   const float fbz = _2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz;
+
+   s[0] = -_2q2 * fgx + _2q1 * fgy - _2bz * q2 * fbx + (-_2bx * q3 + _2bz * q1) * fby + _2bx * q2 * fbz;
+   s[1] = _2q3 * fgx + _2q0 * fgy - 2.0f * _2q1 * fgz + _2bz * q3 * fbx + (_2bx * q2 + _2bz * q0) * fby + (_2bx * q3 - _4bz * q1) * fbz;
+   s[2] = -_2q0 * fgx + _2q3 * fgy - 2.0f * _2q2 * fgz + (-_4bx * q2 - _2bz * q0) * fbx + (_2bx * q1 + _2bz * q3) * fby + (_2bx * q0 - _4bz * q2) * fbz;
+   s[3] = _2q1 * fgx + _2q2 * fgy + (-_4bx * q3 + _2bz * q1) * fbx + (-_2bx * q0 + _2bz * q2) * fby + _2bx * q1 * fbz;
+}
+
+static bool normalize(float* v, uint32_t length)
+{
+   float norm = 0.0f;
+
+   for (uint32_t ii = 0; ii < length; ii ++)
+   {
+      norm += v[ii] * v[ii];
+   }
+
+   if (0.0f == norm)
+   {
+      return false;
+   }
+
+   const float recipNorm = 1.0f / sqrtf(norm);
+
+   for (uint32_t ii = 0; ii < length; ii ++)
+   {
+      v[ii] *= recipNorm;
+   }
+
+   return true;
+}
+
+void SensorTag_updateFusion(struct SensorTag_Fusion* fusion, const float gyro_dps[3], const float accel_g[3], const float mag_uT[3], uint64_t timestamp_ms, struct SensorTag_Quaternion* orientation)
+{
+   const float dt = getTimeStep(fusion, timestamp_ms);
+
+   float* q = fusion->q;
+
+   float g[3] =
+   {
+      gyro_dps[0] * DEGREES_TO_RADIANS,
+      gyro_dps[1] * DEGREES_TO_RADIANS,
+      gyro_dps[2] * DEGREES_TO_RADIANS,
+   };
+
+   float a[3] = { accel_g[0], accel_g[1], accel_g[2] };
+
+   /*
+    * The AK8963 magnetometer axes are rotated relative to the MPU-9250
+    * gyro and accelerometer: x and y are swapped and z is reversed.
+    */
+   float m[3] = { mag_uT[1], mag_uT[0], -mag_uT[2] };
+   bool haveMag = false;
+
+   if (fusion->config.useMagnetometer)
+   {
+      if (fusion->autoCalibrate && (! fusion->magCalibration.valid))
+      {
+         calibrateMagnetometer(fusion, m);
+      }
+
+      if (fusion->magCalibration.valid)
+      {
+         for (uint32_t ii = 0; ii < 3; ii ++)
+         {
+            m[ii] = (m[ii] - fusion->magCalibration.offset_uT[ii]) * fusion->magCalibration.scale[ii];
+         }
+
+         haveMag = normalize(m, 3);
+      }
+   }
+
+   float qDot[4] =
+   {
+      0.5f * (-q[1] * g[0] - q[2] * g[1] - q[3] * g[2]),
+      0.5f * ( q[0] * g[0] + q[2] * g[2] - q[3] * g[1]),
+      0.5f * ( q[0] * g[1] - q[1] * g[2] + q[3] * g[0]),
+      0.5f * ( q[0] * g[2] + q[1] * g[1] - q[2] * g[0]),
+   };
+
+   // in free fall there is no gravity reference
+   if (normalize(a, 3))
+   {
+      float s[4];
+      computeGradient(q, a, haveMag ? m : NULL, s);
+
+      if (normalize(s, 4))
+      {
+         // the angular error, 2 q* (x) s, drives the gyro bias estimate
+         const float error[3] =
+         {
+            2.0f * (q[0] * s[1] - q[1] * s[0] - q[2] * s[3] + q[3] * s[2]),
+            2.0f * (q[0] * s[2] + q[1] * s[3] - q[2] * s[0] - q[3] * s[1]),
+            2.0f * (q[0] * s[3] - q[1] * s[2] + q[2] * s[1] - q[3] * s[0]),
+         };
+
+         for (uint32_t ii = 0; ii < 3; ii ++)
+         {
+            fusion->gyroBias[ii] += error[ii] * dt * fusion->config.zeta;
+         }
+
+         // rotation rate of the bias, subtracted from the gyro term
+         const float* b = fusion->gyroBias;
+
+         qDot[0] -= 0.5f * (-q[1] * b[0] - q[2] * b[1] - q[3] * b[2]) + fusion->config.beta * s[0];
+         qDot[1] -= 0.5f * ( q[0] * b[0] + q[2] * b[2] - q[3] * b[1]) + fusion->config.beta * s[1];
+         qDot[2] -= 0.5f * ( q[0] * b[1] - q[1] * b[2] + q[3] * b[0]) + fusion->config.beta * s[2];
+         qDot[3] -= 0.5f * ( q[0] * b[2] + q[1] * b[1] - q[2] * b[0]) + fusion->config.beta * s[3];
+      }
+   }
+
+   for (uint32_t ii = 0; ii < 4; ii ++)
+   {
+      q[ii] += qDot[ii] * dt;
+   }
+
+   normalize(q, 4);
+
+   orientation->w = q[0];
+   orientation->x = q[1];
+   orientation->y = q[2];
+   orientation->z = q[3];
+}
+
+void SensorTag_fuseIMUSample(struct SensorTag_Fusion* fusion, const struct threeDvector* gyro, const struct threeDvector* accel, const struct threeDvector* mag, uint64_t timestamp_ms, struct SensorTag_Quaternion* orientation)
+{
+   // the scales used by the streaming decoder
+   const float gyroScale  = 500.0f / 65536.0f;
+   const float accelScale = (float) (2 << (fusion->config.accelRange & 0x03)) / 32768.0f;
+
+   const float gyro_dps[3] = { gyro->x * gyroScale, gyro->y * gyroScale, gyro->z * gyroScale };
+   const float accel_g[3]  = { accel->x * accelScale, accel->y * accelScale, accel->z * accelScale };
+   const float mag_uT[3]   = { mag->x, mag->y, mag->z };
+
+   SensorTag_updateFusion(fusion, gyro_dps, accel_g, mag_uT, timestamp_ms, orientation);
+}
+
+void SensorTag_fuseIMUBatch(struct SensorTag_Fusion* fusion, const struct SensorTag_IMUBatch* batch, struct SensorTag_Quaternion* orientation)
+{
+   for (uint32_t ii = 0; ii < batch->count; ii ++)
+   {
+      const float gyro_dps[3] = { batch->gyro_dps[0][ii], batch->gyro_dps[1][ii], batch->gyro_dps[2][ii] };
+      const float accel_g[3]  = { batch->accel_g[0][ii],  batch->accel_g[1][ii],  batch->accel_g[2][ii] };
+      const float mag_uT[3]   = { batch->mag_uT[0][ii],   batch->mag_uT[1][ii],   batch->mag_uT[2][ii] };
+
+      SensorTag_updateFusion(fusion, gyro_dps, accel_g, mag_uT, batch->timestamp_ms[ii], &orientation[ii]);
+   }
+}
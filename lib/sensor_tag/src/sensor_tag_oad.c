@@ -0,0 +1,499 @@
+/**
+ * @file sensor_tag_oad.c
+ * @brief TI CC2650 SensorTag over-the-air firmware download
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+/*
+ * Based on the TI BLE-Stack 2.x OAD profile
+ */
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <osal_core.h>
+
+#include <commands.h>
+
+#include "sensor_tag_oad.h"
+
+#define OAD_MAX_SESSIONS               16
+
+#define OAD_FIRST_REQUEST_TIMEOUT_MS   5000     // the target checks the header
+#define OAD_REQUEST_TIMEOUT_MS         1000     // resend from the last request
+#define OAD_STALL_TIMEOUT_MS           10000    // no progress, or no reboot
+
+#define OAD_MAX_BLOCKS                 0x10000  // block numbers are 16 bit
+
+struct oadSession
+{
+   struct LB_Device*                   device;
+   const struct SensorTag_OADConfig*   config;
+   struct os_condition*                changed;
+
+   // updated from the I/O thread, under the registry lock
+   uint32_t                            requestedBlock;   // next block the target expects
+   uint32_t                            rewoundTo;
+   bool                                requested;
+   bool                                rewind;           // blocks were lost
+   bool                                identifyRejected;
+   bool                                disconnected;
+};
+
+/*
+ * Maps devices to the downloads in progress, for the notification handler
+ */
+static _Atomic(struct os_lock*) registryLock;
+static struct oadSession* sessions[OAD_MAX_SESSIONS];
+
+static struct os_lock* getRegistryLock(void)
+{
+   struct os_lock* lock = atomic_load(&registryLock);
+
+   if (! lock)
+   {
+      struct os_lock* newLock = os_createLock();
+
+      if (atomic_compare_exchange_strong(&registryLock, &lock, newLock))
+      {
+         lock = newLock;
+      }
+      else
+      {
+         os_destroyLock(newLock);
+      }
+   }
+
+   return lock;
+}
+
+static bool registerSession(struct oadSession* session)
+{
+   bool registered = false;
+
+   struct os_lock* lock = getRegistryLock();
+   os_lock(lock);
+
+   for (uint32_t ii = 0; ii < OAD_MAX_SESSIONS; ii ++)
+   {
+      if (! sessions[ii])
+      {
+         sessions[ii] = session;
+         registered   = true;
+         break;
+      }
+   }
+
+   os_unlock(lock);
+
+   return registered;
+}
+
+static void unregisterSession(struct oadSession* session)
+{
+   struct os_lock* lock = getRegistryLock();
+   os_lock(lock);
+
+   for (uint32_t ii = 0; ii < OAD_MAX_SESSIONS; ii ++)
+   {
+      if (sessions[ii] == session)
+      {
+         sessions[ii] = NULL;
+         break;
+      }
+   }
+
+   os_unlock(lock);
+}
+
+/*
+ * Must be called with the registry lock held
+ */
+static struct oadSession* findSession(struct LB_Device* device)
+{
+   for (uint32_t ii = 0; ii < OAD_MAX_SESSIONS; ii ++)
+   {
+      if (sessions[ii] && (sessions[ii]->device == device))
+      {
+         return sessions[ii];
+      }
+   }
+
+   return NULL;
+}
+
+bool SensorTag_on_receivedNotification(struct LB_Device* device, uint16_t attributeHandle, const uint8_t* attributeValue, uint8_t attributeLength)
+{
+   bool consumed = false;
+
+   struct os_lock* lock = getRegistryLock();
+   os_lock(lock);
+
+   struct oadSession* session = findSession(device);
+
+   if (session && (attributeHandle == session->config->blockHandle) && (2 <= attributeLength))
+   {
+      const uint32_t block = attributeValue[0] | (((uint32_t) attributeValue[1]) << 8);
+
+      /*
+       * Requests normally advance one block at a time. The target requests
+       * the block it expects again for every block received out of order,
+       * so only the first repeat rewinds the sender.
+       */
+      if (session->requested && (block <= session->requestedBlock) && (block != session->rewoundTo))
+      {
+         session->rewind    = true;
+         session->rewoundTo = block;
+      }
+
+      session->requestedBlock = block;
+      session->requested      = true;
+
+      os_signalCondition(session->changed, NULL);
+      consumed = true;
+   }
+   else if (session && (attributeHandle == session->config->identifyHandle))
+   {
+      // the target answers a rejected header with its own
+      session->identifyRejected = true;
+
+      os_signalCondition(session->changed, NULL);
+      consumed = true;
+   }
+
+   os_unlock(lock);
+
+   return consumed;
+}
+
+void SensorTag_on_disconnectedFromDevice(struct LB_Device* device)
+{
+   struct os_lock* lock = getRegistryLock();
+   os_lock(lock);
+
+   struct oadSession* session = findSession(device);
+   if (session)
+   {
+      session->disconnected = true;
+      os_signalCondition(session->changed, NULL);
+   }
+
+   os_unlock(lock);
+}
+
+static uint32_t getBlockCount(const struct SensorTag_OADImage* image)
+{
+   // the header length is in 4-byte words
+   uint32_t length = 4 * (image->data[6] | (((uint32_t) image->data[7]) << 8));
+
+   if ((0 == length) || (length > image->length))
+   {
+      length = image->length;
+   }
+
+   return length / SENSOR_TAG_OAD_BLOCK_SIZE;
+}
+
+static enum LB_STATUS download(struct oadSession* session, const struct SensorTag_OADImage* image, uint32_t blockCount, struct SensorTag_OADProgress* progress)
+{
+   const struct SensorTag_OADConfig* config = session->config;
+   struct LB_Device* device = session->device;
+   struct os_lock* lock = getRegistryLock();
+
+   const uint8_t enableNotifications[2] = { 1, 0 };
+
+   enum LB_STATUS status = lb_writeCharValue(device, config->identifyHandle + 1, enableNotifications, sizeof(enableNotifications));
+   if (LB_OK == status)
+   {
+      status = lb_writeCharValue(device, config->blockHandle + 1, enableNotifications, sizeof(enableNotifications));
+   }
+
+   if (LB_OK != status)
+   {
+      return status;
+   }
+
+   // the image header without the CRCs, marked as not verified
+   uint8_t identify[SENSOR_TAG_OAD_IDENTIFY_SIZE];
+   memcpy(identify, image->data + 4, sizeof(identify));
+   identify[sizeof(identify) - 1] = 0xFF;
+
+   status = lb_writeCharValue(device, config->identifyHandle, identify, sizeof(identify));
+   if (LB_OK != status)
+   {
+      return status;
+   }
+
+   const uint32_t window = config->window ? config->window : 1;
+
+   uint32_t nextBlock      = 0;
+   uint32_t requestedBlock = 0;
+   bool     requested      = false;
+   uint64_t lastProgress   = os_getTime_ms();
+
+   while (true)
+   {
+      os_resetCondition(session->changed);
+
+      os_lock(lock);
+      const bool     rejected     = session->identifyRejected;
+      const bool     disconnected = session->disconnected;
+      const bool     rewind       = session->rewind;
+      const bool     haveRequest  = session->requested;
+      const uint32_t targetBlock  = session->requestedBlock;
+      session->rewind = false;
+      os_unlock(lock);
+
+      if (rejected)
+      {
+         return LB_FAILURE;
+      }
+
+      if (haveRequest)
+      {
+         if ((! requested) || (targetBlock > requestedBlock))
+         {
+            lastProgress = os_getTime_ms();
+         }
+
+         requested      = true;
+         requestedBlock = targetBlock;
+
+         if (rewind && (nextBlock > targetBlock))
+         {
+            progress->retransmissions += nextBlock - targetBlock;
+         }
+
+         if (rewind || (nextBlock < targetBlock))
+         {
+            nextBlock = targetBlock;
+         }
+
+         progress->blocksRequested = requestedBlock;
+      }
+
+      if (disconnected)
+      {
+         // the target reboots into the new image once it has all the blocks
+         bool complete = requested && ((requestedBlock + 1) >= blockCount) && (nextBlock >= blockCount);
+         return complete ? LB_OK : LB_DEVICE_NOT_CONNECTED;
+      }
+
+      while (requested && (nextBlock < blockCount) && (nextBlock < (requestedBlock + window)))
+      {
+         uint8_t block[2 + SENSOR_TAG_OAD_BLOCK_SIZE];
+         block[0] = nextBlock & 0xFF;
+         block[1] = (nextBlock >> 8) & 0xFF;
+         memcpy(block + 2, image->data + nextBlock * SENSOR_TAG_OAD_BLOCK_SIZE, SENSOR_TAG_OAD_BLOCK_SIZE);
+
+         status = lb_writeCharValueWithoutResponse(device, config->blockHandle, block, sizeof(block));
+         if (LB_OK != status)
+         {
+            return status;
+         }
+
+         nextBlock ++;
+         progress->blocksSent ++;
+      }
+
+      const uint32_t timeout_ms = requested ? OAD_REQUEST_TIMEOUT_MS : OAD_FIRST_REQUEST_TIMEOUT_MS;
+
+      if (! os_waitForCondition(session->changed, timeout_ms, NULL))
+      {
+         if ((! requested) || ((os_getTime_ms() - lastProgress) > OAD_STALL_TIMEOUT_MS))
+         {
+            return LB_OPERATION_TIMEOUT;
+         }
+
+         // the requests stopped; resend the window
+         if (nextBlock > requestedBlock)
+         {
+            progress->retransmissions += nextBlock - requestedBlock;
+            nextBlock = requestedBlock;
+         }
+      }
+   }
+}
+
+enum LB_STATUS SensorTag_updateFirmware(struct LB_Controller* controller, const uint8_t* address, const struct SensorTag_OADImage* image, const struct SensorTag_OADConfig* config, struct SensorTag_OADProgress* progress)
+{
+   if ((! controller) || (! address) || (! image) || (! image->data) || (! config) || (! progress) ||
+         (SENSOR_TAG_OAD_IMAGE_HEADER_SIZE > image->length) || (image->length % SENSOR_TAG_OAD_BLOCK_SIZE) ||
+         (0 == config->identifyHandle) || (0 == config->blockHandle))
+   {
+      return LB_INVALID_PARAMETERS;
+   }
+
+   const uint32_t blockCount = getBlockCount(image);
+   if (OAD_MAX_BLOCKS < blockCount)
+   {
+      return LB_INVALID_PARAMETERS;
+   }
+
+   memset(progress, 0, sizeof(*progress));
+   progress->blockCount = blockCount;
+
+   struct oadSession session;
+   memset(&session, 0, sizeof(session));
+   session.config  = config;
+   session.changed = os_createCondition();
+
+   const uint32_t maxAttempts = config->maxAttempts ? config->maxAttempts : 1;
+
+   enum LB_STATUS status = LB_FAILURE;
+
+   for (uint32_t attempt = 0; attempt < maxAttempts; attempt ++)
+   {
+      struct LB_Device* device = NULL;
+
+      status = lb_openDeviceConnection(controller, address, &device);
+      if (LB_OK != status)
+      {
+         continue;
+      }
+
+      progress->connections ++;
+
+      session.device           = device;
+      session.requestedBlock   = 0;
+      session.rewoundTo        = UINT32_MAX;
+      session.requested        = false;
+      session.rewind           = false;
+      session.identifyRejected = false;
+      session.disconnected     = false;
+
+      if (! registerSession(&session))
+      {
+         lb_closeDeviceConnection(device);
+         status = LB_CONNECTION_LIMIT_REACHED;
+         break;
+      }
+
+      status = download(&session, image, blockCount, progress);
+
+      unregisterSession(&session);
+
+      // releases the device, even after the target disconnected
+      lb_closeDeviceConnection(device);
+
+      if ((LB_OK == status) || session.identifyRejected)
+      {
+         break;
+      }
+   }
+
+   os_destroyCondition(session.changed);
+
+   return status;
+}
+
+struct controllerWorker
+{
+   struct LB_Controller*               controller;
+   struct SensorTag_OADJob*            jobs;
+   uint32_t                            count;
+   const struct SensorTag_OADImage*    image;
+   const struct SensorTag_OADConfig*   config;
+   struct os_condition*                done;
+};
+
+static void runWorker(void* arg)
+{
+   struct controllerWorker* worker = (struct controllerWorker*) arg;
+
+   for (uint32_t ii = 0; ii < worker->count; ii ++)
+   {
+      struct SensorTag_OADJob* job = &worker->jobs[ii];
+
+      if (job->controller == worker->controller)
+      {
+         job->status = SensorTag_updateFirmware(job->controller, job->address, worker->image, worker->config, &job->progress);
+      }
+   }
+
+   os_signalCondition(worker->done, NULL);
+}
+
+uint32_t SensorTag_updateFirmwareParallel(struct SensorTag_OADJob* jobs, uint32_t count, const struct SensorTag_OADImage* image, const struct SensorTag_OADConfig* config)
+{
+   // at most one worker per job
+   struct controllerWorker* workers = calloc(count, sizeof(struct controllerWorker));
+   if (! workers)
+   {
+      return 0;
+   }
+
+   uint32_t workerCount = 0;
+
+   for (uint32_t ii = 0; ii < count; ii ++)
+   {
+      jobs[ii].status = LB_FAILURE;
+      memset(&jobs[ii].progress, 0, sizeof(jobs[ii].progress));
+
+      uint32_t jj = 0;
+      while ((jj < workerCount) && (workers[jj].controller != jobs[ii].controller))
+      {
+         jj ++;
+      }
+
+      if (jj == workerCount)
+      {
+         workers[jj].controller = jobs[ii].controller;
+         workers[jj].jobs       = jobs;
+         workers[jj].count      = count;
+         workers[jj].image      = image;
+         workers[jj].config     = config;
+         workers[jj].done       = os_createCondition();
+         workerCount ++;
+      }
+   }
+
+   for (uint32_t jj = 0; jj < workerCount; jj ++)
+   {
+      if (! os_executeLater(0, runWorker, &workers[jj]))
+      {
+         runWorker(&workers[jj]);
+      }
+   }
+
+   for (uint32_t jj = 0; jj < workerCount; jj ++)
+   {
+      while (! os_waitForCondition(workers[jj].done, 1000, NULL))
+      {
+      }
+
+      os_destroyCondition(workers[jj].done);
+   }
+
+   free(workers);
+
+   uint32_t succeeded = 0;
+
+   for (uint32_t ii = 0; ii < count; ii ++)
+   {
+      if (LB_OK == jobs[ii].status)
+      {
+         succeeded ++;
+      }
+   }
+
+   return succeeded;
+}
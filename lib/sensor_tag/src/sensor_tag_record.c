@@ -0,0 +1,80 @@
+/**
+ * @file sensor_tag_record.c
+ * @brief TI CC2650 SensorTag sample recording
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+#include "sensor_tag_record.h"
+
+/*
+ * The batches are already stored column by column, so they are copied to
+ * the recording without rearranging
+ */
+
+struct Recorder_Series* SensorTag_addIMUSeries(struct Recorder* recorder, const uint8_t* address)
+{
+   const struct Recorder_Column columns[] =
+   {
+      { .name = "gyro_x",  .type = RECORDER_FLOAT32 },
+      { .name = "gyro_y",  .type = RECORDER_FLOAT32 },
+      { .name = "gyro_z",  .type = RECORDER_FLOAT32 },
+      { .name = "accel_x", .type = RECORDER_FLOAT32 },
+      { .name = "accel_y", .type = RECORDER_FLOAT32 },
+      { .name = "accel_z", .type = RECORDER_FLOAT32 },
+      { .name = "mag_x",   .type = RECORDER_FLOAT32 },
+      { .name = "mag_y",   .type = RECORDER_FLOAT32 },
+      { .name = "mag_z",   .type = RECORDER_FLOAT32 },
+   };
+
+   return Recorder_addSeries(recorder, address, "imu", columns, sizeof(columns) / sizeof(columns[0]));
+}
+
+struct Recorder_Series* SensorTag_addBarometerSeries(struct Recorder* recorder, const uint8_t* address)
+{
+   const struct Recorder_Column columns[] =
+   {
+      { .name = "temperature", .type = RECORDER_FLOAT32 },
+      { .name = "pressure",    .type = RECORDER_FLOAT32 },
+   };
+
+   return Recorder_addSeries(recorder, address, "barometer", columns, sizeof(columns) / sizeof(columns[0]));
+}
+
+uint32_t SensorTag_recordIMUBatch(struct Recorder_Series* series, const struct SensorTag_IMUBatch* batch)
+{
+   const void* const columns[] =
+   {
+      batch->gyro_dps[0], batch->gyro_dps[1], batch->gyro_dps[2],
+      batch->accel_g[0], batch->accel_g[1], batch->accel_g[2],
+      batch->mag_uT[0], batch->mag_uT[1], batch->mag_uT[2],
+   };
+
+   return Recorder_appendSamples(series, batch->count, batch->timestamp_ms, columns);
+}
+
+uint32_t SensorTag_recordBarometerBatch(struct Recorder_Series* series, const struct SensorTag_BarometerBatch* batch)
+{
+   const void* const columns[] =
+   {
+      batch->temperature_C, batch->pressure_hPa,
+   };
+
+   return Recorder_appendSamples(series, batch->count, batch->timestamp_ms, columns);
+}
@@ -0,0 +1,329 @@
+/**
+ * @file sensor_tag_stream.c
+ * @brief TI CC2650 SensorTag streaming sample batches
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+/*
+ * Based on http://www.ti.com/ww/en/wireless_connectivity/sensortag2015/tearDown.html
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <osal_core.h>
+
+#include "sensor_tag_stream.h"
+
+#define BAROMETER_DATA_HANDLE    0x31
+#define IMU_DATA_HANDLE          0x39
+
+#define IMU_DATA_LENGTH          18
+#define BAROMETER_DATA_LENGTH    6
+
+// batches buffered per sensor, including the one being filled
+#define STREAM_DEPTH             8
+
+#define MAX_FIELDS               9
+
+/*
+ * Raw samples, in the same layout as the converted batches
+ */
+struct rawBatch
+{
+   uint32_t    count;
+   uint64_t    timestamp_ms[SENSOR_TAG_BATCH_CAPACITY];
+   int32_t     field[MAX_FIELDS][SENSOR_TAG_BATCH_CAPACITY];
+};
+
+struct sampleQueue
+{
+   struct os_condition* batchReady;
+
+   uint32_t             head;          // oldest complete batch
+   uint32_t             ready;         // complete batches; the next one is being filled
+   uint32_t             dropped;       // samples dropped since a batch was last taken
+
+   struct rawBatch      batch[STREAM_DEPTH];
+};
+
+struct SensorTag_Stream
+{
+   struct LB_Device*    device;
+   struct os_lock*      lock;
+
+   float                accelScale;
+
+   struct sampleQueue   imu;
+   struct sampleQueue   barometer;
+};
+
+struct SensorTag_Stream* SensorTag_createStream(struct LB_Device* device, enum SensorTag_AccelerometerRange accelRange)
+{
+   struct SensorTag_Stream* stream = calloc(1, sizeof(struct SensorTag_Stream));
+   if (! stream)
+   {
+      return NULL;
+   }
+
+   stream->device = device;
+   stream->lock   = os_createLock();
+
+   // full scale is 2, 4, 8 or 16 g
+   stream->accelScale = (float) (2 << (accelRange & 0x03)) / 32768.0f;
+
+   stream->imu.batchReady       = os_createCondition();
+   stream->barometer.batchReady = os_createCondition();
+
+   return stream;
+}
+
+void SensorTag_destroyStream(struct SensorTag_Stream* stream)
+{
+   if (! stream)
+   {
+      return;
+   }
+
+   os_destroyCondition(stream->barometer.batchReady);
+   os_destroyCondition(stream->imu.batchReady);
+   os_destroyLock(stream->lock);
+
+   free(stream);
+}
+
+/*
+ * Must be called with the stream lock held; returns the batch being filled
+ */
+static struct rawBatch* getFillingBatch(struct sampleQueue* queue)
+{
+   return &queue->batch[(queue->head + queue->ready) % STREAM_DEPTH];
+}
+
+/*
+ * Must be called with the stream lock held; returns true if a batch was completed
+ */
+static bool completeSample(struct sampleQueue* queue)
+{
+   struct rawBatch* batch = getFillingBatch(queue);
+
+   batch->count ++;
+   if (SENSOR_TAG_BATCH_CAPACITY > batch->count)
+   {
+      return false;
+   }
+
+   queue->ready ++;
+
+   // keep room for the next batch to fill, dropping the oldest
+   if (STREAM_DEPTH == queue->ready)
+   {
+      queue->dropped += queue->batch[queue->head].count;
+      queue->head     = (queue->head + 1) % STREAM_DEPTH;
+      queue->ready --;
+   }
+
+   getFillingBatch(queue)->count = 0;
+
+   return true;
+}
+
+static inline int32_t readInt16(const uint8_t* buffer)
+{
+   return (int16_t) (((uint16_t) buffer[0]) | (((uint16_t) buffer[1]) << 8));
+}
+
+static inline int32_t readUint24(const uint8_t* buffer)
+{
+   return buffer[0] | (((int32_t) buffer[1]) << 8) | (((int32_t) buffer[2]) << 16);
+}
+
+bool SensorTag_on_streamNotification(struct SensorTag_Stream* stream, struct LB_Device* device, uint16_t attributeHandle, const uint8_t* attributeValue, uint8_t attributeLength)
+{
+   if (device != stream->device)
+   {
+      return false;
+   }
+
+   struct sampleQueue* queue = NULL;
+
+   if ((IMU_DATA_HANDLE == attributeHandle) && (IMU_DATA_LENGTH == attributeLength))
+   {
+      queue = &stream->imu;
+   }
+   else if ((BAROMETER_DATA_HANDLE == attributeHandle) && (BAROMETER_DATA_LENGTH == attributeLength))
+   {
+      queue = &stream->barometer;
+   }
+   else
+   {
+      return false;
+   }
+
+   const uint64_t now = os_getTime_ms();
+
+   os_lock(stream->lock);
+
+   struct rawBatch* batch = getFillingBatch(queue);
+   const uint32_t index = batch->count;
+
+   batch->timestamp_ms[index] = now;
+
+   if (queue == &stream->imu)
+   {
+      // gyro, accelerometer and magnetometer, x, y and z
+      for (uint32_t ii = 0; ii < MAX_FIELDS; ii ++)
+      {
+         batch->field[ii][index] = readInt16(attributeValue + 2 * ii);
+      }
+   }
+   else
+   {
+      // temperature and pressure
+      batch->field[0][index] = readUint24(attributeValue);
+      batch->field[1][index] = readUint24(attributeValue + 3);
+   }
+
+   bool completed = completeSample(queue);
+
+   os_unlock(stream->lock);
+
+   if (completed)
+   {
+      os_signalCondition(queue->batchReady, NULL);
+   }
+
+   return true;
+}
+
+/*
+ * Copies out the oldest complete batch, or after the timeout the batch
+ * being filled
+ */
+static bool takeBatch(struct SensorTag_Stream* stream, struct sampleQueue* queue, struct rawBatch* raw, uint32_t* dropped, uint32_t timeout_ms)
+{
+   const uint64_t deadline = os_getTime_ms() + timeout_ms;
+
+   os_lock(stream->lock);
+
+   while (0 == queue->ready)
+   {
+      const uint64_t now = os_getTime_ms();
+      if (now >= deadline)
+      {
+         break;
+      }
+
+      os_resetCondition(queue->batchReady);
+      os_unlock(stream->lock);
+
+      os_waitForCondition(queue->batchReady, (uint32_t) (deadline - now), NULL);
+
+      os_lock(stream->lock);
+   }
+
+   bool taken = true;
+
+   if (queue->ready)
+   {
+      struct rawBatch* batch = &queue->batch[queue->head];
+      memcpy(raw, batch, sizeof(*raw));
+
+      queue->head = (queue->head + 1) % STREAM_DEPTH;
+      queue->ready --;
+   }
+   else if (getFillingBatch(queue)->count)
+   {
+      struct rawBatch* batch = getFillingBatch(queue);
+      memcpy(raw, batch, sizeof(*raw));
+
+      batch->count = 0;
+   }
+   else
+   {
+      taken = false;
+   }
+
+   *dropped       = queue->dropped;
+   queue->dropped = 0;
+
+   os_unlock(stream->lock);
+
+   return taken;
+}
+
+/*
+ * One pass per axis over contiguous arrays; the compiler vectorizes it
+ */
+static void convert(float* restrict output, const int32_t* restrict input, uint32_t count, float scale)
+{
+   for (uint32_t ii = 0; ii < count; ii ++)
+   {
+      output[ii] = scale * (float) input[ii];
+   }
+}
+
+bool SensorTag_getIMUBatch(struct SensorTag_Stream* stream, struct SensorTag_IMUBatch* batch, uint32_t timeout_ms)
+{
+   struct rawBatch raw;
+
+   if (! takeBatch(stream, &stream->imu, &raw, &batch->dropped, timeout_ms))
+   {
+      batch->count = 0;
+      return false;
+   }
+
+   const uint32_t count = raw.count;
+
+   batch->count = count;
+   memcpy(batch->timestamp_ms, raw.timestamp_ms, count * sizeof(raw.timestamp_ms[0]));
+
+   for (uint32_t axis = 0; axis < 3; axis ++)
+   {
+      // gyro full scale is 250 deg/s; the magnetometer reports uT
+      convert(batch->gyro_dps[axis], raw.field[axis],     count, 500.0f / 65536.0f);
+      convert(batch->accel_g[axis],  raw.field[3 + axis], count, stream->accelScale);
+      convert(batch->mag_uT[axis],   raw.field[6 + axis], count, 1.0f);
+   }
+
+   return true;
+}
+
+bool SensorTag_getBarometerBatch(struct SensorTag_Stream* stream, struct SensorTag_BarometerBatch* batch, uint32_t timeout_ms)
+{
+   struct rawBatch raw;
+
+   if (! takeBatch(stream, &stream->barometer, &raw, &batch->dropped, timeout_ms))
+   {
+      batch->count = 0;
+      return false;
+   }
+
+   const uint32_t count = raw.count;
+
+   batch->count = count;
+   memcpy(batch->timestamp_ms, raw.timestamp_ms, count * sizeof(raw.timestamp_ms[0]));
+
+   // both are reported in hundredths
+   convert(batch->temperature_C, raw.field[0], count, 0.01f);
+   convert(batch->pressure_hPa,  raw.field[1], count, 0.01f);
+
+   return true;
+}
@@ -0,0 +1,478 @@
+/**
+ * @file acl.c
+ * @brief HCI ACL data path and flow control
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+/*
+ * The host may only send as many ACL packets as the controller has
+ * buffers; buffers are returned with Number Of Completed Packets events.
+ *
+ * The buffers are shared by all the links on the controller. A link may
+ * always use its fair share of them; beyond that, it only gets a buffer
+ * when no other link is waiting for one, so a bulk transfer cannot starve
+ * the other links. The buffers left over from the fair shares, all of them
+ * when the links outnumber the buffers, go to the waiting links in turn.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+
+#include <osal_core.h>
+#include <utils.h>
+
+#include <hci.h>
+#include <att.h>
+#include <commands.h>
+
+#include "hci_priv.h"
+#include "lb_priv.h"
+
+void acl_initialize(struct LB_Device* device)
+{
+   device->acl.txLock     = os_createLock();
+   device->acl.inFlight   = 0;
+   device->acl.waiting    = 0;
+   device->acl.rxExpected = 0;
+   device->acl.rxLength   = 0;
+}
+
+void acl_cleanup(struct LB_Device* device)
+{
+   if (device->acl.txLock)
+   {
+      os_destroyLock(device->acl.txLock);
+      device->acl.txLock = NULL;
+   }
+}
+
+MAKE_HCI_COMMAND(LE_READ_BUFFER_SIZE);
+MAKE_HCI_COMMAND(READ_BUFFER_SIZE);
+
+enum LB_STATUS hci_readBufferSize(struct LB_Controller* controller)
+{
+   struct HCI_RESPONSE_LE_Read_Buffer_Size leBufferSize;
+
+   enum LB_STATUS status = lb_executeCommand(controller, (const uint8_t*) &CMD_LE_READ_BUFFER_SIZE, sizeof(CMD_LE_READ_BUFFER_SIZE), (uint8_t*) &leBufferSize, sizeof(leBufferSize));
+   if (LB_OK != status)
+   {
+      return status;
+   }
+
+   uint16_t maxLength  = uint16Value(&leBufferSize.dataPacketLength);
+   uint16_t maxPackets = leBufferSize.totalDataPackets;
+
+   // the LE buffers may be shared with the BR/EDR ones
+   if ((0 == maxLength) || (0 == maxPackets))
+   {
+      struct HCI_RESPONSE_Read_Buffer_Size bufferSize;
+
+      status = lb_executeCommand(controller, (const uint8_t*) &CMD_READ_BUFFER_SIZE, sizeof(CMD_READ_BUFFER_SIZE), (uint8_t*) &bufferSize, sizeof(bufferSize));
+      if (LB_OK != status)
+      {
+         return status;
+      }
+
+      maxLength  = uint16Value(&bufferSize.aclDataPacketLength);
+      maxPackets = uint16Value(&bufferSize.totalACLDataPackets);
+   }
+
+   if ((0 == maxLength) || (0 == maxPackets))
+   {
+      return LB_FAILURE;
+   }
+
+   os_lock(controller->acl.creditLock);
+   controller->acl.maxLength  = maxLength;
+   controller->acl.maxPackets = maxPackets;
+   controller->acl.credits    = maxPackets;
+   os_unlock(controller->acl.creditLock);
+
+   if (lbDebugLevel > 100)
+   {
+      printf("ACL buffers: %u x %u bytes\n", (unsigned) maxPackets, (unsigned) maxLength);
+   }
+
+   return LB_OK;
+}
+
+/*
+ * Picks the waiting link with the fewest buffers in use, starting from the
+ * round-robin position; must be called with the credit lock held
+ */
+static struct LB_Device* getNextWaitingLink(struct LB_Controller* controller)
+{
+   struct LB_Device* selected = NULL;
+
+   for (uint32_t ii = 0; ii < LB_MAX_DEVICES; ii ++)
+   {
+      struct LB_Device* link = &controller->device[(controller->acl.nextLink + ii) % LB_MAX_DEVICES];
+
+      if ((INVALID_CONNECTION_HANDLE != link->connectionHandle) && link->acl.waiting &&
+            ((NULL == selected) || (link->acl.inFlight < selected->acl.inFlight)))
+      {
+         selected = link;
+      }
+   }
+
+   return selected;
+}
+
+/*
+ * Must be called with the credit lock held
+ */
+static bool mayTakeCredit(struct LB_Controller* controller, struct LB_Device* device)
+{
+   if (0 == controller->acl.credits)
+   {
+      return false;
+   }
+
+   uint32_t links = 0;
+   bool othersWaiting = false;
+
+   for (uint32_t ii = 0; ii < LB_MAX_DEVICES; ii ++)
+   {
+      struct LB_Device* link = &controller->device[ii];
+
+      if (INVALID_CONNECTION_HANDLE != link->connectionHandle)
+      {
+         links ++;
+
+         if ((link != device) && link->acl.waiting)
+         {
+            othersWaiting = true;
+         }
+      }
+   }
+
+   if (! othersWaiting)
+   {
+      return true;
+   }
+
+   // rounds down, to 0 when the links outnumber the buffers
+   const uint32_t fairShare = controller->acl.maxPackets / ((links > 0) ? links : 1);
+   if (device->acl.inFlight < fairShare)
+   {
+      return true;
+   }
+
+   // each waiting link gets one of the leftover credits before any gets two
+   return device == getNextWaitingLink(controller);
+}
+
+static bool acquireCredit(struct LB_Controller* controller, struct LB_Device* device)
+{
+   const uint64_t deadline = os_getTime_ms() + controller->timeouts.aclCredit_ms;
+   bool acquired = false;
+
+   os_lock(controller->acl.creditLock);
+   device->acl.waiting ++;
+
+   while (isDeviceConnected(device))
+   {
+      if (mayTakeCredit(controller, device))
+      {
+         controller->acl.credits --;
+         device->acl.inFlight ++;
+         controller->acl.nextLink = (uint32_t) ((device - controller->device) + 1) % LB_MAX_DEVICES;
+         acquired = true;
+         break;
+      }
+
+      uint64_t now = os_getTime_ms();
+      if (now >= deadline)
+      {
+         break;
+      }
+
+      // releases the lock while asleep; credits are returned under it, so the check above cannot miss one
+      os_sleepConditionVariable(controller->acl.creditAvailable, controller->acl.creditLock, (uint32_t) (deadline - now));
+   }
+
+   // a waiter that was held back for this one may go now
+   if (acquired)
+   {
+      os_wakeAllConditionVariable(controller->acl.creditAvailable);
+   }
+
+   device->acl.waiting --;
+   os_unlock(controller->acl.creditLock);
+
+   return acquired;
+}
+
+static void returnCredits(struct LB_Controller* controller, struct LB_Device* device, uint32_t count)
+{
+   os_lock(controller->acl.creditLock);
+
+   // never credit more than was sent; a late event may race a disconnection
+   if (count > device->acl.inFlight)
+   {
+      count = device->acl.inFlight;
+   }
+
+   device->acl.inFlight    -= count;
+   controller->acl.credits += count;
+
+   if (count)
+   {
+      os_wakeAllConditionVariable(controller->acl.creditAvailable);
+   }
+
+   os_unlock(controller->acl.creditLock);
+}
+
+/*
+ * Splits the L2CAP frame into controller-sized ACL packets. Frames on one
+ * link are sent whole, one at a time; the packets of different links may
+ * interleave.
+ *
+ * Must not be called from the I/O thread: it waits for controller buffers
+ * and for the transmission to complete, both signaled from there.
+ */
+enum LB_STATUS hci_sendACLData(struct LB_Device* device, uint16_t channelId, const uint8_t* payload, uint16_t length)
+{
+   struct LB_Controller* controller = device->controller;
+
+   if (0 == controller->acl.maxLength)
+   {
+      return LB_FAILURE;
+   }
+
+   if ((UINT16_MAX - L2CAP_HEADER_LENGTH) < length)
+   {
+      return LB_INVALID_PARAMETERS;
+   }
+
+   uint16_t fragmentCapacity = controller->acl.maxLength;
+   if (fragmentCapacity > LB_ACL_MAX_FRAGMENT)
+   {
+      fragmentCapacity = LB_ACL_MAX_FRAGMENT;
+   }
+
+   uint8_t l2capHeader[L2CAP_HEADER_LENGTH];
+   setUint16Value(l2capHeader, length);
+   setUint16Value(l2capHeader + 2, channelId);
+
+   const uint32_t frameLength = L2CAP_HEADER_LENGTH + length;
+
+   enum LB_STATUS status = LB_OK;
+
+   os_lock(device->acl.txLock);
+
+   for (uint32_t offset = 0; offset < frameLength; )
+   {
+      uint16_t fragmentLength = fragmentCapacity;
+      if ((frameLength - offset) < fragmentLength)
+      {
+         fragmentLength = (uint16_t) (frameLength - offset);
+      }
+
+      uint8_t packet[sizeof(struct HCI_ACLDataHeader) + LB_ACL_MAX_FRAGMENT];
+      uint8_t* fragment = packet + sizeof(struct HCI_ACLDataHeader);
+
+      // the L2CAP header is only at the start of the first fragment
+      for (uint16_t ii = 0; ii < fragmentLength; ii ++)
+      {
+         uint32_t position = offset + ii;
+         fragment[ii] = (position < L2CAP_HEADER_LENGTH) ? l2capHeader[position] : payload[position - L2CAP_HEADER_LENGTH];
+      }
+
+      const uint16_t boundary = (0 == offset) ? HCI_ACL_FIRST_NON_FLUSHABLE : HCI_ACL_CONTINUING_FRAGMENT;
+
+      packet[0] = HCI_PACKET_ACL_DATA;
+      setUint16Value(packet + 1, device->connectionHandle | boundary);
+      setUint16Value(packet + 3, fragmentLength);
+
+      if (! acquireCredit(controller, device))
+      {
+         status = isDeviceConnected(device) ? LB_OPERATION_TIMEOUT : LB_DEVICE_NOT_CONNECTED;
+         break;
+      }
+
+      const uint32_t packetLength = sizeof(struct HCI_ACLDataHeader) + fragmentLength;
+
+      if (lbDebugLevel > 100)
+      {
+         printf("# Send: ");
+         utl_printBuffer(packet, packetLength);
+         putchar('\n');
+         fflush(stdout);
+      }
+
+      os_lock(controller->writeLock);
+      io_sendData(controller->channel, packet, packetLength);
+      io_waitForTransmitComplete(controller->channel);
+      os_unlock(controller->writeLock);
+
+      offset += fragmentLength;
+   }
+
+   os_unlock(device->acl.txLock);
+
+   return status;
+}
+
+/*
+ * Number of handles, followed by (connection handle, completed packets) pairs
+ */
+void hci_on_numberOfCompletedPackets(struct LB_Controller* controller, const uint8_t* event, uint8_t length)
+{
+   if (0 == length)
+   {
+      return;
+   }
+
+   const uint8_t handleCount = event[0];
+
+   for (uint8_t ii = 0; (ii < handleCount) && ((1u + 4u * (ii + 1u)) <= length); ii ++)
+   {
+      const uint8_t* entry = event + 1 + 4 * ii;
+
+      uint16_t connectionHandle = (entry[0] | (((uint16_t) entry[1]) << 8)) & HCI_ACL_HANDLE_MASK;
+      uint16_t completed        = entry[2] | (((uint16_t) entry[3]) << 8);
+
+      struct LB_Device* device = getDevice(controller, connectionHandle);
+      if (device)
+      {
+         returnCredits(controller, device, completed);
+      }
+   }
+}
+
+/*
+ * The controller frees the buffers of a disconnected link without
+ * reporting them as completed.
+ */
+void hci_releaseACLCredits(struct LB_Device* device)
+{
+   returnCredits(device->controller, device, UINT32_MAX);
+
+   device->acl.rxExpected = 0;
+   device->acl.rxLength   = 0;
+}
+
+static void dispatchFrame(struct LB_Device* device, const uint8_t* frame, uint16_t length)
+{
+   const uint16_t channelId = frame[2] | (((uint16_t) frame[3]) << 8);
+
+   switch (channelId)
+   {
+      case L2CAP_CID_ATT:
+         att_on_receive(device, frame + L2CAP_HEADER_LENGTH, length - L2CAP_HEADER_LENGTH);
+         break;
+
+      case L2CAP_CID_LE_SIGNALING:
+         l2cap_on_signaling(device, frame + L2CAP_HEADER_LENGTH, length - L2CAP_HEADER_LENGTH);
+         break;
+
+      default:
+         if (L2CAP_CID_DYNAMIC_FIRST <= channelId)
+         {
+            l2cap_on_receive(device, channelId, frame + L2CAP_HEADER_LENGTH, length - L2CAP_HEADER_LENGTH);
+         }
+         else if (lbDebugLevel > 100)
+         {
+            printf("L2CAP frame on channel %04x -- ", (unsigned) channelId);
+            utl_printBuffer(frame, length);
+            putchar('\n');
+         }
+         break;
+   }
+}
+
+/*
+ * Frames contained in a single ACL packet are dispatched in place; others
+ * are reassembled in the per-link buffer.
+ */
+void hci_on_ACLData(struct LB_Controller* controller, const uint8_t* packet, uint16_t length)
+{
+   const struct HCI_ACLDataHeader* header = (const struct HCI_ACLDataHeader*) packet;
+
+   const uint16_t handle           = uint16Value(&header->handle);
+   const uint16_t connectionHandle = handle & HCI_ACL_HANDLE_MASK;
+
+   const uint8_t* payload       = packet + sizeof(struct HCI_ACLDataHeader);
+   const uint16_t payloadLength = length - sizeof(struct HCI_ACLDataHeader);
+
+   struct LB_Device* device = getDevice(controller, connectionHandle);
+   if (! device)
+   {
+      return;
+   }
+
+   if (HCI_ACL_CONTINUING_FRAGMENT == (handle & HCI_ACL_BOUNDARY_MASK))
+   {
+      if (0 == device->acl.rxExpected)
+      {
+         // the start of this frame was dropped
+         return;
+      }
+
+      if ((device->acl.rxLength + payloadLength) > device->acl.rxExpected)
+      {
+         if (lbDebugLevel > 100)
+         {
+            printf("Dropping overlong L2CAP frame on %04x\n", (unsigned) connectionHandle);
+         }
+         device->acl.rxExpected = 0;
+         return;
+      }
+
+      memcpy(device->acl.rx + device->acl.rxLength, payload, payloadLength);
+      device->acl.rxLength += payloadLength;
+
+      if (device->acl.rxLength == device->acl.rxExpected)
+      {
+         device->acl.rxExpected = 0;
+         dispatchFrame(device, device->acl.rx, device->acl.rxLength);
+      }
+
+      return;
+   }
+
+   // start of a new frame; any partial one is abandoned
+   device->acl.rxExpected = 0;
+
+   if (L2CAP_HEADER_LENGTH > payloadLength)
+   {
+      return;
+   }
+
+   const uint32_t frameLength = L2CAP_HEADER_LENGTH + (payload[0] | (((uint16_t) payload[1]) << 8));
+
+   if (frameLength == payloadLength)
+   {
+      dispatchFrame(device, payload, payloadLength);
+   }
+   else if ((frameLength > payloadLength) && (frameLength <= sizeof(device->acl.rx)))
+   {
+      memcpy(device->acl.rx, payload, payloadLength);
+      device->acl.rxLength   = payloadLength;
+      device->acl.rxExpected = (uint16_t) frameLength;
+   }
+   else if (lbDebugLevel > 100)
+   {
+      printf("Dropping L2CAP frame of %u bytes on %04x\n", (unsigned) frameLength, (unsigned) connectionHandle);
+   }
+}
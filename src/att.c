@@ -0,0 +1,345 @@
+/**
+ * @file att.c
+ * @brief Host Attribute Protocol client
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+
+#include <osal_core.h>
+#include <utils.h>
+
+#include <att.h>
+#include <commands.h>
+
+#include "lb_priv.h"
+#include "hci_priv.h"
+
+void att_initialize(struct LB_Device* device)
+{
+   device->att.responseReceived = os_acquireCompletion(device->controller->completions);
+   device->att.responseTicket   = 0;
+   device->att.pendingRequest   = 0;
+   device->att.responseLength   = 0;
+   device->att.mtu              = ATT_DEFAULT_MTU;
+}
+
+void att_cleanup(struct LB_Device* device)
+{
+   if (device->att.responseReceived)
+   {
+      os_releaseCompletion(device->att.responseReceived);
+      device->att.responseReceived = NULL;
+   }
+}
+
+/*
+ * Returns the request a response PDU answers, or 0 if the PDU is not a response
+ */
+static uint8_t getRequestOpcode(const uint8_t* pdu, uint16_t length)
+{
+   const uint8_t opcode = pdu[0];
+
+   if (ATT_ERROR_RSP == opcode)
+   {
+      return (2 <= length) ? pdu[1] : 0;
+   }
+
+   if ((ATT_EXCHANGE_MTU_RSP <= opcode) && (ATT_EXECUTE_WRITE_RSP >= opcode) && (opcode & 0x01))
+   {
+      return opcode - 1;
+   }
+
+   return 0;
+}
+
+static void sendConfirmation(void* arg)
+{
+   struct LB_Device* device = (struct LB_Device*) arg;
+
+   if (isDeviceConnected(device))
+   {
+      const uint8_t confirmation = ATT_HANDLE_VALUE_CFM;
+      hci_sendACLData(device, L2CAP_CID_ATT, &confirmation, sizeof(confirmation));
+   }
+}
+
+/*
+ * Called from the I/O thread
+ */
+void att_on_receive(struct LB_Device* device, const uint8_t* pdu, uint16_t length)
+{
+   if (0 == length)
+   {
+      return;
+   }
+
+   switch (pdu[0])
+   {
+      case ATT_HANDLE_VALUE_NTF:
+      case ATT_HANDLE_VALUE_IND:
+         if (3 <= length)
+         {
+            uint16_t attributeHandle = pdu[1] | (((uint16_t) pdu[2]) << 8);
+            lb_on_receivedNotification(device, attributeHandle, 0, pdu + 3, (uint8_t) (length - 3));
+
+            if (ATT_HANDLE_VALUE_IND == pdu[0])
+            {
+               // sending waits for controller buffers; not allowed on this thread
+               os_executeLater(0, sendConfirmation, device);
+            }
+         }
+         break;
+
+      default:
+         {
+            const uint8_t request = getRequestOpcode(pdu, length);
+
+            if (request && (request == device->att.pendingRequest))
+            {
+               if (length > sizeof(device->att.response))
+               {
+                  length = sizeof(device->att.response);
+               }
+
+               memcpy(device->att.response, pdu, length);
+               device->att.responseLength = (uint8_t) length;
+               device->att.pendingRequest = 0;
+
+               os_signalCompletion(device->att.responseReceived, device->att.responseTicket, NULL);
+            }
+            else if (lbDebugLevel > 100)
+            {
+               printf("Unexpected ATT PDU -- ");
+               utl_printBuffer(pdu, length);
+               putchar('\n');
+            }
+         }
+         break;
+   }
+}
+
+void att_on_disconnected(struct LB_Device* device)
+{
+   if (device->att.pendingRequest)
+   {
+      device->att.pendingRequest = 0;
+      device->att.responseLength = 0;
+      os_signalCompletion(device->att.responseReceived, device->att.responseTicket, NULL);
+   }
+}
+
+/*
+ * Sends a request and waits for the matching response, or an error
+ * response for it; the response is left in device->att.response.
+ */
+static enum LB_STATUS executeRequest(struct LB_Device* device, const uint8_t* request, uint16_t length)
+{
+   if (length > device->att.mtu)
+   {
+      return LB_INVALID_PARAMETERS;
+   }
+
+   device->att.responseLength = 0;
+   device->att.responseTicket = os_armCompletion(device->att.responseReceived);
+   device->att.pendingRequest = request[0];
+
+   enum LB_STATUS status = hci_sendACLData(device, L2CAP_CID_ATT, request, length);
+   if (LB_OK != status)
+   {
+      device->att.pendingRequest = 0;
+      return status;
+   }
+
+   bool signaled = os_waitForCompletion(device->att.responseReceived, device->att.responseTicket, device->controller->timeouts.attTransaction_ms, NULL);
+   if (! signaled)
+   {
+      device->att.pendingRequest = 0;
+      return LB_OPERATION_TIMEOUT;
+   }
+
+   if (0 == device->att.responseLength)
+   {
+      // disconnected while waiting
+      return LB_DEVICE_NOT_CONNECTED;
+   }
+
+   return LB_OK;
+}
+
+static bool isErrorResponse(struct LB_Device* device, uint8_t* errorCode)
+{
+   if (ATT_ERROR_RSP == device->att.response[0])
+   {
+      *errorCode = (5 <= device->att.responseLength) ? device->att.response[4] : ATT_ERR_UNLIKELY;
+      return true;
+   }
+
+   return false;
+}
+
+enum LB_STATUS att_discoverPrimaryServices(struct LB_Device* device)
+{
+   uint16_t startHandle = 0x0001;
+
+   while (true)
+   {
+      uint8_t request[] =
+      {
+         ATT_READ_BY_GROUP_TYPE_REQ,
+         startHandle & 0xFF,
+         startHandle >> 8,
+         0xFF, 0xFF,                      // end handle
+         GATT_PRIMARY_SERVICE & 0xFF,
+         GATT_PRIMARY_SERVICE >> 8,
+      };
+
+      enum LB_STATUS status = executeRequest(device, request, sizeof(request));
+      if (LB_OK != status)
+      {
+         return status;
+      }
+
+      uint8_t errorCode;
+      if (isErrorResponse(device, &errorCode))
+      {
+         // the end of the attribute range is reported as an error
+         return (ATT_ERR_ATTRIBUTE_NOT_FOUND == errorCode) ? LB_OK : LB_FAILURE;
+      }
+
+      const uint8_t* response = device->att.response;
+      const uint8_t attributeDataLength = response[1];
+
+      if ((2 > device->att.responseLength) || ((6 != attributeDataLength) && (20 != attributeDataLength)))
+      {
+         return LB_FAILURE;
+      }
+
+      uint16_t endGroupHandle = 0;
+
+      for (const uint8_t* attributeData = response + 2;
+            (attributeData + attributeDataLength) <= (response + device->att.responseLength);
+            attributeData += attributeDataLength)
+      {
+         uint16_t attributeHandle = attributeData[0] | (((uint16_t) attributeData[1]) << 8);
+         endGroupHandle           = attributeData[2] | (((uint16_t) attributeData[3]) << 8);
+
+         lb_on_discoveredPrimaryService(device, attributeHandle, endGroupHandle, attributeData + 4, attributeDataLength - 4);
+      }
+
+      if ((0xFFFF == endGroupHandle) || (endGroupHandle < startHandle))
+      {
+         return LB_OK;
+      }
+
+      startHandle = endGroupHandle + 1;
+   }
+}
+
+enum LB_STATUS att_read(struct LB_Device* device, uint16_t attributeHandle)
+{
+   const uint8_t request[] =
+   {
+      ATT_READ_REQ,
+      attributeHandle & 0xFF,
+      attributeHandle >> 8,
+   };
+
+   enum LB_STATUS status = executeRequest(device, request, sizeof(request));
+   if (LB_OK != status)
+   {
+      return status;
+   }
+
+   uint8_t errorCode;
+   if (isErrorResponse(device, &errorCode))
+   {
+      return LB_FAILURE;
+   }
+
+   struct lb_operation* operation = operation_acquire(device, PO_MASK(PO_READ));
+   if (operation)
+   {
+      uint8_t valueLength = device->att.responseLength - 1;
+      if (valueLength > operation->request.readCapacity)
+      {
+         valueLength = operation->request.readCapacity;
+      }
+
+      memcpy(operation->request.readValue, device->att.response + 1, valueLength);
+      *operation->request.readLength = valueLength;
+
+      operation_release(operation);
+   }
+
+   return LB_OK;
+}
+
+/*
+ * Write Command: no response, so the only flow control is the controller
+ * buffers
+ */
+enum LB_STATUS att_writeCommand(struct LB_Device* device, uint16_t attributeHandle, const uint8_t* attributeValue, uint8_t attributeLength)
+{
+   uint8_t command[LB_ATT_MAX_PDU];
+
+   if (((3u + attributeLength) > sizeof(command)) || ((3u + attributeLength) > device->att.mtu))
+   {
+      return LB_INVALID_PARAMETERS;
+   }
+
+   command[0] = ATT_WRITE_CMD;
+   command[1] = attributeHandle & 0xFF;
+   command[2] = attributeHandle >> 8;
+   memcpy(command + 3, attributeValue, attributeLength);
+
+   return hci_sendACLData(device, L2CAP_CID_ATT, command, 3 + attributeLength);
+}
+
+enum LB_STATUS att_write(struct LB_Device* device, uint16_t attributeHandle, const uint8_t* attributeValue, uint8_t attributeLength)
+{
+   uint8_t request[LB_ATT_MAX_PDU];
+
+   if ((3u + attributeLength) > sizeof(request))
+   {
+      return LB_INVALID_PARAMETERS;
+   }
+
+   request[0] = ATT_WRITE_REQ;
+   request[1] = attributeHandle & 0xFF;
+   request[2] = attributeHandle >> 8;
+   memcpy(request + 3, attributeValue, attributeLength);
+
+   enum LB_STATUS status = executeRequest(device, request, 3 + attributeLength);
+   if (LB_OK != status)
+   {
+      return status;
+   }
+
+   uint8_t errorCode;
+   if (isErrorResponse(device, &errorCode))
+   {
+      return LB_FAILURE;
+   }
+
+   return LB_OK;
+}
@@ -96,15 +96,23 @@ static void processBuffer(struct LB_Controller* controller)
                   hci_on_eventCommandStatus(controller, (const struct HCI_EVENT_Command_Status*) ptr, header->length);
                   break;
 
+               case HCI_EVENTID_Number_Of_Completed_Packets:
+                  hci_on_numberOfCompletedPackets(controller, (const uint8_t*) ptr, header->length);
+                  break;
+
                case HCI_EVENTID_Meta:
-                  if (controller->vendorFunctions)
+                  if (controller->vendorFunctions && controller->vendorFunctions->on_metaEvent)
                   {
                      controller->vendorFunctions->on_metaEvent(controller, (const uint8_t*) ptr, header->length);
                   }
+                  else
+                  {
+                     hci_on_metaEvent(controller, (const uint8_t*) ptr, header->length);
+                  }
                   break;
 
                case HCI_EVENTID_Vendor_Specific:
-                  if (controller->vendorFunctions)
+                  if (controller->vendorFunctions && controller->vendorFunctions->on_vendorSpecificEvent)
                   {
                      controller->vendorFunctions->on_vendorSpecificEvent(controller, (const uint8_t*) ptr, header->length);
                   }
@@ -120,8 +128,38 @@ static void processBuffer(struct LB_Controller* controller)
          }
          else
          {
-            // incomplete packet
-            memmove(controller->buffer, buffer, length);
+            // incomplete packet, kept for the next read
+            break;
+         }
+      }
+      else if (HCI_PACKET_ACL_DATA == *buffer)
+      {
+         const struct HCI_ACLDataHeader* header = (struct HCI_ACLDataHeader*) buffer;
+
+         uint32_t packetLength = 0;
+         if (sizeof(struct HCI_ACLDataHeader) <= length)
+         {
+            packetLength = sizeof(struct HCI_ACLDataHeader) + uint16Value(&header->length);
+         }
+
+         if (packetLength > sizeof(controller->buffer))
+         {
+            // corrupt data
+            memset(controller->buffer, 0, sizeof(controller->buffer));
+            length = 0;
+            break;
+         }
+
+         if (packetLength && (packetLength <= length))
+         {
+            hci_on_ACLData(controller, buffer, (uint16_t) packetLength);
+
+            buffer += packetLength;
+            length -= packetLength;
+         }
+         else
+         {
+            // incomplete packet, kept for the next read
             break;
          }
       }
@@ -134,6 +172,12 @@ static void processBuffer(struct LB_Controller* controller)
       }
    }
 
+   // move the incomplete packet, if any, to the start of the buffer
+   if (length && (buffer != controller->buffer))
+   {
+      memmove(controller->buffer, buffer, length);
+   }
+
    controller->length = length;
 }
 
@@ -159,7 +203,12 @@ enum LB_STATUS lb_executeCommand(struct LB_Controller* controller, const uint8_t
 {
    assert(4 <= commandLength);
    uint16_t opcode = (((uint16_t) command[2]) << 8) | command[1];
-   struct hci_condition* cond = allocateCondition(opcode, response, maxResponseLength);
+   struct hci_condition* cond = allocateCondition(controller, opcode, response, maxResponseLength);
+   if (! cond)
+   {
+      // as many commands in flight as there are slots
+      return LB_FAILURE;
+   }
 
    if (lbDebugLevel > 100)
    {
@@ -169,12 +218,13 @@ enum LB_STATUS lb_executeCommand(struct LB_Controller* controller, const uint8_t
       fflush(stdout);
    }
 
+   os_lock(controller->writeLock);
    io_sendData(controller->channel, command, commandLength);
-
    io_waitForTransmitComplete(controller->channel);
+   os_unlock(controller->writeLock);
 
    uint8_t responseLength = 0;
-   enum HCI_StatusCode status = waitForCondition(cond, &responseLength);
+   enum HCI_StatusCode status = waitForCondition(controller, cond, controller->timeouts.command_ms, &responseLength);
 
    if (HCI_STATUS_SUCCESS == status)
    {
@@ -204,25 +254,69 @@ enum LB_STATUS lb_resetHCI(struct LB_Controller* controller)
 
 extern struct lb_vendorFunctions lb_vendorFunctions_ST;
 extern struct lb_vendorFunctions lb_vendorFunctions_TI;
+extern struct lb_vendorFunctions lb_vendorFunctions_HCI;
 
-enum LB_STATUS lb_initializeHCI(struct LB_Controller* controller)
+enum LB_STATUS lb_setControllerConfig(struct LB_Controller* controller, const struct LB_ControllerConfig* config)
 {
-   enum LB_STATUS status = LB_OK;
-
-   status = lb_resetHCI(controller);
+   if ((0 == config->maxConnections) || (LB_MAX_DEVICES < config->maxConnections))
+   {
+      return LB_INVALID_PARAMETERS;
+   }
 
-   if (LB_OK == status)
+   if (0 != getConnectionCount(controller))
    {
-      struct HCI_RESPONSE_Read_Local_Version_Information version;
+      return LB_FAILURE;
+   }
 
-      status = lb_readLocalVersionInformation(controller, &version);
+   controller->config = *config;
 
-      if (LB_OK == status)
-      {
-         controller->manufacturerId = (unsigned int) uint16Value(&version.manufacturerId);
-      }
-   }
+   return LB_OK;
+}
 
+static const struct LB_Timeouts DEFAULT_TIMEOUTS =
+{
+   .command_ms          = 1000,
+   .connect_ms          = 2000,
+   .disconnect_ms       = 1000,
+   .serviceDiscovery_ms = 10 * 1000,
+   .connectionUpdate_ms = 1000,
+   .read_ms             = 1000,
+   .write_ms            = 1000,
+   .attTransaction_ms   = 30 * 1000,      // Vol 3, Part F, 3.3.3
+   .signaling_ms        = 30 * 1000,      // Vol 3, Part A, 6.2.1
+   .aclCredit_ms        = 1000,
+   .channelCredit_ms    = 10 * 1000,
+};
+
+static inline uint32_t selectTimeout(uint32_t timeout_ms, uint32_t default_ms)
+{
+   return timeout_ms ? timeout_ms : default_ms;
+}
+
+void lb_setTimeouts(struct LB_Controller* controller, const struct LB_Timeouts* timeouts)
+{
+   struct LB_Timeouts* current = &controller->timeouts;
+
+   current->command_ms          = selectTimeout(timeouts->command_ms,          DEFAULT_TIMEOUTS.command_ms);
+   current->connect_ms          = selectTimeout(timeouts->connect_ms,          DEFAULT_TIMEOUTS.connect_ms);
+   current->disconnect_ms       = selectTimeout(timeouts->disconnect_ms,       DEFAULT_TIMEOUTS.disconnect_ms);
+   current->serviceDiscovery_ms = selectTimeout(timeouts->serviceDiscovery_ms, DEFAULT_TIMEOUTS.serviceDiscovery_ms);
+   current->connectionUpdate_ms = selectTimeout(timeouts->connectionUpdate_ms, DEFAULT_TIMEOUTS.connectionUpdate_ms);
+   current->read_ms             = selectTimeout(timeouts->read_ms,             DEFAULT_TIMEOUTS.read_ms);
+   current->write_ms            = selectTimeout(timeouts->write_ms,            DEFAULT_TIMEOUTS.write_ms);
+   current->attTransaction_ms   = selectTimeout(timeouts->attTransaction_ms,   DEFAULT_TIMEOUTS.attTransaction_ms);
+   current->signaling_ms        = selectTimeout(timeouts->signaling_ms,        DEFAULT_TIMEOUTS.signaling_ms);
+   current->aclCredit_ms        = selectTimeout(timeouts->aclCredit_ms,        DEFAULT_TIMEOUTS.aclCredit_ms);
+   current->channelCredit_ms    = selectTimeout(timeouts->channelCredit_ms,    DEFAULT_TIMEOUTS.channelCredit_ms);
+}
+
+void lb_getTimeouts(struct LB_Controller* controller, struct LB_Timeouts* timeouts)
+{
+   *timeouts = controller->timeouts;
+}
+
+static void selectVendorFunctions(struct LB_Controller* controller)
+{
    switch (controller->manufacturerId)
    {
       case 0x0D:
@@ -234,17 +328,46 @@ enum LB_STATUS lb_initializeHCI(struct LB_Controller* controller)
          break;
 
       default:
+         // no vendor extensions; use the standard commands
+         controller->vendorFunctions = &lb_vendorFunctions_HCI;
          break;
    }
+}
 
-   if (controller->vendorFunctions)
+enum LB_STATUS lb_initializeHCI(struct LB_Controller* controller)
+{
+   enum LB_STATUS status = LB_OK;
+
+   controller->maxConnections = controller->config.maxConnections;
+
+   state_onReset(controller);
+
+   status = lb_resetHCI(controller);
+
+   if (LB_OK == status)
    {
-      status = controller->vendorFunctions->initializeHCI(controller);
+      struct HCI_RESPONSE_Read_Local_Version_Information version;
+
+      status = lb_readLocalVersionInformation(controller, &version);
+
+      if (LB_OK == status)
+      {
+         controller->manufacturerId = (unsigned int) uint16Value(&version.manufacturerId);
+      }
    }
-   else
+
+   if (LB_OK != status)
    {
-      status = LB_UNKNOWN_VENDOR;
-      printf("%% Unknown HCI vendor %x\n", (unsigned) controller->manufacturerId);
+      return status;
+   }
+
+   selectVendorFunctions(controller);
+
+   status = controller->vendorFunctions->initializeHCI(controller);
+
+   if ((LB_OK == status) && controller->config.standardScan && (&lb_vendorFunctions_HCI != controller->vendorFunctions))
+   {
+      status = hci_enableLEEvents(controller);
    }
 
    return status;
@@ -252,62 +375,339 @@ enum LB_STATUS lb_initializeHCI(struct LB_Controller* controller)
 
 enum LB_STATUS lb_configureAsCentral(struct LB_Controller* controller)
 {
-   enum LB_STATUS status = LB_UNKNOWN_VENDOR;
+   // the standard commands need no role configuration
+   enum LB_STATUS status = LB_OK;
 
    if (controller->vendorFunctions)
    {
       status = controller->vendorFunctions->configureAsCentral(controller);
+
+      if (LB_OK == status)
+      {
+         state_onConfigured(controller);
+      }
    }
-   else
+
+   return status;
+}
+
+static void setUpDevice(struct LB_Device* device, struct LB_Controller* controller, const uint8_t* address, uint16_t handle, uint16_t interval, uint16_t latency, uint16_t supervisionTimeout)
+{
+   device->controller       = controller;
+
+   operation_initialize(device);
+   acl_initialize(device);
+   att_initialize(device);
+   l2cap_initialize(device);
+
+   memcpy(device->address, address, sizeof(device->address));
+
+   device->connectionHandle = handle;
+   device->linkLost         = false;
+
+   device->connectionParameters.interval           = interval;
+   device->connectionParameters.latency            = latency;
+   device->connectionParameters.supervisionTimeout = supervisionTimeout;
+
+   device->disconnect.completion = NULL;
+   device->disconnect.ticket     = 0;
+
+   state_recordDevice(device);
+}
+
+/*
+ * Frees the host resources of a device; the link and its record are left alone
+ */
+static void releaseDevice(struct LB_Device* device)
+{
+   l2cap_cleanup(device);
+   att_cleanup(device);
+   acl_cleanup(device);
+   operation_cleanup(device);
+
+   device->controller       = NULL;
+   device->connectionHandle = INVALID_CONNECTION_HANDLE;
+}
+
+static void tearDownDevice(struct LB_Device* device)
+{
+   state_forgetDevice(device);
+
+   releaseDevice(device);
+}
+
+/*
+ * The links stay up in the controller, and stay recorded for a later
+ * lb_attachHCI
+ */
+void detachDevices(struct LB_Controller* controller)
+{
+   for (uint32_t ii = 0; ii < LB_MAX_DEVICES; ii ++)
    {
-      printf("%% Unknown HCI vendor %x\n", (unsigned) controller->manufacturerId);
+      struct LB_Device* device = &controller->device[ii];
+
+      if (INVALID_CONNECTION_HANDLE != device->connectionHandle)
+      {
+         releaseDevice(device);
+      }
    }
+}
 
-   return status;
+static bool isLinkAlive(struct LB_Controller* controller, uint16_t connectionHandle)
+{
+   const uint8_t cmd[] =
+   {
+      HCI_PACKET_COMMAND,
+      HCI_READ_RSSI & 0xFF,
+      HCI_READ_RSSI >> 8,
+      2,                                     // parameter length
+      connectionHandle & 0xFF,
+      connectionHandle >> 8,
+   };
+
+   struct HCI_RESPONSE_Read_RSSI response;
+
+   // fails with Unknown Connection Identifier once the link is gone
+   return LB_OK == lb_executeCommand(controller, cmd, sizeof(cmd), (uint8_t*) &response, sizeof(response));
 }
 
-enum LB_STATUS lb_startDeviceDiscovery(struct LB_Controller* controller)
+/*
+ * Takes over the recorded links the controller still has, in the slots
+ * they were recorded in
+ */
+static uint32_t restoreDevices(struct LB_Controller* controller)
 {
-   enum LB_STATUS status = LB_UNKNOWN_VENDOR;
+   uint32_t count = 0;
 
-   if (controller->vendorFunctions)
+   for (uint32_t ii = 0; ii < controller->maxConnections; ii ++)
    {
-      status = controller->vendorFunctions->startDeviceDiscovery(controller);
+      struct lb_savedDevice saved;
+
+      if (! state_getSavedDevice(controller, ii, &saved))
+      {
+         continue;
+      }
+
+      // tracked before the check, so a disconnection racing with it is not lost
+      struct LB_Device* device = &controller->device[ii];
+      setUpDevice(device, controller, saved.address, saved.connectionHandle, saved.interval, saved.latency, saved.supervisionTimeout);
+
+      if (isLinkAlive(controller, saved.connectionHandle))
+      {
+         count ++;
+      }
+      else
+      {
+         tearDownDevice(device);
+      }
    }
-   else
+
+   return count;
+}
+
+enum LB_STATUS lb_attachHCI(struct LB_Controller* controller, uint32_t* restored)
+{
+   *restored = 0;
+
+   if (0 != getConnectionCount(controller))
    {
-      printf("%% Unknown HCI vendor %x\n", (unsigned) controller->manufacturerId);
+      return LB_FAILURE;
+   }
+
+   // the controller must answer before anything else is trusted
+   struct HCI_RESPONSE_Read_Local_Version_Information version;
+
+   enum LB_STATUS status = lb_readLocalVersionInformation(controller, &version);
+   if (LB_OK != status)
+   {
+      return status;
+   }
+
+   const uint16_t manufacturerId = uint16Value(&version.manufacturerId);
+
+   if (state_isConfigured(controller, manufacturerId))
+   {
+      controller->manufacturerId = manufacturerId;
+      controller->maxConnections = controller->config.maxConnections;
+
+      selectVendorFunctions(controller);
+
+      status = controller->vendorFunctions->attachHCI(controller);
+
+      if ((LB_OK == status) && controller->config.standardScan && (&lb_vendorFunctions_HCI != controller->vendorFunctions))
+      {
+         status = hci_enableLEEvents(controller);
+      }
+
+      if (LB_OK == status)
+      {
+         *restored = restoreDevices(controller);
+      }
+
+      if (*restored)
+      {
+         scan_onConnectionsChanged(controller);
+         return LB_OK;
+      }
+   }
+
+   // no link to keep, so a reset costs nothing
+   status = lb_initializeHCI(controller);
+
+   if (LB_OK == status)
+   {
+      status = lb_configureAsCentral(controller);
    }
 
    return status;
 }
 
-enum LB_STATUS lb_stopDeviceDiscovery(struct LB_Controller* controller)
+static const struct LB_ConnectionParameters connectionProfiles[] =
 {
-   enum LB_STATUS status = LB_UNKNOWN_VENDOR;
-
-   if (controller->vendorFunctions)
+   [LB_CONNECTION_PROFILE_DEFAULT] =
+   {
+      .intervalMin         = 0x0014,      // 25 ms
+      .intervalMax         = 0x0028,      // 50 ms
+      .latency             = 0,
+      .supervisionTimeout  = 0x0064,      // 1 s
+      .minCELength         = 0x0002,
+      .maxCELength         = 0x0002,
+   },
+   [LB_CONNECTION_PROFILE_LOW_LATENCY] =
+   {
+      .intervalMin         = 0x0006,      // 7.5 ms
+      .intervalMax         = 0x0006,      // 7.5 ms
+      .latency             = 0,
+      .supervisionTimeout  = 0x0064,      // 1 s
+      .minCELength         = 0x0000,
+      .maxCELength         = 0x0004,
+   },
+   [LB_CONNECTION_PROFILE_THROUGHPUT] =
    {
-      status = controller->vendorFunctions->stopDeviceDiscovery(controller);
+      .intervalMin         = 0x0006,      // 7.5 ms
+      .intervalMax         = 0x000C,      // 15 ms
+      .latency             = 0,
+      .supervisionTimeout  = 0x00C8,      // 2 s
+      .minCELength         = 0x000C,
+      .maxCELength         = 0x0018,
+   },
+   [LB_CONNECTION_PROFILE_POWER_SAVE] =
+   {
+      .intervalMin         = 0x0190,      // 500 ms
+      .intervalMax         = 0x0320,      // 1 s
+      .latency             = 2,
+      .supervisionTimeout  = 0x0320,      // 8 s
+      .minCELength         = 0x0002,
+      .maxCELength         = 0x0002,
+   },
+};
+
+const struct LB_ConnectionParameters* lb_getConnectionProfile(enum LB_ConnectionProfile profile)
+{
+   if ((uint32_t) profile < (sizeof(connectionProfiles) / sizeof(connectionProfiles[0])))
+   {
+      return &connectionProfiles[profile];
    }
    else
    {
-      printf("%% Unknown HCI vendor %x\n", (unsigned) controller->manufacturerId);
+      return NULL;
    }
+}
 
-   return status;
+/*
+ * Bluetooth Core Specification v4.2, Vol 2, Part E, 7.8.12
+ */
+static bool areConnectionParametersValid(const struct LB_ConnectionParameters* parameters)
+{
+   if ((parameters->intervalMin < 0x0006) || (parameters->intervalMax > 0x0C80) || (parameters->intervalMin > parameters->intervalMax))
+   {
+      return false;
+   }
+
+   if (parameters->latency > 0x01F3)
+   {
+      return false;
+   }
+
+   if ((parameters->supervisionTimeout < 0x000A) || (parameters->supervisionTimeout > 0x0C80))
+   {
+      return false;
+   }
+
+   if (parameters->minCELength > parameters->maxCELength)
+   {
+      return false;
+   }
+
+   /*
+    * the supervision timeout (10 ms units) must be larger than
+    * (1 + latency) * intervalMax * 2 (1.25 ms units)
+    */
+   const uint32_t minimumTimeout_us = (1 + (uint32_t) parameters->latency) * parameters->intervalMax * 1250 * 2;
+   if (((uint32_t) parameters->supervisionTimeout * 10000) <= minimumTimeout_us)
+   {
+      return false;
+   }
+
+   return true;
 }
 
 enum LB_STATUS lb_openDeviceConnection(struct LB_Controller* controller, const uint8_t* address, struct LB_Device** device)
 {
+   return lb_openDeviceConnectionWithParameters(controller, address, &connectionProfiles[LB_CONNECTION_PROFILE_DEFAULT], device);
+}
+
+enum LB_STATUS lb_openDeviceConnectionWithParameters(struct LB_Controller* controller, const uint8_t* address, const struct LB_ConnectionParameters* parameters, struct LB_Device** device)
+{
+   if (! areConnectionParametersValid(parameters))
+   {
+      *device = NULL;
+      return LB_INVALID_PARAMETERS;
+   }
+
    os_lock(controller->operationLock);
-   os_resetCondition(controller->operationComplete);
 
    enum LB_STATUS status = LB_UNKNOWN_VENDOR;
 
+   if (getConnectionCount(controller) >= controller->maxConnections)
+   {
+      *device = NULL;
+      status = LB_CONNECTION_LIMIT_REACHED;
+      goto done;
+   }
+
+   /*
+    * With several links sharing the radio, each connection event must leave
+    * room for the others: cap the connection event length (0.625 ms units)
+    * to an equal share of the shortest connection interval (1.25 ms units).
+    */
+   struct LB_ConnectionParameters scheduledParameters = *parameters;
+   if (1 < controller->maxConnections)
+   {
+      const uint16_t ceShare = (uint16_t) ((2 * (uint32_t) parameters->intervalMin) / controller->maxConnections);
+      if (scheduledParameters.maxCELength > ceShare)
+      {
+         scheduledParameters.maxCELength = ceShare;
+      }
+      if (scheduledParameters.minCELength > scheduledParameters.maxCELength)
+      {
+         scheduledParameters.minCELength = scheduledParameters.maxCELength;
+      }
+   }
+
+   // connection establishment and discovery cannot run concurrently
+   scan_suspend(controller);
+
+   struct os_completion* completion = os_acquireCompletion(controller->completions);
+   assert(completion);
+
+   memcpy(controller->connect.address, address, sizeof(controller->connect.address));
+   controller->connect.ticket     = os_armCompletion(completion);
+   controller->connect.completion = completion;
+
    if (controller->vendorFunctions)
    {
-      status = controller->vendorFunctions->openDeviceConnection(controller, address);
+      status = controller->vendorFunctions->openDeviceConnection(controller, address, &scheduledParameters);
    }
    else
    {
@@ -315,7 +715,36 @@ enum LB_STATUS lb_openDeviceConnection(struct LB_Controller* controller, const u
    }
 
    void* arg = NULL;
-   bool signaled = os_waitForCondition(controller->operationComplete, 2000, &arg);
+   bool signaled = false;
+
+   if (LB_OK == status)
+   {
+      signaled = os_waitForCompletion(completion, controller->connect.ticket, controller->timeouts.connect_ms, &arg);
+
+      if ((! signaled) && controller->vendorFunctions->cancelDeviceConnection)
+      {
+         /*
+          * The controller reports the cancelled attempt as failed; if the link
+          * came up meanwhile, the cancel is rejected and the connection event
+          * is on its way instead.
+          */
+         controller->vendorFunctions->cancelDeviceConnection(controller);
+         signaled = os_waitForCompletion(completion, controller->connect.ticket, controller->timeouts.command_ms, &arg);
+      }
+   }
+
+   // a late connection event can no longer reach this request
+   controller->connect.completion = NULL;
+   os_releaseCompletion(completion);
+
+   scan_resume(controller);
+
+   if (LB_OK != status)
+   {
+      *device = NULL;
+      goto done;
+   }
+
    if (! signaled)
    {
       *device = NULL;
@@ -323,6 +752,14 @@ enum LB_STATUS lb_openDeviceConnection(struct LB_Controller* controller, const u
       goto done;
    }
 
+   if (! arg)
+   {
+      // a cancelled attempt is reported as an unknown connection
+      *device = NULL;
+      status = (HCI_NO_CONNECTION == controller->connect.status) ? LB_OPERATION_TIMEOUT : LB_CONNECTION_FAILED;
+      goto done;
+   }
+
    *device = (struct LB_Device*) arg;
    status = LB_OK;
 
@@ -333,12 +770,11 @@ done:
    return status;
 }
 
-void on_connectedToDevice(struct LB_Controller* controller, const uint8_t* address, uint16_t handle)
+void on_connectedToDevice(struct LB_Controller* controller, const uint8_t* address, uint16_t handle, uint16_t interval, uint16_t latency, uint16_t supervisionTimeout)
 {
    struct LB_Device* device = NULL;
 
-   uint32_t ii = 0;
-   while (ii < (sizeof(controller->device) / sizeof(controller->device[0])))
+   for (uint32_t ii = 0; ii < controller->maxConnections; ii ++)
    {
       if (INVALID_CONNECTION_HANDLE == controller->device[ii].connectionHandle)
       {
@@ -348,13 +784,24 @@ void on_connectedToDevice(struct LB_Controller* controller, const uint8_t* addre
    }
    assert(device);
 
-   device->controller       = controller;
-   device->connectionHandle = handle;
+   setUpDevice(device, controller, address, handle, interval, latency, supervisionTimeout);
 
-   device->operationLock     = os_createLock();
-   device->operationComplete = os_createCondition();
+   struct os_completion* completion = controller->connect.completion;
+   if (completion && (0 == memcmp(controller->connect.address, address, sizeof(controller->connect.address))))
+   {
+      os_signalCompletion(completion, controller->connect.ticket, device);
+   }
+}
 
-   os_signalCondition(controller->operationComplete, device);
+void on_connectionFailed(struct LB_Controller* controller, uint8_t status)
+{
+   // the controller makes one connection attempt at a time, so this is the pending one
+   struct os_completion* completion = controller->connect.completion;
+   if (completion)
+   {
+      controller->connect.status = status;
+      os_signalCompletion(completion, controller->connect.ticket, NULL);
+   }
 }
 
 enum LB_STATUS lb_closeDeviceConnection(struct LB_Device* device)
@@ -364,7 +811,22 @@ enum LB_STATUS lb_closeDeviceConnection(struct LB_Device* device)
    struct LB_Controller* controller = device->controller;
 
    os_lock(controller->operationLock);
-   os_resetCondition(controller->operationComplete);
+
+   if (device->linkLost)
+   {
+      // the handle may already name another link, which must not be dropped
+      tearDownDevice(device);
+
+      os_unlock(controller->operationLock);
+
+      return LB_OK;
+   }
+
+   struct os_completion* completion = os_acquireCompletion(controller->completions);
+   assert(completion);
+
+   device->disconnect.ticket     = os_armCompletion(completion);
+   device->disconnect.completion = completion;
 
    enum LB_STATUS status = LB_UNKNOWN_VENDOR;
 
@@ -377,8 +839,7 @@ enum LB_STATUS lb_closeDeviceConnection(struct LB_Device* device)
       printf("%% Unknown HCI vendor %x\n", (unsigned) controller->manufacturerId);
    }
 
-   void* arg = NULL;
-   bool signaled = os_waitForCondition(controller->operationComplete, 1000, &arg);
+   bool signaled = os_waitForCompletion(completion, device->disconnect.ticket, controller->timeouts.disconnect_ms, NULL);
    if (! signaled)
    {
       status = LB_OPERATION_TIMEOUT;
@@ -389,27 +850,63 @@ enum LB_STATUS lb_closeDeviceConnection(struct LB_Device* device)
 
 done:
 
-   os_destroyCondition(device->operationComplete);
-   os_destroyLock(device->operationLock);
+   device->disconnect.completion = NULL;
+   os_releaseCompletion(completion);
 
-   device->controller       = NULL;
-   device->connectionHandle = INVALID_CONNECTION_HANDLE;
+   tearDownDevice(device);
 
    os_unlock(controller->operationLock);
 
+   scan_onConnectionsChanged(controller);
+
    return status;
 }
 
 void on_disconnectedFromDevice(struct LB_Controller* controller, uint16_t connectionHandle, uint8_t reason)
 {
    struct LB_Device* device = getDevice(controller, connectionHandle);
+   if (! device)
+   {
+      return;
+   }
+
+   struct lb_operation* operation = operation_acquire(device, ~0u);
+   if (operation)
+   {
+      operation_complete(operation, LB_DEVICE_NOT_CONNECTED, NULL);
+   }
+
+   att_on_disconnected(device);
+   l2cap_on_disconnected(device);
+   hci_releaseACLCredits(device);
+
+   state_forgetDevice(device);
+
+   device->linkLost = true;
+
+   // peer-initiated drops change the background scan duty cycle too
+   scan_onConnectionsChanged(controller);
+
    lb_on_disconnectedFromDevice(device, reason);
 
-   os_signalCondition(controller->operationComplete, (void*) (uintptr_t) reason);
+   // the link is matched on its connection handle, so only its own close completes
+   struct os_completion* completion = device->disconnect.completion;
+   if (completion)
+   {
+      os_signalCompletion(completion, device->disconnect.ticket, NULL);
+   }
 }
 
-enum LB_STATUS lb_startServiceDiscovery(struct LB_Device* device)
+/*
+ * Checks the preconditions shared by the queued device requests
+ */
+static enum LB_STATUS checkDeviceRequest(struct LB_Device* device, enum LB_Priority priority)
 {
+   if (priority >= LB_PRIORITY_COUNT)
+   {
+      return LB_INVALID_PARAMETERS;
+   }
+
    if (! isDeviceConnected(device))
    {
       return LB_DEVICE_NOT_CONNECTED;
@@ -423,43 +920,27 @@ enum LB_STATUS lb_startServiceDiscovery(struct LB_Device* device)
       return LB_UNKNOWN_VENDOR;
    }
 
-   os_lock(device->operationLock);
-   assert(0 == device->pendingOperation.attributeHandle);
-   assert(PO_IDLE == device->pendingOperation.type);
-
-   device->pendingOperation.type            = PO_DISCOVER;
-
-   enum HCI_StatusCode status = HCI_HOST_TIMEOUT;
-
-   os_resetCondition(device->operationComplete);
-
-   enum LB_STATUS commandStatus = device->controller->vendorFunctions->startServiceDiscovery(device);
-   if (LB_OK != commandStatus)
-   {
-      goto done;
-   }
+   return LB_OK;
+}
 
-   void* operationStatus = NULL;
-   bool signaled = os_waitForCondition(device->operationComplete, 10 * 1000, &operationStatus);
-   if (! signaled)
+enum LB_STATUS lb_startServiceDiscovery(struct LB_Device* device)
+{
+   enum LB_STATUS status = checkDeviceRequest(device, LB_PRIORITY_NORMAL);
+   if (LB_OK != status)
    {
-      status = HCI_HOST_TIMEOUT;
-      goto done;
+      return status;
    }
 
-   if (NULL == operationStatus)
+   const struct lb_request request =
    {
-      status = HCI_STATUS_SUCCESS;
-   }
+      .type     = PO_DISCOVER,
+      .priority = LB_PRIORITY_NORMAL,
+   };
 
-done:
-
-   device->pendingOperation.attributeHandle = 0;
-   device->pendingOperation.type            = PO_IDLE;
-
-   os_unlock(device->operationLock);
+   void* operationStatus = NULL;
+   status = operation_execute(device, &request, device->controller->timeouts.serviceDiscovery_ms, &operationStatus);
 
-   if (HCI_STATUS_SUCCESS == status)
+   if ((LB_OK == status) && (NULL == operationStatus))
    {
       return LB_OK;
    }
@@ -469,20 +950,35 @@ done:
    }
 }
 
-void on_serviceDiscoveryComplete(struct LB_Controller* controller, uint16_t connectionHandle)
+enum LB_STATUS lb_startServiceDiscoveryAsync(struct LB_Device* device, LB_OperationCallback callback, void* context)
 {
-   struct LB_Device* device = getDevice(controller, connectionHandle);
+   enum LB_STATUS status = checkDeviceRequest(device, LB_PRIORITY_NORMAL);
+   if (LB_OK != status)
+   {
+      return status;
+   }
 
-   os_signalCondition(device->operationComplete, 0);
+   const struct lb_request request =
+   {
+      .type     = PO_DISCOVER,
+      .priority = LB_PRIORITY_NORMAL,
+   };
+
+   return operation_submit(device, &request, device->controller->timeouts.serviceDiscovery_ms, callback, context);
 }
 
-enum LB_STATUS lb_writeCharValue(struct LB_Device* device, uint16_t attributeHandle, const uint8_t* attributeValue, uint8_t attributeLength)
+enum LB_STATUS lb_updateConnectionParameters(struct LB_Device* device, const struct LB_ConnectionParameters* parameters)
 {
    if (! isDeviceConnected(device))
    {
       return LB_DEVICE_NOT_CONNECTED;
    }
 
+   if (! areConnectionParametersValid(parameters))
+   {
+      return LB_INVALID_PARAMETERS;
+   }
+
    struct LB_Controller* controller = device->controller;
 
    if (! controller->vendorFunctions)
@@ -491,53 +987,133 @@ enum LB_STATUS lb_writeCharValue(struct LB_Device* device, uint16_t attributeHan
       return LB_UNKNOWN_VENDOR;
    }
 
-   os_lock(device->operationLock);
-   assert(0 == device->pendingOperation.attributeHandle);
-   assert(PO_IDLE == device->pendingOperation.type);
+   /*
+    * the new parameters take effect at an instant chosen by the link layer,
+    * a few connection events in the future; allow for ten of the current
+    * connection intervals on top of the command round-trip
+    */
+   const uint32_t timeout_ms = controller->timeouts.connectionUpdate_ms + ((uint32_t) device->connectionParameters.interval * 125 / 10);
+
+   const struct lb_request request =
+   {
+      .type       = PO_UPDATE,
+      .priority   = LB_PRIORITY_CONTROL,
+      .parameters = parameters,
+   };
+
+   void* operationStatus = NULL;
+   enum LB_STATUS status = operation_execute(device, &request, timeout_ms, &operationStatus);
+
+   if (LB_OK != status)
+   {
+      return (LB_OPERATION_TIMEOUT == status) ? LB_OPERATION_TIMEOUT : LB_FAILURE;
+   }
+
+   if (HCI_STATUS_SUCCESS == (enum HCI_StatusCode) (uintptr_t) operationStatus)
+   {
+      return LB_OK;
+   }
+   else
+   {
+      return LB_FAILURE;
+   }
+}
 
-   device->pendingOperation.attributeHandle = attributeHandle;
-   device->pendingOperation.type            = PO_WRITE;
+void on_connectionParametersUpdated(struct LB_Controller* controller, uint16_t connectionHandle, uint8_t status, uint16_t interval, uint16_t latency, uint16_t supervisionTimeout)
+{
+   struct LB_Device* device = getDevice(controller, connectionHandle);
+   if (! device)
+   {
+      return;
+   }
 
-   enum HCI_StatusCode status = HCI_HOST_TIMEOUT;
+   if (HCI_STATUS_SUCCESS == status)
+   {
+      device->connectionParameters.interval           = interval;
+      device->connectionParameters.latency            = latency;
+      device->connectionParameters.supervisionTimeout = supervisionTimeout;
 
-   os_resetCondition(device->operationComplete);
+      state_recordDevice(device);
+   }
 
-   enum LB_STATUS commandStatus = controller->vendorFunctions->writeCharValue(device, attributeHandle, attributeValue, attributeLength);
-   if (LB_OK != commandStatus)
+   if (lbDebugLevel > 100)
    {
-      goto done;
+      printf("Connection %04x parameters updated; status %u, interval %u, latency %u, timeout %u\n",
+            connectionHandle, status, interval, latency, supervisionTimeout);
    }
 
-   void* operationStatus = NULL;
-   bool signaled = os_waitForCondition(device->operationComplete, 1000, &operationStatus);
-   if (! signaled)
+   /*
+    * the peripheral may request an update on its own; only signal
+    * if we are waiting for one
+    */
+   struct lb_operation* operation = operation_acquire(device, PO_MASK(PO_UPDATE));
+   if (operation)
    {
-      goto done;
+      operation_complete(operation, LB_OK, (void*) (uintptr_t) status);
    }
+}
 
-   if (NULL == operationStatus)
+enum LB_STATUS lb_getConnectionParameters(struct LB_Device* device, uint16_t* interval, uint16_t* latency, uint16_t* supervisionTimeout)
+{
+   if (! isDeviceConnected(device))
    {
-      status = HCI_STATUS_SUCCESS;
+      return LB_DEVICE_NOT_CONNECTED;
    }
 
-done:
+   *interval           = device->connectionParameters.interval;
+   *latency            = device->connectionParameters.latency;
+   *supervisionTimeout = device->connectionParameters.supervisionTimeout;
 
-   device->pendingOperation.attributeHandle = 0;
-   device->pendingOperation.type            = PO_IDLE;
+   return LB_OK;
+}
 
-   os_unlock(device->operationLock);
+enum LB_STATUS lb_getDeviceAddress(struct LB_Device* device, uint8_t* address)
+{
+   if (! isDeviceConnected(device))
+   {
+      return LB_DEVICE_NOT_CONNECTED;
+   }
 
-   if (HCI_STATUS_SUCCESS == status)
+   memcpy(address, device->address, sizeof(device->address));
+
+   return LB_OK;
+}
+
+uint32_t lb_getConnectedDevices(struct LB_Controller* controller, struct LB_Device** devices, uint32_t capacity)
+{
+   uint32_t count = 0;
+
+   for (uint32_t ii = 0; (ii < LB_MAX_DEVICES) && (count < capacity); ii ++)
    {
-      return LB_OK;
+      if (isDeviceConnected(&controller->device[ii]))
+      {
+         devices[count ++] = &controller->device[ii];
+      }
    }
-   else
+
+   return count;
+}
+
+void on_serviceDiscoveryComplete(struct LB_Controller* controller, uint16_t connectionHandle)
+{
+   struct LB_Device* device = getDevice(controller, connectionHandle);
+   if (! device)
    {
-      return LB_FAILURE;
+      return;
+   }
+
+   struct lb_operation* operation = operation_acquire(device, PO_MASK(PO_DISCOVER));
+   if (operation)
+   {
+      operation_complete(operation, LB_OK, NULL);
    }
 }
 
-enum LB_STATUS lb_readCharValue(struct LB_Device* device, uint16_t attributeHandle, uint8_t* attributeValue, uint8_t attributeCapacity, uint8_t* attributeLength)
+/*
+ * Writes without response complete when the command does, so they do not
+ * take the device operation
+ */
+enum LB_STATUS lb_writeCharValueWithoutResponse(struct LB_Device* device, uint16_t attributeHandle, const uint8_t* attributeValue, uint8_t attributeLength)
 {
    if (! isDeviceConnected(device))
    {
@@ -552,49 +1128,103 @@ enum LB_STATUS lb_readCharValue(struct LB_Device* device, uint16_t attributeHand
       return LB_UNKNOWN_VENDOR;
    }
 
-   os_lock(device->operationLock);
-   assert(0 == device->pendingOperation.attributeHandle);
-   assert(PO_IDLE == device->pendingOperation.type);
+   if (! controller->vendorFunctions->writeCharValueWithoutResponse)
+   {
+      return LB_FAILURE;
+   }
 
-   device->pendingOperation.attributeHandle   = attributeHandle;
-   device->pendingOperation.type              = PO_READ;
+   return controller->vendorFunctions->writeCharValueWithoutResponse(device, attributeHandle, attributeValue, attributeLength);
+}
 
-   device->pendingRead.attributeValue    = attributeValue;
-   device->pendingRead.attributeLength   = 0;
-   device->pendingRead.attributeCapacity = attributeCapacity;
+enum LB_STATUS lb_writeCharValue(struct LB_Device* device, uint16_t attributeHandle, const uint8_t* attributeValue, uint8_t attributeLength)
+{
+   return lb_writeCharValueWithPriority(device, attributeHandle, attributeValue, attributeLength, LB_PRIORITY_CONTROL);
+}
 
-   enum HCI_StatusCode status = HCI_HOST_TIMEOUT;
+enum LB_STATUS lb_writeCharValueWithPriority(struct LB_Device* device, uint16_t attributeHandle, const uint8_t* attributeValue, uint8_t attributeLength, enum LB_Priority priority)
+{
+   enum LB_STATUS status = checkDeviceRequest(device, priority);
+   if (LB_OK != status)
+   {
+      return status;
+   }
 
-   os_resetCondition(device->operationComplete);
+   const struct lb_request request =
+   {
+      .type            = PO_WRITE,
+      .attributeHandle = attributeHandle,
+      .priority        = priority,
+      .value           = attributeValue,
+      .valueLength     = attributeLength,
+   };
 
-   enum LB_STATUS commandStatus = controller->vendorFunctions->requestCharValue(device, attributeHandle);
-   if (LB_OK != commandStatus)
+   void* operationStatus = NULL;
+   status = operation_execute(device, &request, device->controller->timeouts.write_ms, &operationStatus);
+
+   if ((LB_OK == status) && (NULL == operationStatus))
    {
-      goto done;
+      return LB_OK;
    }
+   else
+   {
+      return LB_FAILURE;
+   }
+}
 
-   void* operationStatus = NULL;
-   bool signaled = os_waitForCondition(device->operationComplete, 1000, &operationStatus);
-   if (! signaled)
+enum LB_STATUS lb_writeCharValueAsync(struct LB_Device* device, uint16_t attributeHandle, const uint8_t* attributeValue, uint8_t attributeLength, enum LB_Priority priority, LB_OperationCallback callback, void* context)
+{
+   enum LB_STATUS status = checkDeviceRequest(device, priority);
+   if (LB_OK != status)
    {
-      goto done;
+      return status;
    }
 
-   *attributeLength = device->pendingRead.attributeLength;
+   const struct lb_request request =
+   {
+      .type            = PO_WRITE,
+      .attributeHandle = attributeHandle,
+      .priority        = priority,
+      .value           = attributeValue,
+      .valueLength     = attributeLength,
+   };
+
+   return operation_submit(device, &request, device->controller->timeouts.write_ms, callback, context);
+}
 
-   if (NULL == operationStatus)
+enum LB_STATUS lb_readCharValue(struct LB_Device* device, uint16_t attributeHandle, uint8_t* attributeValue, uint8_t attributeCapacity, uint8_t* attributeLength)
+{
+   return lb_readCharValueWithPriority(device, attributeHandle, attributeValue, attributeCapacity, attributeLength, LB_PRIORITY_NORMAL);
+}
+
+enum LB_STATUS lb_readCharValueWithPriority(struct LB_Device* device, uint16_t attributeHandle, uint8_t* attributeValue, uint8_t attributeCapacity, uint8_t* attributeLength, enum LB_Priority priority)
+{
+   enum LB_STATUS status = checkDeviceRequest(device, priority);
+   if (LB_OK != status)
    {
-      status = HCI_STATUS_SUCCESS;
+      return status;
    }
 
-done:
+   *attributeLength = 0;
+
+   const struct lb_request request =
+   {
+      .type            = PO_READ,
+      .attributeHandle = attributeHandle,
+      .priority        = priority,
+      .readValue       = attributeValue,
+      .readCapacity    = attributeCapacity,
+      .readLength      = attributeLength,
+   };
 
-   device->pendingOperation.attributeHandle = 0;
-   device->pendingOperation.type            = PO_IDLE;
+   void* operationStatus = NULL;
+   status = operation_execute(device, &request, device->controller->timeouts.read_ms, &operationStatus);
 
-   os_unlock(device->operationLock);
+   if (LB_OK != status)
+   {
+      return (LB_OPERATION_TIMEOUT == status) ? LB_OPERATION_TIMEOUT : LB_FAILURE;
+   }
 
-   if (HCI_STATUS_SUCCESS == status)
+   if (NULL == operationStatus)
    {
       return LB_OK;
    }
@@ -604,3 +1234,25 @@ done:
    }
 }
 
+enum LB_STATUS lb_readCharValueAsync(struct LB_Device* device, uint16_t attributeHandle, uint8_t* attributeValue, uint8_t attributeCapacity, uint8_t* attributeLength, enum LB_Priority priority, LB_OperationCallback callback, void* context)
+{
+   enum LB_STATUS status = checkDeviceRequest(device, priority);
+   if (LB_OK != status)
+   {
+      return status;
+   }
+
+   *attributeLength = 0;
+
+   const struct lb_request request =
+   {
+      .type            = PO_READ,
+      .attributeHandle = attributeHandle,
+      .priority        = priority,
+      .readValue       = attributeValue,
+      .readCapacity    = attributeCapacity,
+      .readLength      = attributeLength,
+   };
+
+   return operation_submit(device, &request, device->controller->timeouts.read_ms, callback, context);
+}
@@ -39,15 +39,21 @@ int lb_initialize(void)
       return -1;
    }
 
-   hci_initialize();
+   return 0;
+}
+
+int lb_initializePolled(void)
+{
+   if (os_initializePolled() < 0)
+   {
+      return -1;
+   }
 
    return 0;
 }
 
 void lb_cleanup(void)
 {
-   hci_cleanup();
-
    os_cleanup();
 }
 
@@ -62,9 +68,30 @@ struct LB_Controller* lb_connect(const char* portName)
    memset(controller, 0, sizeof(struct LB_Controller));
 
    controller->operationLock     = os_createLock();
-   controller->operationComplete = os_createCondition();
+   controller->writeLock         = os_createLock();
+   controller->completions       = os_createCompletionPool(LB_MAX_DEVICES * LB_DEVICE_COMPLETIONS + 1);
 
-   for (uint32_t ii = 0; ii < sizeof(controller->device) / sizeof(controller->device[0]); ii ++)
+   hci_initialize(controller);
+
+   controller->acl.creditLock      = os_createLock();
+   controller->acl.creditAvailable = os_createConditionVariable();
+   controller->acl.credits         = 0;
+   controller->acl.nextLink        = 0;
+
+   atomic_init(&controller->scheduler.kicks, 0);
+   atomic_init(&controller->scheduler.sweeper, NULL);
+
+   scan_initialize(controller);
+   observer_initialize(controller);
+
+   const struct LB_Timeouts defaultTimeouts = { 0 };
+   lb_setTimeouts(controller, &defaultTimeouts);
+
+   controller->config.maxConnections     = 1;
+   controller->config.scanWhileConnected = false;
+   controller->maxConnections            = 1;
+
+   for (uint32_t ii = 0; ii < LB_MAX_DEVICES; ii ++)
    {
       controller->device[ii].controller       = 0;
       controller->device[ii].connectionHandle = INVALID_CONNECTION_HANDLE;
@@ -87,23 +114,50 @@ void lb_disconnect(struct LB_Controller* controller)
 {
    if (controller)
    {
-      for (uint32_t ii = 0; ii < sizeof(controller->device) / sizeof(controller->device[0]); ii ++)
-      {
-         if (INVALID_CONNECTION_HANDLE != controller->device[ii].connectionHandle)
-         {
-            // TODO: disconnect
-         }
-      }
+      scan_cleanup(controller);
 
-      os_destroyLock(controller->operationLock);
-      os_destroyCondition(controller->operationComplete);
+      operation_stopSweeper(controller);
+      operation_waitForScheduler(controller);
 
+      // nothing sends commands any more; once closed, no event is delivered for this controller
       if (controller->channel)
       {
          io_closePort(controller->channel);
+         controller->channel = NULL;
       }
 
+      // the links are kept, for another process to attach to
+      detachDevices(controller);
+
+      os_destroyLock(controller->operationLock);
+      os_destroyLock(controller->writeLock);
+      os_destroyCompletionPool(controller->completions);
+
+      os_destroyLock(controller->acl.creditLock);
+      os_destroyConditionVariable(controller->acl.creditAvailable);
+
+      hci_cleanup(controller);
+
+      observer_cleanup(controller);
+
+      state_close(controller);
+
       free(controller);
    }
 }
 
+intptr_t lb_getPollFd(struct LB_Controller* controller)
+{
+   assert(controller);
+
+   return io_getPollFd(controller->channel);
+}
+
+int lb_poll(struct LB_Controller* controller, uint32_t timeout_ms)
+{
+   assert(controller);
+   assert(os_isPolled());
+
+   return os_poll(timeout_ms);
+}
+
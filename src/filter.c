@@ -0,0 +1,227 @@
+/**
+ * @file filter.c
+ * @brief Advertisement filters
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+#include <malloc.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <osal_core.h>
+
+#include <commands.h>
+#include <gap.h>
+
+#include "lb_priv.h"
+
+static bool compileFilter(const struct LB_ScanFilter* filter, struct lb_compiledFilter* compiled)
+{
+   memset(compiled, 0, sizeof(*compiled));
+
+   compiled->minRSSI = filter->minRSSI;
+
+   if (filter->matchServiceUUID)
+   {
+      compiled->criteria   |= FILTER_SERVICE_UUID;
+      compiled->serviceUUID = filter->serviceUUID;
+   }
+
+   if (filter->matchCompanyId)
+   {
+      compiled->criteria |= FILTER_COMPANY_ID;
+      compiled->companyId = filter->companyId;
+   }
+
+   if (filter->namePrefix && filter->namePrefix[0])
+   {
+      size_t length = strlen(filter->namePrefix);
+      if (length > sizeof(compiled->namePrefix))
+      {
+         // longer than any name that fits in an advertisement
+         return false;
+      }
+
+      compiled->criteria        |= FILTER_NAME_PREFIX;
+      compiled->namePrefixLength = (uint8_t) length;
+      memcpy(compiled->namePrefix, filter->namePrefix, length);
+   }
+
+   return true;
+}
+
+enum LB_STATUS lb_setScanFilters(struct LB_Controller* controller, const struct LB_ScanFilter* filters, uint32_t count)
+{
+   if (count > LB_MAX_SCAN_FILTERS)
+   {
+      return LB_INVALID_PARAMETERS;
+   }
+
+   struct lb_filterProgram* program = NULL;
+
+   if (count)
+   {
+      program = malloc(sizeof(struct lb_filterProgram) + count * sizeof(struct lb_compiledFilter));
+      if (! program)
+      {
+         return LB_FAILURE;
+      }
+
+      program->minRSSI  = INT8_MAX;
+      program->criteria = 0;
+      program->count    = count;
+
+      for (uint32_t ii = 0; ii < count; ii ++)
+      {
+         if (! compileFilter(&filters[ii], &program->filter[ii]))
+         {
+            free(program);
+            return LB_INVALID_PARAMETERS;
+         }
+
+         if (program->minRSSI > filters[ii].minRSSI)
+         {
+            program->minRSSI = filters[ii].minRSSI;
+         }
+
+         program->criteria |= program->filter[ii].criteria;
+      }
+   }
+
+   os_lock(controller->observer.lock);
+   struct lb_filterProgram* oldProgram = controller->observer.filters;
+   controller->observer.filters = program;
+   os_unlock(controller->observer.lock);
+
+   free(oldProgram);
+
+   return LB_OK;
+}
+
+/*
+ * The RSSI thresholds are checked first, since they need no decoding; the
+ * surviving filters are then matched in a single pass over the AD
+ * structures, each structure setting the criteria it satisfies.
+ */
+bool filter_accept(const struct lb_filterProgram* program, int8_t rssi, const uint8_t* data, uint8_t length)
+{
+   if (rssi < program->minRSSI)
+   {
+      return false;
+   }
+
+   uint32_t candidates = 0;
+
+   for (uint32_t ii = 0; ii < program->count; ii ++)
+   {
+      if (rssi >= program->filter[ii].minRSSI)
+      {
+         if (0 == program->filter[ii].criteria)
+         {
+            return true;
+         }
+
+         candidates |= 1u << ii;
+      }
+   }
+
+   if (0 == candidates)
+   {
+      return false;
+   }
+
+   uint8_t matched[LB_MAX_SCAN_FILTERS] = { 0 };
+
+   struct GAP_ADIterator iterator;
+   gap_initADIterator(&iterator, data, length);
+
+   struct GAP_ADStructure structure;
+
+   while (gap_nextADStructure(&iterator, &structure))
+   {
+      switch (structure.type)
+      {
+         case AD_TYPE_16_BIT_SERV_UUID:
+         case AD_TYPE_16_BIT_SERV_UUID_CMPLT:
+            if (program->criteria & FILTER_SERVICE_UUID)
+            {
+               for (uint8_t jj = 0; (jj + 1) < structure.length; jj += 2)
+               {
+                  uint16_t uuid = structure.value[jj] | (((uint16_t) structure.value[jj + 1]) << 8);
+
+                  for (uint32_t ii = 0; ii < program->count; ii ++)
+                  {
+                     if ((candidates & (1u << ii)) && (program->filter[ii].criteria & FILTER_SERVICE_UUID) && (uuid == program->filter[ii].serviceUUID))
+                     {
+                        matched[ii] |= FILTER_SERVICE_UUID;
+                     }
+                  }
+               }
+            }
+            break;
+
+         case AD_TYPE_MANUFACTURER_SPECIFIC_DATA:
+            if ((program->criteria & FILTER_COMPANY_ID) && (2 <= structure.length))
+            {
+               uint16_t companyId = structure.value[0] | (((uint16_t) structure.value[1]) << 8);
+
+               for (uint32_t ii = 0; ii < program->count; ii ++)
+               {
+                  if ((candidates & (1u << ii)) && (program->filter[ii].criteria & FILTER_COMPANY_ID) && (companyId == program->filter[ii].companyId))
+                  {
+                     matched[ii] |= FILTER_COMPANY_ID;
+                  }
+               }
+            }
+            break;
+
+         case AD_TYPE_SHORTENED_LOCAL_NAME:
+         case AD_TYPE_COMPLETE_LOCAL_NAME:
+            if (program->criteria & FILTER_NAME_PREFIX)
+            {
+               for (uint32_t ii = 0; ii < program->count; ii ++)
+               {
+                  const struct lb_compiledFilter* filter = &program->filter[ii];
+
+                  if ((candidates & (1u << ii)) && (filter->criteria & FILTER_NAME_PREFIX) &&
+                        (structure.length >= filter->namePrefixLength) &&
+                        (0 == memcmp(structure.value, filter->namePrefix, filter->namePrefixLength)))
+                  {
+                     matched[ii] |= FILTER_NAME_PREFIX;
+                  }
+               }
+            }
+            break;
+
+         default:
+            break;
+      }
+   }
+
+   for (uint32_t ii = 0; ii < program->count; ii ++)
+   {
+      if ((candidates & (1u << ii)) && (matched[ii] == program->filter[ii].criteria))
+      {
+         return true;
+      }
+   }
+
+   return false;
+}
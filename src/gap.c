@@ -21,64 +21,383 @@
  * This file is part of LightBLUE Bluetooth Smart Library
  */
 
-#include <assert.h>
 #include <stdio.h>
 
 #include <gap.h>
+#include <utils.h>
+
+void gap_initADIterator(struct GAP_ADIterator* iterator, const uint8_t* advertisingData, uint8_t length)
+{
+   iterator->position  = advertisingData;
+   iterator->end       = advertisingData + length;
+   iterator->malformed = false;
+}
 
 /*
  * Length / Type / Value... / Length / Type / Value
  */
+bool gap_nextADStructure(struct GAP_ADIterator* iterator, struct GAP_ADStructure* structure)
+{
+   if (iterator->end <= iterator->position)
+   {
+      return false;
+   }
+
+   uint8_t length = iterator->position[0];
+   if (0 == length)
+   {
+      // the rest of the payload is padding
+      iterator->position = iterator->end;
+      return false;
+   }
+
+   if ((iterator->end - iterator->position) <= length)
+   {
+      iterator->position  = iterator->end;
+      iterator->malformed = true;
+      return false;
+   }
+
+   structure->type   = iterator->position[1];
+   structure->length = length - 1;
+   structure->value  = iterator->position + 2;
+
+   iterator->position += length + 1;
+
+   return true;
+}
+
+bool gap_findADStructure(const uint8_t* advertisingData, uint8_t length, uint8_t type, struct GAP_ADStructure* structure)
+{
+   struct GAP_ADIterator iterator;
+   gap_initADIterator(&iterator, advertisingData, length);
+
+   while (gap_nextADStructure(&iterator, structure))
+   {
+      if (type == structure->type)
+      {
+         return true;
+      }
+   }
+
+   return false;
+}
+
+bool gap_getFlags(const uint8_t* advertisingData, uint8_t length, uint8_t* flags)
+{
+   struct GAP_ADStructure structure;
+
+   if (gap_findADStructure(advertisingData, length, AD_TYPE_FLAGS, &structure) && (1 <= structure.length))
+   {
+      *flags = structure.value[0];
+      return true;
+   }
+
+   return false;
+}
+
+bool gap_getTxPowerLevel(const uint8_t* advertisingData, uint8_t length, int8_t* txPower)
+{
+   struct GAP_ADStructure structure;
+
+   if (gap_findADStructure(advertisingData, length, AD_TYPE_TX_POWER_LEVEL, &structure) && (1 == structure.length))
+   {
+      *txPower = (int8_t) structure.value[0];
+      return true;
+   }
+
+   return false;
+}
+
+bool gap_getLocalName(const uint8_t* advertisingData, uint8_t length, const char** name, uint8_t* nameLength, bool* complete)
+{
+   struct GAP_ADIterator iterator;
+   gap_initADIterator(&iterator, advertisingData, length);
+
+   struct GAP_ADStructure structure;
+   bool found = false;
+
+   while (gap_nextADStructure(&iterator, &structure))
+   {
+      if ((AD_TYPE_COMPLETE_LOCAL_NAME == structure.type) || ((AD_TYPE_SHORTENED_LOCAL_NAME == structure.type) && (! found)))
+      {
+         *name       = (const char*) structure.value;
+         *nameLength = structure.length;
+         if (complete)
+         {
+            *complete = (AD_TYPE_COMPLETE_LOCAL_NAME == structure.type);
+         }
+         found = true;
+
+         if (AD_TYPE_COMPLETE_LOCAL_NAME == structure.type)
+         {
+            break;
+         }
+      }
+   }
+
+   return found;
+}
+
+static bool decodeUUIDList(const struct GAP_ADStructure* structure, struct GAP_UUIDList* list)
+{
+   uint8_t width;
+
+   switch (structure->type)
+   {
+      case AD_TYPE_16_BIT_SERV_UUID:
+      case AD_TYPE_16_BIT_SERV_UUID_CMPLT:
+         width = 2;
+         break;
+
+      case AD_TYPE_32_BIT_SERV_UUID:
+      case AD_TYPE_32_BIT_SERV_UUID_CMPLT:
+         width = 4;
+         break;
+
+      case AD_TYPE_128_BIT_SERV_UUID:
+      case AD_TYPE_128_BIT_SERV_UUID_CMPLT:
+         width = 16;
+         break;
+
+      default:
+         return false;
+   }
+
+   if (0 != (structure->length % width))
+   {
+      return false;
+   }
+
+   list->value    = structure->value;
+   list->width    = width;
+   list->count    = structure->length / width;
+   list->complete = (0 != (structure->type & 0x01));
+
+   return true;
+}
+
+bool gap_getServiceUUIDs(const uint8_t* advertisingData, uint8_t length, uint8_t width, struct GAP_UUIDList* list)
+{
+   struct GAP_ADIterator iterator;
+   gap_initADIterator(&iterator, advertisingData, length);
+
+   struct GAP_ADStructure structure;
+
+   while (gap_nextADStructure(&iterator, &structure))
+   {
+      if (decodeUUIDList(&structure, list) && (width == list->width))
+      {
+         return true;
+      }
+   }
+
+   return false;
+}
+
+uint16_t gap_getUUID16(const struct GAP_UUIDList* list, uint8_t index)
+{
+   const uint8_t* value = list->value + index * 2;
+   return value[0] | (((uint16_t) value[1]) << 8);
+}
+
+uint32_t gap_getUUID32(const struct GAP_UUIDList* list, uint8_t index)
+{
+   const uint8_t* value = list->value + index * 4;
+   return value[0] | (((uint32_t) value[1]) << 8) | (((uint32_t) value[2]) << 16) | (((uint32_t) value[3]) << 24);
+}
+
+const uint8_t* gap_getUUID128(const struct GAP_UUIDList* list, uint8_t index)
+{
+   return list->value + index * 16;
+}
+
+bool gap_hasServiceUUID16(const uint8_t* advertisingData, uint8_t length, uint16_t uuid)
+{
+   struct GAP_ADIterator iterator;
+   gap_initADIterator(&iterator, advertisingData, length);
+
+   struct GAP_ADStructure structure;
+   struct GAP_UUIDList list;
+
+   while (gap_nextADStructure(&iterator, &structure))
+   {
+      if (decodeUUIDList(&structure, &list) && (2 == list.width))
+      {
+         for (uint8_t ii = 0; ii < list.count; ii ++)
+         {
+            if (uuid == gap_getUUID16(&list, ii))
+            {
+               return true;
+            }
+         }
+      }
+   }
+
+   return false;
+}
+
+bool gap_getManufacturerData(const uint8_t* advertisingData, uint8_t length, uint16_t* companyId, const uint8_t** data, uint8_t* dataLength)
+{
+   struct GAP_ADStructure structure;
+
+   if (gap_findADStructure(advertisingData, length, AD_TYPE_MANUFACTURER_SPECIFIC_DATA, &structure) && (2 <= structure.length))
+   {
+      *companyId  = structure.value[0] | (((uint16_t) structure.value[1]) << 8);
+      *data       = structure.value + 2;
+      *dataLength = structure.length - 2;
+      return true;
+   }
+
+   return false;
+}
+
+bool gap_decodeServiceData(const struct GAP_ADStructure* structure, struct GAP_ServiceData* serviceData)
+{
+   uint8_t width;
+
+   switch (structure->type)
+   {
+      case AD_TYPE_SERVICE_DATA:
+         width = 2;
+         break;
+
+      case AD_TYPE_SERVICE_DATA_32_BIT_UUID:
+         width = 4;
+         break;
+
+      case AD_TYPE_SERVICE_DATA_128_BIT_UUID:
+         width = 16;
+         break;
+
+      default:
+         return false;
+   }
+
+   if (structure->length < width)
+   {
+      return false;
+   }
+
+   serviceData->uuid      = structure->value;
+   serviceData->uuidWidth = width;
+   serviceData->value     = structure->value + width;
+   serviceData->length    = structure->length - width;
+
+   return true;
+}
+
+bool gap_getServiceData16(const uint8_t* advertisingData, uint8_t length, uint16_t uuid, struct GAP_ServiceData* serviceData)
+{
+   struct GAP_ADIterator iterator;
+   gap_initADIterator(&iterator, advertisingData, length);
+
+   struct GAP_ADStructure structure;
+
+   while (gap_nextADStructure(&iterator, &structure))
+   {
+      if (gap_decodeServiceData(&structure, serviceData) && (2 == serviceData->uuidWidth))
+      {
+         if (uuid == (serviceData->uuid[0] | (((uint16_t) serviceData->uuid[1]) << 8)))
+         {
+            return true;
+         }
+      }
+   }
+
+   return false;
+}
+
+static void printUUIDList(const char* label, const struct GAP_UUIDList* list)
+{
+   printf(" [%s =", label);
+   for (uint8_t ii = 0; ii < list->count; ii ++)
+   {
+      switch (list->width)
+      {
+         case 2:
+            printf(" %x", gap_getUUID16(list, ii));
+            break;
+
+         case 4:
+            printf(" %lx", (unsigned long) gap_getUUID32(list, ii));
+            break;
+
+         default:
+            putchar(' ');
+            utl_printUUID(gap_getUUID128(list, ii), 16);
+            break;
+      }
+   }
+   putchar(']');
+}
+
 void gap_decodeAdvertisingData(const uint8_t* advertisingData, uint8_t advertisingDataLength)
 {
-   const uint8_t* const advertisingDataEnd = advertisingData + advertisingDataLength;
-   while (advertisingDataEnd > advertisingData)
+   struct GAP_ADIterator iterator;
+   gap_initADIterator(&iterator, advertisingData, advertisingDataLength);
+
+   struct GAP_ADStructure structure;
+
+   while (gap_nextADStructure(&iterator, &structure))
    {
-      uint8_t length = *advertisingData;
-      advertisingData ++;
-      uint8_t type   = *advertisingData;
-      const uint8_t* const value = advertisingData + 1;
-      advertisingData += length;
+      const uint8_t* const value = structure.value;
+      const uint8_t length       = structure.length;
+
+      struct GAP_UUIDList list;
+      struct GAP_ServiceData serviceData;
 
-      switch (type)
+      switch (structure.type)
       {
          case AD_TYPE_FLAGS:
-            assert(2 == length);
-            printf(" [Flags = %x]", *value);
+            if (1 <= length)
+            {
+               printf(" [Flags = %x]", *value);
+            }
             break;
 
          case AD_TYPE_16_BIT_SERV_UUID:
-            assert(3 == length);
-            printf(" [UUID16 = %x]", value[0] | (((uint16_t) value[1]) << 8));
+         case AD_TYPE_16_BIT_SERV_UUID_CMPLT:
+            if (decodeUUIDList(&structure, &list))
+            {
+               printUUIDList("UUID16", &list);
+            }
             break;
 
-         case AD_TYPE_SHORTENED_LOCAL_NAME:
-            printf(" [S.Name = ");
-            for (uint8_t ii = 0; ii < (length - 1); ii ++)
+         case AD_TYPE_32_BIT_SERV_UUID:
+         case AD_TYPE_32_BIT_SERV_UUID_CMPLT:
+            if (decodeUUIDList(&structure, &list))
             {
-               putchar(value[ii]);
+               printUUIDList("UUID32", &list);
             }
-            putchar(']');
             break;
 
-         case AD_TYPE_COMPLETE_LOCAL_NAME:
-            printf(" [C.Name = ");
-            for (uint8_t ii = 0; ii < (length - 1); ii ++)
+         case AD_TYPE_128_BIT_SERV_UUID:
+         case AD_TYPE_128_BIT_SERV_UUID_CMPLT:
+            if (decodeUUIDList(&structure, &list))
             {
-               putchar(value[ii]);
+               printUUIDList("UUID128", &list);
             }
-            putchar(']');
+            break;
+
+         case AD_TYPE_SHORTENED_LOCAL_NAME:
+            printf(" [S.Name = %.*s]", (int) length, (const char*) value);
+            break;
+
+         case AD_TYPE_COMPLETE_LOCAL_NAME:
+            printf(" [C.Name = %.*s]", (int) length, (const char*) value);
             break;
 
          case AD_TYPE_TX_POWER_LEVEL:
+            if (1 == length)
             {
-               int8_t txPower = *((int8_t*) value);
+               int8_t txPower = (int8_t) *value;
                printf(" [TX Power = %d dbm]", txPower);
             }
             break;
 
          case AD_TYPE_SLAVE_CONN_INTERVAL:
-            assert(5 == length);
+            if (4 == length)
             {
                uint16_t connMin = value[0] | (((uint16_t) value[1]) << 8);
                uint16_t connMax = value[2] | (((uint16_t) value[3]) << 8);
@@ -86,7 +405,19 @@ void gap_decodeAdvertisingData(const uint8_t* advertisingData, uint8_t advertisi
             }
             break;
 
+         case AD_TYPE_SERVICE_DATA:
+         case AD_TYPE_SERVICE_DATA_32_BIT_UUID:
+         case AD_TYPE_SERVICE_DATA_128_BIT_UUID:
+            if (gap_decodeServiceData(&structure, &serviceData))
+            {
+               printf(" [Service ");
+               utl_printUUID(serviceData.uuid, serviceData.uuidWidth);
+               printf(" data %u bytes]", serviceData.length);
+            }
+            break;
+
          case AD_TYPE_MANUFACTURER_SPECIFIC_DATA:
+            if (2 <= length)
             {
                uint16_t manufacturerId = value[0] | (((uint16_t) value[1]) << 8);
                printf(" [Manufacturer %u]", manufacturerId);
@@ -94,9 +425,13 @@ void gap_decodeAdvertisingData(const uint8_t* advertisingData, uint8_t advertisi
             break;
 
          default:
-            printf(" [AD %x]", type);
+            printf(" [AD %x]", structure.type);
             break;
       }
    }
-}
 
+   if (iterator.malformed)
+   {
+      printf(" [Malformed]");
+   }
+}
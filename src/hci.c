@@ -35,42 +35,32 @@
 #include "hci_priv.h"
 #include "lb_priv.h"
 
-struct hci_condition
+void hci_initialize(struct LB_Controller* controller)
 {
-   struct os_condition* handle;
+   struct lb_commandState* commands = &controller->commands;
 
-   uint16_t opcode;
-   uint8_t capacity;
-   uint8_t* buffer;
+   memset(commands->pending, 0, sizeof(commands->pending));
 
-   uint8_t status;
-   uint8_t length;
-};
-
-static struct hci_condition pendingCommands[4];
-
-static struct os_lock* pendingLock;
-
-void hci_initialize(void)
-{
-   memset(pendingCommands, 0, sizeof(pendingCommands));
-
-   for (uint32_t ii = 0; ii < (sizeof(pendingCommands) / sizeof(pendingCommands[0])); ii ++)
+   for (uint32_t ii = 0; ii < LB_PENDING_COMMANDS; ii ++)
    {
-      pendingCommands[ii].handle = os_createCondition();
+      commands->pending[ii].handle = os_createCondition();
    }
 
-   pendingLock = os_createLock();
+   commands->lock = os_createLock();
 }
 
-void hci_cleanup(void)
+void hci_cleanup(struct LB_Controller* controller)
 {
-   for (uint32_t ii = 0; ii < (sizeof(pendingCommands) / sizeof(pendingCommands[0])); ii ++)
+   struct lb_commandState* commands = &controller->commands;
+
+   for (uint32_t ii = 0; ii < LB_PENDING_COMMANDS; ii ++)
    {
-      os_destroyCondition(pendingCommands[ii].handle);
+      os_destroyCondition(commands->pending[ii].handle);
+      commands->pending[ii].handle = NULL;
    }
 
-   os_destroyLock(pendingLock);
+   os_destroyLock(commands->lock);
+   commands->lock = NULL;
 }
 
 void hci_on_eventCommandComplete(struct LB_Controller* controller, const struct HCI_EVENT_Command_Complete* event, uint8_t length)
@@ -78,12 +68,12 @@ void hci_on_eventCommandComplete(struct LB_Controller* controller, const struct
    /*
     * signal event->opcode
     */
-   signalCondition(uint16Value(&event->opcode), event->status, (((uint8_t*) event) + sizeof(struct HCI_EVENT_Command_Complete)), length - sizeof(struct HCI_EVENT_Command_Complete));
+   signalCondition(controller, uint16Value(&event->opcode), event->status, (((uint8_t*) event) + sizeof(struct HCI_EVENT_Command_Complete)), length - sizeof(struct HCI_EVENT_Command_Complete));
 }
 
 void hci_on_eventCommandStatus(struct LB_Controller* controller, const struct HCI_EVENT_Command_Status* event, uint8_t length)
 {
-   signalCondition(uint16Value(&event->opcode), event->status, NULL, 0);
+   signalCondition(controller, uint16Value(&event->opcode), event->status, NULL, 0);
 }
 
 void hci_on_vendorSpecificEvent(struct LB_Controller* controller, struct HCI_EVENT_Vendor_Specific* event, uint8_t length)
@@ -97,67 +87,52 @@ void hci_on_vendorSpecificEvent(struct LB_Controller* controller, struct HCI_EVE
    }
 }
 
-struct hci_condition* allocateCondition(uint16_t opcode, uint8_t* result, uint8_t capacity)
+struct hci_condition* allocateCondition(struct LB_Controller* controller, uint16_t opcode, uint8_t* result, uint8_t capacity)
 {
-   os_lock(pendingLock);
+   struct lb_commandState* commands = &controller->commands;
+   struct hci_condition* cond = NULL;
 
-   uint32_t ii = 0;
+   os_lock(commands->lock);
 
-   while ((sizeof(pendingCommands) / sizeof(pendingCommands[0])) > ii )
+   for (uint32_t ii = 0; ii < LB_PENDING_COMMANDS; ii ++)
    {
-      if (0 == pendingCommands[ii].opcode)
+      if (0 == commands->pending[ii].opcode)
       {
-         // reserve
-         pendingCommands[ii].opcode = opcode;
+         cond = &commands->pending[ii];
          break;
       }
-      else
-      {
-         ii ++;
-      }
    }
 
-   os_unlock(pendingLock);
-
-   if ((sizeof(pendingCommands) / sizeof(pendingCommands[0])) == ii)
+   if (cond)
    {
-      return NULL;
-   }
-
-   struct hci_condition* cond = &pendingCommands[ii];
+      // reserve
+      os_resetCondition(cond->handle);
 
-   os_resetCondition(cond->handle);
+      cond->opcode   = opcode;
+      cond->capacity = capacity;
+      cond->buffer   = result;
 
-   cond->capacity = capacity;
-   cond->buffer   = result;
+      cond->length   = 0;
+      cond->status   = HCI_CONTROLLER_BUSY;
+   }
 
-   cond->length   = 0;
-   cond->status   = HCI_CONTROLLER_BUSY;
+   os_unlock(commands->lock);
 
    return cond;
 }
 
-void releaseCondition(uint16_t opcode)
+void releaseCondition(struct LB_Controller* controller, struct hci_condition* cond)
 {
-   uint32_t ii = 0;
+   os_lock(controller->commands.lock);
 
-   while ((sizeof(pendingCommands) / sizeof(pendingCommands[0])) > ii)
-   {
-      if (opcode == pendingCommands[ii].opcode)
-      {
-         pendingCommands[ii].opcode = 0;
-         break;
-      }
-      else
-      {
-         ii ++;
-      }
-   }
+   // a late event no longer finds the slot, nor the caller buffer
+   cond->opcode = 0;
+   cond->buffer = NULL;
 
-   assert ((sizeof(pendingCommands) / sizeof(pendingCommands[0])) != ii);
+   os_unlock(controller->commands.lock);
 }
 
-void signalCondition(uint16_t opcode, enum HCI_StatusCode status, const uint8_t* result, uint8_t length)
+void signalCondition(struct LB_Controller* controller, uint16_t opcode, enum HCI_StatusCode status, const uint8_t* result, uint8_t length)
 {
    if (lbDebugLevel > 1000)
    {
@@ -171,24 +146,22 @@ void signalCondition(uint16_t opcode, enum HCI_StatusCode status, const uint8_t*
       putchar('\n');
    }
 
-   uint32_t ii = 0;
+   struct lb_commandState* commands = &controller->commands;
+   struct hci_condition* cond = NULL;
+
+   os_lock(commands->lock);
 
-   while ((sizeof(pendingCommands) / sizeof(pendingCommands[0])) > ii)
+   for (uint32_t ii = 0; ii < LB_PENDING_COMMANDS; ii ++)
    {
-      if (opcode == pendingCommands[ii].opcode)
+      if (opcode == commands->pending[ii].opcode)
       {
+         cond = &commands->pending[ii];
          break;
       }
-      else
-      {
-         ii ++;
-      }
    }
 
-   if ((sizeof(pendingCommands) / sizeof(pendingCommands[0])) != ii)
+   if (cond)
    {
-      struct hci_condition* cond = &pendingCommands[ii];
-
       if (length > cond->capacity)
       {
          length = cond->capacity;
@@ -204,25 +177,31 @@ void signalCondition(uint16_t opcode, enum HCI_StatusCode status, const uint8_t*
 
       os_signalCondition(cond->handle, NULL);
    }
-   else
+   else if (lbDebugLevel > 100)
    {
-      assert(false);
+      // the command timed out, and its slot was released
+      printf("Result for opcode %04x without a pending command\n", (unsigned) opcode);
    }
+
+   os_unlock(commands->lock);
 }
 
-enum HCI_StatusCode waitForCondition(struct hci_condition* cond, uint8_t* length)
+enum HCI_StatusCode waitForCondition(struct LB_Controller* controller, struct hci_condition* cond, uint32_t timeout_ms, uint8_t* length)
 {
    enum HCI_StatusCode retval = HCI_CONTROLLER_BUSY;
 
    void* arg;
-   bool signaled = os_waitForCondition(cond->handle, 1000, &arg);
+   bool signaled = os_waitForCondition(cond->handle, timeout_ms, &arg);
+
    if (signaled)
    {
-      retval       = cond->status;
-      *length      = cond->length;
-      cond->opcode = 0;
+      retval  = cond->status;
+      *length = cond->length;
    }
 
+   // released on timeout too, or the slot would be lost
+   releaseCondition(controller, cond);
+
    return retval;
 }
 
@@ -245,8 +224,169 @@ void hci_on_ATT_READ_BY_GROUP_TYPE_RESP_EVENT(struct LB_Controller* controller,
       uint16_t endGroupHandle  = attributeValue[2] | (((uint16_t) attributeValue[3]) << 8);
 
       struct LB_Device* device = getDevice(controller, connectionHandle);
+      if (! device)
+      {
+         break;
+      }
+
       lb_on_discoveredPrimaryService(device, attributeHandle, endGroupHandle, attributeValue + 4, event->attributeDataLength - 4);
 
       attributeValue += event->attributeDataLength;
    }
 }
+
+/*
+ * Each report is laid out as: event type, address type, address[6],
+ * data length, data[data length], rssi. This is how controllers pack
+ * multiple reports in practice, rather than the parameter arrays of the
+ * specification text. The reports are passed on in place, without copying.
+ */
+void hci_on_LE_ADVERTISING_REPORT_EVENT(struct LB_Controller* controller, const uint8_t* buffer, uint8_t length)
+{
+   if (0 == length)
+   {
+      return;
+   }
+
+   uint8_t reportCount = buffer[0];
+
+   const uint8_t* report = buffer + 1;
+   const uint8_t* const reportEnd = buffer + length;
+
+   for (uint8_t ii = 0; ii < reportCount; ii ++)
+   {
+      if ((reportEnd - report) < 9)
+      {
+         break;
+      }
+
+      const uint8_t* address = report + 2;
+      uint8_t dataLength     = report[8];
+      const uint8_t* data    = report + 9;
+
+      if ((reportEnd - data) < (dataLength + 1))
+      {
+         break;
+      }
+
+      int8_t rssi = (int8_t) data[dataLength];
+      on_observedDeviceAdvertisment(controller, address, rssi, data, dataLength);
+
+      report = data + dataLength + 1;
+   }
+}
+
+void hci_on_metaEvent(struct LB_Controller* controller, const uint8_t* event, uint8_t length)
+{
+   if (0 == length)
+   {
+      return;
+   }
+
+   switch (event[0])    // subevent code
+   {
+      case HCI_LE_ADVERTISING_REPORT_EVENT:
+         hci_on_LE_ADVERTISING_REPORT_EVENT(controller, event + 1, length - 1);
+         break;
+
+      default:
+         if (lbDebugLevel > 100)
+         {
+            printf("LE meta event: (code: %02x) -- ", (unsigned) event[0]);
+            utl_printBuffer(event, length);
+            putchar('\n');
+            fflush(stdout);
+         }
+         break;
+   }
+}
+
+/*
+ * The default event mask with the LE Meta event (bit 61) added
+ */
+static const uint8_t CMD_SET_EVENT_MASK[] =
+{
+   HCI_PACKET_COMMAND,
+   HCI_SET_EVENT_MASK & 0xFF,
+   HCI_SET_EVENT_MASK >> 8,
+   8,                                     // parameter length
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x1F, 0x00, 0x20,
+};
+
+/*
+ * Connection complete, advertising report, connection update complete,
+ * read remote used features complete, long term key request
+ */
+static const uint8_t CMD_LE_SET_EVENT_MASK[] =
+{
+   HCI_PACKET_COMMAND,
+   HCI_LE_SET_EVENT_MASK & 0xFF,
+   HCI_LE_SET_EVENT_MASK >> 8,
+   8,                                     // parameter length
+   0x1F, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+enum LB_STATUS hci_enableLEEvents(struct LB_Controller* controller)
+{
+   enum LB_STATUS status = lb_executeCommand(controller, CMD_SET_EVENT_MASK, sizeof(CMD_SET_EVENT_MASK), NULL, 0);
+
+   if (LB_OK == status)
+   {
+      status = lb_executeCommand(controller, CMD_LE_SET_EVENT_MASK, sizeof(CMD_LE_SET_EVENT_MASK), NULL, 0);
+   }
+
+   return status;
+}
+
+enum LB_STATUS hci_startDeviceDiscovery(struct LB_Controller* controller, const struct LB_ScanParameters* parameters)
+{
+   uint8_t setParameters[] =
+   {
+      HCI_PACKET_COMMAND,
+      HCI_LE_SET_SCAN_PARAMETERS & 0xFF,
+      HCI_LE_SET_SCAN_PARAMETERS >> 8,
+      7,                                  // parameter length
+      parameters->active,                 // scan type
+      parameters->interval & 0xFF,
+      parameters->interval >> 8,
+      parameters->window & 0xFF,
+      parameters->window >> 8,
+      0x00,                               // own address type: public
+      0x00,                               // accept all advertisements
+   };
+
+   enum LB_STATUS status = lb_executeCommand(controller, setParameters, sizeof(setParameters), NULL, 0);
+
+   if (LB_OK == status)
+   {
+      uint8_t enable[] =
+      {
+         HCI_PACKET_COMMAND,
+         HCI_LE_SET_SCAN_ENABLE & 0xFF,
+         HCI_LE_SET_SCAN_ENABLE >> 8,
+         2,                               // parameter length
+         0x01,                            // enable
+         parameters->filterDuplicates,
+      };
+
+      status = lb_executeCommand(controller, enable, sizeof(enable), NULL, 0);
+   }
+
+   return status;
+}
+
+static const uint8_t CMD_LE_SET_SCAN_DISABLE[] =
+{
+   HCI_PACKET_COMMAND,
+   HCI_LE_SET_SCAN_ENABLE & 0xFF,
+   HCI_LE_SET_SCAN_ENABLE >> 8,
+   2,                                     // parameter length
+   0x00,                                  // disable
+   0x00,
+};
+
+enum LB_STATUS hci_stopDeviceDiscovery(struct LB_Controller* controller)
+{
+   enum LB_STATUS status = lb_executeCommand(controller, CMD_LE_SET_SCAN_DISABLE, sizeof(CMD_LE_SET_SCAN_DISABLE), NULL, 0);
+   return status;
+}
@@ -29,25 +29,46 @@
  */
 
 #include <hci.h>
+#include <commands.h>
 
-void hci_initialize(void);
+void hci_initialize(struct LB_Controller* controller);
 
-void hci_cleanup(void);
+void hci_cleanup(struct LB_Controller* controller);
 
 struct hci_condition;
 
-struct hci_condition* allocateCondition(uint16_t opcode, uint8_t* result, uint8_t capacity);
+struct hci_condition* allocateCondition(struct LB_Controller* controller, uint16_t opcode, uint8_t* result, uint8_t capacity);
 
-void releaseCondition(uint16_t opcode);
+void releaseCondition(struct LB_Controller* controller, struct hci_condition* cond);
 
-void signalCondition(uint16_t opcode, enum HCI_StatusCode status, const uint8_t* result, uint8_t length);
+void signalCondition(struct LB_Controller* controller, uint16_t opcode, enum HCI_StatusCode status, const uint8_t* result, uint8_t length);
 
-enum HCI_StatusCode waitForCondition(struct hci_condition* cond, uint8_t* length);
+enum HCI_StatusCode waitForCondition(struct LB_Controller* controller, struct hci_condition* cond, uint32_t timeout_ms, uint8_t* length);
 
 extern unsigned lbDebugLevel;
 
 void hci_on_ATT_READ_BY_GROUP_TYPE_RESP_EVENT(struct LB_Controller* controller, const uint8_t* buffer, uint8_t length);
 
+void hci_on_LE_ADVERTISING_REPORT_EVENT(struct LB_Controller* controller, const uint8_t* buffer, uint8_t length);
+
+void hci_on_metaEvent(struct LB_Controller* controller, const uint8_t* event, uint8_t length);
+
+enum LB_STATUS hci_enableLEEvents(struct LB_Controller* controller);
+
+enum LB_STATUS hci_startDeviceDiscovery(struct LB_Controller* controller, const struct LB_ScanParameters* parameters);
+
+enum LB_STATUS hci_stopDeviceDiscovery(struct LB_Controller* controller);
+
+enum LB_STATUS hci_readBufferSize(struct LB_Controller* controller);
+
+enum LB_STATUS hci_sendACLData(struct LB_Device* device, uint16_t channelId, const uint8_t* payload, uint16_t length);
+
+void hci_on_ACLData(struct LB_Controller* controller, const uint8_t* packet, uint16_t length);
+
+void hci_on_numberOfCompletedPackets(struct LB_Controller* controller, const uint8_t* event, uint8_t length);
+
+void hci_releaseACLCredits(struct LB_Device* device);
+
 
 #endif // __HCI_PRIV_H__
 
@@ -0,0 +1,905 @@
+/**
+ * @file l2cap.c
+ * @brief L2CAP LE signaling and credit based channels
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+/*
+ * Based on:
+ *    Bluetooth Core Specification Version 4.2, Vol 3, Part A
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <malloc.h>
+
+#include <osal_core.h>
+#include <utils.h>
+
+#include <att.h>
+#include <commands.h>
+
+#include "lb_priv.h"
+#include "hci_priv.h"
+
+#define L2CAP_MAX_CREDITS              0xFFFF
+
+// the initial credits cover the whole receive ring
+#define L2CAP_INITIAL_CREDITS          (LB_L2CAP_RX_BUFFER / LB_L2CAP_MPS)
+
+static inline uint16_t readUint16(const uint8_t* buffer)
+{
+   return buffer[0] | (((uint16_t) buffer[1]) << 8);
+}
+
+void l2cap_initialize(struct LB_Device* device)
+{
+   device->l2cap.requestLock       = os_createLock();
+   device->l2cap.channelLock       = os_createLock();
+   device->l2cap.responseLock      = os_createLock();
+   device->l2cap.responseReceived  = os_acquireCompletion(device->controller->completions);
+   device->l2cap.responseTicket    = 0;
+   device->l2cap.pendingIdentifier = 0;
+   atomic_init(&device->l2cap.nextIdentifier, 1);
+   device->l2cap.responseLength    = 0;
+   device->l2cap.pendingChannel    = NULL;
+
+   memset(device->l2cap.channel, 0, sizeof(device->l2cap.channel));
+}
+
+static void destroyChannel(struct LB_Channel* channel)
+{
+   os_destroyCondition(channel->dataReceived);
+   os_destroyCondition(channel->creditsReceived);
+   os_destroyLock(channel->rxLock);
+   os_destroyLock(channel->txLock);
+   os_destroyLock(channel->lock);
+
+   free(channel);
+}
+
+void l2cap_cleanup(struct LB_Device* device)
+{
+   if (! device->l2cap.channelLock)
+   {
+      return;
+   }
+
+   for (uint32_t ii = 0; ii < LB_L2CAP_MAX_CHANNELS; ii ++)
+   {
+      if (device->l2cap.channel[ii])
+      {
+         destroyChannel(device->l2cap.channel[ii]);
+         device->l2cap.channel[ii] = NULL;
+      }
+   }
+
+   os_releaseCompletion(device->l2cap.responseReceived);
+   os_destroyLock(device->l2cap.responseLock);
+   os_destroyLock(device->l2cap.channelLock);
+   os_destroyLock(device->l2cap.requestLock);
+
+   device->l2cap.responseReceived = NULL;
+   device->l2cap.responseLock     = NULL;
+   device->l2cap.channelLock      = NULL;
+   device->l2cap.requestLock      = NULL;
+}
+
+static uint8_t allocateIdentifier(struct LB_Device* device)
+{
+   uint8_t identifier;
+
+   // identifier 0 is invalid
+   do
+   {
+      identifier = (uint8_t) atomic_fetch_add(&device->l2cap.nextIdentifier, 1);
+   } while (0 == identifier);
+
+   return identifier;
+}
+
+static enum LB_STATUS sendSignal(struct LB_Device* device, uint8_t code, uint8_t identifier, const uint8_t* data, uint16_t length)
+{
+   uint8_t pdu[LB_L2CAP_MAX_SIGNAL];
+
+   assert((L2CAP_SIGNALING_HEADER_LENGTH + length) <= sizeof(pdu));
+
+   pdu[0] = code;
+   pdu[1] = identifier;
+   setUint16Value(pdu + 2, length);
+   memcpy(pdu + L2CAP_SIGNALING_HEADER_LENGTH, data, length);
+
+   return hci_sendACLData(device, L2CAP_CID_LE_SIGNALING, pdu, L2CAP_SIGNALING_HEADER_LENGTH + length);
+}
+
+struct deferredSignal
+{
+   struct LB_Device* device;
+   uint8_t           code;
+   uint8_t           identifier;
+   uint16_t          length;
+   uint8_t           data[LB_L2CAP_MAX_SIGNAL - L2CAP_SIGNALING_HEADER_LENGTH];
+};
+
+static void sendDeferredSignal(void* arg)
+{
+   struct deferredSignal* signal = (struct deferredSignal*) arg;
+
+   if (isDeviceConnected(signal->device))
+   {
+      sendSignal(signal->device, signal->code, signal->identifier, signal->data, signal->length);
+   }
+
+   free(signal);
+}
+
+/*
+ * Sending waits for controller buffers, which is not allowed on the I/O
+ * thread; responses to the peer requests are sent from the thread pool.
+ */
+static void sendSignalLater(struct LB_Device* device, uint8_t code, uint8_t identifier, const uint8_t* data, uint16_t length)
+{
+   struct deferredSignal* signal = malloc(sizeof(struct deferredSignal));
+   if (! signal)
+   {
+      return;
+   }
+
+   assert(length <= sizeof(signal->data));
+
+   signal->device     = device;
+   signal->code       = code;
+   signal->identifier = identifier;
+   signal->length     = length;
+   memcpy(signal->data, data, length);
+
+   if (! os_executeLater(0, sendDeferredSignal, signal))
+   {
+      free(signal);
+   }
+}
+
+/*
+ * Sends a signaling request and waits for the response with the same
+ * identifier; the response is copied, header included.
+ */
+static enum LB_STATUS executeRequest(struct LB_Device* device, uint8_t code, const uint8_t* data, uint16_t length, struct LB_Channel* channel, uint8_t* response, uint8_t* responseLength)
+{
+   os_lock(device->l2cap.requestLock);
+
+   const uint8_t identifier = allocateIdentifier(device);
+
+   os_lock(device->l2cap.responseLock);
+   device->l2cap.responseLength = 0;
+   device->l2cap.pendingChannel = channel;
+   device->l2cap.responseTicket = os_armCompletion(device->l2cap.responseReceived);
+   device->l2cap.pendingIdentifier = identifier;
+   const uint32_t ticket = device->l2cap.responseTicket;
+   os_unlock(device->l2cap.responseLock);
+
+   enum LB_STATUS status = sendSignal(device, code, identifier, data, length);
+
+   if (LB_OK == status)
+   {
+      bool signaled = os_waitForCompletion(device->l2cap.responseReceived, ticket, device->controller->timeouts.signaling_ms, NULL);
+      if (! signaled)
+      {
+         status = LB_OPERATION_TIMEOUT;
+      }
+   }
+
+   // once cleared under the lock, the I/O thread no longer touches the pending channel
+   os_lock(device->l2cap.responseLock);
+
+   device->l2cap.pendingIdentifier = 0;
+   device->l2cap.pendingChannel    = NULL;
+
+   if ((LB_OK == status) && (0 == device->l2cap.responseLength))
+   {
+      // disconnected while waiting
+      status = LB_DEVICE_NOT_CONNECTED;
+   }
+
+   if (LB_OK == status)
+   {
+      memcpy(response, device->l2cap.response, device->l2cap.responseLength);
+      *responseLength = device->l2cap.responseLength;
+   }
+
+   os_unlock(device->l2cap.responseLock);
+
+   os_unlock(device->l2cap.requestLock);
+
+   return status;
+}
+
+/*
+ * Must be called with the channel lock held
+ */
+static struct LB_Channel* findLocalChannel(struct LB_Device* device, uint16_t channelId)
+{
+   if ((L2CAP_CID_DYNAMIC_FIRST > channelId) || ((L2CAP_CID_DYNAMIC_FIRST + LB_L2CAP_MAX_CHANNELS) <= channelId))
+   {
+      return NULL;
+   }
+
+   return device->l2cap.channel[channelId - L2CAP_CID_DYNAMIC_FIRST];
+}
+
+static void closeChannel(struct LB_Channel* channel)
+{
+   os_lock(channel->lock);
+   channel->open = false;
+   os_unlock(channel->lock);
+
+   // wake up blocked readers and writers
+   os_signalCondition(channel->dataReceived, NULL);
+   os_signalCondition(channel->creditsReceived, NULL);
+}
+
+/*
+ * Called from the I/O thread, with the response matching the outstanding
+ * connection request
+ */
+static void onConnectionResponse(struct LB_Channel* channel, const uint8_t* data, uint16_t length)
+{
+   if ((10 > length) || (L2CAP_LE_CONNECTION_SUCCESSFUL != readUint16(data + 8)))
+   {
+      return;
+   }
+
+   const uint16_t remoteId = readUint16(data);
+   const uint16_t mtu      = readUint16(data + 2);
+   const uint16_t mps      = readUint16(data + 4);
+   const uint16_t credits  = readUint16(data + 6);
+
+   if ((L2CAP_CID_DYNAMIC_FIRST > remoteId) || (L2CAP_CID_DYNAMIC_LAST < remoteId) ||
+         (L2CAP_LE_MIN_MTU > mtu) || (L2CAP_LE_MIN_MTU > mps) || (0xFFFD < mps))
+   {
+      return;
+   }
+
+   // configured here, so credits sent right after the response are not lost
+   os_lock(channel->lock);
+   channel->remoteId  = remoteId;
+   channel->remoteMtu = mtu;
+   channel->remoteMps = mps;
+   channel->txCredits = credits;
+   channel->open      = true;
+   os_unlock(channel->lock);
+}
+
+static void onCreditsReceived(struct LB_Device* device, uint16_t remoteId, uint16_t credits)
+{
+   os_lock(device->l2cap.channelLock);
+
+   for (uint32_t ii = 0; ii < LB_L2CAP_MAX_CHANNELS; ii ++)
+   {
+      struct LB_Channel* channel = device->l2cap.channel[ii];
+
+      if (channel && channel->open && (channel->remoteId == remoteId))
+      {
+         os_lock(channel->lock);
+         channel->txCredits += credits;
+         if (L2CAP_MAX_CREDITS < channel->txCredits)
+         {
+            channel->txCredits = L2CAP_MAX_CREDITS;
+         }
+         os_unlock(channel->lock);
+
+         os_signalCondition(channel->creditsReceived, NULL);
+         break;
+      }
+   }
+
+   os_unlock(device->l2cap.channelLock);
+}
+
+static void onDisconnectionRequest(struct LB_Device* device, uint8_t identifier, const uint8_t* data)
+{
+   const uint16_t localId  = readUint16(data);
+   const uint16_t remoteId = readUint16(data + 2);
+
+   os_lock(device->l2cap.channelLock);
+
+   struct LB_Channel* channel = findLocalChannel(device, localId);
+   bool matched = channel && (channel->remoteId == remoteId);
+
+   if (matched)
+   {
+      closeChannel(channel);
+   }
+
+   os_unlock(device->l2cap.channelLock);
+
+   if (matched)
+   {
+      sendSignalLater(device, L2CAP_DISCONNECTION_RSP, identifier, data, 4);
+   }
+   else
+   {
+      uint8_t reject[6] = { 0x02, 0x00 };           // invalid CID in request
+      memcpy(reject + 2, data, 4);
+      sendSignalLater(device, L2CAP_COMMAND_REJECT, identifier, reject, sizeof(reject));
+   }
+}
+
+/*
+ * Called from the I/O thread
+ */
+void l2cap_on_signaling(struct LB_Device* device, const uint8_t* pdu, uint16_t length)
+{
+   if (L2CAP_SIGNALING_HEADER_LENGTH > length)
+   {
+      return;
+   }
+
+   const uint8_t code       = pdu[0];
+   const uint8_t identifier = pdu[1];
+   const uint16_t dataLength = readUint16(pdu + 2);
+   const uint8_t* data      = pdu + L2CAP_SIGNALING_HEADER_LENGTH;
+
+   if ((length - L2CAP_SIGNALING_HEADER_LENGTH) < dataLength)
+   {
+      return;
+   }
+
+   switch (code)
+   {
+      case L2CAP_COMMAND_REJECT:
+      case L2CAP_DISCONNECTION_RSP:
+      case L2CAP_CONNECTION_PARAMETER_UPDATE_RSP:
+      case L2CAP_LE_CREDIT_CONNECTION_RSP:
+         os_lock(device->l2cap.responseLock);
+
+         if (identifier && (identifier == device->l2cap.pendingIdentifier))
+         {
+            if ((L2CAP_LE_CREDIT_CONNECTION_RSP == code) && device->l2cap.pendingChannel)
+            {
+               onConnectionResponse(device->l2cap.pendingChannel, data, dataLength);
+            }
+
+            length = L2CAP_SIGNALING_HEADER_LENGTH + dataLength;
+            if (length > sizeof(device->l2cap.response))
+            {
+               length = sizeof(device->l2cap.response);
+            }
+
+            memcpy(device->l2cap.response, pdu, length);
+            device->l2cap.responseLength    = (uint8_t) length;
+            device->l2cap.pendingIdentifier = 0;
+
+            os_signalCompletion(device->l2cap.responseReceived, device->l2cap.responseTicket, NULL);
+         }
+
+         os_unlock(device->l2cap.responseLock);
+         break;
+
+      case L2CAP_LE_FLOW_CONTROL_CREDIT:
+         if (4 <= dataLength)
+         {
+            onCreditsReceived(device, readUint16(data), readUint16(data + 2));
+         }
+         break;
+
+      case L2CAP_DISCONNECTION_REQ:
+         if (4 <= dataLength)
+         {
+            onDisconnectionRequest(device, identifier, data);
+         }
+         break;
+
+      case L2CAP_CONNECTION_PARAMETER_UPDATE_REQ:
+         {
+            // the application chooses the connection parameters
+            const uint8_t rejected[2] = { 0x01, 0x00 };
+            sendSignalLater(device, L2CAP_CONNECTION_PARAMETER_UPDATE_RSP, identifier, rejected, sizeof(rejected));
+         }
+         break;
+
+      case L2CAP_LE_CREDIT_CONNECTION_REQ:
+         {
+            // no local services
+            uint8_t refused[10] = { 0 };
+            setUint16Value(refused + 8, L2CAP_LE_PSM_NOT_SUPPORTED);
+            sendSignalLater(device, L2CAP_LE_CREDIT_CONNECTION_RSP, identifier, refused, sizeof(refused));
+         }
+         break;
+
+      default:
+         {
+            const uint8_t notUnderstood[2] = { 0x00, 0x00 };
+            sendSignalLater(device, L2CAP_COMMAND_REJECT, identifier, notUnderstood, sizeof(notUnderstood));
+         }
+         break;
+   }
+}
+
+/*
+ * Must be called with the channel lock held; returns true if data was
+ * added to the receive ring
+ */
+static bool receiveFrame(struct LB_Channel* channel, const uint8_t* pdu, uint16_t length)
+{
+   if (! channel->open)
+   {
+      return false;
+   }
+
+   if ((0 == channel->rxCredits) || (LB_L2CAP_MPS < length))
+   {
+      if (lbDebugLevel > 100)
+      {
+         printf("Dropping K-frame on channel %04x: flow control violation\n", (unsigned) channel->localId);
+      }
+      return false;
+   }
+
+   channel->rxCredits --;
+
+   if (0 == channel->sduRemaining)
+   {
+      // the first K-frame of an SDU starts with the SDU length
+      if (2 > length)
+      {
+         return false;
+      }
+
+      const uint16_t sduLength = readUint16(pdu);
+      if (LB_L2CAP_MTU < sduLength)
+      {
+         return false;
+      }
+
+      channel->sduRemaining = sduLength;
+      pdu    += 2;
+      length -= 2;
+   }
+
+   if (length > channel->sduRemaining)
+   {
+      channel->sduRemaining = 0;
+      return false;
+   }
+
+   channel->sduRemaining -= length;
+
+   // the granted credits guarantee the space
+   assert((channel->rxCount + length) <= LB_L2CAP_RX_BUFFER);
+
+   uint32_t tail = (channel->rxHead + channel->rxCount) % LB_L2CAP_RX_BUFFER;
+   uint32_t first = LB_L2CAP_RX_BUFFER - tail;
+   if (first > length)
+   {
+      first = length;
+   }
+
+   memcpy(channel->rx + tail, pdu, first);
+   memcpy(channel->rx, pdu + first, length - first);
+   channel->rxCount += length;
+
+   return 0 != length;
+}
+
+/*
+ * Called from the I/O thread with a K-frame on a dynamic channel
+ */
+void l2cap_on_receive(struct LB_Device* device, uint16_t channelId, const uint8_t* pdu, uint16_t length)
+{
+   os_lock(device->l2cap.channelLock);
+
+   struct LB_Channel* channel = findLocalChannel(device, channelId);
+   if (channel)
+   {
+      os_lock(channel->lock);
+      bool received = receiveFrame(channel, pdu, length);
+      os_unlock(channel->lock);
+
+      if (received)
+      {
+         os_signalCondition(channel->dataReceived, NULL);
+      }
+   }
+
+   os_unlock(device->l2cap.channelLock);
+}
+
+void l2cap_on_disconnected(struct LB_Device* device)
+{
+   os_lock(device->l2cap.channelLock);
+
+   for (uint32_t ii = 0; ii < LB_L2CAP_MAX_CHANNELS; ii ++)
+   {
+      if (device->l2cap.channel[ii])
+      {
+         closeChannel(device->l2cap.channel[ii]);
+      }
+   }
+
+   os_unlock(device->l2cap.channelLock);
+
+   os_lock(device->l2cap.responseLock);
+
+   if (device->l2cap.pendingIdentifier)
+   {
+      device->l2cap.pendingIdentifier = 0;
+      device->l2cap.responseLength    = 0;
+      os_signalCompletion(device->l2cap.responseReceived, device->l2cap.responseTicket, NULL);
+   }
+
+   os_unlock(device->l2cap.responseLock);
+}
+
+/*
+ * Grants the peer credits for the free space in the receive ring; grants
+ * are batched unless the peer ran out of credits.
+ */
+static void replenishCredits(struct LB_Channel* channel)
+{
+   os_lock(channel->lock);
+
+   uint32_t credits = 0;
+
+   if (channel->open)
+   {
+      uint32_t reserved = channel->rxCount + channel->rxCredits * LB_L2CAP_MPS;
+      credits = (LB_L2CAP_RX_BUFFER - reserved) / LB_L2CAP_MPS;
+
+      if ((credits < (L2CAP_INITIAL_CREDITS / 2)) && (0 != channel->rxCredits))
+      {
+         credits = 0;
+      }
+
+      channel->rxCredits += credits;
+   }
+
+   os_unlock(channel->lock);
+
+   if (credits)
+   {
+      uint8_t data[4];
+      setUint16Value(data, channel->localId);
+      setUint16Value(data + 2, (uint16_t) credits);
+
+      sendSignal(channel->device, L2CAP_LE_FLOW_CONTROL_CREDIT, allocateIdentifier(channel->device), data, sizeof(data));
+   }
+}
+
+enum LB_STATUS lb_openChannel(struct LB_Device* device, uint16_t psm, struct LB_Channel** channel)
+{
+   if ((! device) || (! channel) || (0 == psm))
+   {
+      return LB_INVALID_PARAMETERS;
+   }
+
+   *channel = NULL;
+
+   if (! isDeviceConnected(device))
+   {
+      return LB_DEVICE_NOT_CONNECTED;
+   }
+
+   struct LB_Channel* newChannel = calloc(1, sizeof(struct LB_Channel));
+   if (! newChannel)
+   {
+      return LB_FAILURE;
+   }
+
+   newChannel->device          = device;
+   newChannel->lock            = os_createLock();
+   newChannel->txLock          = os_createLock();
+   newChannel->rxLock          = os_createLock();
+   newChannel->creditsReceived = os_createCondition();
+   newChannel->dataReceived    = os_createCondition();
+   newChannel->psm             = psm;
+   newChannel->rxCredits       = L2CAP_INITIAL_CREDITS;
+
+   // the slot index selects the source CID
+   os_lock(device->l2cap.channelLock);
+
+   for (uint32_t ii = 0; ii < LB_L2CAP_MAX_CHANNELS; ii ++)
+   {
+      if (! device->l2cap.channel[ii])
+      {
+         device->l2cap.channel[ii] = newChannel;
+         newChannel->localId       = (uint16_t) (L2CAP_CID_DYNAMIC_FIRST + ii);
+         break;
+      }
+   }
+
+   os_unlock(device->l2cap.channelLock);
+
+   if (0 == newChannel->localId)
+   {
+      destroyChannel(newChannel);
+      return LB_CONNECTION_LIMIT_REACHED;
+   }
+
+   uint8_t request[10];
+   setUint16Value(request,     psm);
+   setUint16Value(request + 2, newChannel->localId);
+   setUint16Value(request + 4, LB_L2CAP_MTU);
+   setUint16Value(request + 6, LB_L2CAP_MPS);
+   setUint16Value(request + 8, L2CAP_INITIAL_CREDITS);
+
+   uint8_t response[LB_L2CAP_MAX_SIGNAL];
+   uint8_t responseLength = 0;
+
+   enum LB_STATUS status = executeRequest(device, L2CAP_LE_CREDIT_CONNECTION_REQ, request, sizeof(request), newChannel, response, &responseLength);
+
+   if ((LB_OK == status) && (! newChannel->open))
+   {
+      if ((lbDebugLevel > 100) && (L2CAP_LE_CREDIT_CONNECTION_RSP == response[0]) && (14 <= responseLength))
+      {
+         printf("Channel to PSM %04x refused: %04x\n", (unsigned) psm, (unsigned) readUint16(response + 12));
+      }
+
+      status = LB_FAILURE;
+   }
+
+   if (LB_OK != status)
+   {
+      os_lock(device->l2cap.channelLock);
+      device->l2cap.channel[newChannel->localId - L2CAP_CID_DYNAMIC_FIRST] = NULL;
+      os_unlock(device->l2cap.channelLock);
+
+      destroyChannel(newChannel);
+      return status;
+   }
+
+   *channel = newChannel;
+
+   return LB_OK;
+}
+
+static enum LB_STATUS acquireCredit(struct LB_Channel* channel)
+{
+   const uint64_t deadline = os_getTime_ms() + channel->device->controller->timeouts.channelCredit_ms;
+
+   os_lock(channel->lock);
+
+   while (channel->open && (0 == channel->txCredits))
+   {
+      os_resetCondition(channel->creditsReceived);
+      os_unlock(channel->lock);
+
+      uint64_t now = os_getTime_ms();
+      if (now < deadline)
+      {
+         os_waitForCondition(channel->creditsReceived, (uint32_t) (deadline - now), NULL);
+      }
+
+      os_lock(channel->lock);
+
+      if (now >= deadline)
+      {
+         break;
+      }
+   }
+
+   enum LB_STATUS status = LB_OK;
+
+   if (! channel->open)
+   {
+      status = LB_CHANNEL_CLOSED;
+   }
+   else if (0 == channel->txCredits)
+   {
+      status = LB_OPERATION_TIMEOUT;
+   }
+   else
+   {
+      channel->txCredits --;
+   }
+
+   os_unlock(channel->lock);
+
+   return status;
+}
+
+enum LB_STATUS lb_writeChannel(struct LB_Channel* channel, const uint8_t* data, uint32_t length)
+{
+   if ((! channel) || ((! data) && length))
+   {
+      return LB_INVALID_PARAMETERS;
+   }
+
+   struct LB_Device* device = channel->device;
+
+   // we may send K-frames smaller than the peer MPS
+   uint16_t frameCapacity = channel->remoteMps;
+   if (frameCapacity > LB_L2CAP_MPS)
+   {
+      frameCapacity = LB_L2CAP_MPS;
+   }
+
+   uint8_t frame[LB_L2CAP_MPS];
+
+   enum LB_STATUS status = LB_OK;
+
+   os_lock(channel->txLock);
+
+   for (uint32_t offset = 0; (offset < length) && (LB_OK == status); )
+   {
+      uint16_t sduLength = channel->remoteMtu;
+      if ((length - offset) < sduLength)
+      {
+         sduLength = (uint16_t) (length - offset);
+      }
+
+      // the first K-frame of an SDU starts with the SDU length
+      setUint16Value(frame, sduLength);
+      uint16_t headerLength = 2;
+
+      for (uint16_t sent = 0; sent < sduLength; )
+      {
+         uint16_t segmentLength = frameCapacity - headerLength;
+         if ((sduLength - sent) < segmentLength)
+         {
+            segmentLength = sduLength - sent;
+         }
+
+         memcpy(frame + headerLength, data + offset + sent, segmentLength);
+
+         status = acquireCredit(channel);
+         if (LB_OK != status)
+         {
+            break;
+         }
+
+         status = hci_sendACLData(device, channel->remoteId, frame, headerLength + segmentLength);
+         if (LB_OK != status)
+         {
+            break;
+         }
+
+         sent        += segmentLength;
+         headerLength = 0;
+      }
+
+      offset += sduLength;
+   }
+
+   os_unlock(channel->txLock);
+
+   return status;
+}
+
+enum LB_STATUS lb_readChannel(struct LB_Channel* channel, uint8_t* buffer, uint32_t capacity, uint32_t* length, uint32_t timeout_ms)
+{
+   if ((! channel) || (! buffer) || (! length))
+   {
+      return LB_INVALID_PARAMETERS;
+   }
+
+   *length = 0;
+
+   os_lock(channel->rxLock);
+
+   // credits of discarded K-frames are granted again
+   replenishCredits(channel);
+
+   const uint64_t deadline = os_getTime_ms() + timeout_ms;
+
+   enum LB_STATUS status;
+
+   os_lock(channel->lock);
+
+   while (true)
+   {
+      if (channel->rxCount)
+      {
+         uint32_t count = (capacity < channel->rxCount) ? capacity : channel->rxCount;
+
+         uint32_t first = LB_L2CAP_RX_BUFFER - channel->rxHead;
+         if (first > count)
+         {
+            first = count;
+         }
+
+         memcpy(buffer, channel->rx + channel->rxHead, first);
+         memcpy(buffer + first, channel->rx, count - first);
+
+         channel->rxHead   = (channel->rxHead + count) % LB_L2CAP_RX_BUFFER;
+         channel->rxCount -= count;
+
+         *length = count;
+         status  = LB_OK;
+         break;
+      }
+
+      if (! channel->open)
+      {
+         status = LB_CHANNEL_CLOSED;
+         break;
+      }
+
+      uint64_t now = os_getTime_ms();
+      if (now >= deadline)
+      {
+         status = LB_OPERATION_TIMEOUT;
+         break;
+      }
+
+      os_resetCondition(channel->dataReceived);
+      os_unlock(channel->lock);
+
+      os_waitForCondition(channel->dataReceived, (uint32_t) (deadline - now), NULL);
+
+      os_lock(channel->lock);
+   }
+
+   os_unlock(channel->lock);
+
+   if (*length)
+   {
+      replenishCredits(channel);
+   }
+
+   os_unlock(channel->rxLock);
+
+   return status;
+}
+
+enum LB_STATUS lb_closeChannel(struct LB_Channel* channel)
+{
+   if (! channel)
+   {
+      return LB_INVALID_PARAMETERS;
+   }
+
+   struct LB_Device* device = channel->device;
+
+   os_lock(channel->lock);
+   bool wasOpen = channel->open;
+   os_unlock(channel->lock);
+
+   closeChannel(channel);
+
+   enum LB_STATUS status = LB_OK;
+
+   if (wasOpen && isDeviceConnected(device))
+   {
+      uint8_t request[4];
+      setUint16Value(request,     channel->remoteId);
+      setUint16Value(request + 2, channel->localId);
+
+      uint8_t response[LB_L2CAP_MAX_SIGNAL];
+      uint8_t responseLength = 0;
+
+      status = executeRequest(device, L2CAP_DISCONNECTION_REQ, request, sizeof(request), NULL, response, &responseLength);
+   }
+
+   // let a writer or a reader woken up by the close finish
+   os_lock(channel->txLock);
+   os_unlock(channel->txLock);
+
+   os_lock(channel->rxLock);
+   os_unlock(channel->rxLock);
+
+   os_lock(device->l2cap.channelLock);
+   device->l2cap.channel[channel->localId - L2CAP_CID_DYNAMIC_FIRST] = NULL;
+   os_unlock(device->l2cap.channelLock);
+
+   destroyChannel(channel);
+
+   return status;
+}
@@ -29,13 +29,48 @@
  */
 
 #include <assert.h>
+#include <stdatomic.h>
 
+#include <osal_core.h>
 #include <osal_io.h>
 
 #include <commands.h>
 
 #define INVALID_CONNECTION_HANDLE  0xffff
 
+#define LB_MAX_DEVICES             8
+
+// operations a device queues, including the one in progress
+#define LB_OPERATION_QUEUE         8
+
+// completions a connected device takes from the controller pool: one per
+// operation slot, the ATT and L2CAP signaling responses, and the disconnect
+#define LB_DEVICE_COMPLETIONS      (LB_OPERATION_QUEUE + 3)
+
+// largest ATT PDU handled by the host ATT client
+#define LB_ATT_MAX_PDU             64
+
+// largest inbound L2CAP frame reassembled from ACL fragments, header included
+#define LB_L2CAP_MAX_FRAME         520
+
+// largest ACL packet payload sent, regardless of the controller buffers
+#define LB_ACL_MAX_FRAGMENT        251
+
+// connection-oriented channels per device
+#define LB_L2CAP_MAX_CHANNELS      4
+
+// receive parameters of connection-oriented channels; a K-frame with
+// the largest MPS fills a reassembled L2CAP frame
+#define LB_L2CAP_MTU               2048
+#define LB_L2CAP_MPS               (LB_L2CAP_MAX_FRAME - 4)
+#define LB_L2CAP_RX_BUFFER         8192
+
+// largest L2CAP signaling command handled
+#define LB_L2CAP_MAX_SIGNAL        64
+
+// HCI commands awaiting their completion, per controller
+#define LB_PENDING_COMMANDS        4
+
 struct lb_vendorFunctions
 {
    void           (* on_vendorSpecificEvent)(struct LB_Controller* controller, const uint8_t* event, uint8_t length);
@@ -44,16 +79,29 @@ struct lb_vendorFunctions
    enum LB_STATUS (* initializeHCI)(struct LB_Controller* controller);
    enum LB_STATUS (* configureAsCentral)(struct LB_Controller* controller);
 
-   enum LB_STATUS (* startDeviceDiscovery)(struct LB_Controller* controller);
+   // rebuilds the host state of a controller configured by an earlier process, keeping its links
+   enum LB_STATUS (* attachHCI)(struct LB_Controller* controller);
+
+   enum LB_STATUS (* startDeviceDiscovery)(struct LB_Controller* controller, const struct LB_ScanParameters* parameters);
    enum LB_STATUS (* stopDeviceDiscovery)(struct LB_Controller* controller);
 
-   enum LB_STATUS (* openDeviceConnection)(struct LB_Controller* controller, const uint8_t* address);
+   enum LB_STATUS (* openDeviceConnection)(struct LB_Controller* controller, const uint8_t* address, const struct LB_ConnectionParameters* parameters);
+
+   // optional; the cancelled attempt is then reported through on_connectionFailed
+   enum LB_STATUS (* cancelDeviceConnection)(struct LB_Controller* controller);
+
    enum LB_STATUS (* closeDeviceConnection)(struct LB_Device* device);
+   enum LB_STATUS (* updateConnectionParameters)(struct LB_Device* device, const struct LB_ConnectionParameters* parameters);
 
    enum LB_STATUS (* startServiceDiscovery)(struct LB_Device* device);
 
    enum LB_STATUS (* writeCharValue)  (struct LB_Device* device, uint16_t attributeHandle, const uint8_t* attributeValue, uint8_t attributeLength);
    enum LB_STATUS (* requestCharValue)(struct LB_Device* device, uint16_t attributeHandle);
+
+   enum LB_STATUS (* writeCharValueWithoutResponse)(struct LB_Device* device, uint16_t attributeHandle, const uint8_t* attributeValue, uint8_t attributeLength);
+
+   // the GATT functions above run the whole ATT transaction before returning
+   bool           blockingGATT;
 };
 
 enum PendingOperation
@@ -62,16 +110,95 @@ enum PendingOperation
    PO_DISCOVER,
    PO_READ,
    PO_WRITE,
+   PO_UPDATE,
+};
+
+#define PO_MASK(type)            (1u << (type))
+
+/*
+ * Life cycle of a device operation slot. A caller claims a FREE slot,
+ * publishes its request in it, and frees it when the request is finished.
+ *
+ * The transitions are atomic, and they decide who may touch the caller
+ * buffers: the thread that issues the request while ISSUING, the thread
+ * that completes it while COMPLETING, and the caller otherwise. A caller
+ * that times out abandons a QUEUED or ISSUED request and returns at once.
+ * An asynchronous request has no caller waiting: whoever finishes it frees
+ * the slot.
+ */
+enum OperationState
+{
+   OP_FREE,
+   OP_CLAIMED,             // request being filled in
+   OP_QUEUED,
+   OP_ISSUING,             // vendor command being sent
+   OP_ISSUED,
+   OP_COMPLETING,          // I/O thread filling in the results
+   OP_RESPONDED,           // completed while ISSUING; the issuing thread finishes it
+   OP_DONE,
+   OP_ABANDONED,
+};
+
+struct lb_request
+{
+   uint16_t                type;                // enum PendingOperation above
+   uint16_t                attributeHandle;
+   uint8_t                 priority;            // enum LB_Priority
+
+   const uint8_t*          value;               // PO_WRITE
+   uint8_t                 valueLength;
+
+   uint8_t*                readValue;           // PO_READ
+   uint8_t                 readCapacity;
+   uint8_t*                readLength;
+
+   const struct LB_ConnectionParameters*  parameters;    // PO_UPDATE
+};
+
+struct lb_operation
+{
+   atomic_uint             state;               // enum OperationState above
+   unsigned                resumeState;         // restored by operation_release
+
+   struct lb_request       request;
+   uint32_t                sequence;            // FIFO order within the priority class
+
+   struct LB_Device*       device;
+
+   enum LB_STATUS          result;
+   void*                   status;              // from the completing thread
+
+   struct os_completion*   completion;
+   uint32_t                ticket;
+
+   // asynchronous requests are completed through the callback instead
+   LB_OperationCallback    callback;
+   void*                   context;
+   _Atomic uint64_t        deadline_ms;         // UINT64_MAX for the blocking requests
 };
 
 struct LB_Controller;
 
+struct lb_savedState;
+
 struct LB_Device
 {
    struct LB_Controller*   controller;
 
    uint16_t                connectionHandle;
 
+   // the peer or the controller dropped the link; the slot stays taken until closed
+   volatile bool           linkLost;
+
+   uint8_t                 address[6];
+
+   struct
+   {
+      uint16_t             interval;
+      uint16_t             latency;
+      uint16_t             supervisionTimeout;
+   }  connectionParameters;
+
    /*
     * The ATT_ReadResponse structure does not contain any attribute handle
     * so this means there can be only one in-flight read operation per
@@ -80,72 +207,463 @@ struct LB_Device
     * Also, ST BlueNRG does not return ATT_WriteRsp as distinct from
     * ATT_ReadRsp, instead it returns GATT_PROC_COMPLETE, forcing us to
     * remember what command was in-flight.
+    *
+    * Requests from application threads are queued in operation slots, and
+    * the controller scheduler issues them one at a time.
     */
+   struct
+   {
+      atomic_uint          sequence;
+      struct lb_operation* _Atomic active;      // issued, read by the I/O thread
+      struct lb_operation  slot[LB_OPERATION_QUEUE];
+   }  operations;
 
-   struct os_lock*         operationLock;
-   struct os_condition*    operationComplete;
+   /*
+    * Host ATT client, used with controllers that pass ACL data to the host.
+    * ATT allows a single outstanding request per bearer; the response is
+    * matched against it on the I/O thread and copied here.
+    */
+   struct
+   {
+      struct os_completion* responseReceived;
+      uint32_t             responseTicket;
+      volatile uint8_t     pendingRequest;      // request opcode, 0 if none
+      uint8_t              responseLength;
+      uint8_t              response[LB_ATT_MAX_PDU];
+      uint16_t             mtu;
+   }  att;
+
+   /*
+    * HCI ACL state, used with controllers that pass ACL data to the host;
+    * the counters are protected by the controller acl.creditLock
+    */
+   struct
+   {
+      struct os_lock*      txLock;              // keeps the fragments of a frame together
+      uint32_t             inFlight;            // sent, not yet reported as completed
+      uint32_t             waiting;             // senders blocked for a credit
+
+      uint16_t             rxExpected;          // length of the frame being reassembled
+      uint16_t             rxLength;
+      uint8_t              rx[LB_L2CAP_MAX_FRAME];
+   }  acl;
 
+   /*
+    * L2CAP signaling and connection-oriented channels, used with
+    * controllers that pass ACL data to the host. Like ATT, a single
+    * signaling request is outstanding at a time. The channel table is
+    * read on the I/O thread, under channelLock.
+    */
    struct
    {
-      uint16_t             type;                // enum PendingOperation above
-      uint16_t             attributeHandle;
-   }  pendingOperation;
+      struct os_lock*      requestLock;
+      struct os_lock*      channelLock;
+      struct os_lock*      responseLock;        // protects the outstanding request fields below
+      struct os_completion* responseReceived;
+      uint32_t             responseTicket;
+      volatile uint8_t     pendingIdentifier;   // 0 if none
+      atomic_uint          nextIdentifier;
+      uint8_t              responseLength;
+      uint8_t              response[LB_L2CAP_MAX_SIGNAL];
+      struct LB_Channel*   pendingChannel;      // being opened by the outstanding request
+      struct LB_Channel*   channel[LB_L2CAP_MAX_CHANNELS];
+   }  l2cap;
 
+   /*
+    * Set while lb_closeDeviceConnection waits for the link to go down;
+    * the disconnection event completes it through the connection handle.
+    */
    struct
    {
-      uint8_t*             attributeValue;
-      uint8_t              attributeCapacity;
-      uint8_t              attributeLength;
-   }  pendingRead;
+      struct os_completion* completion;
+      uint32_t             ticket;
+   }  disconnect;
+};
+
+/*
+ * LE credit based channel. The peer may send one K-frame per credit we
+ * granted, and we only grant credits for free space in the receive ring,
+ * so received data is never dropped.
+ */
+struct LB_Channel
+{
+   struct LB_Device*       device;
+
+   struct os_lock*         lock;                // protects the fields below
+   struct os_lock*         txLock;              // keeps the K-frames of a write together
+   struct os_lock*         rxLock;              // held by a reader for the whole read
+   struct os_condition*    creditsReceived;
+   struct os_condition*    dataReceived;
+
+   bool                    open;
+
+   uint16_t                psm;
+   uint16_t                localId;
+   uint16_t                remoteId;
+   uint16_t                remoteMtu;
+   uint16_t                remoteMps;
+
+   uint32_t                txCredits;           // K-frames we may send
+   uint32_t                rxCredits;           // K-frames the peer may send
+
+   uint16_t                sduRemaining;        // bytes left in the SDU being received
+
+   uint32_t                rxHead;
+   uint32_t                rxCount;
+   uint8_t                 rx[LB_L2CAP_RX_BUFFER];
+};
+
+struct lb_scanState
+{
+   struct os_lock*            lock;
+
+   // used by lb_startDeviceDiscovery
+   struct LB_ScanParameters   parameters;
+
+   // used by the background scanner
+   struct LB_ScanParameters   idleParameters;
+   struct LB_ScanParameters   connectedParameters;
+   bool                       background;
+   uint32_t                   suspended;
+
+   // discovery in progress; cleared from the I/O thread
+   volatile bool              running;
+   struct LB_ScanParameters   current;
+   uint64_t                   deadline_ms;
+
+   // deferred calls referencing the controller, not yet executed
+   atomic_uint                pendingCalls;
+};
+
+struct lb_observedSlot
+{
+   bool                       used;
+   int16_t                    rssiAverage;         // 1/16 dBm
+   int8_t                     rssiReported;        // average when last passed to the application
+   struct LB_ObservedDevice   device;
+};
+
+enum lb_filterCriteria
+{
+   FILTER_SERVICE_UUID  = 0x01,
+   FILTER_COMPANY_ID    = 0x02,
+   FILTER_NAME_PREFIX   = 0x04,
+};
+
+struct lb_compiledFilter
+{
+   uint8_t                    criteria;            // enum lb_filterCriteria bitmask
+   int8_t                     minRSSI;
+   uint16_t                   serviceUUID;
+   uint16_t                   companyId;
+   uint8_t                    namePrefixLength;
+   char                       namePrefix[29];
+};
+
+struct lb_filterProgram
+{
+   int8_t                     minRSSI;             // weakest RSSI accepted by any filter
+   uint8_t                    criteria;            // union of all filter criteria
+   uint32_t                   count;
+   struct lb_compiledFilter   filter[];
+};
+
+struct lb_observerState
+{
+   struct os_lock*            lock;
+
+   // open addressed with linear probing; capacity is a power of two
+   struct lb_observedSlot*    slots;
+   uint32_t                   capacity;
+   uint32_t                   count;
+   uint32_t                   maxCount;
+
+   enum LB_AdvertisementReportMode  reportMode;
+   uint8_t                    rssiThreshold;
+
+   // NULL accepts every report
+   struct lb_filterProgram*   filters;
+};
+
+struct lb_aclState
+{
+   // controller buffers available, per HCI flow control
+   struct os_lock*            creditLock;
+   struct os_conditionVariable* creditAvailable;
+   uint32_t                   credits;
+   uint32_t                   nextLink;         // device slot first in line for the leftover credits
+
+   uint16_t                   maxLength;
+   uint16_t                   maxPackets;
+};
+
+/*
+ * An HCI command waiting for its Command Complete or Command Status event;
+ * matched by opcode, a slot is free when the opcode is 0
+ */
+struct hci_condition
+{
+   struct os_condition* handle;
+
+   uint16_t opcode;
+   uint8_t capacity;
+   uint8_t* buffer;
+
+   uint8_t status;
+   uint8_t length;
+};
+
+struct lb_commandState
+{
+   // protects the slots; the response is copied under it
+   struct os_lock*            lock;
+   struct hci_condition       pending[LB_PENDING_COMMANDS];
 };
 
 struct LB_Controller
 {
    struct io_channel* channel;
 
-   // accumulator
-   uint8_t  buffer[128];
+   // accumulator; holds one full serial read plus a partial packet
+   uint8_t  buffer[512];
    uint32_t length;
 
    struct os_lock*         operationLock;
-   struct os_condition*    operationComplete;
 
-   struct LB_Device  device[8];        // max Bluetooth device support
+   // serializes HCI command and ACL writes; the channel reuses one pending write
+   struct os_lock*         writeLock;
+
+   struct lb_commandState  commands;
+
+   /*
+    * Set while lb_openDeviceConnection waits for the link; only a
+    * connection to the same peer address completes it.
+    */
+   struct
+   {
+      struct os_completion*   completion;
+      uint32_t                ticket;
+      uint8_t                 address[6];
+      uint8_t                 status;           // HCI status of a failed attempt
+   }  connect;
+
+   // LB_DEVICE_COMPLETIONS for each device slot, and one for the connect
+   struct os_completionPool*  completions;
+
+   struct LB_Device  device[LB_MAX_DEVICES];
+
+   struct LB_ControllerConfig config;
+
+   struct LB_Timeouts         timeouts;
+
+   // number of device slots usable with the current configuration
+   uint8_t  maxConnections;
 
    const struct lb_vendorFunctions* vendorFunctions;
 
    uint16_t manufacturerId;
+
+   // last connection parameters sent to vendors that keep them as state
+   struct LB_ConnectionParameters   connectionParameters;
+
+   // last scan parameters sent to vendors that keep them as state
+   struct LB_ScanParameters         scanParameters;
+
+   struct lb_scanState              scan;
+
+   struct lb_observerState          observer;
+
+   struct lb_aclState               acl;
+
+   // connections and configuration, kept in a file for lb_attachHCI
+   struct os_mappedFile*            stateFile;
+   struct lb_savedState*            state;
+
+   /*
+    * Issues the queued device operations, one at a time, from a worker
+    * started when the first kick arrives; the worker keeps going until it
+    * has consumed all the kicks
+    */
+   struct
+   {
+      atomic_uint          kicks;
+      uint8_t              nextDevice[LB_PRIORITY_COUNT];
+
+      // times out the asynchronous requests; started with the first one
+      struct os_timer* _Atomic   sweeper;
+   }  scheduler;
 };
 
+/*
+ * Returns NULL for links the host does not track, such as the links kept
+ * by the controller across a host restart, until lb_attachHCI takes them
+ * over; their events are dropped. A lost link keeps its handle until it is
+ * closed, and the controller may already have given the handle to a new
+ * link, so lost links are skipped.
+ */
 static inline struct LB_Device* getDevice(struct LB_Controller* controller, uint16_t connectionHandle)
 {
-   struct LB_Device* device = NULL;
-
-   uint32_t ii = 0;
-   while (ii < (sizeof(controller->device) / sizeof(controller->device[0])))
+   for (uint32_t ii = 0; ii < LB_MAX_DEVICES; ii ++)
    {
-      if (controller->device[ii].connectionHandle == connectionHandle)
+      if ((controller->device[ii].connectionHandle == connectionHandle) && (! controller->device[ii].linkLost))
       {
-         device = &controller->device[ii];
-         break;
+         return &controller->device[ii];
       }
    }
 
-   assert(device);
-   return device;
+   return NULL;
 }
 
 static inline bool isDeviceConnected(struct LB_Device* device)
 {
-   return (INVALID_CONNECTION_HANDLE != device->connectionHandle);
+   return (INVALID_CONNECTION_HANDLE != device->connectionHandle) && (! device->linkLost);
+}
+
+static inline uint32_t getConnectionCount(struct LB_Controller* controller)
+{
+   uint32_t count = 0;
+
+   for (uint32_t ii = 0; ii < LB_MAX_DEVICES; ii ++)
+   {
+      if (INVALID_CONNECTION_HANDLE != controller->device[ii].connectionHandle)
+      {
+         count ++;
+      }
+   }
+
+   return count;
 }
 
-void on_connectedToDevice(struct LB_Controller* controller, const uint8_t* address, uint16_t connectionHandle);
+/*
+ * Counts the links still up, leaving out the dropped ones that were not closed yet
+ */
+static inline uint32_t getLiveConnectionCount(struct LB_Controller* controller)
+{
+   uint32_t count = 0;
+
+   for (uint32_t ii = 0; ii < LB_MAX_DEVICES; ii ++)
+   {
+      if ((INVALID_CONNECTION_HANDLE != controller->device[ii].connectionHandle) && (! controller->device[ii].linkLost))
+      {
+         count ++;
+      }
+   }
+
+   return count;
+}
+
+static inline void setUint16Value(uint8_t* buffer, uint16_t value)
+{
+   buffer[0] = value & 0xFF;
+   buffer[1] = value >> 8;
+}
+
+/*
+ * Connection recorded in the controller state file
+ */
+struct lb_savedDevice
+{
+   uint16_t connectionHandle;    // INVALID_CONNECTION_HANDLE for a free slot
+   uint8_t  address[6];
+   uint16_t interval;
+   uint16_t latency;
+   uint16_t supervisionTimeout;
+};
+
+void state_close(struct LB_Controller* controller);
+
+void state_onReset(struct LB_Controller* controller);
+
+void state_onConfigured(struct LB_Controller* controller);
+
+bool state_isConfigured(struct LB_Controller* controller, uint16_t manufacturerId);
+
+bool state_getSavedDevice(struct LB_Controller* controller, uint32_t slot, struct lb_savedDevice* saved);
+
+void state_recordDevice(struct LB_Device* device);
+
+void state_forgetDevice(struct LB_Device* device);
+
+void detachDevices(struct LB_Controller* controller);
+
+void on_connectedToDevice(struct LB_Controller* controller, const uint8_t* address, uint16_t connectionHandle, uint16_t interval, uint16_t latency, uint16_t supervisionTimeout);
+
+void on_connectionFailed(struct LB_Controller* controller, uint8_t status);
+
+void on_connectionParametersUpdated(struct LB_Controller* controller, uint16_t connectionHandle, uint8_t status, uint16_t interval, uint16_t latency, uint16_t supervisionTimeout);
 
 void on_disconnectedFromDevice(struct LB_Controller* controller, uint16_t connectionHandle, uint8_t reason);
 
 void on_serviceDiscoveryComplete(struct LB_Controller* controller, uint16_t connectionHandle);
 
+void on_deviceDiscoveryComplete(struct LB_Controller* controller);
+
+void scan_initialize(struct LB_Controller* controller);
+
+void scan_cleanup(struct LB_Controller* controller);
+
+void scan_suspend(struct LB_Controller* controller);
+
+void scan_resume(struct LB_Controller* controller);
+
+void scan_onConnectionsChanged(struct LB_Controller* controller);
+
+void on_observedDeviceAdvertisment(struct LB_Controller* controller, const uint8_t* address, int8_t rssi, const uint8_t* data, uint8_t length);
+
+void observer_initialize(struct LB_Controller* controller);
+
+void observer_cleanup(struct LB_Controller* controller);
+
+void operation_initialize(struct LB_Device* device);
+
+void operation_cleanup(struct LB_Device* device);
+
+enum LB_STATUS operation_execute(struct LB_Device* device, const struct lb_request* request, uint32_t timeout_ms, void** status);
+
+enum LB_STATUS operation_submit(struct LB_Device* device, const struct lb_request* request, uint32_t timeout_ms, LB_OperationCallback callback, void* context);
+
+struct lb_operation* operation_acquire(struct LB_Device* device, uint32_t typeMask);
+
+void operation_release(struct lb_operation* operation);
+
+void operation_complete(struct lb_operation* operation, enum LB_STATUS result, void* status);
+
+void operation_waitForScheduler(struct LB_Controller* controller);
+
+void operation_stopSweeper(struct LB_Controller* controller);
+
+void acl_initialize(struct LB_Device* device);
+
+void acl_cleanup(struct LB_Device* device);
+
+void l2cap_initialize(struct LB_Device* device);
+
+void l2cap_cleanup(struct LB_Device* device);
+
+void l2cap_on_signaling(struct LB_Device* device, const uint8_t* pdu, uint16_t length);
+
+void l2cap_on_receive(struct LB_Device* device, uint16_t channelId, const uint8_t* pdu, uint16_t length);
+
+void l2cap_on_disconnected(struct LB_Device* device);
+
+void att_initialize(struct LB_Device* device);
+
+void att_cleanup(struct LB_Device* device);
+
+void att_on_receive(struct LB_Device* device, const uint8_t* pdu, uint16_t length);
+
+void att_on_disconnected(struct LB_Device* device);
+
+enum LB_STATUS att_discoverPrimaryServices(struct LB_Device* device);
+
+enum LB_STATUS att_read(struct LB_Device* device, uint16_t attributeHandle);
+
+enum LB_STATUS att_write(struct LB_Device* device, uint16_t attributeHandle, const uint8_t* attributeValue, uint8_t attributeLength);
+
+enum LB_STATUS att_writeCommand(struct LB_Device* device, uint16_t attributeHandle, const uint8_t* attributeValue, uint8_t attributeLength);
+
+bool filter_accept(const struct lb_filterProgram* program, int8_t rssi, const uint8_t* data, uint8_t length);
+
 
 #endif // __LB_PRIV_H__
 
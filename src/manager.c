@@ -0,0 +1,425 @@
+/**
+ * @file manager.c
+ * @brief Management of several Bluetooth controllers
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <osal_core.h>
+#include <osal_serial.h>
+
+#include <commands.h>
+#include <controller.h>
+#include <manager.h>
+
+#include "lb_priv.h"
+
+struct managedController
+{
+   struct LB_Manager*      manager;
+   char*                   portName;
+   struct LB_Controller*   controller;
+   enum LB_STATUS          status;
+
+   // connections being established by the manager
+   uint32_t                pending;
+};
+
+struct LB_Manager
+{
+   struct os_lock*         lock;
+
+   struct LB_ControllerConfig config;
+   bool                    configured;
+
+   struct managedController* controller;
+   uint32_t                count;
+
+   // controllers still being initialized
+   uint32_t                initializing;
+   struct os_condition*    initialized;
+
+   // first controller examined by the next placement; spreads ties
+   uint32_t                next;
+};
+
+static void initializeController(void* arg)
+{
+   struct managedController* managed = (struct managedController*) arg;
+   struct LB_Manager* manager = managed->manager;
+
+   enum LB_STATUS status = LB_FAILURE;
+
+   managed->controller = lb_connect(managed->portName);
+   if (managed->controller)
+   {
+      status = LB_OK;
+
+      if (manager->configured)
+      {
+         status = lb_setControllerConfig(managed->controller, &manager->config);
+      }
+
+      if (LB_OK == status)
+      {
+         status = lb_initializeHCI(managed->controller);
+      }
+
+      if (LB_OK == status)
+      {
+         status = lb_configureAsCentral(managed->controller);
+      }
+   }
+
+   managed->status = status;
+
+   os_lock(manager->lock);
+
+   manager->initializing --;
+   if (0 == manager->initializing)
+   {
+      os_signalCondition(manager->initialized, NULL);
+   }
+
+   os_unlock(manager->lock);
+}
+
+static void waitForInitialization(struct LB_Manager* manager)
+{
+   while (true)
+   {
+      os_lock(manager->lock);
+      const uint32_t initializing = manager->initializing;
+      os_unlock(manager->lock);
+
+      if (0 == initializing)
+      {
+         break;
+      }
+
+      os_waitForCondition(manager->initialized, UINT32_MAX, NULL);
+   }
+}
+
+static char* copyString(const char* source)
+{
+   const size_t size = strlen(source) + 1;
+
+   char* copy = malloc(size);
+   if (copy)
+   {
+      memcpy(copy, source, size);
+   }
+
+   return copy;
+}
+
+struct LB_Manager* lb_createManager(const char* const* portNames, uint32_t portCount, const struct LB_ControllerConfig* config)
+{
+   if (0 == portCount)
+   {
+      return NULL;
+   }
+
+   struct LB_Manager* manager = malloc(sizeof(struct LB_Manager));
+   if (! manager)
+   {
+      return NULL;
+   }
+
+   memset(manager, 0, sizeof(struct LB_Manager));
+
+   manager->lock        = os_createLock();
+   manager->initialized = os_createCondition();
+   manager->controller  = calloc(portCount, sizeof(struct managedController));
+
+   if (! (manager->lock && manager->initialized && manager->controller))
+   {
+      lb_destroyManager(manager);
+      return NULL;
+   }
+
+   if (config)
+   {
+      manager->config     = *config;
+      manager->configured = true;
+   }
+
+   for (uint32_t ii = 0; ii < portCount; ii ++)
+   {
+      manager->controller[ii].manager  = manager;
+      manager->controller[ii].portName = copyString(portNames[ii]);
+      manager->controller[ii].status   = LB_FAILURE;
+
+      if (! manager->controller[ii].portName)
+      {
+         manager->count = ii;
+         lb_destroyManager(manager);
+         return NULL;
+      }
+   }
+
+   manager->count        = portCount;
+   manager->initializing = portCount;
+
+   os_resetCondition(manager->initialized);
+
+   /*
+    * Bringing up a controller is a sequence of blocking commands; start all
+    * of them at once, each on a worker
+    */
+   for (uint32_t ii = 0; ii < portCount; ii ++)
+   {
+      if (os_isPolled() || (! os_executeLater(0, initializeController, &manager->controller[ii])))
+      {
+         initializeController(&manager->controller[ii]);
+      }
+   }
+
+   waitForInitialization(manager);
+
+   // keep the controllers that came up
+   uint32_t count = 0;
+
+   for (uint32_t ii = 0; ii < portCount; ii ++)
+   {
+      struct managedController* managed = &manager->controller[ii];
+
+      if (LB_OK == managed->status)
+      {
+         manager->controller[count ++] = *managed;
+         continue;
+      }
+
+      printf("%% Failed to initialize the controller on %s: %u\n", managed->portName, (unsigned) managed->status);
+
+      lb_disconnect(managed->controller);
+      free(managed->portName);
+   }
+
+   manager->count = count;
+
+   if (0 == count)
+   {
+      lb_destroyManager(manager);
+      manager = NULL;
+   }
+
+   return manager;
+}
+
+struct portList
+{
+   char**      name;
+   uint32_t    count;
+   uint32_t    capacity;
+   bool        failed;
+};
+
+static void addPort(void* arg, const char* portName)
+{
+   struct portList* ports = (struct portList*) arg;
+
+   if (ports->count == ports->capacity)
+   {
+      const uint32_t capacity = ports->capacity ? 2 * ports->capacity : 16;
+
+      char** name = realloc(ports->name, capacity * sizeof(char*));
+      if (! name)
+      {
+         ports->failed = true;
+         return;
+      }
+
+      ports->name     = name;
+      ports->capacity = capacity;
+   }
+
+   char* copy = copyString(portName);
+   if (! copy)
+   {
+      ports->failed = true;
+      return;
+   }
+
+   ports->name[ports->count ++] = copy;
+}
+
+struct LB_Manager* lb_createManagerForPorts(const char* pattern, const struct LB_ControllerConfig* config)
+{
+   struct portList ports = { 0 };
+
+   io_enumerateSerialPorts(pattern, addPort, &ports);
+
+   struct LB_Manager* manager = NULL;
+
+   if (! ports.failed)
+   {
+      manager = lb_createManager((const char* const*) ports.name, ports.count, config);
+   }
+
+   for (uint32_t ii = 0; ii < ports.count; ii ++)
+   {
+      free(ports.name[ii]);
+   }
+   free(ports.name);
+
+   return manager;
+}
+
+void lb_destroyManager(struct LB_Manager* manager)
+{
+   if (manager)
+   {
+      for (uint32_t ii = 0; ii < manager->count; ii ++)
+      {
+         lb_disconnect(manager->controller[ii].controller);
+         free(manager->controller[ii].portName);
+      }
+
+      free(manager->controller);
+
+      if (manager->initialized)
+      {
+         os_destroyCondition(manager->initialized);
+      }
+
+      if (manager->lock)
+      {
+         os_destroyLock(manager->lock);
+      }
+
+      free(manager);
+   }
+}
+
+uint32_t lb_getManagedControllerCount(struct LB_Manager* manager)
+{
+   assert(manager);
+
+   return manager->count;
+}
+
+bool lb_getManagedController(struct LB_Manager* manager, uint32_t index, struct LB_ManagedController* state)
+{
+   assert(manager);
+
+   if (index >= manager->count)
+   {
+      return false;
+   }
+
+   struct managedController* managed = &manager->controller[index];
+
+   os_lock(manager->lock);
+
+   state->controller         = managed->controller;
+   state->portName           = managed->portName;
+   state->connections        = getConnectionCount(managed->controller);
+   state->pendingConnections = managed->pending;
+   state->maxConnections     = managed->controller->maxConnections;
+
+   os_unlock(manager->lock);
+
+   return true;
+}
+
+/*
+ * Reserves a connection on the controller with the lowest ratio of
+ * connections to capacity; must be called with the manager lock held
+ */
+static struct managedController* placeConnection(struct LB_Manager* manager)
+{
+   struct managedController* best = NULL;
+   uint32_t bestIndex = 0;
+   uint32_t bestLoad = 0;
+   uint32_t bestCapacity = 1;
+
+   for (uint32_t ii = 0; ii < manager->count; ii ++)
+   {
+      const uint32_t index = (manager->next + ii) % manager->count;
+      struct managedController* managed = &manager->controller[index];
+
+      const uint32_t load     = getConnectionCount(managed->controller) + managed->pending;
+      const uint32_t capacity = managed->controller->maxConnections;
+
+      if (load >= capacity)
+      {
+         continue;
+      }
+
+      if ((! best) || (load * bestCapacity < bestLoad * capacity))
+      {
+         best         = managed;
+         bestIndex    = index;
+         bestLoad     = load;
+         bestCapacity = capacity;
+      }
+   }
+
+   if (best)
+   {
+      best->pending ++;
+      manager->next = (bestIndex + 1) % manager->count;
+   }
+
+   return best;
+}
+
+enum LB_STATUS lb_openManagedDeviceConnection(struct LB_Manager* manager, const uint8_t* address, const struct LB_ConnectionParameters* parameters, struct LB_Device** device)
+{
+   assert(manager);
+
+   if (! parameters)
+   {
+      parameters = lb_getConnectionProfile(LB_CONNECTION_PROFILE_DEFAULT);
+   }
+
+   enum LB_STATUS status = LB_CONNECTION_LIMIT_REACHED;
+   *device = NULL;
+
+   /*
+    * A controller may fill up behind the manager's back, with connections
+    * opened directly; try the next one then
+    */
+   for (uint32_t attempt = 0; (attempt < manager->count) && (LB_CONNECTION_LIMIT_REACHED == status); attempt ++)
+   {
+      os_lock(manager->lock);
+      struct managedController* managed = placeConnection(manager);
+      os_unlock(manager->lock);
+
+      if (! managed)
+      {
+         break;
+      }
+
+      status = lb_openDeviceConnectionWithParameters(managed->controller, address, parameters, device);
+
+      os_lock(manager->lock);
+      managed->pending --;
+      os_unlock(manager->lock);
+   }
+
+   return status;
+}
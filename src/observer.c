@@ -0,0 +1,348 @@
+/**
+ * @file observer.c
+ * @brief Observed device table
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+#include <malloc.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <osal_core.h>
+
+#include <commands.h>
+
+#include "lb_priv.h"
+
+void observer_initialize(struct LB_Controller* controller)
+{
+   controller->observer.lock       = os_createLock();
+   controller->observer.slots      = NULL;
+   controller->observer.capacity   = 0;
+   controller->observer.count      = 0;
+   controller->observer.reportMode = LB_REPORT_ALL;
+   controller->observer.filters    = NULL;
+}
+
+void observer_cleanup(struct LB_Controller* controller)
+{
+   if (controller->observer.lock)
+   {
+      lb_disableObserver(controller);
+      lb_setScanFilters(controller, NULL, 0);
+
+      os_destroyLock(controller->observer.lock);
+      controller->observer.lock = NULL;
+   }
+}
+
+/*
+ * FNV-1a over the device address
+ */
+static uint32_t hashAddress(const uint8_t* address)
+{
+   uint32_t hash = 2166136261u;
+
+   for (uint32_t ii = 0; ii < 6; ii ++)
+   {
+      hash ^= address[ii];
+      hash *= 16777619u;
+   }
+
+   return hash;
+}
+
+enum LB_STATUS lb_enableObserver(struct LB_Controller* controller, const struct LB_ObserverConfig* config)
+{
+   if ((0 == config->capacity) || (config->capacity > (UINT32_MAX / 4)) || (config->reportMode > LB_REPORT_CHANGES))
+   {
+      return LB_INVALID_PARAMETERS;
+   }
+
+   // keep the load factor under 3/4, so probe sequences stay short
+   uint32_t capacity = 8;
+   while ((capacity / 4) * 3 < config->capacity)
+   {
+      capacity *= 2;
+   }
+
+   struct lb_observedSlot* slots = calloc(capacity, sizeof(struct lb_observedSlot));
+   if (! slots)
+   {
+      return LB_FAILURE;
+   }
+
+   os_lock(controller->observer.lock);
+
+   struct lb_observedSlot* oldSlots = controller->observer.slots;
+
+   controller->observer.slots         = slots;
+   controller->observer.capacity      = capacity;
+   controller->observer.count         = 0;
+   controller->observer.maxCount      = config->capacity;
+   controller->observer.reportMode    = config->reportMode;
+   controller->observer.rssiThreshold = config->rssiThreshold;
+
+   os_unlock(controller->observer.lock);
+
+   free(oldSlots);
+
+   return LB_OK;
+}
+
+void lb_disableObserver(struct LB_Controller* controller)
+{
+   os_lock(controller->observer.lock);
+
+   struct lb_observedSlot* slots = controller->observer.slots;
+
+   controller->observer.slots      = NULL;
+   controller->observer.capacity   = 0;
+   controller->observer.count      = 0;
+   controller->observer.reportMode = LB_REPORT_ALL;
+
+   os_unlock(controller->observer.lock);
+
+   free(slots);
+}
+
+/*
+ * Must be called with the observer lock held; returns NULL if the device
+ * is not tracked and there is no room for it.
+ */
+static struct lb_observedSlot* findSlot(struct lb_observerState* observer, const uint8_t* address, bool* isNew)
+{
+   const uint32_t mask = observer->capacity - 1;
+   uint32_t index = hashAddress(address) & mask;
+
+   while (observer->slots[index].used)
+   {
+      if (0 == memcmp(observer->slots[index].device.address, address, 6))
+      {
+         *isNew = false;
+         return &observer->slots[index];
+      }
+
+      index = (index + 1) & mask;
+   }
+
+   if (observer->count >= observer->maxCount)
+   {
+      return NULL;
+   }
+
+   observer->count ++;
+
+   struct lb_observedSlot* slot = &observer->slots[index];
+   memset(slot, 0, sizeof(*slot));
+   slot->used = true;
+   memcpy(slot->device.address, address, 6);
+
+   *isNew = true;
+   return slot;
+}
+
+static int8_t toRSSI(int16_t average)
+{
+   // round to nearest, away from zero
+   return (int8_t) ((average + ((average < 0) ? -8 : 8)) / 16);
+}
+
+/*
+ * Called from the I/O thread for every advertisement report
+ */
+void on_observedDeviceAdvertisment(struct LB_Controller* controller, const uint8_t* address, int8_t rssi, const uint8_t* data, uint8_t length)
+{
+   struct lb_observerState* observer = &controller->observer;
+
+   bool report = true;
+
+   os_lock(observer->lock);
+
+   if (observer->filters && (! filter_accept(observer->filters, rssi, data, length)))
+   {
+      report = false;
+   }
+   else if (observer->slots)
+   {
+      bool isNew = false;
+      struct lb_observedSlot* slot = findSlot(observer, address, &isNew);
+
+      if (slot)
+      {
+         struct LB_ObservedDevice* device = &slot->device;
+         uint64_t now = os_getTime_ms();
+
+         uint8_t dataLength = length;
+         if (dataLength > sizeof(device->data))
+         {
+            dataLength = sizeof(device->data);
+         }
+
+         bool changed = isNew;
+
+         if (isNew)
+         {
+            device->firstSeen_ms = now;
+            device->rssiMin      = rssi;
+            device->rssiMax      = rssi;
+            slot->rssiAverage    = rssi * 16;
+         }
+         else
+         {
+            if (rssi < device->rssiMin)
+            {
+               device->rssiMin = rssi;
+            }
+            if (rssi > device->rssiMax)
+            {
+               device->rssiMax = rssi;
+            }
+            slot->rssiAverage += (rssi * 16 - slot->rssiAverage) / 8;
+
+            if ((dataLength != device->dataLength) || memcmp(device->data, data, dataLength))
+            {
+               changed = true;
+            }
+         }
+
+         device->lastSeen_ms = now;
+         device->reportCount ++;
+         device->rssiLast    = rssi;
+         device->rssiAverage = toRSSI(slot->rssiAverage);
+         device->dataLength  = dataLength;
+         memcpy(device->data, data, dataLength);
+
+         if (observer->rssiThreshold)
+         {
+            int delta = device->rssiAverage - slot->rssiReported;
+            if ((delta >= observer->rssiThreshold) || (-delta >= observer->rssiThreshold))
+            {
+               changed = true;
+            }
+         }
+
+         switch (observer->reportMode)
+         {
+            case LB_REPORT_ALL:
+               break;
+
+            case LB_REPORT_NEW_DEVICES:
+               report = isNew;
+               break;
+
+            case LB_REPORT_CHANGES:
+               report = changed;
+               break;
+         }
+
+         if (report)
+         {
+            slot->rssiReported = device->rssiAverage;
+         }
+      }
+   }
+
+   os_unlock(observer->lock);
+
+   // outside the lock, so the callback can take a snapshot
+   if (report)
+   {
+      lb_on_observedDeviceAdvertisment(controller, address, rssi, data, length);
+   }
+}
+
+uint32_t lb_getObservedDevices(struct LB_Controller* controller, struct LB_ObservedDevice* devices, uint32_t capacity)
+{
+   uint32_t count = 0;
+
+   os_lock(controller->observer.lock);
+
+   for (uint32_t ii = 0; (ii < controller->observer.capacity) && (count < capacity); ii ++)
+   {
+      if (controller->observer.slots[ii].used)
+      {
+         devices[count] = controller->observer.slots[ii].device;
+         count ++;
+      }
+   }
+
+   os_unlock(controller->observer.lock);
+
+   return count;
+}
+
+/*
+ * Backward shift deletion: move following entries of the probe sequence
+ * into the hole, so lookups never need tombstones.
+ *
+ * Must be called with the observer lock held
+ */
+static void removeSlot(struct lb_observerState* observer, uint32_t hole)
+{
+   const uint32_t mask = observer->capacity - 1;
+   uint32_t index = (hole + 1) & mask;
+
+   while (observer->slots[index].used)
+   {
+      uint32_t home = hashAddress(observer->slots[index].device.address) & mask;
+
+      // can the entry at index move back to the hole without passing its home slot?
+      if (((index - home) & mask) >= ((index - hole) & mask))
+      {
+         observer->slots[hole] = observer->slots[index];
+         hole = index;
+      }
+
+      index = (index + 1) & mask;
+   }
+
+   observer->slots[hole].used = false;
+   observer->count --;
+}
+
+uint32_t lb_expireObservedDevices(struct LB_Controller* controller, uint32_t maxAge_ms)
+{
+   uint32_t removed = 0;
+
+   os_lock(controller->observer.lock);
+
+   uint64_t now = os_getTime_ms();
+
+   for (uint32_t ii = 0; ii < controller->observer.capacity; )
+   {
+      struct lb_observedSlot* slot = &controller->observer.slots[ii];
+
+      if (slot->used && ((now - slot->device.lastSeen_ms) > maxAge_ms))
+      {
+         // an entry may have moved into this slot; look at it again
+         removeSlot(&controller->observer, ii);
+         removed ++;
+      }
+      else
+      {
+         ii ++;
+      }
+   }
+
+   os_unlock(controller->observer.lock);
+
+   return removed;
+}
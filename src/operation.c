@@ -0,0 +1,602 @@
+/**
+ * @file operation.c
+ * @brief Per-device request queues and the controller scheduler
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+/*
+ * A device runs one GATT operation at a time, because the vendor events do
+ * not always say which request they answer. Application threads do not
+ * take turns on a lock: each one claims a slot of the device, publishes
+ * its request there, and waits for its own completion.
+ *
+ * The controller scheduler issues the requests. It runs on a worker, and
+ * is kicked when a request is queued and when a device becomes idle, most
+ * often on the I/O thread as the response arrives. Each pass picks the
+ * highest priority class with an issuable request, and the next device in
+ * round-robin order within that class; a device issues its requests in
+ * order within a class. The requests are issued one at a time, so the
+ * vendor commands of different devices do not overlap.
+ *
+ * Asynchronous requests have no waiting thread: whoever completes them
+ * frees the slot and calls the callback, and a periodic sweeper times them
+ * out.
+ */
+
+#include <stddef.h>
+
+#include <osal_core.h>
+
+#include <commands.h>
+
+#include "lb_priv.h"
+
+// how often a caller that timed out checks on a request being issued or completed
+#define OPERATION_GRACE_MS       10
+
+// how often the asynchronous requests are checked for timeouts
+#define OPERATION_SWEEP_MS       50
+
+void operation_initialize(struct LB_Device* device)
+{
+   atomic_init(&device->operations.sequence, 0);
+   atomic_init(&device->operations.active, NULL);
+
+   for (uint32_t ii = 0; ii < LB_OPERATION_QUEUE; ii ++)
+   {
+      struct lb_operation* operation = &device->operations.slot[ii];
+
+      atomic_init(&operation->state, OP_FREE);
+      atomic_init(&operation->deadline_ms, UINT64_MAX);
+      operation->device     = device;
+      operation->completion = os_acquireCompletion(device->controller->completions);
+      assert(operation->completion);
+   }
+}
+
+void operation_cleanup(struct LB_Device* device)
+{
+   for (uint32_t ii = 0; ii < LB_OPERATION_QUEUE; ii ++)
+   {
+      struct lb_operation* operation = &device->operations.slot[ii];
+
+      os_releaseCompletion(operation->completion);
+      operation->completion = NULL;
+   }
+}
+
+static struct lb_operation* claimSlot(struct LB_Device* device)
+{
+   for (uint32_t ii = 0; ii < LB_OPERATION_QUEUE; ii ++)
+   {
+      struct lb_operation* operation = &device->operations.slot[ii];
+
+      unsigned expected = OP_FREE;
+      if (atomic_compare_exchange_strong_explicit(&operation->state, &expected, OP_CLAIMED, memory_order_acquire, memory_order_relaxed))
+      {
+         return operation;
+      }
+   }
+
+   return NULL;
+}
+
+static void freeSlot(struct lb_operation* operation)
+{
+   atomic_store_explicit(&operation->state, OP_FREE, memory_order_release);
+}
+
+/*
+ * Lets the device issue its next request; returns false if another thread
+ * already did
+ */
+static bool releaseDevice(struct LB_Device* device, struct lb_operation* operation)
+{
+   struct lb_operation* expected = operation;
+
+   return atomic_compare_exchange_strong_explicit(&device->operations.active, &expected, NULL, memory_order_acq_rel, memory_order_relaxed);
+}
+
+static void runScheduler(void* arg);
+
+/*
+ * Frees the slot of a completed asynchronous request and reports the
+ * outcome; the slot may be claimed again before the callback returns
+ */
+static void finishAsync(struct lb_operation* operation)
+{
+   const LB_OperationCallback callback = operation->callback;
+   void* context = operation->context;
+
+   enum LB_STATUS result = operation->result;
+   if ((LB_OK == result) && (NULL != operation->status))
+   {
+      result = LB_FAILURE;
+   }
+   else if ((LB_OK != result) && (LB_OPERATION_TIMEOUT != result))
+   {
+      result = LB_FAILURE;
+   }
+
+   freeSlot(operation);
+
+   callback(context, result);
+}
+
+/*
+ * Hands the results of a completed request over to its caller
+ */
+static void finish(struct lb_operation* operation)
+{
+   if (operation->callback)
+   {
+      finishAsync(operation);
+      return;
+   }
+
+   // the slot may be reused as soon as it is marked done
+   struct os_completion* completion = operation->completion;
+   const uint32_t ticket = operation->ticket;
+
+   atomic_store_explicit(&operation->state, OP_DONE, memory_order_release);
+
+   os_signalCompletion(completion, ticket, NULL);
+}
+
+static void kickScheduler(struct LB_Controller* controller)
+{
+   if (0 == atomic_fetch_add_explicit(&controller->scheduler.kicks, 1, memory_order_acq_rel))
+   {
+      if (! os_executeLater(0, runScheduler, controller))
+      {
+         atomic_store_explicit(&controller->scheduler.kicks, 0, memory_order_release);
+      }
+   }
+}
+
+static enum LB_STATUS sendRequest(struct LB_Device* device, const struct lb_request* request)
+{
+   const struct lb_vendorFunctions* vendorFunctions = device->controller->vendorFunctions;
+
+   switch (request->type)
+   {
+      case PO_DISCOVER:
+         return vendorFunctions->startServiceDiscovery(device);
+
+      case PO_READ:
+         return vendorFunctions->requestCharValue(device, request->attributeHandle);
+
+      case PO_WRITE:
+         return vendorFunctions->writeCharValue(device, request->attributeHandle, request->value, request->valueLength);
+
+      case PO_UPDATE:
+         return vendorFunctions->updateConnectionParameters(device, request->parameters);
+
+      default:
+         assert(false);
+         return LB_FAILURE;
+   }
+}
+
+static void issue(void* arg)
+{
+   struct lb_operation* operation = (struct lb_operation*) arg;
+   struct LB_Device* device = operation->device;
+
+   enum LB_STATUS status = LB_DEVICE_NOT_CONNECTED;
+
+   if (isDeviceConnected(device))
+   {
+      status = sendRequest(device, &operation->request);
+   }
+
+   /*
+    * the response may already be in, with the I/O thread filling in the
+    * results or even done with them; the slot is still ours either way
+    */
+   const unsigned next = (LB_OK == status) ? OP_ISSUED : OP_COMPLETING;
+   unsigned expected = OP_ISSUING;
+
+   while (! atomic_compare_exchange_strong_explicit(&operation->state, &expected, next, memory_order_acq_rel, memory_order_acquire))
+   {
+      if (OP_COMPLETING != expected)
+      {
+         assert(OP_RESPONDED == expected);
+         finish(operation);
+         return;
+      }
+
+      expected = OP_ISSUING;
+      os_sleep_ms(0);
+   }
+
+   if (LB_OK != status)
+   {
+      operation->resumeState = OP_ISSUED;
+      operation_complete(operation, status, NULL);
+   }
+}
+
+static bool isBefore(const struct lb_operation* left, const struct lb_operation* right)
+{
+   return (int32_t) (left->sequence - right->sequence) < 0;
+}
+
+/*
+ * Returns the oldest request of the class queued on the device; frees the
+ * slots of the abandoned requests on the way
+ */
+static struct lb_operation* findQueued(struct LB_Device* device, uint8_t priority)
+{
+   struct lb_operation* found = NULL;
+
+   for (uint32_t ii = 0; ii < LB_OPERATION_QUEUE; ii ++)
+   {
+      struct lb_operation* operation = &device->operations.slot[ii];
+
+      const unsigned state = atomic_load_explicit(&operation->state, memory_order_acquire);
+
+      if (OP_ABANDONED == state)
+      {
+         unsigned expected = OP_ABANDONED;
+         atomic_compare_exchange_strong_explicit(&operation->state, &expected, OP_FREE, memory_order_acq_rel, memory_order_relaxed);
+      }
+      else if ((OP_QUEUED == state) && (priority == operation->request.priority))
+      {
+         if ((NULL == found) || isBefore(operation, found))
+         {
+            found = operation;
+         }
+      }
+   }
+
+   return found;
+}
+
+/*
+ * Issues one request; returns false if no device has one to issue
+ */
+static bool issueNext(struct LB_Controller* controller)
+{
+   for (uint8_t priority = 0; priority < LB_PRIORITY_COUNT; priority ++)
+   {
+      for (uint32_t ii = 0; ii < LB_MAX_DEVICES; ii ++)
+      {
+         const uint32_t index = (controller->scheduler.nextDevice[priority] + ii) % LB_MAX_DEVICES;
+         struct LB_Device* device = &controller->device[index];
+
+         if ((! isDeviceConnected(device)) || atomic_load_explicit(&device->operations.active, memory_order_acquire))
+         {
+            continue;
+         }
+
+         struct lb_operation* operation = findQueued(device, priority);
+         if (! operation)
+         {
+            continue;
+         }
+
+         unsigned expected = OP_QUEUED;
+         if (! atomic_compare_exchange_strong_explicit(&operation->state, &expected, OP_ISSUING, memory_order_acq_rel, memory_order_relaxed))
+         {
+            // abandoned meanwhile; look again
+            return true;
+         }
+
+         controller->scheduler.nextDevice[priority] = (uint8_t) ((index + 1) % LB_MAX_DEVICES);
+
+         atomic_store_explicit(&device->operations.active, operation, memory_order_release);
+
+         /*
+          * when the vendor runs the whole transaction in the issuing call,
+          * the devices must not wait for each other
+          */
+         if ((! controller->vendorFunctions->blockingGATT) || (! os_executeLater(0, issue, operation)))
+         {
+            issue(operation);
+         }
+
+         return true;
+      }
+   }
+
+   return false;
+}
+
+static void runScheduler(void* arg)
+{
+   struct LB_Controller* controller = (struct LB_Controller*) arg;
+
+   unsigned kicks = atomic_load_explicit(&controller->scheduler.kicks, memory_order_acquire);
+
+   for (;;)
+   {
+      while (issueNext(controller))
+      {
+      }
+
+      const unsigned remaining = atomic_fetch_sub_explicit(&controller->scheduler.kicks, kicks, memory_order_acq_rel) - kicks;
+      if (0 == remaining)
+      {
+         return;
+      }
+
+      kicks = remaining;
+   }
+}
+
+void operation_waitForScheduler(struct LB_Controller* controller)
+{
+   while (atomic_load_explicit(&controller->scheduler.kicks, memory_order_acquire))
+   {
+      os_sleep_ms(1);
+   }
+}
+
+/*
+ * Queues a request and waits for it to complete; the timeout covers the
+ * time spent in the queue
+ */
+enum LB_STATUS operation_execute(struct LB_Device* device, const struct lb_request* request, uint32_t timeout_ms, void** status)
+{
+   const uint64_t deadline = os_getTime_ms() + timeout_ms;
+
+   struct lb_operation* operation = NULL;
+
+   while (NULL == (operation = claimSlot(device)))
+   {
+      if (os_getTime_ms() >= deadline)
+      {
+         return LB_OPERATION_TIMEOUT;
+      }
+
+      os_sleep_ms(1);
+   }
+
+   operation->request  = *request;
+   operation->sequence = atomic_fetch_add_explicit(&device->operations.sequence, 1, memory_order_relaxed);
+   operation->result   = LB_OK;
+   operation->status   = NULL;
+   operation->ticket   = os_armCompletion(operation->completion);
+   operation->callback = NULL;
+
+   atomic_store_explicit(&operation->deadline_ms, UINT64_MAX, memory_order_relaxed);
+
+   atomic_store_explicit(&operation->state, OP_QUEUED, memory_order_release);
+
+   kickScheduler(device->controller);
+
+   for (;;)
+   {
+      const uint64_t now = os_getTime_ms();
+      if (now < deadline)
+      {
+         os_waitForCompletion(operation->completion, operation->ticket, (uint32_t) (deadline - now), NULL);
+      }
+
+      unsigned state = atomic_load_explicit(&operation->state, memory_order_acquire);
+      if (OP_DONE == state)
+      {
+         break;
+      }
+
+      if (os_getTime_ms() < deadline)
+      {
+         continue;
+      }
+
+      if ((OP_QUEUED == state) &&
+            atomic_compare_exchange_strong_explicit(&operation->state, &state, OP_ABANDONED, memory_order_acq_rel, memory_order_acquire))
+      {
+         // the scheduler frees the slot
+         return LB_OPERATION_TIMEOUT;
+      }
+
+      // taken over like a response would, so the scheduler cannot free the slot meanwhile
+      if ((OP_ISSUED == state) &&
+            atomic_compare_exchange_strong_explicit(&operation->state, &state, OP_COMPLETING, memory_order_acq_rel, memory_order_acquire))
+      {
+         releaseDevice(device, operation);
+         freeSlot(operation);
+         kickScheduler(device->controller);
+         return LB_OPERATION_TIMEOUT;
+      }
+
+      // being issued or completed, with the caller buffers still in use
+      os_waitForCompletion(operation->completion, operation->ticket, OPERATION_GRACE_MS, NULL);
+   }
+
+   if (status)
+   {
+      *status = operation->status;
+   }
+
+   const enum LB_STATUS result = operation->result;
+
+   freeSlot(operation);
+
+   return result;
+}
+
+static void sweep(void* arg)
+{
+   struct LB_Controller* controller = (struct LB_Controller*) arg;
+
+   const uint64_t now = os_getTime_ms();
+
+   for (uint32_t ii = 0; ii < LB_MAX_DEVICES; ii ++)
+   {
+      for (uint32_t jj = 0; jj < LB_OPERATION_QUEUE; jj ++)
+      {
+         struct lb_operation* operation = &controller->device[ii].operations.slot[jj];
+
+         unsigned state = atomic_load_explicit(&operation->state, memory_order_acquire);
+         if ((OP_QUEUED != state) && (OP_ISSUED != state))
+         {
+            continue;
+         }
+
+         if (now < atomic_load_explicit(&operation->deadline_ms, memory_order_relaxed))
+         {
+            continue;
+         }
+
+         if (! atomic_compare_exchange_strong_explicit(&operation->state, &state, OP_COMPLETING, memory_order_acq_rel, memory_order_relaxed))
+         {
+            continue;
+         }
+
+         // the slot may have been reused since it was looked at
+         if (now < atomic_load_explicit(&operation->deadline_ms, memory_order_relaxed))
+         {
+            atomic_store_explicit(&operation->state, state, memory_order_release);
+            continue;
+         }
+
+         operation->resumeState = state;
+         operation_complete(operation, LB_OPERATION_TIMEOUT, NULL);
+      }
+   }
+}
+
+static void startSweeper(struct LB_Controller* controller)
+{
+   if (atomic_load_explicit(&controller->scheduler.sweeper, memory_order_acquire))
+   {
+      return;
+   }
+
+   struct os_timer* timer = os_startTimer(OPERATION_SWEEP_MS, OPERATION_SWEEP_MS, sweep, controller);
+   if (! timer)
+   {
+      return;
+   }
+
+   struct os_timer* expected = NULL;
+   if (! atomic_compare_exchange_strong_explicit(&controller->scheduler.sweeper, &expected, timer, memory_order_acq_rel, memory_order_acquire))
+   {
+      os_stopTimer(timer);
+   }
+}
+
+void operation_stopSweeper(struct LB_Controller* controller)
+{
+   os_stopTimer(atomic_exchange_explicit(&controller->scheduler.sweeper, NULL, memory_order_acq_rel));
+}
+
+/*
+ * Queues a request without waiting for it; the callback reports the
+ * outcome, including the timeout
+ */
+enum LB_STATUS operation_submit(struct LB_Device* device, const struct lb_request* request, uint32_t timeout_ms, LB_OperationCallback callback, void* context)
+{
+   assert(callback);
+
+   struct lb_operation* operation = claimSlot(device);
+   if (! operation)
+   {
+      return LB_QUEUE_FULL;
+   }
+
+   startSweeper(device->controller);
+
+   operation->request     = *request;
+   operation->sequence    = atomic_fetch_add_explicit(&device->operations.sequence, 1, memory_order_relaxed);
+   operation->result      = LB_OK;
+   operation->status      = NULL;
+   operation->callback    = callback;
+   operation->context     = context;
+
+   atomic_store_explicit(&operation->deadline_ms, os_getTime_ms() + timeout_ms, memory_order_relaxed);
+
+   atomic_store_explicit(&operation->state, OP_QUEUED, memory_order_release);
+
+   kickScheduler(device->controller);
+
+   return LB_OK;
+}
+
+/*
+ * Takes over the issued operation to fill in its results, if it is one of
+ * the given types; the operation must be released or completed afterwards
+ */
+struct lb_operation* operation_acquire(struct LB_Device* device, uint32_t typeMask)
+{
+   struct lb_operation* operation = atomic_load_explicit(&device->operations.active, memory_order_acquire);
+   if (! operation)
+   {
+      return NULL;
+   }
+
+   unsigned state = atomic_load_explicit(&operation->state, memory_order_relaxed);
+
+   do
+   {
+      if ((OP_ISSUING != state) && (OP_ISSUED != state))
+      {
+         return NULL;
+      }
+   }
+   while (! atomic_compare_exchange_weak_explicit(&operation->state, &state, OP_COMPLETING, memory_order_acq_rel, memory_order_relaxed));
+
+   if (! (PO_MASK(operation->request.type) & typeMask))
+   {
+      atomic_store_explicit(&operation->state, state, memory_order_release);
+      return NULL;
+   }
+
+   operation->resumeState = state;
+
+   return operation;
+}
+
+/*
+ * Hands back an acquired operation that is not complete yet
+ */
+void operation_release(struct lb_operation* operation)
+{
+   atomic_store_explicit(&operation->state, operation->resumeState, memory_order_release);
+}
+
+/*
+ * Completes an acquired operation, and lets the device issue its next
+ * request right away
+ */
+void operation_complete(struct lb_operation* operation, enum LB_STATUS result, void* status)
+{
+   struct LB_Device* device = operation->device;
+
+   operation->result = result;
+   operation->status = status;
+
+   releaseDevice(device, operation);
+
+   if (OP_ISSUING == operation->resumeState)
+   {
+      // the issuing thread still uses the slot, and finishes the request
+      atomic_store_explicit(&operation->state, OP_RESPONDED, memory_order_release);
+   }
+   else
+   {
+      finish(operation);
+   }
+
+   kickScheduler(device->controller);
+}
@@ -0,0 +1,709 @@
+/**
+ * @file poller.c
+ * @brief Earliest deadline first scheduler for periodic characteristic reads
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+#include <malloc.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <osal_core.h>
+
+#include <commands.h>
+#include <poller.h>
+
+#include "lb_priv.h"
+
+// idle workers wake up at least this often
+#define POLLER_IDLE_WAIT_MS      1000
+
+#define NOT_QUEUED               UINT32_MAX
+
+struct LB_PollJob
+{
+   struct LB_Poller*       poller;
+   struct LB_PollJobConfig config;
+
+   // scheduled start and deadline of the next read
+   uint64_t                release_ms;
+   uint64_t                deadline_ms;
+
+   // position in the pending or ready queue
+   uint32_t                queueIndex;
+   bool                    ready;
+
+   bool                    running;
+   bool                    removed;
+
+   struct LB_PollStatistics statistics;
+};
+
+/*
+ * Binary min-heap, ordered by release time or by deadline
+ */
+struct jobQueue
+{
+   struct LB_PollJob**     job;
+   uint32_t                count;
+   uint32_t                capacity;
+   bool                    byDeadline;
+};
+
+struct pollWorker
+{
+   struct LB_Poller*       poller;
+   struct os_condition*    wakeup;
+   bool                    waiting;
+   struct LB_PollJob*      job;
+};
+
+struct LB_Poller
+{
+   struct os_lock*         lock;
+
+   struct LB_PollerConfig  config;
+
+   // jobs waiting for their release time, and released jobs waiting for a worker
+   struct jobQueue         pending;
+   struct jobQueue         ready;
+   uint32_t                jobCount;
+
+   struct pollWorker*      worker;
+   uint32_t                activeWorkers;
+   bool                    stopping;
+
+   struct os_condition*    jobCompleted;
+   struct os_condition*    stopped;
+};
+
+static inline uint64_t getKey(const struct jobQueue* queue, const struct LB_PollJob* job)
+{
+   return queue->byDeadline ? job->deadline_ms : job->release_ms;
+}
+
+static void placeJob(struct jobQueue* queue, struct LB_PollJob* job, uint32_t index)
+{
+   queue->job[index] = job;
+   job->queueIndex = index;
+}
+
+static void siftUp(struct jobQueue* queue, uint32_t index)
+{
+   struct LB_PollJob* job = queue->job[index];
+   uint64_t key = getKey(queue, job);
+
+   while (index)
+   {
+      uint32_t parent = (index - 1) / 2;
+      if (getKey(queue, queue->job[parent]) <= key)
+      {
+         break;
+      }
+
+      placeJob(queue, queue->job[parent], index);
+      index = parent;
+   }
+
+   placeJob(queue, job, index);
+}
+
+static void siftDown(struct jobQueue* queue, uint32_t index)
+{
+   struct LB_PollJob* job = queue->job[index];
+   uint64_t key = getKey(queue, job);
+
+   while (true)
+   {
+      uint32_t child = 2 * index + 1;
+      if (child >= queue->count)
+      {
+         break;
+      }
+
+      if ((child + 1 < queue->count) && (getKey(queue, queue->job[child + 1]) < getKey(queue, queue->job[child])))
+      {
+         child ++;
+      }
+
+      if (key <= getKey(queue, queue->job[child]))
+      {
+         break;
+      }
+
+      placeJob(queue, queue->job[child], index);
+      index = child;
+   }
+
+   placeJob(queue, job, index);
+}
+
+static bool reserveQueue(struct jobQueue* queue, uint32_t capacity)
+{
+   if (capacity <= queue->capacity)
+   {
+      return true;
+   }
+
+   uint32_t newCapacity = queue->capacity ? (queue->capacity * 2) : 16;
+   if (newCapacity < capacity)
+   {
+      newCapacity = capacity;
+   }
+
+   struct LB_PollJob** job = realloc(queue->job, newCapacity * sizeof(struct LB_PollJob*));
+   if (! job)
+   {
+      return false;
+   }
+
+   queue->job = job;
+   queue->capacity = newCapacity;
+
+   return true;
+}
+
+/*
+ * The capacity is reserved when jobs are added, so queueing cannot fail
+ */
+static void pushJob(struct jobQueue* queue, struct LB_PollJob* job)
+{
+   assert(queue->count < queue->capacity);
+
+   job->ready = queue->byDeadline;
+   placeJob(queue, job, queue->count ++);
+   siftUp(queue, job->queueIndex);
+}
+
+static void removeJob(struct jobQueue* queue, uint32_t index)
+{
+   assert(index < queue->count);
+
+   queue->job[index]->queueIndex = NOT_QUEUED;
+
+   queue->count --;
+   if (index < queue->count)
+   {
+      struct LB_PollJob* moved = queue->job[queue->count];
+      placeJob(queue, moved, index);
+      siftDown(queue, index);
+      siftUp(queue, moved->queueIndex);
+   }
+}
+
+/*
+ * Called with the lock held
+ */
+static void wakeWorkers(struct LB_Poller* poller)
+{
+   for (uint32_t ii = 0; ii < poller->config.workerCount; ii ++)
+   {
+      if (poller->worker[ii].waiting)
+      {
+         os_signalCondition(poller->worker[ii].wakeup, NULL);
+      }
+   }
+}
+
+static void releaseJobs(struct LB_Poller* poller, uint64_t now_ms)
+{
+   while (poller->pending.count && (poller->pending.job[0]->release_ms <= now_ms))
+   {
+      struct LB_PollJob* job = poller->pending.job[0];
+      removeJob(&poller->pending, 0);
+      pushJob(&poller->ready, job);
+   }
+}
+
+/*
+ * A job may start if its device has no read in progress and its
+ * controller is below the limit
+ */
+static bool mayStart(const struct LB_Poller* poller, const struct LB_PollJob* job)
+{
+   const struct LB_Device* device = job->config.device;
+   uint32_t controllerReads = 0;
+
+   for (uint32_t ii = 0; ii < poller->config.workerCount; ii ++)
+   {
+      const struct LB_PollJob* running = poller->worker[ii].job;
+      if (running)
+      {
+         if (running->config.device == device)
+         {
+            return false;
+         }
+
+         if (running->config.device->controller == device->controller)
+         {
+            controllerReads ++;
+         }
+      }
+   }
+
+   return (0 == poller->config.maxReadsPerController) || (controllerReads < poller->config.maxReadsPerController);
+}
+
+/*
+ * Takes the released job with the earliest deadline that may start
+ */
+static struct LB_PollJob* takeReadyJob(struct LB_Poller* poller)
+{
+   struct jobQueue* ready = &poller->ready;
+
+   if (0 == ready->count)
+   {
+      return NULL;
+   }
+
+   uint32_t selected = NOT_QUEUED;
+
+   if (mayStart(poller, ready->job[0]))
+   {
+      selected = 0;
+   }
+   else
+   {
+      for (uint32_t ii = 1; ii < ready->count; ii ++)
+      {
+         if (((NOT_QUEUED == selected) || (ready->job[ii]->deadline_ms < ready->job[selected]->deadline_ms)) &&
+               mayStart(poller, ready->job[ii]))
+         {
+            selected = ii;
+         }
+      }
+   }
+
+   if (NOT_QUEUED == selected)
+   {
+      return NULL;
+   }
+
+   struct LB_PollJob* job = ready->job[selected];
+   removeJob(ready, selected);
+
+   return job;
+}
+
+/*
+ * Reads one value and computes the next release; called without the lock,
+ * the job fields used here are owned by the worker while the job runs
+ */
+static void executeJob(struct LB_PollJob* job, uint8_t* value, uint8_t capacity)
+{
+   const struct LB_PollJobConfig* config = &job->config;
+
+   uint64_t start_ms = os_getTime_ms();
+
+   uint8_t length = 0;
+   enum LB_STATUS status = lb_readCharValue(config->device, config->attributeHandle, value, capacity, &length);
+   if (LB_OK != status)
+   {
+      length = 0;
+   }
+
+   uint64_t completed_ms = os_getTime_ms();
+
+   config->decoder(config->context, config->device, config->attributeHandle, status, value, length, completed_ms);
+
+   uint32_t missed = 0;
+
+   if (completed_ms > job->deadline_ms)
+   {
+      missed ++;
+      if (config->onMissedDeadline)
+      {
+         config->onMissedDeadline(config->context, config->device, config->attributeHandle, job->deadline_ms, completed_ms);
+      }
+   }
+
+   uint32_t startDelay_ms = (start_ms > job->release_ms) ? (uint32_t) (start_ms - job->release_ms) : 0;
+
+   // skip the reads that can no longer complete in time, rather than
+   // running them back to back
+   uint32_t relativeDeadline_ms = job->deadline_ms - job->release_ms;
+
+   job->release_ms += config->period_ms;
+   while (job->release_ms + relativeDeadline_ms <= completed_ms)
+   {
+      missed ++;
+      if (config->onMissedDeadline)
+      {
+         config->onMissedDeadline(config->context, config->device, config->attributeHandle, job->release_ms + relativeDeadline_ms, 0);
+      }
+      job->release_ms += config->period_ms;
+   }
+   job->deadline_ms = job->release_ms + relativeDeadline_ms;
+
+   struct LB_PollStatistics* statistics = &job->statistics;
+
+   os_lock(job->poller->lock);
+
+   statistics->reads ++;
+   statistics->failures += (LB_OK != status);
+   statistics->missedDeadlines += missed;
+   statistics->totalStartDelay_ms += startDelay_ms;
+   if (startDelay_ms > statistics->maxStartDelay_ms)
+   {
+      statistics->maxStartDelay_ms = startDelay_ms;
+   }
+
+   os_unlock(job->poller->lock);
+}
+
+static void runWorker(void* arg)
+{
+   struct pollWorker* worker = (struct pollWorker*) arg;
+   struct LB_Poller* poller = worker->poller;
+
+   uint8_t value[LB_ATT_MAX_PDU];
+
+   os_lock(poller->lock);
+
+   while (! poller->stopping)
+   {
+      uint64_t now_ms = os_getTime_ms();
+
+      releaseJobs(poller, now_ms);
+
+      struct LB_PollJob* job = takeReadyJob(poller);
+      if (! job)
+      {
+         uint32_t timeout_ms = POLLER_IDLE_WAIT_MS;
+         if (poller->pending.count && (poller->pending.job[0]->release_ms - now_ms < timeout_ms))
+         {
+            timeout_ms = (uint32_t) (poller->pending.job[0]->release_ms - now_ms);
+         }
+
+         worker->waiting = true;
+         os_resetCondition(worker->wakeup);
+         os_unlock(poller->lock);
+
+         os_waitForCondition(worker->wakeup, timeout_ms, NULL);
+
+         os_lock(poller->lock);
+         worker->waiting = false;
+         continue;
+      }
+
+      job->running = true;
+      worker->job = job;
+
+      os_unlock(poller->lock);
+
+      executeJob(job, value, sizeof(value));
+
+      os_lock(poller->lock);
+
+      worker->job = NULL;
+      job->running = false;
+
+      if (job->removed)
+      {
+         os_signalCondition(poller->jobCompleted, NULL);
+      }
+      else
+      {
+         pushJob(&poller->pending, job);
+      }
+
+      // the device may have released jobs waiting for it
+      wakeWorkers(poller);
+   }
+
+   poller->activeWorkers --;
+   if (0 == poller->activeWorkers)
+   {
+      os_signalCondition(poller->stopped, NULL);
+   }
+
+   os_unlock(poller->lock);
+}
+
+static void freePoller(struct LB_Poller* poller)
+{
+   for (uint32_t ii = 0; ii < poller->pending.count; ii ++)
+   {
+      free(poller->pending.job[ii]);
+   }
+
+   for (uint32_t ii = 0; ii < poller->ready.count; ii ++)
+   {
+      free(poller->ready.job[ii]);
+   }
+
+   free(poller->pending.job);
+   free(poller->ready.job);
+
+   if (poller->worker)
+   {
+      for (uint32_t ii = 0; ii < poller->config.workerCount; ii ++)
+      {
+         if (poller->worker[ii].wakeup)
+         {
+            os_destroyCondition(poller->worker[ii].wakeup);
+         }
+      }
+      free(poller->worker);
+   }
+
+   if (poller->jobCompleted)
+   {
+      os_destroyCondition(poller->jobCompleted);
+   }
+
+   if (poller->stopped)
+   {
+      os_destroyCondition(poller->stopped);
+   }
+
+   if (poller->lock)
+   {
+      os_destroyLock(poller->lock);
+   }
+
+   free(poller);
+}
+
+struct LB_Poller* lb_createPoller(const struct LB_PollerConfig* config)
+{
+   // the workers run for the lifetime of the poller
+   if ((0 == config->workerCount) || os_isPolled())
+   {
+      return NULL;
+   }
+
+   struct LB_Poller* poller = calloc(1, sizeof(struct LB_Poller));
+   if (! poller)
+   {
+      return NULL;
+   }
+
+   poller->config = *config;
+   poller->ready.byDeadline = true;
+
+   poller->lock = os_createLock();
+   poller->jobCompleted = os_createCondition();
+   poller->stopped = os_createCondition();
+   poller->worker = calloc(config->workerCount, sizeof(struct pollWorker));
+
+   if ((! poller->lock) || (! poller->jobCompleted) || (! poller->stopped) || (! poller->worker))
+   {
+      freePoller(poller);
+      return NULL;
+   }
+
+   for (uint32_t ii = 0; ii < config->workerCount; ii ++)
+   {
+      poller->worker[ii].poller = poller;
+      poller->worker[ii].wakeup = os_createCondition();
+      if (! poller->worker[ii].wakeup)
+      {
+         freePoller(poller);
+         return NULL;
+      }
+   }
+
+   os_lock(poller->lock);
+
+   for (uint32_t ii = 0; ii < config->workerCount; ii ++)
+   {
+      if (os_executeLater(0, runWorker, &poller->worker[ii]))
+      {
+         poller->activeWorkers ++;
+      }
+   }
+
+   os_unlock(poller->lock);
+
+   if (0 == poller->activeWorkers)
+   {
+      freePoller(poller);
+      return NULL;
+   }
+
+   return poller;
+}
+
+void lb_destroyPoller(struct LB_Poller* poller)
+{
+   if (! poller)
+   {
+      return;
+   }
+
+   os_lock(poller->lock);
+
+   poller->stopping = true;
+   wakeWorkers(poller);
+
+   while (poller->activeWorkers)
+   {
+      os_resetCondition(poller->stopped);
+      os_unlock(poller->lock);
+
+      os_waitForCondition(poller->stopped, POLLER_IDLE_WAIT_MS, NULL);
+
+      os_lock(poller->lock);
+   }
+
+   os_unlock(poller->lock);
+
+   freePoller(poller);
+}
+
+enum LB_STATUS lb_addPollJob(struct LB_Poller* poller, const struct LB_PollJobConfig* config, struct LB_PollJob** job)
+{
+   if ((! config->device) || (0 == config->attributeHandle) || (0 == config->period_ms) || (! config->decoder))
+   {
+      return LB_INVALID_PARAMETERS;
+   }
+
+   struct LB_PollJob* newJob = calloc(1, sizeof(struct LB_PollJob));
+   if (! newJob)
+   {
+      return LB_FAILURE;
+   }
+
+   newJob->poller = poller;
+   newJob->config = *config;
+   newJob->release_ms = os_getTime_ms() + config->offset_ms;
+   newJob->deadline_ms = newJob->release_ms + (config->deadline_ms ? config->deadline_ms : config->period_ms);
+
+   os_lock(poller->lock);
+
+   // either queue may hold all the jobs
+   if ((! reserveQueue(&poller->pending, poller->jobCount + 1)) ||
+         (! reserveQueue(&poller->ready, poller->jobCount + 1)))
+   {
+      os_unlock(poller->lock);
+      free(newJob);
+      return LB_FAILURE;
+   }
+
+   poller->jobCount ++;
+   pushJob(&poller->pending, newJob);
+   wakeWorkers(poller);
+
+   os_unlock(poller->lock);
+
+   *job = newJob;
+
+   return LB_OK;
+}
+
+/*
+ * Called with the lock held; returns with the lock held, after the job
+ * has been taken out of the queues and is no longer running
+ */
+static void unscheduleJob(struct LB_Poller* poller, struct LB_PollJob* job)
+{
+   job->removed = true;
+
+   while (job->running)
+   {
+      os_resetCondition(poller->jobCompleted);
+      os_unlock(poller->lock);
+
+      // other removals may reset the condition, so wait briefly
+      os_waitForCondition(poller->jobCompleted, 100, NULL);
+
+      os_lock(poller->lock);
+   }
+
+   if (NOT_QUEUED != job->queueIndex)
+   {
+      removeJob(job->ready ? &poller->ready : &poller->pending, job->queueIndex);
+   }
+
+   poller->jobCount --;
+}
+
+void lb_removePollJob(struct LB_PollJob* job)
+{
+   if (! job)
+   {
+      return;
+   }
+
+   struct LB_Poller* poller = job->poller;
+
+   os_lock(poller->lock);
+   unscheduleJob(poller, job);
+   os_unlock(poller->lock);
+
+   free(job);
+}
+
+static struct LB_PollJob* findDeviceJob(struct LB_Poller* poller, const struct LB_Device* device)
+{
+   for (uint32_t ii = 0; ii < poller->pending.count; ii ++)
+   {
+      if (poller->pending.job[ii]->config.device == device)
+      {
+         return poller->pending.job[ii];
+      }
+   }
+
+   for (uint32_t ii = 0; ii < poller->ready.count; ii ++)
+   {
+      if (poller->ready.job[ii]->config.device == device)
+      {
+         return poller->ready.job[ii];
+      }
+   }
+
+   for (uint32_t ii = 0; ii < poller->config.workerCount; ii ++)
+   {
+      struct LB_PollJob* job = poller->worker[ii].job;
+      if (job && (job->config.device == device) && (! job->removed))
+      {
+         return job;
+      }
+   }
+
+   return NULL;
+}
+
+uint32_t lb_removeDevicePollJobs(struct LB_Poller* poller, struct LB_Device* device)
+{
+   uint32_t removed = 0;
+
+   os_lock(poller->lock);
+
+   struct LB_PollJob* job;
+   while (NULL != (job = findDeviceJob(poller, device)))
+   {
+      unscheduleJob(poller, job);
+      free(job);
+      removed ++;
+   }
+
+   os_unlock(poller->lock);
+
+   return removed;
+}
+
+void lb_getPollStatistics(struct LB_PollJob* job, struct LB_PollStatistics* statistics)
+{
+   os_lock(job->poller->lock);
+   *statistics = job->statistics;
+   os_unlock(job->poller->lock);
+}
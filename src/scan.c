@@ -0,0 +1,426 @@
+/**
+ * @file scan.c
+ * @brief Device discovery and background scanning
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+
+#include <osal_core.h>
+
+#include <commands.h>
+
+#include "lb_priv.h"
+#include "hci_priv.h"
+
+/*
+ * Delay before restarting a discovery that was just stopped, so the
+ * procedure complete event for the old one is not mistaken for the new one.
+ */
+#define RESTART_DELAY_MS         10
+
+static const struct LB_ScanParameters defaultScanParameters =
+{
+   .active              = true,
+   .interval            = 2000,        // 2000 * 0.625msec = 1.25 seconds
+   .window              = 2000,        // 2000 * 0.625msec = 1.25 seconds
+   .filterDuplicates    = true,
+   .randomOwnAddress    = true,
+   .duration_ms         = 0,
+};
+
+void scan_initialize(struct LB_Controller* controller)
+{
+   controller->scan.lock       = os_createLock();
+   controller->scan.parameters = defaultScanParameters;
+   controller->scan.running    = false;
+   controller->scan.background = false;
+   controller->scan.suspended  = 0;
+
+   atomic_init(&controller->scan.pendingCalls, 0);
+}
+
+void scan_cleanup(struct LB_Controller* controller)
+{
+   if (controller->scan.lock)
+   {
+      os_lock(controller->scan.lock);
+      controller->scan.background = false;
+      os_unlock(controller->scan.lock);
+
+      // deferred calls hold a pointer to the controller
+      while (0 != atomic_load(&controller->scan.pendingCalls))
+      {
+         os_sleep_ms(1);
+      }
+
+      os_destroyLock(controller->scan.lock);
+      controller->scan.lock = NULL;
+   }
+}
+
+/*
+ * Bluetooth Core Specification v4.2, Vol 2, Part E, 7.8.10
+ */
+static bool areScanParametersValid(const struct LB_ScanParameters* parameters)
+{
+   if ((parameters->interval < 0x0004) || (parameters->interval > 0x4000))
+   {
+      return false;
+   }
+
+   if ((parameters->window < 0x0004) || (parameters->window > parameters->interval))
+   {
+      return false;
+   }
+
+   return true;
+}
+
+static void executeLater(struct LB_Controller* controller, uint32_t interval_ms, void (* func)(void* arg))
+{
+   atomic_fetch_add(&controller->scan.pendingCalls, 1);
+
+   if (! os_executeLater(interval_ms, func, controller))
+   {
+      atomic_fetch_sub(&controller->scan.pendingCalls, 1);
+   }
+}
+
+/*
+ * Controllers without vendor support, or configured so, scan with the
+ * standard LE commands; such a scan runs until disabled.
+ */
+static bool isStandardScan(struct LB_Controller* controller)
+{
+   return (NULL == controller->vendorFunctions) ||
+      (hci_startDeviceDiscovery == controller->vendorFunctions->startDeviceDiscovery) ||
+      controller->config.standardScan;
+}
+
+static enum LB_STATUS stopScan(struct LB_Controller* controller);
+
+static void onScanDeadline(void* arg)
+{
+   struct LB_Controller* controller = (struct LB_Controller*) arg;
+
+   os_lock(controller->scan.lock);
+
+   if (controller->scan.running && (os_getTime_ms() >= controller->scan.deadline_ms))
+   {
+      stopScan(controller);
+   }
+
+   os_unlock(controller->scan.lock);
+
+   atomic_fetch_sub(&controller->scan.pendingCalls, 1);
+}
+
+/*
+ * Must be called with the scan lock held
+ */
+static enum LB_STATUS startScan(struct LB_Controller* controller, const struct LB_ScanParameters* parameters)
+{
+   enum LB_STATUS status;
+
+   if (isStandardScan(controller))
+   {
+      status = hci_startDeviceDiscovery(controller, parameters);
+   }
+   else
+   {
+      status = controller->vendorFunctions->startDeviceDiscovery(controller, parameters);
+   }
+
+   if (LB_OK == status)
+   {
+      controller->scan.running     = true;
+      controller->scan.current     = *parameters;
+      controller->scan.deadline_ms = UINT64_MAX;
+
+      if (parameters->duration_ms)
+      {
+         controller->scan.deadline_ms = os_getTime_ms() + parameters->duration_ms;
+         executeLater(controller, parameters->duration_ms, onScanDeadline);
+      }
+   }
+
+   return status;
+}
+
+/*
+ * Must be called with the scan lock held
+ */
+static enum LB_STATUS stopScan(struct LB_Controller* controller)
+{
+   enum LB_STATUS status;
+
+   if (isStandardScan(controller))
+   {
+      status = hci_stopDeviceDiscovery(controller);
+
+      if (LB_OK == status)
+      {
+         // there is no procedure complete event to wait for
+         on_deviceDiscoveryComplete(controller);
+      }
+   }
+   else
+   {
+      status = controller->vendorFunctions->stopDeviceDiscovery(controller);
+   }
+
+   if (LB_OK == status)
+   {
+      controller->scan.running = false;
+   }
+
+   return status;
+}
+
+enum LB_STATUS lb_setScanParameters(struct LB_Controller* controller, const struct LB_ScanParameters* parameters)
+{
+   if (! areScanParametersValid(parameters))
+   {
+      return LB_INVALID_PARAMETERS;
+   }
+
+   os_lock(controller->scan.lock);
+   controller->scan.parameters = *parameters;
+   os_unlock(controller->scan.lock);
+
+   return LB_OK;
+}
+
+enum LB_STATUS lb_startDeviceDiscovery(struct LB_Controller* controller)
+{
+   os_lock(controller->scan.lock);
+   enum LB_STATUS status = startScan(controller, &controller->scan.parameters);
+   os_unlock(controller->scan.lock);
+
+   return status;
+}
+
+enum LB_STATUS lb_stopDeviceDiscovery(struct LB_Controller* controller)
+{
+   os_lock(controller->scan.lock);
+   enum LB_STATUS status = stopScan(controller);
+   os_unlock(controller->scan.lock);
+
+   return status;
+}
+
+/*
+ * Background scanning
+ */
+
+static const struct LB_ScanParameters* selectBackgroundParameters(struct LB_Controller* controller)
+{
+   if (0 == getLiveConnectionCount(controller))
+   {
+      return &controller->scan.idleParameters;
+   }
+   else if (controller->config.scanWhileConnected)
+   {
+      return &controller->scan.connectedParameters;
+   }
+   else
+   {
+      return NULL;
+   }
+}
+
+static void onBackgroundRestart(void* arg);
+
+/*
+ * Must be called with the scan lock held
+ */
+static void updateBackgroundScan(struct LB_Controller* controller)
+{
+   if ((! controller->scan.background) || controller->scan.suspended)
+   {
+      return;
+   }
+
+   const struct LB_ScanParameters* parameters = selectBackgroundParameters(controller);
+
+   if (controller->scan.running)
+   {
+      if ((NULL == parameters) || memcmp(&controller->scan.current, parameters, sizeof(*parameters)))
+      {
+         if ((LB_OK == stopScan(controller)) && parameters)
+         {
+            executeLater(controller, RESTART_DELAY_MS, onBackgroundRestart);
+         }
+      }
+   }
+   else if (parameters)
+   {
+      if (LB_OK != startScan(controller, parameters))
+      {
+         if (lbDebugLevel > 100)
+         {
+            puts("Failed to restart background discovery");
+         }
+      }
+   }
+}
+
+static void onBackgroundRestart(void* arg)
+{
+   struct LB_Controller* controller = (struct LB_Controller*) arg;
+
+   os_lock(controller->scan.lock);
+   updateBackgroundScan(controller);
+   os_unlock(controller->scan.lock);
+
+   atomic_fetch_sub(&controller->scan.pendingCalls, 1);
+}
+
+enum LB_STATUS lb_startBackgroundScan(struct LB_Controller* controller, const struct LB_ScanParameters* idleParameters, const struct LB_ScanParameters* connectedParameters)
+{
+   if (! areScanParametersValid(idleParameters))
+   {
+      return LB_INVALID_PARAMETERS;
+   }
+
+   if (connectedParameters && (! areScanParametersValid(connectedParameters)))
+   {
+      return LB_INVALID_PARAMETERS;
+   }
+
+   os_lock(controller->scan.lock);
+
+   controller->scan.idleParameters = *idleParameters;
+
+   if (connectedParameters)
+   {
+      controller->scan.connectedParameters = *connectedParameters;
+   }
+   else
+   {
+      controller->scan.connectedParameters        = *idleParameters;
+      controller->scan.connectedParameters.window = idleParameters->interval / 8;
+      if (controller->scan.connectedParameters.window < 0x0004)
+      {
+         controller->scan.connectedParameters.window = 0x0004;
+      }
+   }
+
+   controller->scan.background = true;
+
+   enum LB_STATUS status = LB_OK;
+
+   if (controller->scan.running)
+   {
+      // replace whatever discovery is in progress
+      status = stopScan(controller);
+      if (LB_OK == status)
+      {
+         executeLater(controller, RESTART_DELAY_MS, onBackgroundRestart);
+      }
+   }
+   else
+   {
+      updateBackgroundScan(controller);
+   }
+
+   os_unlock(controller->scan.lock);
+
+   return status;
+}
+
+enum LB_STATUS lb_stopBackgroundScan(struct LB_Controller* controller)
+{
+   enum LB_STATUS status = LB_OK;
+
+   os_lock(controller->scan.lock);
+
+   controller->scan.background = false;
+
+   if (controller->scan.running)
+   {
+      status = stopScan(controller);
+   }
+
+   os_unlock(controller->scan.lock);
+
+   return status;
+}
+
+void scan_suspend(struct LB_Controller* controller)
+{
+   os_lock(controller->scan.lock);
+
+   controller->scan.suspended ++;
+
+   if (controller->scan.background && controller->scan.running)
+   {
+      stopScan(controller);
+   }
+
+   os_unlock(controller->scan.lock);
+}
+
+void scan_resume(struct LB_Controller* controller)
+{
+   os_lock(controller->scan.lock);
+
+   assert(controller->scan.suspended);
+   controller->scan.suspended --;
+
+   if (controller->scan.background)
+   {
+      executeLater(controller, RESTART_DELAY_MS, onBackgroundRestart);
+   }
+
+   os_unlock(controller->scan.lock);
+}
+
+/*
+ * Also called from the I/O thread, so it does not take the scan lock; the
+ * restart checks the background flag again under the lock.
+ */
+void scan_onConnectionsChanged(struct LB_Controller* controller)
+{
+   if (controller->scan.background)
+   {
+      executeLater(controller, RESTART_DELAY_MS, onBackgroundRestart);
+   }
+}
+
+/*
+ * Called from the I/O thread; must not block on the scan lock, since its
+ * holder may be waiting for a command response from this very thread.
+ */
+void on_deviceDiscoveryComplete(struct LB_Controller* controller)
+{
+   controller->scan.running = false;
+
+   if (controller->scan.background)
+   {
+      executeLater(controller, RESTART_DELAY_MS, onBackgroundRestart);
+   }
+
+   lb_on_deviceDiscoveryComplete(controller);
+}
@@ -55,12 +55,15 @@ enum ST_HCI_CommandOpcode
    ACI_GAP_START_GENERAL_DISCOVERY_PROC   = 0xFC97,
    ACI_GAP_CREATE_CONNECTION              = 0xFC9C,
    ACI_GAP_TERMINATE_GAP_PROC             = 0xFC9D,
+   ACI_GAP_START_CONNECTION_UPDATE        = 0xFC9E,
+   ACI_GAP_START_OBSERVATION_PROC         = 0xFCA2,
 
    ACI_GATT_INIT                          = 0xFD01,
 
    ACI_GATT_DISC_ALL_PRIMARY_SERVICES     = 0xFD12,
    ACI_GATT_READ_CHAR_VALUE               = 0xFD18,
    ACI_GATT_WRITE_CHAR_VALUE              = 0xFD1C,
+   ACI_GATT_WRITE_WITHOUT_RESP            = 0xFD23,
 };
 
 enum ACI_PARAM_OFFSET
@@ -110,6 +113,7 @@ enum ST_GAP_PROCEDURE_CODES
    GAP_GENERAL_CONNECTION_ESTABLISHMENT_PROC   = 0x10,
    GAP_SELECTIVE_CONNECTION_ESTABLISHMENT_PROC = 0x20,
    GAP_DIRECT_CONNECTION_ESTABLISHMENT_PROC    = 0x40,
+   GAP_OBSERVATION_PROC                        = 0x80,
 };
 
 struct ACI_EVENT_GAP_Device_Found
@@ -150,6 +154,29 @@ static const uint8_t CMD_ACI_SET_DATA_MODE[] =
    ACI_DATA_MODE_ONE_CONNECTION_LARGE_DB,
 };
 
+/*
+ * Selects the stack data mode matching the controller configuration, and
+ * returns the number of connections that mode supports.
+ */
+static uint8_t selectDataMode_ST(const struct LB_ControllerConfig* config, enum ACI_DATA_MODE_VALUE* dataMode)
+{
+   if (config->scanWhileConnected)
+   {
+      *dataMode = ACI_DATA_MODE_FOUR_CONNECTIONS_SCANNING;
+      return 4;
+   }
+   else if (1 < config->maxConnections)
+   {
+      *dataMode = ACI_DATA_MODE_EIGHT_CONNECTIONS;
+      return 8;
+   }
+   else
+   {
+      *dataMode = ACI_DATA_MODE_ONE_CONNECTION_LARGE_DB;
+      return 1;
+   }
+}
+
 static const uint8_t CMD_ACI_GATT_INIT[] =
 {
    HCI_PACKET_COMMAND,
@@ -160,13 +187,26 @@ static const uint8_t CMD_ACI_GATT_INIT[] =
 
 static enum LB_STATUS lb_performVendorSpecificInitialization_ST(struct LB_Controller* controller)
 {
+   enum ACI_DATA_MODE_VALUE dataMode = ACI_DATA_MODE_ONE_CONNECTION_LARGE_DB;
+   const uint8_t modeConnections = selectDataMode_ST(&controller->config, &dataMode);
+
+   if (modeConnections < controller->config.maxConnections)
+   {
+      printf("%% ST data mode %u supports only %u connections\n", (unsigned) dataMode, (unsigned) modeConnections);
+      return LB_INVALID_PARAMETERS;
+   }
+
    enum LB_STATUS status;
 
    status = lb_resetHCI(controller);
 
    if (LB_OK == status)
    {
-      status = lb_executeCommand(controller, CMD_ACI_SET_DATA_MODE, sizeof(CMD_ACI_SET_DATA_MODE), NULL, 0);
+      uint8_t cmd[sizeof(CMD_ACI_SET_DATA_MODE)];
+      memcpy(cmd, CMD_ACI_SET_DATA_MODE, sizeof(CMD_ACI_SET_DATA_MODE));
+      cmd[6] = dataMode;
+
+      status = lb_executeCommand(controller, cmd, sizeof(cmd), NULL, 0);
    }
 
    if (LB_OK == status)
@@ -177,6 +217,15 @@ static enum LB_STATUS lb_performVendorSpecificInitialization_ST(struct LB_Contro
    return status;
 }
 
+/*
+ * The data mode and the GATT and GAP initialization are kept by the
+ * controller; redoing them would need a reset
+ */
+static enum LB_STATUS lb_attachHCI_ST(struct LB_Controller* controller)
+{
+   return LB_OK;
+}
+
 static const uint8_t ACI_SET_POWER_LEVEL[] =
 {
    HCI_PACKET_COMMAND,
@@ -209,19 +258,27 @@ static enum LB_STATUS lb_configureAsCentral_ST(struct LB_Controller* controller)
    return status;
 }
 
-#define DEFAULT_SCAN_WINDOW      2000      // 2000 * 0.625msec = 1.25 seconds
-#define DEFAULT_SCAN_INTERVAL    2000      // 2000 * 0.625msec = 1.25 seconds
-
 static const uint8_t ACI_START_DISCOVERY[] =
 {
    HCI_PACKET_COMMAND,
    ACI_GAP_START_GENERAL_DISCOVERY_PROC & 0xFF,
    ACI_GAP_START_GENERAL_DISCOVERY_PROC >> 8,
    6,                                     // length from here on
-   DEFAULT_SCAN_INTERVAL & 0xFF,
-   DEFAULT_SCAN_INTERVAL >> 8,
-   DEFAULT_SCAN_WINDOW & 0xFF,
-   DEFAULT_SCAN_WINDOW >> 8,
+   0x00, 0x00,                            // scan interval
+   0x00, 0x00,                            // scan window
+   0x01,                                  // random address
+   0x01,                                  // filter duplicates
+};
+
+static const uint8_t ACI_START_OBSERVATION[] =
+{
+   HCI_PACKET_COMMAND,
+   ACI_GAP_START_OBSERVATION_PROC & 0xFF,
+   ACI_GAP_START_OBSERVATION_PROC >> 8,
+   7,                                     // length from here on
+   0x00, 0x00,                            // scan interval
+   0x00, 0x00,                            // scan window
+   0x00,                                  // passive scan
    0x01,                                  // random address
    0x01,                                  // filter duplicates
 };
@@ -235,15 +292,54 @@ static const uint8_t ACI_STOP_DISCOVERY[] =
    GAP_GENERAL_DISCOVERY_PROC,
 };
 
-static enum LB_STATUS lb_startDeviceDiscovery_ST(struct LB_Controller* controller)
+/*
+ * The general discovery procedure always scans actively; a passive scan
+ * uses the observation procedure, which reports through standard
+ * LE Advertising Report events and runs until terminated.
+ */
+static enum LB_STATUS lb_startDeviceDiscovery_ST(struct LB_Controller* controller, const struct LB_ScanParameters* parameters)
 {
-   enum LB_STATUS status = lb_executeCommand(controller, ACI_START_DISCOVERY, sizeof(ACI_START_DISCOVERY), NULL, 0);
+   enum LB_STATUS status;
+
+   if (parameters->active)
+   {
+      uint8_t cmd[sizeof(ACI_START_DISCOVERY)];
+      memcpy(cmd, ACI_START_DISCOVERY, sizeof(ACI_START_DISCOVERY));
+
+      setUint16Value(cmd + 4, parameters->interval);
+      setUint16Value(cmd + 6, parameters->window);
+      cmd[8] = parameters->randomOwnAddress;
+      cmd[9] = parameters->filterDuplicates;
+
+      status = lb_executeCommand(controller, cmd, sizeof(cmd), NULL, 0);
+   }
+   else
+   {
+      uint8_t cmd[sizeof(ACI_START_OBSERVATION)];
+      memcpy(cmd, ACI_START_OBSERVATION, sizeof(ACI_START_OBSERVATION));
+
+      setUint16Value(cmd + 4, parameters->interval);
+      setUint16Value(cmd + 6, parameters->window);
+      cmd[9]  = parameters->randomOwnAddress;
+      cmd[10] = parameters->filterDuplicates;
+
+      status = lb_executeCommand(controller, cmd, sizeof(cmd), NULL, 0);
+   }
+
    return status;
 }
 
 static enum LB_STATUS lb_stopDeviceDiscovery_ST(struct LB_Controller* controller)
 {
-   enum LB_STATUS status = lb_executeCommand(controller, ACI_STOP_DISCOVERY, sizeof(ACI_STOP_DISCOVERY), NULL, 0);
+   uint8_t cmd[sizeof(ACI_STOP_DISCOVERY)];
+   memcpy(cmd, ACI_STOP_DISCOVERY, sizeof(ACI_STOP_DISCOVERY));
+
+   if (! controller->scan.current.active)
+   {
+      cmd[4] = GAP_OBSERVATION_PROC;
+   }
+
+   enum LB_STATUS status = lb_executeCommand(controller, cmd, sizeof(cmd), NULL, 0);
    return status;
 }
 
@@ -271,7 +367,7 @@ static void lb_on_vendorSpecificEvent_ST(struct LB_Controller* controller, const
             int8_t rssi = advertisingData[advertisingDataLength];
 
             assert(AT_SCAN_RESPONSE >= device->eventType);
-            lb_on_observedDeviceAdvertisment(controller, device->peerAddress, rssi, advertisingData, advertisingDataLength);
+            on_observedDeviceAdvertisment(controller, device->peerAddress, rssi, advertisingData, advertisingDataLength);
          }
          break;
 
@@ -281,7 +377,8 @@ static void lb_on_vendorSpecificEvent_ST(struct LB_Controller* controller, const
             switch (procComplete->code)
             {
                case GAP_GENERAL_DISCOVERY_PROC:
-                  lb_on_deviceDiscoveryComplete(controller);
+               case GAP_OBSERVATION_PROC:
+                  on_deviceDiscoveryComplete(controller);
                   break;
 
                case GAP_DIRECT_CONNECTION_ESTABLISHMENT_PROC:
@@ -309,6 +406,11 @@ static void lb_on_vendorSpecificEvent_ST(struct LB_Controller* controller, const
          {
             uint16_t connectionHandle = event[2] | (((uint16_t) event[3]) << 8);
             struct LB_Device* device = getDevice(controller, connectionHandle);
+            if (! device)
+            {
+               break;
+            }
+
             uint8_t attributeLength = event[4];
             uint16_t attributeHandle = event[5] | (((uint16_t) event[6]) << 8);
 
@@ -320,17 +422,18 @@ static void lb_on_vendorSpecificEvent_ST(struct LB_Controller* controller, const
          {
             uint16_t connectionHandle = event[2] | (((uint16_t) event[3]) << 8);
             struct LB_Device* device = getDevice(controller, connectionHandle);
-
-            if (PO_DISCOVER == device->pendingOperation.type)
+            if (! device)
             {
-               on_serviceDiscoveryComplete(controller, connectionHandle);
+               break;
             }
-            else
+
+            struct lb_operation* operation = operation_acquire(device, PO_MASK(PO_DISCOVER) | PO_MASK(PO_READ) | PO_MASK(PO_WRITE));
+            if (operation)
             {
-               assert((PO_READ == device->pendingOperation.type) || (PO_WRITE == device->pendingOperation.type));
-               assert(device->pendingOperation.attributeHandle);
+               // discovery reports success as NULL, like with the other vendors
+               void* status = (PO_DISCOVER == operation->request.type) ? NULL : (void*) (uintptr_t) event[5];
 
-               os_signalCondition(device->operationComplete, (void*) (uintptr_t) event[5]);
+               operation_complete(operation, LB_OK, status);
             }
          }
          break;
@@ -339,20 +442,28 @@ static void lb_on_vendorSpecificEvent_ST(struct LB_Controller* controller, const
          {
             uint16_t connectionHandle = event[2] | (((uint16_t) event[3]) << 8);
             struct LB_Device* device = getDevice(controller, connectionHandle);
-
-            assert(device->pendingOperation.attributeHandle);
-            assert(PO_READ == device->pendingOperation.type);
+            if (! device)
+            {
+               break;
+            }
 
             uint8_t attributeLength = event[4];
             //printf("Length: %u   AttributeLength: %u\n", length, attributeLength);
             assert((attributeLength + 5) == length);
 
-            if (attributeLength < device->pendingRead.attributeCapacity)
+            // completed by the GATT procedure complete event
+            struct lb_operation* operation = operation_acquire(device, PO_MASK(PO_READ));
+            if (operation)
             {
-               attributeLength = device->pendingRead.attributeCapacity;
+               if (attributeLength > operation->request.readCapacity)
+               {
+                  attributeLength = operation->request.readCapacity;
+               }
+               memcpy(operation->request.readValue, &event[5], attributeLength);
+               *operation->request.readLength = attributeLength;
+
+               operation_release(operation);
             }
-            memcpy(device->pendingRead.attributeValue, &event[5], attributeLength);
-            device->pendingRead.attributeLength = attributeLength;
          }
          break;
 
@@ -378,12 +489,20 @@ static void lb_on_metaEvent_ST(struct LB_Controller* controller, const uint8_t*
          {
             assert(sizeof(struct Event_HCI_LE_CONNECTION_COMPLETE) + 1 == length);
             const struct Event_HCI_LE_CONNECTION_COMPLETE* linkEvent = (const struct Event_HCI_LE_CONNECTION_COMPLETE*) (event + 1);
-            on_connectedToDevice(controller, linkEvent->peerAddress, uint16Value(&linkEvent->connectionHandle));
+            on_connectedToDevice(controller, linkEvent->peerAddress, uint16Value(&linkEvent->connectionHandle),
+                  uint16Value(&linkEvent->connectionInterval), uint16Value(&linkEvent->connectionLatency), uint16Value(&linkEvent->supervisionTimeout));
          }
          break;
       case HCI_LE_ADVERTISING_REPORT_EVENT:
+         hci_on_LE_ADVERTISING_REPORT_EVENT(controller, event + 1, length - 1);
          break;
       case HCI_LE_CONNECTION_UPDATE_COMPLETE_EVENT:
+         {
+            assert(sizeof(struct Event_HCI_LE_CONNECTION_UPDATE_COMPLETE) + 1 == length);
+            const struct Event_HCI_LE_CONNECTION_UPDATE_COMPLETE* updateEvent = (const struct Event_HCI_LE_CONNECTION_UPDATE_COMPLETE*) (event + 1);
+            on_connectionParametersUpdated(controller, uint16Value(&updateEvent->connectionHandle), updateEvent->status,
+                  uint16Value(&updateEvent->connectionInterval), uint16Value(&updateEvent->connectionLatency), uint16Value(&updateEvent->supervisionTimeout));
+         }
          break;
       case HCI_LE_READ_REMOTE_USED_FEATURES_EVENT:
          break;
@@ -405,24 +524,59 @@ static const uint8_t ACI_OPEN_CONNECTION_CMD[] =
    0x00,                            // peer address type: public
    0x00,0x00,0x00,0x00,0x00,0x00,   // peer address
    0x00,                            // own address type: public
-   0x14,0x00,                       // controller interval min
-   0x28,0x00,                       // controller interval max
-   0x00,0x00,                       // controller latency
-   0x64,0x00,                       // supervision timeout
-   0x02,0x00,                       // minimum CE length
-   0x02,0x00,                       // maximum CE length
+   0x00,0x00,                       // connection interval min
+   0x00,0x00,                       // connection interval max
+   0x00,0x00,                       // connection latency
+   0x00,0x00,                       // supervision timeout
+   0x00,0x00,                       // minimum CE length
+   0x00,0x00,                       // maximum CE length
 };
 
-static enum LB_STATUS lb_openDeviceConnection_ST(struct LB_Controller* controller, const uint8_t* address)
+static enum LB_STATUS lb_openDeviceConnection_ST(struct LB_Controller* controller, const uint8_t* address, const struct LB_ConnectionParameters* parameters)
 {
-   uint8_t cmd[sizeof(ACI_OPEN_CONNECTION_CMD) + 6];
+   uint8_t cmd[sizeof(ACI_OPEN_CONNECTION_CMD)];
    memcpy(cmd, ACI_OPEN_CONNECTION_CMD, sizeof(ACI_OPEN_CONNECTION_CMD));
    memcpy(cmd + 9, address, 6);
 
+   setUint16Value(cmd + 16, parameters->intervalMin);
+   setUint16Value(cmd + 18, parameters->intervalMax);
+   setUint16Value(cmd + 20, parameters->latency);
+   setUint16Value(cmd + 22, parameters->supervisionTimeout);
+   setUint16Value(cmd + 24, parameters->minCELength);
+   setUint16Value(cmd + 26, parameters->maxCELength);
+
    enum LB_STATUS status = lb_executeCommand(controller, cmd, sizeof(cmd), NULL, 0);
    return status;
 }
 
+static enum LB_STATUS lb_updateConnectionParameters_ST(struct LB_Device* device, const struct LB_ConnectionParameters* parameters)
+{
+   uint8_t cmd[] =
+   {
+      HCI_PACKET_COMMAND,
+      ACI_GAP_START_CONNECTION_UPDATE & 0xFF,
+      ACI_GAP_START_CONNECTION_UPDATE >> 8,
+      14,                                    // parameter length
+      device->connectionHandle & 0xFF,
+      device->connectionHandle >> 8,
+      parameters->intervalMin & 0xFF,
+      parameters->intervalMin >> 8,
+      parameters->intervalMax & 0xFF,
+      parameters->intervalMax >> 8,
+      parameters->latency & 0xFF,
+      parameters->latency >> 8,
+      parameters->supervisionTimeout & 0xFF,
+      parameters->supervisionTimeout >> 8,
+      parameters->minCELength & 0xFF,
+      parameters->minCELength >> 8,
+      parameters->maxCELength & 0xFF,
+      parameters->maxCELength >> 8,
+   };
+
+   enum LB_STATUS status = lb_executeCommand(device->controller, cmd, sizeof(cmd), NULL, 0);
+   return status;
+}
+
 static const uint8_t ACI_TERMINATE_CONNECTION_CMD[] =
 {
    HCI_PACKET_COMMAND,
@@ -486,6 +640,37 @@ static enum LB_STATUS lb_writeCharValue_ST(struct LB_Device* device, uint16_t at
    return status;
 }
 
+static enum LB_STATUS lb_writeCharValueWithoutResponse_ST(struct LB_Device* device, uint16_t attributeHandle, const uint8_t* attributeValue, uint8_t attributeLength)
+{
+   if (lbDebugLevel > 1000)
+   {
+      printf("-> ST Write Without Response for handle %04x: ", attributeHandle);
+      utl_printBuffer(attributeValue, attributeLength);
+      putchar('\n');
+   }
+
+   uint8_t cmd[64];
+
+   if ((9u + attributeLength) > sizeof(cmd))
+   {
+      return LB_INVALID_PARAMETERS;
+   }
+
+   cmd[0] = HCI_PACKET_COMMAND;
+   cmd[1] = ACI_GATT_WRITE_WITHOUT_RESP & 0xFF;
+   cmd[2] = ACI_GATT_WRITE_WITHOUT_RESP >> 8;
+   cmd[3] = 5 + attributeLength;
+   cmd[4] = device->connectionHandle & 0xFF;
+   cmd[5] = device->connectionHandle >> 8;
+   cmd[6] = attributeHandle & 0xFF;
+   cmd[7] = attributeHandle >> 8;
+   cmd[8] = attributeLength;
+   memcpy(&cmd[9], attributeValue, attributeLength);
+
+   // completes with the command; there is no procedure complete event
+   return lb_executeCommand(device->controller, cmd, 9 + attributeLength, NULL, 0);
+}
+
 static enum LB_STATUS lb_requestCharValue_ST(struct LB_Device* device, uint16_t attributeHandle)
 {
    if (lbDebugLevel > 1000)
@@ -514,6 +699,7 @@ struct lb_vendorFunctions lb_vendorFunctions_ST =
    .on_vendorSpecificEvent  = lb_on_vendorSpecificEvent_ST,
    .on_metaEvent            = lb_on_metaEvent_ST,
    .initializeHCI           = lb_performVendorSpecificInitialization_ST,
+   .attachHCI               = lb_attachHCI_ST,
    .configureAsCentral      = lb_configureAsCentral_ST,
 
    .startDeviceDiscovery    = lb_startDeviceDiscovery_ST,
@@ -521,12 +707,15 @@ struct lb_vendorFunctions lb_vendorFunctions_ST =
 
    .openDeviceConnection    = lb_openDeviceConnection_ST,
    .closeDeviceConnection   = lb_closeDeviceConnection_ST,
+   .updateConnectionParameters = lb_updateConnectionParameters_ST,
 
    .startServiceDiscovery   = lb_startServiceDiscovery_ST,
 
    .writeCharValue          = lb_writeCharValue_ST,
    .requestCharValue        = lb_requestCharValue_ST,
 
+   .writeCharValueWithoutResponse = lb_writeCharValueWithoutResponse_ST,
+
 };
 
 
@@ -0,0 +1,201 @@
+/**
+ * @file state.c
+ * @brief Controller state file, for attaching without a reset
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+/*
+ * A controller keeps its configuration and its links when the host
+ * process exits. The host records them in a file mapped in memory and
+ * updated as the links come and go, so the record survives the process
+ * exiting abruptly; a restarted host reads it to take the links over.
+ *
+ * Entries are written with the connection handle last, so an entry torn
+ * by a crash is either free or names a handle that lb_attachHCI checks
+ * with the controller.
+ */
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <osal_core.h>
+#include <osal_file.h>
+
+#include <commands.h>
+
+#include "lb_priv.h"
+
+#define STATE_MAGIC        0x5453424Cu       // "LBST"
+#define STATE_VERSION      1
+
+struct lb_savedState
+{
+   uint32_t magic;
+   uint16_t version;
+   uint16_t manufacturerId;
+
+   // controller configuration, valid when configured
+   uint8_t  configured;
+   uint8_t  maxConnections;
+   uint8_t  scanWhileConnected;
+   uint8_t  standardScan;
+
+   struct lb_savedDevice   device[LB_MAX_DEVICES];
+};
+
+static void clearDevices(struct lb_savedState* state)
+{
+   for (uint32_t ii = 0; ii < LB_MAX_DEVICES; ii ++)
+   {
+      state->device[ii].connectionHandle = INVALID_CONNECTION_HANDLE;
+   }
+}
+
+enum LB_STATUS lb_setStateFile(struct LB_Controller* controller, const char* path)
+{
+   state_close(controller);
+
+   if (! path)
+   {
+      return LB_OK;
+   }
+
+   struct os_mappedFile* file = os_mapFile(path, sizeof(struct lb_savedState), true);
+   if (! file)
+   {
+      return LB_FAILURE;
+   }
+
+   if (os_getMappedSize(file) < sizeof(struct lb_savedState))
+   {
+      os_unmapFile(file);
+      return LB_FAILURE;
+   }
+
+   struct lb_savedState* state = (struct lb_savedState*) os_getMappedAddress(file);
+
+   if ((STATE_MAGIC != state->magic) || (STATE_VERSION != state->version))
+   {
+      memset(state, 0, sizeof(*state));
+      clearDevices(state);
+
+      state->version = STATE_VERSION;
+      state->magic   = STATE_MAGIC;
+   }
+
+   controller->stateFile = file;
+   controller->state     = state;
+
+   return LB_OK;
+}
+
+void state_close(struct LB_Controller* controller)
+{
+   if (controller->stateFile)
+   {
+      os_unmapFile(controller->stateFile);
+
+      controller->stateFile = NULL;
+      controller->state     = NULL;
+   }
+}
+
+void state_onReset(struct LB_Controller* controller)
+{
+   struct lb_savedState* state = controller->state;
+
+   if (state)
+   {
+      state->configured = 0;
+      clearDevices(state);
+   }
+}
+
+void state_onConfigured(struct LB_Controller* controller)
+{
+   struct lb_savedState* state = controller->state;
+
+   if (state)
+   {
+      state->manufacturerId     = controller->manufacturerId;
+      state->maxConnections     = controller->config.maxConnections;
+      state->scanWhileConnected = controller->config.scanWhileConnected;
+      state->standardScan       = controller->config.standardScan;
+      state->configured         = 1;
+   }
+}
+
+bool state_isConfigured(struct LB_Controller* controller, uint16_t manufacturerId)
+{
+   const struct lb_savedState* state = controller->state;
+
+   return state && state->configured &&
+      (state->manufacturerId == manufacturerId) &&
+      (state->maxConnections == controller->config.maxConnections) &&
+      (state->scanWhileConnected == controller->config.scanWhileConnected) &&
+      (state->standardScan == controller->config.standardScan);
+}
+
+bool state_getSavedDevice(struct LB_Controller* controller, uint32_t slot, struct lb_savedDevice* saved)
+{
+   const struct lb_savedState* state = controller->state;
+
+   if ((! state) || (slot >= LB_MAX_DEVICES))
+   {
+      return false;
+   }
+
+   *saved = state->device[slot];
+
+   return INVALID_CONNECTION_HANDLE != saved->connectionHandle;
+}
+
+void state_recordDevice(struct LB_Device* device)
+{
+   struct lb_savedState* state = device->controller->state;
+
+   if (state)
+   {
+      struct lb_savedDevice* saved = &state->device[device - device->controller->device];
+
+      // keeps the compiler from merging or reordering the handle stores
+      saved->connectionHandle = INVALID_CONNECTION_HANDLE;
+      atomic_signal_fence(memory_order_seq_cst);
+
+      memcpy(saved->address, device->address, sizeof(saved->address));
+      saved->interval           = device->connectionParameters.interval;
+      saved->latency            = device->connectionParameters.latency;
+      saved->supervisionTimeout = device->connectionParameters.supervisionTimeout;
+
+      atomic_signal_fence(memory_order_seq_cst);
+      saved->connectionHandle = device->connectionHandle;
+   }
+}
+
+void state_forgetDevice(struct LB_Device* device)
+{
+   struct lb_savedState* state = device->controller->state;
+
+   if (state)
+   {
+      state->device[device - device->controller->device].connectionHandle = INVALID_CONNECTION_HANDLE;
+   }
+}
@@ -0,0 +1,277 @@
+/**
+ * @file std_hci.c
+ * @brief Standard HCI controller support
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+/*
+ * Controllers without vendor extensions: the link layer is driven with
+ * standard HCI commands, and ATT runs on the host over ACL data.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+
+#include <osal_core.h>
+#include <utils.h>
+
+#include <hci.h>
+#include <commands.h>
+
+#include "hci_priv.h"
+#include "lb_priv.h"
+
+#define INITIATOR_SCAN_INTERVAL  0x0060      // 60 ms
+#define INITIATOR_SCAN_WINDOW    0x0030      // 30 ms
+
+static void lb_on_metaEvent_HCI(struct LB_Controller* controller, const uint8_t* event, uint8_t length)
+{
+   if (0 == length)
+   {
+      return;
+   }
+
+   switch (event[0])    // subevent code
+   {
+      case HCI_LE_CONNECTION_COMPLETE_EVENT:
+         if (sizeof(struct Event_HCI_LE_CONNECTION_COMPLETE) + 1 <= length)
+         {
+            const struct Event_HCI_LE_CONNECTION_COMPLETE* linkEvent = (const struct Event_HCI_LE_CONNECTION_COMPLETE*) (event + 1);
+
+            if (HCI_STATUS_SUCCESS == linkEvent->status)
+            {
+               on_connectedToDevice(controller, linkEvent->peerAddress, uint16Value(&linkEvent->connectionHandle),
+                     uint16Value(&linkEvent->connectionInterval), uint16Value(&linkEvent->connectionLatency), uint16Value(&linkEvent->supervisionTimeout));
+            }
+            else
+            {
+               on_connectionFailed(controller, linkEvent->status);
+            }
+         }
+         break;
+
+      case HCI_LE_CONNECTION_UPDATE_COMPLETE_EVENT:
+         if (sizeof(struct Event_HCI_LE_CONNECTION_UPDATE_COMPLETE) + 1 <= length)
+         {
+            const struct Event_HCI_LE_CONNECTION_UPDATE_COMPLETE* updateEvent = (const struct Event_HCI_LE_CONNECTION_UPDATE_COMPLETE*) (event + 1);
+            on_connectionParametersUpdated(controller, uint16Value(&updateEvent->connectionHandle), updateEvent->status,
+                  uint16Value(&updateEvent->connectionInterval), uint16Value(&updateEvent->connectionLatency), uint16Value(&updateEvent->supervisionTimeout));
+         }
+         break;
+
+      default:
+         hci_on_metaEvent(controller, event, length);
+         break;
+   }
+}
+
+static enum LB_STATUS lb_initializeHCI_HCI(struct LB_Controller* controller)
+{
+   enum LB_STATUS status = hci_enableLEEvents(controller);
+
+   if (LB_OK == status)
+   {
+      status = hci_readBufferSize(controller);
+   }
+
+   return status;
+}
+
+static enum LB_STATUS lb_configureAsCentral_HCI(struct LB_Controller* controller)
+{
+   // the standard commands need no role configuration
+   return LB_OK;
+}
+
+static enum LB_STATUS lb_openDeviceConnection_HCI(struct LB_Controller* controller, const uint8_t* address, const struct LB_ConnectionParameters* parameters)
+{
+   uint8_t cmd[] =
+   {
+      HCI_PACKET_COMMAND,
+      HCI_LE_CREATE_CONNECTION & 0xFF,
+      HCI_LE_CREATE_CONNECTION >> 8,
+      25,                                    // parameter length
+      INITIATOR_SCAN_INTERVAL & 0xFF,
+      INITIATOR_SCAN_INTERVAL >> 8,
+      INITIATOR_SCAN_WINDOW & 0xFF,
+      INITIATOR_SCAN_WINDOW >> 8,
+      0x00,                                  // initiator filter policy: use peer address
+      0x00,                                  // peer address type: public
+      0, 0, 0, 0, 0, 0,                      // peer address
+      0x00,                                  // own address type: public
+      0, 0,                                  // connection interval min
+      0, 0,                                  // connection interval max
+      0, 0,                                  // latency
+      0, 0,                                  // supervision timeout
+      0, 0,                                  // minimum CE length
+      0, 0,                                  // maximum CE length
+   };
+
+   memcpy(cmd + 10, address, 6);
+
+   setUint16Value(cmd + 17, parameters->intervalMin);
+   setUint16Value(cmd + 19, parameters->intervalMax);
+   setUint16Value(cmd + 21, parameters->latency);
+   setUint16Value(cmd + 23, parameters->supervisionTimeout);
+   setUint16Value(cmd + 25, parameters->minCELength);
+   setUint16Value(cmd + 27, parameters->maxCELength);
+
+   enum LB_STATUS status = lb_executeCommand(controller, cmd, sizeof(cmd), NULL, 0);
+   return status;
+}
+
+/*
+ * Bluetooth Core Specification v4.2, Vol 2, Part E, 7.8.13; the controller
+ * then reports the attempt with an Unknown Connection Identifier status
+ */
+static enum LB_STATUS lb_cancelDeviceConnection_HCI(struct LB_Controller* controller)
+{
+   const uint8_t cmd[] =
+   {
+      HCI_PACKET_COMMAND,
+      HCI_LE_CREATE_CONNECTION_CANCEL & 0xFF,
+      HCI_LE_CREATE_CONNECTION_CANCEL >> 8,
+      0,                                     // parameter length
+   };
+
+   enum LB_STATUS status = lb_executeCommand(controller, cmd, sizeof(cmd), NULL, 0);
+   return status;
+}
+
+static enum LB_STATUS lb_closeDeviceConnection_HCI(struct LB_Device* device)
+{
+   uint8_t cmd[] =
+   {
+      HCI_PACKET_COMMAND,
+      HCI_DISCONNECT & 0xFF,
+      HCI_DISCONNECT >> 8,
+      3,                                     // parameter length
+      device->connectionHandle & 0xFF,
+      device->connectionHandle >> 8,
+      HCI_OE_USER_ENDED_CONNECTION,
+   };
+
+   enum LB_STATUS status = lb_executeCommand(device->controller, cmd, sizeof(cmd), NULL, 0);
+   return status;
+}
+
+static enum LB_STATUS lb_updateConnectionParameters_HCI(struct LB_Device* device, const struct LB_ConnectionParameters* parameters)
+{
+   uint8_t cmd[] =
+   {
+      HCI_PACKET_COMMAND,
+      HCI_LE_CONNECTION_UPDATE & 0xFF,
+      HCI_LE_CONNECTION_UPDATE >> 8,
+      14,                                    // parameter length
+      device->connectionHandle & 0xFF,
+      device->connectionHandle >> 8,
+      0, 0,                                  // connection interval min
+      0, 0,                                  // connection interval max
+      0, 0,                                  // latency
+      0, 0,                                  // supervision timeout
+      0, 0,                                  // minimum CE length
+      0, 0,                                  // maximum CE length
+   };
+
+   setUint16Value(cmd + 6, parameters->intervalMin);
+   setUint16Value(cmd + 8, parameters->intervalMax);
+   setUint16Value(cmd + 10, parameters->latency);
+   setUint16Value(cmd + 12, parameters->supervisionTimeout);
+   setUint16Value(cmd + 14, parameters->minCELength);
+   setUint16Value(cmd + 16, parameters->maxCELength);
+
+   enum LB_STATUS status = lb_executeCommand(device->controller, cmd, sizeof(cmd), NULL, 0);
+   return status;
+}
+
+/*
+ * The ATT procedures run to completion on the calling thread; completion
+ * is then signaled the same way the vendor events do it.
+ */
+static enum LB_STATUS lb_startServiceDiscovery_HCI(struct LB_Device* device)
+{
+   enum LB_STATUS status = att_discoverPrimaryServices(device);
+
+   if (LB_OK == status)
+   {
+      on_serviceDiscoveryComplete(device->controller, device->connectionHandle);
+   }
+
+   return status;
+}
+
+static enum LB_STATUS lb_writeCharValue_HCI(struct LB_Device* device, uint16_t attributeHandle, const uint8_t* attributeValue, uint8_t attributeLength)
+{
+   enum LB_STATUS status = att_write(device, attributeHandle, attributeValue, attributeLength);
+
+   if (LB_OK == status)
+   {
+      struct lb_operation* operation = operation_acquire(device, PO_MASK(PO_WRITE));
+      if (operation)
+      {
+         operation_complete(operation, LB_OK, NULL);
+      }
+   }
+
+   return status;
+}
+
+static enum LB_STATUS lb_requestCharValue_HCI(struct LB_Device* device, uint16_t attributeHandle)
+{
+   enum LB_STATUS status = att_read(device, attributeHandle);
+
+   if (LB_OK == status)
+   {
+      struct lb_operation* operation = operation_acquire(device, PO_MASK(PO_READ));
+      if (operation)
+      {
+         operation_complete(operation, LB_OK, NULL);
+      }
+   }
+
+   return status;
+}
+
+struct lb_vendorFunctions lb_vendorFunctions_HCI =
+{
+   .on_vendorSpecificEvent  = NULL,
+   .on_metaEvent            = lb_on_metaEvent_HCI,
+   .initializeHCI           = lb_initializeHCI_HCI,
+   .attachHCI               = lb_initializeHCI_HCI,          // leaves the links alone
+   .configureAsCentral      = lb_configureAsCentral_HCI,
+
+   .startDeviceDiscovery    = hci_startDeviceDiscovery,
+   .stopDeviceDiscovery     = hci_stopDeviceDiscovery,
+
+   .openDeviceConnection    = lb_openDeviceConnection_HCI,
+   .cancelDeviceConnection  = lb_cancelDeviceConnection_HCI,
+   .closeDeviceConnection   = lb_closeDeviceConnection_HCI,
+   .updateConnectionParameters = lb_updateConnectionParameters_HCI,
+
+   .startServiceDiscovery   = lb_startServiceDiscovery_HCI,
+
+   .writeCharValue          = lb_writeCharValue_HCI,
+   .requestCharValue        = lb_requestCharValue_HCI,
+
+   .writeCharValueWithoutResponse = att_writeCommand,
+
+   .blockingGATT            = true,
+};
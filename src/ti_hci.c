@@ -47,10 +47,13 @@ enum TI_HCI_CommandOpcode
    HCI_EXT_GAP_DEVICE_DISC_CANCEL         = 0xFE05,
    HCI_EXT_GAP_EST_LINK_REQ               = 0xFE09,
    GAP_TerminateLinkReq                   = 0xFE0A,
+   GAP_UpdateLinkParamReq                 = 0xFE11,
+   GAP_SetParamValue                      = 0xFE30,
 
    GATT_ReadCharValue                     = 0xFD8A,
    GATT_DiscAllPrimaryServices            = 0xFD90,
    GATT_WriteCharValue                    = 0xFD92,
+   GATT_WriteNoRsp                        = 0xFDB6,
 
 };
 
@@ -63,6 +66,7 @@ enum TI_HCI_GAP_EVENTS
    GAP_DeviceDiscovery         = 0x0601,
    GAP_LinkEstablished         = 0x0605,
    GAP_LinkTerminated          = 0x0606,
+   GAP_LinkParamUpdate         = 0x0607,
    GAP_DeviceInformation       = 0x060D,
    CommandStatus               = 0x067F,
 
@@ -109,6 +113,42 @@ enum StatusTypes
    bleInsufficientKeySize                          = 0x43,
 };
 
+/*
+ * GAP parameters, used with GAP_SetParamValue
+ */
+enum TI_GAP_ParamId
+{
+   TGAP_GEN_DISC_SCAN                              = 2,
+   TGAP_GEN_DISC_SCAN_INT                          = 16,
+   TGAP_GEN_DISC_SCAN_WIND                         = 17,
+   TGAP_CONN_EST_INT_MIN                           = 21,
+   TGAP_CONN_EST_INT_MAX                           = 22,
+   TGAP_CONN_EST_SCAN_INT                          = 23,
+   TGAP_CONN_EST_SCAN_WIND                         = 24,
+   TGAP_CONN_EST_SUPERV_TIMEOUT                    = 25,
+   TGAP_CONN_EST_LATENCY                           = 26,
+   TGAP_CONN_EST_MIN_CE_LEN                        = 27,
+   TGAP_CONN_EST_MAX_CE_LEN                        = 28,
+   TGAP_FILTER_ADV_REPORTS                         = 35,
+};
+
+static enum LB_STATUS lb_setParamValue_TI(struct LB_Controller* controller, enum TI_GAP_ParamId paramId, uint16_t value)
+{
+   uint8_t cmd[] =
+   {
+      HCI_PACKET_COMMAND,
+      GAP_SetParamValue & 0xFF,
+      GAP_SetParamValue >> 8,
+      3,                                     // parameter length
+      paramId,
+      value & 0xFF,
+      value >> 8,
+   };
+
+   enum LB_STATUS status = lb_executeCommand(controller, cmd, sizeof(cmd), NULL, 0);
+   return status;
+}
+
 static enum LB_STATUS lb_performVendorSpecificInitialization_TI(struct LB_Controller* controller)
 {
    return LB_OK;
@@ -151,9 +191,77 @@ static const uint8_t TI_START_DISCOVERY_CMD[] =
    0,             // whitelist only?
 };
 
-static enum LB_STATUS lb_startDeviceDiscovery_TI(struct LB_Controller* controller)
+#define TI_DEFAULT_DISCOVERY_DURATION  10240    // msec
+
+/*
+ * The discovery request only selects active or passive scanning; timing
+ * and duplicate filtering are GAP parameters that need to be set
+ * beforehand. The discovery procedure is always bounded, so an unbounded
+ * scan uses the default duration and is restarted by the caller.
+ */
+static enum LB_STATUS lb_setScanParameters_TI(struct LB_Controller* controller, const struct LB_ScanParameters* parameters)
+{
+   uint32_t duration = parameters->duration_ms;
+   if (0 == duration)
+   {
+      duration = TI_DEFAULT_DISCOVERY_DURATION;
+   }
+   else if (duration > UINT16_MAX)
+   {
+      duration = UINT16_MAX;
+   }
+
+   const struct LB_ScanParameters* cached = &controller->scanParameters;
+
+   const struct
+   {
+      enum TI_GAP_ParamId  paramId;
+      uint16_t             value;
+      bool                 changed;
+   } values[] =
+   {
+      { TGAP_GEN_DISC_SCAN,       (uint16_t) duration,           duration != cached->duration_ms },
+      { TGAP_GEN_DISC_SCAN_INT,   parameters->interval,          parameters->interval != cached->interval },
+      { TGAP_GEN_DISC_SCAN_WIND,  parameters->window,            parameters->window != cached->window },
+      { TGAP_FILTER_ADV_REPORTS,  parameters->filterDuplicates,  parameters->filterDuplicates != cached->filterDuplicates },
+   };
+
+   enum LB_STATUS status = LB_OK;
+
+   for (uint32_t ii = 0; (LB_OK == status) && (ii < (sizeof(values) / sizeof(values[0]))); ii ++)
+   {
+      if (values[ii].changed || (0 == cached->interval))
+      {
+         status = lb_setParamValue_TI(controller, values[ii].paramId, values[ii].value);
+      }
+   }
+
+   if (LB_OK == status)
+   {
+      controller->scanParameters             = *parameters;
+      controller->scanParameters.duration_ms = duration;
+   }
+   else
+   {
+      memset(&controller->scanParameters, 0, sizeof(controller->scanParameters));
+   }
+
+   return status;
+}
+
+static enum LB_STATUS lb_startDeviceDiscovery_TI(struct LB_Controller* controller, const struct LB_ScanParameters* parameters)
 {
-   enum LB_STATUS status = lb_executeCommand(controller, TI_START_DISCOVERY_CMD, sizeof(TI_START_DISCOVERY_CMD), NULL, 0);
+   enum LB_STATUS status = lb_setScanParameters_TI(controller, parameters);
+   if (LB_OK != status)
+   {
+      return status;
+   }
+
+   uint8_t cmd[sizeof(TI_START_DISCOVERY_CMD)];
+   memcpy(cmd, TI_START_DISCOVERY_CMD, sizeof(TI_START_DISCOVERY_CMD));
+   cmd[5] = parameters->active;
+
+   status = lb_executeCommand(controller, cmd, sizeof(cmd), NULL, 0);
    return status;
 }
 
@@ -266,7 +374,17 @@ static void lb_on_vendorSpecificEvent_TI(struct LB_Controller* controller, const
          {
             assert((sizeof(struct Event_GAP_LinkEstablished) + 2) == length);
             const struct Event_GAP_LinkEstablished* linkEvent = (const struct Event_GAP_LinkEstablished*) (event + 2);
-            on_connectedToDevice(controller, linkEvent->peerAddress, uint16Value(&linkEvent->connectionHandle));
+            on_connectedToDevice(controller, linkEvent->peerAddress, uint16Value(&linkEvent->connectionHandle),
+                  uint16Value(&linkEvent->connectionInterval), uint16Value(&linkEvent->connectionLatency), uint16Value(&linkEvent->connectionTimeout));
+         }
+         break;
+
+      case GAP_LinkParamUpdate:
+         {
+            assert((sizeof(struct Event_HCI_LE_CONNECTION_UPDATE_COMPLETE) + 2) == length);
+            const struct Event_HCI_LE_CONNECTION_UPDATE_COMPLETE* updateEvent = (const struct Event_HCI_LE_CONNECTION_UPDATE_COMPLETE*) (event + 2);
+            on_connectionParametersUpdated(controller, uint16Value(&updateEvent->connectionHandle), updateEvent->status,
+                  uint16Value(&updateEvent->connectionInterval), uint16Value(&updateEvent->connectionLatency), uint16Value(&updateEvent->supervisionTimeout));
          }
          break;
 
@@ -286,7 +404,7 @@ static void lb_on_vendorSpecificEvent_TI(struct LB_Controller* controller, const
             const uint8_t* advertisingData = event + 2 + sizeof(*deviceInfo);
             uint8_t advertisingDataLength = deviceInfo->dataLength;
             assert(AT_SCAN_RESPONSE >= deviceInfo->eventType);
-            lb_on_observedDeviceAdvertisment(controller, deviceInfo->addr, deviceInfo->rssi, advertisingData, advertisingDataLength);
+            on_observedDeviceAdvertisment(controller, deviceInfo->addr, deviceInfo->rssi, advertisingData, advertisingDataLength);
          }
          break;
 
@@ -308,7 +426,7 @@ static void lb_on_vendorSpecificEvent_TI(struct LB_Controller* controller, const
                   putchar('\n');
                }
             }
-            lb_on_deviceDiscoveryComplete(controller);
+            on_deviceDiscoveryComplete(controller);
          }
          break;
 
@@ -321,7 +439,7 @@ static void lb_on_vendorSpecificEvent_TI(struct LB_Controller* controller, const
             {
                commandResult = NULL;
             }
-            signalCondition(uint16Value(&commandStatus->opcode), commandStatus->status, commandResult, commandStatus->dataLength);
+            signalCondition(controller, uint16Value(&commandStatus->opcode), commandStatus->status, commandResult, commandStatus->dataLength);
          }
          break;
 
@@ -346,6 +464,10 @@ static void lb_on_vendorSpecificEvent_TI(struct LB_Controller* controller, const
          {
             uint16_t connectionHandle = event[3] | (((uint16_t) event[4]) << 8);
             struct LB_Device* device = getDevice(controller, connectionHandle);
+            if (! device)
+            {
+               break;
+            }
 
             uint16_t attributeHandle = event[7] | (((uint16_t) event[8]) << 8);
             uint8_t status = event[9];
@@ -355,10 +477,11 @@ static void lb_on_vendorSpecificEvent_TI(struct LB_Controller* controller, const
                printf("TI ErrorRsp; connection: %04x, attribute: %04x, status: %02x\n", connectionHandle, attributeHandle, status);
             }
 
-            if ((PO_READ == device->pendingOperation.type) || (PO_WRITE == device->pendingOperation.type))
+            struct lb_operation* operation = operation_acquire(device, PO_MASK(PO_READ) | PO_MASK(PO_WRITE));
+            if (operation)
             {
-               assert(attributeHandle == device->pendingOperation.attributeHandle);
-               os_signalCondition(device->operationComplete, (void*) (uintptr_t) status);
+               assert(attributeHandle == operation->request.attributeHandle);
+               operation_complete(operation, LB_OK, (void*) (uintptr_t) status);
             }
          }
          break;
@@ -367,11 +490,17 @@ static void lb_on_vendorSpecificEvent_TI(struct LB_Controller* controller, const
          {
             uint16_t connectionHandle = event[3] | (((uint16_t) event[4]) << 8);
             struct LB_Device* device = getDevice(controller, connectionHandle);
+            if (! device)
+            {
+               break;
+            }
 
-            assert(device->pendingOperation.attributeHandle);
-            assert(PO_WRITE == device->pendingOperation.type);
             //printf("TI WriteResponse status: %02x\n", event[2]);
-            os_signalCondition(device->operationComplete, (void*) (uintptr_t) event[2]);
+            struct lb_operation* operation = operation_acquire(device, PO_MASK(PO_WRITE));
+            if (operation)
+            {
+               operation_complete(operation, LB_OK, (void*) (uintptr_t) event[2]);
+            }
          }
          break;
 
@@ -379,21 +508,27 @@ static void lb_on_vendorSpecificEvent_TI(struct LB_Controller* controller, const
          {
             uint16_t connectionHandle = event[3] | (((uint16_t) event[4]) << 8);
             struct LB_Device* device = getDevice(controller, connectionHandle);
-
-            assert(device->pendingOperation.attributeHandle);
-            assert(PO_READ == device->pendingOperation.type);
+            if (! device)
+            {
+               break;
+            }
 
             uint8_t attributeLength = event[5];
             //printf("Length: %u   AttributeLength: %u\n", length, attributeLength);
             assert((attributeLength + 6) == length);
-            if (attributeLength < device->pendingRead.attributeCapacity)
+
+            struct lb_operation* operation = operation_acquire(device, PO_MASK(PO_READ));
+            if (operation)
             {
-               attributeLength = device->pendingRead.attributeCapacity;
-            }
-            memcpy(device->pendingRead.attributeValue, &event[6], attributeLength);
-            device->pendingRead.attributeLength = attributeLength;
+               if (attributeLength > operation->request.readCapacity)
+               {
+                  attributeLength = operation->request.readCapacity;
+               }
+               memcpy(operation->request.readValue, &event[6], attributeLength);
+               *operation->request.readLength = attributeLength;
 
-            os_signalCondition(device->operationComplete, (void*) (uintptr_t) event[2]);
+               operation_complete(operation, LB_OK, (void*) (uintptr_t) event[2]);
+            }
          }
          break;
 
@@ -402,6 +537,11 @@ static void lb_on_vendorSpecificEvent_TI(struct LB_Controller* controller, const
             uint8_t status = event[2];
             uint16_t connectionHandle = event[3] | (((uint16_t) event[4]) << 8);
             struct LB_Device* device = getDevice(controller, connectionHandle);
+            if (! device)
+            {
+               break;
+            }
+
             uint8_t attributeLength = event[5];
             uint16_t attributeHandle = event[6] | (((uint16_t) event[7]) << 8);
 
@@ -429,13 +569,87 @@ static const uint8_t TI_OPEN_CONNECTION_CMD[] =
    0,                                     // address type peer: public
 };
 
-static enum LB_STATUS lb_openDeviceConnection_TI(struct LB_Controller* controller, const uint8_t* address)
+/*
+ * The TI link establishment request does not carry connection parameters;
+ * they are GAP parameters that need to be set beforehand.
+ */
+static enum LB_STATUS lb_setConnectionParameters_TI(struct LB_Controller* controller, const struct LB_ConnectionParameters* parameters)
+{
+   if (0 == memcmp(&controller->connectionParameters, parameters, sizeof(*parameters)))
+   {
+      return LB_OK;
+   }
+
+   const struct
+   {
+      enum TI_GAP_ParamId  paramId;
+      uint16_t             value;
+   } values[] =
+   {
+      { TGAP_CONN_EST_INT_MIN,         parameters->intervalMin },
+      { TGAP_CONN_EST_INT_MAX,         parameters->intervalMax },
+      { TGAP_CONN_EST_LATENCY,         parameters->latency },
+      { TGAP_CONN_EST_SUPERV_TIMEOUT,  parameters->supervisionTimeout },
+      { TGAP_CONN_EST_MIN_CE_LEN,      parameters->minCELength },
+      { TGAP_CONN_EST_MAX_CE_LEN,      parameters->maxCELength },
+   };
+
+   enum LB_STATUS status = LB_OK;
+
+   for (uint32_t ii = 0; (LB_OK == status) && (ii < (sizeof(values) / sizeof(values[0]))); ii ++)
+   {
+      status = lb_setParamValue_TI(controller, values[ii].paramId, values[ii].value);
+   }
+
+   if (LB_OK == status)
+   {
+      controller->connectionParameters = *parameters;
+   }
+   else
+   {
+      memset(&controller->connectionParameters, 0, sizeof(controller->connectionParameters));
+   }
+
+   return status;
+}
+
+static enum LB_STATUS lb_openDeviceConnection_TI(struct LB_Controller* controller, const uint8_t* address, const struct LB_ConnectionParameters* parameters)
 {
+   enum LB_STATUS status = lb_setConnectionParameters_TI(controller, parameters);
+   if (LB_OK != status)
+   {
+      return status;
+   }
+
    uint8_t cmd[sizeof(TI_OPEN_CONNECTION_CMD) + 6];
    memcpy(cmd, TI_OPEN_CONNECTION_CMD, sizeof(TI_OPEN_CONNECTION_CMD));
    memcpy(cmd + sizeof(TI_OPEN_CONNECTION_CMD), address, 6);
 
-   enum LB_STATUS status = lb_executeCommand(controller, cmd, sizeof(cmd), NULL, 0);
+   status = lb_executeCommand(controller, cmd, sizeof(cmd), NULL, 0);
+   return status;
+}
+
+static enum LB_STATUS lb_updateConnectionParameters_TI(struct LB_Device* device, const struct LB_ConnectionParameters* parameters)
+{
+   uint8_t cmd[] =
+   {
+      HCI_PACKET_COMMAND,
+      GAP_UpdateLinkParamReq & 0xFF,
+      GAP_UpdateLinkParamReq >> 8,
+      10,                                    // parameter length
+      device->connectionHandle & 0xFF,
+      device->connectionHandle >> 8,
+      parameters->intervalMin & 0xFF,
+      parameters->intervalMin >> 8,
+      parameters->intervalMax & 0xFF,
+      parameters->intervalMax >> 8,
+      parameters->latency & 0xFF,
+      parameters->latency >> 8,
+      parameters->supervisionTimeout & 0xFF,
+      parameters->supervisionTimeout >> 8,
+   };
+
+   enum LB_STATUS status = lb_executeCommand(device->controller, cmd, sizeof(cmd), NULL, 0);
    return status;
 }
 
@@ -502,6 +716,36 @@ static enum LB_STATUS lb_writeCharValue_TI(struct LB_Device* device, uint16_t at
    return status;
 }
 
+static enum LB_STATUS lb_writeCharValueWithoutResponse_TI(struct LB_Device* device, uint16_t attributeHandle, const uint8_t* attributeValue, uint8_t attributeLength)
+{
+   if (lbDebugLevel > 1000)
+   {
+      printf("-> TI Write Without Response for handle %04x: ", attributeHandle);
+      utl_printBuffer(attributeValue, attributeLength);
+      putchar('\n');
+   }
+
+   uint8_t cmd[64];
+
+   if ((8u + attributeLength) > sizeof(cmd))
+   {
+      return LB_INVALID_PARAMETERS;
+   }
+
+   cmd[0] = HCI_PACKET_COMMAND;
+   cmd[1] = GATT_WriteNoRsp & 0xFF;
+   cmd[2] = GATT_WriteNoRsp >> 8;
+   cmd[3] = 4 + attributeLength;
+   cmd[4] = device->connectionHandle & 0xFF;
+   cmd[5] = device->connectionHandle >> 8;
+   cmd[6] = attributeHandle & 0xFF;
+   cmd[7] = attributeHandle >> 8;
+   memcpy(&cmd[8], attributeValue, attributeLength);
+
+   // the command status is the only completion
+   return lb_executeCommand(device->controller, cmd, 8 + attributeLength, NULL, 0);
+}
+
 static enum LB_STATUS lb_requestCharValue_TI(struct LB_Device* device, uint16_t attributeHandle)
 {
    if (lbDebugLevel > 1000)
@@ -531,6 +775,7 @@ struct lb_vendorFunctions lb_vendorFunctions_TI =
    .on_metaEvent            = NULL,
 
    .initializeHCI           = lb_performVendorSpecificInitialization_TI,
+   .attachHCI               = lb_performVendorSpecificInitialization_TI,
    .configureAsCentral      = lb_configureAsCentral_TI,
 
    .startDeviceDiscovery    = lb_startDeviceDiscovery_TI,
@@ -538,10 +783,13 @@ struct lb_vendorFunctions lb_vendorFunctions_TI =
 
    .openDeviceConnection    = lb_openDeviceConnection_TI,
    .closeDeviceConnection   = lb_closeDeviceConnection_TI,
+   .updateConnectionParameters = lb_updateConnectionParameters_TI,
 
    .startServiceDiscovery   = lb_startServiceDiscovery_TI,
 
    .writeCharValue          = lb_writeCharValue_TI,
    .requestCharValue        = lb_requestCharValue_TI,
+
+   .writeCharValueWithoutResponse = lb_writeCharValueWithoutResponse_TI,
 };
 
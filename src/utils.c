@@ -153,6 +153,10 @@ void utl_printUUID(const uint8_t* buffer, uint8_t length)
    {
       printf("%02x%02x", buffer[1], buffer[0]);
    }
+   else if (4 == length)
+   {
+      printf("%02x%02x%02x%02x", buffer[3], buffer[2], buffer[1], buffer[0]);
+   }
    else if (16 == length)
    {
       for (uint32_t ii = 0; ii < 16; ii ++)
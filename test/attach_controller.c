@@ -0,0 +1,165 @@
+/**
+ * @file attach_controller.c
+ * @brief Keeps device connections across restarts of the application
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <osal_core.h>
+#include <osal_io.h>
+
+#include <hci.h>
+#include <controller.h>
+#include <commands.h>
+#include <utils.h>
+
+#define MAX_PEERS    8
+
+void lb_on_observedDeviceAdvertisment(struct LB_Controller* controller, const uint8_t* address, int8_t rssi, const uint8_t* data, uint8_t length)
+{
+}
+
+void lb_on_deviceDiscoveryComplete(struct LB_Controller* controller)
+{
+}
+
+void lb_on_disconnectedFromDevice(struct LB_Device* device, enum HCI_StatusCode reason)
+{
+   printf("Device disconnected: %p\n", device);
+}
+
+void lb_on_discoveredPrimaryService(struct LB_Device* device, uint16_t attributeHandle, uint16_t groupEndHandle, const uint8_t* attribute, uint8_t attributeLength)
+{
+}
+
+void lb_on_receivedNotification(struct LB_Device* device, uint16_t attributeHandle, uint8_t status, const uint8_t* attributeValue, uint8_t attributeLength)
+{
+}
+
+static bool isConnected(struct LB_Controller* controller, const uint8_t* address)
+{
+   struct LB_Device* device[MAX_PEERS];
+   const uint32_t count = lb_getConnectedDevices(controller, device, MAX_PEERS);
+
+   for (uint32_t ii = 0; ii < count; ii ++)
+   {
+      uint8_t deviceAddress[6];
+
+      if ((LB_OK == lb_getDeviceAddress(device[ii], deviceAddress)) && (0 == memcmp(deviceAddress, address, sizeof(deviceAddress))))
+      {
+         return true;
+      }
+   }
+
+   return false;
+}
+
+int main(int argc, char* argv[])
+{
+   if (argc < 3)
+   {
+      puts("Usage: attach_controller <serial port> <state file> [address]...");
+      return 1;
+   }
+
+   if (argc - 3 > MAX_PEERS)
+   {
+      printf("At most %u devices\n", MAX_PEERS);
+      return 1;
+   }
+
+   uint8_t peerAddress[MAX_PEERS][6];
+   const uint32_t peerCount = (uint32_t) (argc - 3);
+
+   for (uint32_t ii = 0; ii < peerCount; ii ++)
+   {
+      if (! utl_parseAddress(argv[ii + 3], peerAddress[ii]))
+      {
+         printf("Failed to parse input address: %s\n", argv[ii + 3]);
+         return 1;
+      }
+   }
+
+   if (lb_initialize() < 0)
+   {
+      puts("Failed to initialize lightBLUE library");
+      return 2;
+   }
+
+   io_setDebugLevel(0);
+   lb_setDebugLevel(0);
+
+   struct LB_Controller* controller = lb_connect(argv[1]);
+
+   if (! controller)
+   {
+      printf("Failed to connect to %s.\n", argv[1]);
+      return 3;
+   }
+
+   const struct LB_ControllerConfig config =
+   {
+      .maxConnections     = MAX_PEERS,
+      .scanWhileConnected = false,
+   };
+
+   if ((LB_OK != lb_setControllerConfig(controller, &config)) || (LB_OK != lb_setStateFile(controller, argv[2])))
+   {
+      goto done;
+   }
+
+   const uint64_t start_ms = os_getTime_ms();
+
+   uint32_t restored = 0;
+   if (LB_OK != lb_attachHCI(controller, &restored))
+   {
+      goto done;
+   }
+
+   printf("Attached in %u ms, %u connections kept\n", (unsigned) (os_getTime_ms() - start_ms), (unsigned) restored);
+
+   for (uint32_t ii = 0; ii < peerCount; ii ++)
+   {
+      if (isConnected(controller, peerAddress[ii]))
+      {
+         continue;
+      }
+
+      struct LB_Device* device = NULL;
+      enum LB_STATUS status = lb_openDeviceConnection(controller, peerAddress[ii], &device);
+
+      utl_printAddress(peerAddress[ii]);
+      printf((LB_OK == status) ? ": connected\n" : ": failed to connect\n");
+   }
+
+   // the connections are left open for the next run
+   puts("Waiting for events. Press Ctrl-C to quit.");
+   os_waitForKeyboardInterrupt();
+
+done:
+
+   lb_disconnect(controller);
+
+   lb_cleanup();
+
+   return 0;
+}
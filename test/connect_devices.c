@@ -0,0 +1,156 @@
+/**
+ * @file connect_devices.c
+ * @brief Connects to devices through all the controllers on the matching ports
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+#include <stdio.h>
+
+#include <osal_core.h>
+#include <osal_io.h>
+
+#include <hci.h>
+#include <controller.h>
+#include <commands.h>
+#include <manager.h>
+#include <utils.h>
+
+#define MAX_PEERS    64
+
+void lb_on_observedDeviceAdvertisment(struct LB_Controller* controller, const uint8_t* address, int8_t rssi, const uint8_t* data, uint8_t length)
+{
+}
+
+void lb_on_deviceDiscoveryComplete(struct LB_Controller* controller)
+{
+}
+
+void lb_on_disconnectedFromDevice(struct LB_Device* device, enum HCI_StatusCode reason)
+{
+   printf("Device disconnected: %p\n", device);
+}
+
+void lb_on_discoveredPrimaryService(struct LB_Device* device, uint16_t attributeHandle, uint16_t groupEndHandle, const uint8_t* attribute, uint8_t attributeLength)
+{
+}
+
+void lb_on_receivedNotification(struct LB_Device* device, uint16_t attributeHandle, uint8_t status, const uint8_t* attributeValue, uint8_t attributeLength)
+{
+}
+
+static void printControllers(struct LB_Manager* manager)
+{
+   struct LB_ManagedController state;
+
+   for (uint32_t ii = 0; lb_getManagedController(manager, ii, &state); ii ++)
+   {
+      printf("   %s: %u of %u connections\n", state.portName, (unsigned) state.connections, (unsigned) state.maxConnections);
+   }
+}
+
+int main(int argc, char* argv[])
+{
+   if (argc < 2)
+   {
+      puts("Serial port pattern missing, for instance COM*");
+      return 1;
+   }
+
+   if (argc - 2 > MAX_PEERS)
+   {
+      printf("At most %u devices\n", MAX_PEERS);
+      return 1;
+   }
+
+   uint8_t peerAddress[MAX_PEERS][6];
+   const uint32_t peerCount = (uint32_t) (argc - 2);
+
+   for (uint32_t ii = 0; ii < peerCount; ii ++)
+   {
+      if (! utl_parseAddress(argv[ii + 2], peerAddress[ii]))
+      {
+         printf("Failed to parse input address: %s\n", argv[ii + 2]);
+         return 1;
+      }
+   }
+
+   if (lb_initialize() < 0)
+   {
+      puts("Failed to initialize lightBLUE library");
+      return 2;
+   }
+
+   io_setDebugLevel(0);
+   lb_setDebugLevel(0);
+
+   const struct LB_ControllerConfig config =
+   {
+      .maxConnections     = 8,
+      .scanWhileConnected = false,
+   };
+
+   const uint64_t start_ms = os_getTime_ms();
+
+   struct LB_Manager* manager = lb_createManagerForPorts(argv[1], &config);
+   if (! manager)
+   {
+      printf("No controller could be initialized on %s.\n", argv[1]);
+      lb_cleanup();
+      return 3;
+   }
+
+   printf("Initialized %u controllers in %u ms\n", (unsigned) lb_getManagedControllerCount(manager), (unsigned) (os_getTime_ms() - start_ms));
+
+   struct LB_Device* device[MAX_PEERS] = { NULL };
+
+   for (uint32_t ii = 0; ii < peerCount; ii ++)
+   {
+      enum LB_STATUS status = lb_openManagedDeviceConnection(manager, peerAddress[ii], NULL, &device[ii]);
+
+      utl_printAddress(peerAddress[ii]);
+      if (LB_OK == status)
+      {
+         printf(": connected using %p\n", device[ii]);
+      }
+      else
+      {
+         printf(": failed to connect: %u\n", (unsigned) status);
+      }
+   }
+
+   printControllers(manager);
+
+   puts("Waiting for events. Press Ctrl-C to quit.");
+   os_waitForKeyboardInterrupt();
+
+   for (uint32_t ii = 0; ii < peerCount; ii ++)
+   {
+      if (device[ii])
+      {
+         lb_closeDeviceConnection(device[ii]);
+      }
+   }
+
+   lb_destroyManager(manager);
+
+   lb_cleanup();
+
+   return 0;
+}
@@ -0,0 +1,178 @@
+/**
+ * @file coroutine_devices.cpp
+ * @brief Connect, read and write from C++ coroutines
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <lightblue.hpp>
+
+extern "C"
+{
+#include <osal_io.h>
+
+#include <hci.h>
+#include <utils.h>
+}
+
+// one coroutine, with its connect, read and write awaiters
+#define FRAME_SIZE   2048
+#define FRAME_COUNT  1
+
+extern "C"
+{
+
+void lb_on_observedDeviceAdvertisment(struct LB_Controller* controller, const uint8_t* address, int8_t rssi, const uint8_t* data, uint8_t length)
+{
+}
+
+void lb_on_deviceDiscoveryComplete(struct LB_Controller* controller)
+{
+}
+
+void lb_on_disconnectedFromDevice(struct LB_Device* device, enum HCI_StatusCode reason)
+{
+   std::printf("Device disconnected: %p\n", static_cast<void*>(device));
+}
+
+void lb_on_discoveredPrimaryService(struct LB_Device* device, uint16_t attributeHandle, uint16_t groupEndHandle, const uint8_t* attribute, uint8_t attributeLength)
+{
+}
+
+void lb_on_receivedNotification(struct LB_Device* device, uint16_t attributeHandle, uint8_t status, const uint8_t* attributeValue, uint8_t attributeLength)
+{
+}
+
+}
+
+static uint32_t failures;
+
+static LB_Device* connected;
+
+static void check(bool condition, const char* description)
+{
+   std::printf("%s: %s\n", condition ? "ok" : "FAILED", description);
+
+   if (! condition)
+   {
+      failures ++;
+   }
+}
+
+/*
+ * Reads the attribute, then writes the value read back to it
+ */
+static lightblue::Task exercise(lightblue::Executor& executor, lightblue::Controller& controller, const uint8_t* address, uint16_t attributeHandle)
+{
+   auto [status, device] = co_await controller.connect(address);
+
+   check(LB_OK == status, "the device connects");
+   if (LB_OK != status)
+   {
+      co_return;
+   }
+
+   connected = device.get();
+
+   // bound past the co_await expression, which destroys the awaiter
+   const lightblue::Value& value = co_await device.read(attributeHandle);
+
+   check(LB_OK == value.status, "the attribute is read");
+   if (LB_OK != value.status)
+   {
+      co_return;
+   }
+
+   std::printf("Value:");
+   utl_printBuffer(value.data, value.length);
+   std::putchar('\n');
+
+   status = co_await device.write(attributeHandle, value.data, value.length);
+
+   check(LB_OK == status, "the value is written back");
+}
+
+int main(int argc, char* argv[])
+{
+   if (argc < 4)
+   {
+      std::puts("Usage: coroutine_devices <serial port> <address> <attribute handle>");
+      return 1;
+   }
+
+   uint8_t address[6];
+   if (! utl_parseAddress(argv[2], address))
+   {
+      std::printf("Failed to parse input address: %s\n", argv[2]);
+      return 1;
+   }
+
+   const uint16_t attributeHandle = static_cast<uint16_t>(std::strtoul(argv[3], nullptr, 0));
+
+   if (lb_initialize() < 0)
+   {
+      std::puts("Failed to initialize lightBLUE library");
+      return 2;
+   }
+
+   io_setDebugLevel(0);
+   lb_setDebugLevel(0);
+
+   LB_Controller* controller = lb_connect(argv[1]);
+
+   if (! controller)
+   {
+      std::printf("Failed to connect to %s.\n", argv[1]);
+      return 3;
+   }
+
+   if ((LB_OK == lb_initializeHCI(controller)) && (LB_OK == lb_configureAsCentral(controller)))
+   {
+      lightblue::Executor executor(FRAME_SIZE, FRAME_COUNT);
+      lightblue::Controller coroutineController(executor, controller);
+
+      check(static_cast<bool>(exercise(executor, coroutineController, address, attributeHandle)), "the coroutine starts");
+
+      executor.run();
+
+      if (connected)
+      {
+         lb_closeDeviceConnection(connected);
+      }
+   }
+   else
+   {
+      check(false, "the controller initializes");
+   }
+
+   lb_disconnect(controller);
+
+   lb_cleanup();
+
+   if (failures)
+   {
+      std::printf("%u checks failed\n", static_cast<unsigned>(failures));
+      return 4;
+   }
+
+   return 0;
+}
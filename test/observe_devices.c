@@ -0,0 +1,232 @@
+/**
+ * @file observe_devices.c
+ * @brief Check that the observer reports advertisements and connections
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <osal_core.h>
+#include <osal_io.h>
+
+#include <hci.h>
+#include <controller.h>
+#include <commands.h>
+#include <utils.h>
+
+#define MAX_OBSERVED       64
+#define OBSERVE_TIME_MS    5000
+
+static uint8_t observedAddress[MAX_OBSERVED][6];
+static atomic_uint observedCount;
+
+static struct LB_Device* _Atomic disconnectedDevice;
+static atomic_uint disconnectedCount;
+
+static uint32_t failures;
+
+void lb_on_observedDeviceAdvertisment(struct LB_Controller* controller, const uint8_t* address, int8_t rssi, const uint8_t* data, uint8_t length)
+{
+   // only new devices are reported, so each address comes once
+   const uint32_t index = atomic_fetch_add(&observedCount, 1);
+   if (index < MAX_OBSERVED)
+   {
+      memcpy(observedAddress[index], address, sizeof(observedAddress[index]));
+   }
+}
+
+void lb_on_deviceDiscoveryComplete(struct LB_Controller* controller)
+{
+}
+
+void lb_on_disconnectedFromDevice(struct LB_Device* device, enum HCI_StatusCode reason)
+{
+   atomic_store(&disconnectedDevice, device);
+   atomic_fetch_add(&disconnectedCount, 1);
+}
+
+void lb_on_discoveredPrimaryService(struct LB_Device* device, uint16_t attributeHandle, uint16_t groupEndHandle, const uint8_t* attribute, uint8_t attributeLength)
+{
+}
+
+void lb_on_receivedNotification(struct LB_Device* device, uint16_t attributeHandle, uint8_t status, const uint8_t* attributeValue, uint8_t attributeLength)
+{
+}
+
+static void check(bool condition, const char* description)
+{
+   printf("%s: %s\n", condition ? "ok" : "FAILED", description);
+
+   if (! condition)
+   {
+      failures ++;
+   }
+}
+
+static const struct LB_ObservedDevice* findObserved(const struct LB_ObservedDevice* devices, uint32_t count, const uint8_t* address)
+{
+   for (uint32_t ii = 0; ii < count; ii ++)
+   {
+      if (0 == memcmp(devices[ii].address, address, sizeof(devices[ii].address)))
+      {
+         return &devices[ii];
+      }
+   }
+
+   return NULL;
+}
+
+static void checkAdvertisements(struct LB_Controller* controller, const uint8_t* peerAddress)
+{
+   static struct LB_ObservedDevice devices[MAX_OBSERVED];
+   const uint32_t count = lb_getObservedDevices(controller, devices, MAX_OBSERVED);
+   const uint32_t reported = atomic_load(&observedCount);
+
+   printf("%u devices reported, %u in the table\n", (unsigned) reported, (unsigned) count);
+
+   check(0 < reported, "advertisements are reported");
+   check(reported == count, "each tracked device is reported once");
+
+   bool consistent = true;
+   for (uint32_t ii = 0; (ii < reported) && (ii < MAX_OBSERVED); ii ++)
+   {
+      const struct LB_ObservedDevice* device = findObserved(devices, count, observedAddress[ii]);
+
+      if ((! device) || (0 == device->reportCount) || (device->firstSeen_ms > device->lastSeen_ms) ||
+            (device->rssiMin > device->rssiLast) || (device->rssiLast > device->rssiMax))
+      {
+         utl_printAddress(observedAddress[ii]);
+         puts(": missing or inconsistent table entry");
+         consistent = false;
+      }
+   }
+   check(consistent, "reported devices are tracked in the table");
+
+   if (peerAddress)
+   {
+      check(NULL != findObserved(devices, count, peerAddress), "the peer is observed");
+   }
+}
+
+static void checkConnection(struct LB_Controller* controller, const uint8_t* peerAddress)
+{
+   struct LB_Device* device = NULL;
+   enum LB_STATUS status = lb_openDeviceConnection(controller, peerAddress, &device);
+
+   check((LB_OK == status) && device, "the peer connects");
+   if (LB_OK != status)
+   {
+      return;
+   }
+
+   uint8_t deviceAddress[6];
+   check((LB_OK == lb_getDeviceAddress(device, deviceAddress)) && (0 == memcmp(deviceAddress, peerAddress, sizeof(deviceAddress))),
+         "the connection reports the peer address");
+
+   status = lb_closeDeviceConnection(device);
+
+   check(LB_OK == status, "the peer disconnects");
+   check((1 == atomic_load(&disconnectedCount)) && (device == atomic_load(&disconnectedDevice)), "the disconnection is reported once, for the peer");
+}
+
+int main(int argc, char* argv[])
+{
+   if (argc < 2)
+   {
+      puts("Usage: observe_devices <serial port> [address]");
+      return 1;
+   }
+
+   uint8_t peerAddress[6];
+   if ((argc > 2) && (! utl_parseAddress(argv[2], peerAddress)))
+   {
+      printf("Failed to parse input address: %s\n", argv[2]);
+      return 1;
+   }
+
+   if (lb_initialize() < 0)
+   {
+      puts("Failed to initialize lightBLUE library");
+      return 2;
+   }
+
+   io_setDebugLevel(0);
+   lb_setDebugLevel(0);
+
+   struct LB_Controller* controller = lb_connect(argv[1]);
+
+   if (! controller)
+   {
+      printf("Failed to connect to %s.\n", argv[1]);
+      return 3;
+   }
+
+   check(LB_OK == lb_initializeHCI(controller), "the controller initializes");
+   check(LB_OK == lb_configureAsCentral(controller), "the controller is configured as central");
+   if (failures)
+   {
+      goto done;
+   }
+
+   const struct LB_ObserverConfig config =
+   {
+      .capacity      = MAX_OBSERVED,
+      .reportMode    = LB_REPORT_NEW_DEVICES,
+      .rssiThreshold = 0,
+   };
+
+   check(LB_OK == lb_enableObserver(controller, &config), "the observer is enabled");
+
+   check(LB_OK == lb_startDeviceDiscovery(controller), "discovery starts");
+   if (failures)
+   {
+      goto done;
+   }
+
+   printf("Observing for %u ms\n", OBSERVE_TIME_MS);
+   os_sleep_ms(OBSERVE_TIME_MS);
+
+   lb_stopDeviceDiscovery(controller);
+
+   checkAdvertisements(controller, (argc > 2) ? peerAddress : NULL);
+
+   if (argc > 2)
+   {
+      checkConnection(controller, peerAddress);
+   }
+
+   lb_disableObserver(controller);
+
+done:
+
+   lb_disconnect(controller);
+
+   lb_cleanup();
+
+   if (failures)
+   {
+      printf("%u checks failed\n", (unsigned) failures);
+      return 4;
+   }
+
+   return 0;
+}
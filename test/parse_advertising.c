@@ -0,0 +1,110 @@
+/**
+ * @file parse_advertising.c
+ * @brief Test advertising data decoding
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <gap.h>
+#include <utils.h>
+
+static bool parseHex(const char* buffer, uint8_t* data, uint8_t capacity, uint8_t* length)
+{
+   size_t digits = strlen(buffer);
+   if ((digits % 2) || ((digits / 2) > capacity))
+   {
+      return false;
+   }
+
+   for (size_t ii = 0; ii < digits / 2; ii ++)
+   {
+      unsigned value;
+      if (1 != sscanf(buffer + 2 * ii, "%2x", &value))
+      {
+         return false;
+      }
+      data[ii] = (uint8_t) value;
+   }
+
+   *length = (uint8_t) (digits / 2);
+   return true;
+}
+
+int main(int argc, char* argv[])
+{
+   if (argc < 2)
+   {
+      puts("Input advertising data missing");
+      return 1;
+   }
+
+   uint8_t data[31];
+   uint8_t length;
+
+   if (! parseHex(argv[1], data, sizeof(data), &length))
+   {
+      printf("Failed to parse input: '%s'\n", argv[1]);
+      return 1;
+   }
+
+   printf("Decoded:");
+   gap_decodeAdvertisingData(data, length);
+   putchar('\n');
+
+   uint8_t flags;
+   if (gap_getFlags(data, length, &flags))
+   {
+      printf("Flags: %x\n", flags);
+   }
+
+   const char* name;
+   uint8_t nameLength;
+   bool complete;
+   if (gap_getLocalName(data, length, &name, &nameLength, &complete))
+   {
+      printf("Name: '%.*s' (%s)\n", (int) nameLength, name, complete ? "complete" : "shortened");
+   }
+
+   struct GAP_UUIDList list;
+   if (gap_getServiceUUIDs(data, length, 2, &list))
+   {
+      printf("Services:");
+      for (uint8_t ii = 0; ii < list.count; ii ++)
+      {
+         printf(" %04x", gap_getUUID16(&list, ii));
+      }
+      putchar('\n');
+   }
+
+   uint16_t companyId;
+   const uint8_t* manufacturerData;
+   uint8_t manufacturerDataLength;
+   if (gap_getManufacturerData(data, length, &companyId, &manufacturerData, &manufacturerDataLength))
+   {
+      printf("Manufacturer %04x: ", companyId);
+      utl_printBuffer(manufacturerData, manufacturerDataLength);
+      putchar('\n');
+   }
+
+   return 0;
+}
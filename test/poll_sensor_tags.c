@@ -0,0 +1,266 @@
+/**
+ * @file poll_sensor_tags.c
+ * @brief Polls the barometers of many SensorTags on one or more controllers
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <osal_core.h>
+#include <osal_io.h>
+
+#include <hci.h>
+#include <controller.h>
+#include <commands.h>
+#include <gap.h>
+#include <poller.h>
+#include <utils.h>
+
+#include "sensor_tag.h"
+
+#define MAX_CONTROLLERS    4
+#define MAX_DEVICES        (MAX_CONTROLLERS * 8)
+
+struct polledDevice
+{
+   struct LB_Device*    device;
+   uint8_t              address[6];
+   struct LB_PollJob*   job;
+};
+
+static struct LB_Controller* controllers[MAX_CONTROLLERS];
+static uint32_t controllerCount = 0;
+
+static struct polledDevice devices[MAX_DEVICES];
+static uint32_t deviceCount = 0;
+
+static void decodeBarometer(void* context, struct LB_Device* device, uint16_t attributeHandle, enum LB_STATUS status, const uint8_t* attributeValue, uint8_t attributeLength, uint64_t timestamp_ms)
+{
+   struct polledDevice* polled = (struct polledDevice*) context;
+
+   float temperature_C;
+   unsigned pressure_Pa;
+
+   if ((LB_OK == status) && SensorTag_decodeBarometerData(attributeValue, attributeLength, &temperature_C, &pressure_Pa))
+   {
+      printf("%llu ", (unsigned long long) timestamp_ms);
+      utl_printAddress(polled->address);
+      printf("  Temperature: %.2lf degC   Pressure: %.3lf kPa\n", temperature_C, (pressure_Pa / 1000.0));
+   }
+   else
+   {
+      utl_printAddress(polled->address);
+      printf("  read failed: %d\n", (int) status);
+   }
+}
+
+static void reportMissedDeadline(void* context, struct LB_Device* device, uint16_t attributeHandle, uint64_t deadline_ms, uint64_t completed_ms)
+{
+   struct polledDevice* polled = (struct polledDevice*) context;
+
+   utl_printAddress(polled->address);
+   if (completed_ms)
+   {
+      printf("  read completed %llu ms late\n", (unsigned long long) (completed_ms - deadline_ms));
+   }
+   else
+   {
+      puts("  read skipped");
+   }
+}
+
+/*
+ * Arguments: the read period, then each serial port followed by the
+ * addresses of the devices to connect to through it
+ */
+int main(int argc, char* argv[])
+{
+   if (argc < 4)
+   {
+      puts("Usage: poll_sensor_tags <period_ms> <serial port> <address> [<address> ...] [<serial port> <address> ...]");
+      return 1;
+   }
+
+   uint32_t period_ms = (uint32_t) strtoul(argv[1], NULL, 0);
+   if (period_ms < SensorTag_getMinimumPeriod(SENSOR_TAG_BAROMETER))
+   {
+      period_ms = SensorTag_getMinimumPeriod(SENSOR_TAG_BAROMETER);
+   }
+
+   if (lb_initialize() < 0)
+   {
+      puts("Failed to initialize lightBLUE library");
+      return 2;
+   }
+
+   io_setDebugLevel(0);
+   lb_setDebugLevel(0);
+
+   struct LB_Controller* controller = NULL;
+
+   for (int ii = 2; ii < argc; ii ++)
+   {
+      uint8_t address[6];
+
+      if (! utl_parseAddress(argv[ii], address))
+      {
+         if (MAX_CONTROLLERS == controllerCount)
+         {
+            puts("Too many controllers");
+            goto done;
+         }
+
+         controller = lb_connect(argv[ii]);
+         if ((! controller) ||
+               (LB_OK != lb_initializeHCI(controller)) ||
+               (LB_OK != lb_configureAsCentral(controller)))
+         {
+            printf("Failed to connect to %s.\n", argv[ii]);
+            if (controller)
+            {
+               lb_disconnect(controller);
+            }
+            goto done;
+         }
+
+         controllers[controllerCount ++] = controller;
+         continue;
+      }
+
+      if ((! controller) || (MAX_DEVICES == deviceCount))
+      {
+         printf("Skipping %s\n", argv[ii]);
+         continue;
+      }
+
+      struct polledDevice* polled = &devices[deviceCount];
+
+      if ((LB_OK != lb_openDeviceConnection(controller, address, &polled->device)) ||
+            (! SensorTag_enableBarometer(polled->device, true)))
+      {
+         printf("Failed to connect to %s\n", argv[ii]);
+         if (polled->device)
+         {
+            lb_closeDeviceConnection(polled->device);
+            polled->device = NULL;
+         }
+         continue;
+      }
+
+      memcpy(polled->address, address, sizeof(address));
+      deviceCount ++;
+   }
+
+   const struct LB_PollerConfig pollerConfig =
+   {
+      .workerCount           = 4 * controllerCount,
+      .maxReadsPerController = 4,
+   };
+
+   struct LB_Poller* poller = deviceCount ? lb_createPoller(&pollerConfig) : NULL;
+
+   if (! poller)
+   {
+      puts("Nothing to poll");
+      goto done;
+   }
+
+   for (uint32_t ii = 0; ii < deviceCount; ii ++)
+   {
+      const struct LB_PollJobConfig jobConfig =
+      {
+         .device           = devices[ii].device,
+         .attributeHandle  = SensorTag_getDataHandle(SENSOR_TAG_BAROMETER),
+         .period_ms        = period_ms,
+         .offset_ms        = (period_ms * ii) / deviceCount,
+         .decoder          = decodeBarometer,
+         .onMissedDeadline = reportMissedDeadline,
+         .context          = &devices[ii],
+      };
+
+      if (LB_OK != lb_addPollJob(poller, &jobConfig, &devices[ii].job))
+      {
+         puts("Failed to schedule a read");
+      }
+   }
+
+   os_waitForKeyboardInterrupt();
+
+   for (uint32_t ii = 0; ii < deviceCount; ii ++)
+   {
+      if (devices[ii].job)
+      {
+         struct LB_PollStatistics statistics;
+         lb_getPollStatistics(devices[ii].job, &statistics);
+
+         utl_printAddress(devices[ii].address);
+         printf("  %llu reads, %llu failed, %llu missed deadlines, start delay: %.1f ms average, %u ms maximum\n",
+               (unsigned long long) statistics.reads, (unsigned long long) statistics.failures,
+               (unsigned long long) statistics.missedDeadlines,
+               statistics.reads ? ((double) statistics.totalStartDelay_ms / statistics.reads) : 0.0,
+               (unsigned) statistics.maxStartDelay_ms);
+      }
+   }
+
+   lb_destroyPoller(poller);
+
+done:
+
+   for (uint32_t ii = 0; ii < deviceCount; ii ++)
+   {
+      SensorTag_enableBarometer(devices[ii].device, false);
+      lb_closeDeviceConnection(devices[ii].device);
+   }
+
+   for (uint32_t ii = 0; ii < controllerCount; ii ++)
+   {
+      lb_disconnect(controllers[ii]);
+   }
+
+   lb_cleanup();
+
+   return 0;
+}
+
+void lb_on_disconnectedFromDevice(struct LB_Device* device, enum HCI_StatusCode reason)
+{
+   printf("Device disconnected: %p\n", device);
+}
+
+/*
+ * Empty handlers
+ */
+void lb_on_observedDeviceAdvertisment(struct LB_Controller* controller, const uint8_t* address, int8_t rssi, const uint8_t* data, uint8_t length)
+{
+}
+
+void lb_on_deviceDiscoveryComplete(struct LB_Controller* controller)
+{
+}
+
+void lb_on_discoveredPrimaryService(struct LB_Device* device, uint16_t attributeHandle, uint16_t groupEndHandle, const uint8_t* attribute, uint8_t attributeLength)
+{
+}
+
+void lb_on_receivedNotification(struct LB_Device* device, uint16_t attributeHandle, uint8_t status, const uint8_t* attributeValue, uint8_t attributeLength)
+{
+}
@@ -0,0 +1,141 @@
+/**
+ * @file read_recording.c
+ * @brief Prints the samples of a recording in a time range
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <utils.h>
+
+#include <recorder.h>
+
+static void printValue(const struct Recorder_SeriesInfo* info, uint32_t column, const void* values, uint32_t index)
+{
+   uint32_t width = info->column[column].width;
+   const uint8_t* value = (const uint8_t*) values + index * width;
+
+   switch (info->column[column].type)
+   {
+      case RECORDER_FLOAT32:
+         printf(",%.4f", *(const float*) value);
+         break;
+
+      case RECORDER_INT32:
+         printf(",%" PRId32, *(const int32_t*) value);
+         break;
+
+      default:
+         putchar(',');
+         for (uint32_t ii = 0; ii < width; ii ++)
+         {
+            printf("%02x", value[ii]);
+         }
+         break;
+   }
+}
+
+/*
+ * Without a series name, lists the series; otherwise prints the samples
+ * in the time range as comma separated values
+ */
+int main(int argc, char* argv[])
+{
+   if (argc < 2)
+   {
+      puts("Recording file name missing");
+      return 1;
+   }
+
+   struct Recorder_Reader* reader = Recorder_openReader(argv[1]);
+   if (! reader)
+   {
+      printf("Failed to open recording %s\n", argv[1]);
+      return 1;
+   }
+
+   struct Recorder_SeriesInfo info;
+
+   if (argc < 4)
+   {
+      for (uint32_t ss = 0; ss < Recorder_getSeriesCount(reader); ss ++)
+      {
+         if (Recorder_getSeriesInfo(reader, ss, &info))
+         {
+            utl_printAddress(info.address);
+            printf(" %s: %" PRIu64 " samples, %" PRIu64 " - %" PRIu64 " ms\n", info.name, info.sampleCount, info.first_ms, info.last_ms);
+         }
+      }
+
+      Recorder_closeReader(reader);
+      return 0;
+   }
+
+   uint8_t address[6];
+   if (! utl_parseAddress(argv[2], address))
+   {
+      printf("Failed to parse input address: %s\n", argv[2]);
+      Recorder_closeReader(reader);
+      return 1;
+   }
+
+   uint64_t from_ms = (argc > 4) ? strtoull(argv[4], NULL, 0) : 0;
+   uint64_t to_ms = (argc > 5) ? strtoull(argv[5], NULL, 0) : UINT64_MAX;
+
+   int32_t series = Recorder_findSeries(reader, address, argv[3]);
+   if ((series < 0) || (! Recorder_getSeriesInfo(reader, (uint32_t) series, &info)))
+   {
+      printf("Series %s not found\n", argv[3]);
+      Recorder_closeReader(reader);
+      return 1;
+   }
+
+   printf("timestamp_ms");
+   for (uint32_t cc = 0; cc < info.columnCount; cc ++)
+   {
+      printf(",%s", info.column[cc].name);
+   }
+   putchar('\n');
+
+   struct Recorder_Cursor cursor;
+   struct Recorder_Span span;
+
+   if (Recorder_seek(reader, (uint32_t) series, from_ms, to_ms, &cursor))
+   {
+      while (Recorder_next(&cursor, &span))
+      {
+         for (uint32_t ii = 0; ii < span.count; ii ++)
+         {
+            printf("%" PRIu64, span.timestamp_ms[ii]);
+            for (uint32_t cc = 0; cc < info.columnCount; cc ++)
+            {
+               printValue(&info, cc, span.column[cc], ii);
+            }
+            putchar('\n');
+         }
+      }
+   }
+
+   Recorder_closeReader(reader);
+
+   return 0;
+}
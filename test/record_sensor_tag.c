@@ -0,0 +1,273 @@
+/**
+ * @file record_sensor_tag.c
+ * @brief Records SensorTag samples to a file
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+#include <stdio.h>
+
+#include <osal_core.h>
+#include <osal_io.h>
+
+#include <hci.h>
+#include <controller.h>
+#include <commands.h>
+#include <gap.h>
+#include <utils.h>
+
+#include <recorder.h>
+
+#include "sensor_tag.h"
+#include "sensor_tag_stream.h"
+#include "sensor_tag_record.h"
+
+#define RECORDING_SIZE           (256u * 1024 * 1024)
+
+#define FLUSH_INTERVAL_MS        5000
+
+#define MAX_CHARACTERISTICS      8
+
+static struct SensorTag_Stream* stream = NULL;
+static struct Recorder* recorder = NULL;
+static uint8_t peerAddress[6];
+
+/*
+ * Notifications that are not IMU or barometer samples are recorded raw,
+ * one series per attribute handle
+ */
+static uint16_t characteristicHandle[MAX_CHARACTERISTICS];
+static struct Recorder_Series* characteristicSeries[MAX_CHARACTERISTICS];
+static uint32_t characteristicCount = 0;
+
+static struct Recorder_Series* getCharacteristicSeries(uint16_t attributeHandle)
+{
+   for (uint32_t ii = 0; ii < characteristicCount; ii ++)
+   {
+      if (characteristicHandle[ii] == attributeHandle)
+      {
+         return characteristicSeries[ii];
+      }
+   }
+
+   if (characteristicCount == MAX_CHARACTERISTICS)
+   {
+      return NULL;
+   }
+
+   struct Recorder_Series* series = Recorder_addCharacteristicSeries(recorder, peerAddress, attributeHandle, 20);
+   if (series)
+   {
+      characteristicHandle[characteristicCount] = attributeHandle;
+      characteristicSeries[characteristicCount] = series;
+      characteristicCount ++;
+   }
+
+   return series;
+}
+
+int main(int argc, char* argv[])
+{
+   if (argc < 2)
+   {
+      puts("Serial port missing");
+      return 1;
+   }
+
+   if (argc < 3)
+   {
+      puts("Bluetooth address missing");
+      return 1;
+   }
+
+   if (argc < 4)
+   {
+      puts("Recording file name missing");
+      return 1;
+   }
+
+   if (! utl_parseAddress(argv[2], peerAddress))
+   {
+      printf("Failed to parse input address: %s\n", argv[2]);
+      return 1;
+   }
+
+   recorder = Recorder_open(argv[3], RECORDING_SIZE);
+   if (! recorder)
+   {
+      printf("Failed to open recording %s\n", argv[3]);
+      return 1;
+   }
+
+   struct Recorder_Series* imuSeries = SensorTag_addIMUSeries(recorder, peerAddress);
+   struct Recorder_Series* barometerSeries = SensorTag_addBarometerSeries(recorder, peerAddress);
+
+   if ((! imuSeries) || (! barometerSeries))
+   {
+      puts("Failed to add the sensor series");
+      Recorder_close(recorder);
+      return 1;
+   }
+
+   if (lb_initialize() < 0)
+   {
+      puts("Failed to initialize lightBLUE library");
+      Recorder_close(recorder);
+      return 2;
+   }
+
+   io_setDebugLevel(0);
+   lb_setDebugLevel(0);
+
+   struct LB_Controller* controller = lb_connect(argv[1]);
+
+   if (! controller)
+   {
+      printf("Failed to connect to %s.\n", argv[1]);
+      Recorder_close(recorder);
+      return 3;
+   }
+
+   struct LB_Device* device = NULL;
+
+   if ((LB_OK != lb_initializeHCI(controller)) ||
+         (LB_OK != lb_configureAsCentral(controller)) ||
+         (LB_OK != lb_openDeviceConnection(controller, peerAddress, &device)))
+   {
+      goto done;
+   }
+
+   stream = SensorTag_createStream(device, SENSOR_TAG_ACCEL_RANGE_2G);
+
+   const struct SensorTag_MovementConfig movementConfig =
+   {
+      .axes       = SENSOR_TAG_ALL_AXES,
+      .accelRange = SENSOR_TAG_ACCEL_RANGE_2G,
+      .notify     = true,
+      .period_ms  = 0,
+   };
+
+   const struct SensorTag_SensorConfig barometerConfig =
+   {
+      .enable     = true,
+      .notify     = true,
+      .period_ms  = 0,
+   };
+
+   if ((! SensorTag_configureMovement(device, &movementConfig)) ||
+         (! SensorTag_configureSensor(device, SENSOR_TAG_BAROMETER, &barometerConfig)))
+   {
+      puts("Failed to enable sensors");
+      goto done;
+   }
+
+   static struct SensorTag_IMUBatch imu;
+   static struct SensorTag_BarometerBatch barometer;
+
+   uint64_t imuSamples = 0;
+   uint64_t barometerSamples = 0;
+   uint64_t lost = 0;
+
+   uint64_t lastFlush_ms = os_getTime_ms();
+
+   while (! os_interrupted())
+   {
+      if (SensorTag_getIMUBatch(stream, &imu, 1000))
+      {
+         uint32_t recorded = SensorTag_recordIMUBatch(imuSeries, &imu);
+         imuSamples += recorded;
+         lost += imu.dropped + (imu.count - recorded);
+      }
+
+      if (SensorTag_getBarometerBatch(stream, &barometer, 0))
+      {
+         uint32_t recorded = SensorTag_recordBarometerBatch(barometerSeries, &barometer);
+         barometerSamples += recorded;
+         lost += barometer.dropped + (barometer.count - recorded);
+      }
+
+      uint64_t now_ms = os_getTime_ms();
+      if (now_ms - lastFlush_ms >= FLUSH_INTERVAL_MS)
+      {
+         Recorder_flush(recorder);
+         lastFlush_ms = now_ms;
+
+         printf("Recorded %llu IMU and %llu barometer samples, %llu lost\n",
+               (unsigned long long) imuSamples, (unsigned long long) barometerSamples, (unsigned long long) lost);
+      }
+   }
+
+   const struct SensorTag_MovementConfig movementOff = { .axes = 0 };
+   const struct SensorTag_SensorConfig barometerOff = { .enable = false };
+
+   SensorTag_configureMovement(device, &movementOff);
+   SensorTag_configureSensor(device, SENSOR_TAG_BAROMETER, &barometerOff);
+
+done:
+
+   if (device)
+   {
+      lb_closeDeviceConnection(device);
+   }
+
+   SensorTag_destroyStream(stream);
+   stream = NULL;
+
+   lb_disconnect(controller);
+
+   lb_cleanup();
+
+   Recorder_close(recorder);
+
+   return 0;
+}
+
+void lb_on_receivedNotification(struct LB_Device* device, uint16_t attributeHandle, uint8_t status, const uint8_t* attributeValue, uint8_t attributeLength)
+{
+   if (stream && SensorTag_on_streamNotification(stream, device, attributeHandle, attributeValue, attributeLength))
+   {
+      return;
+   }
+
+   struct Recorder_Series* series = getCharacteristicSeries(attributeHandle);
+   if (series)
+   {
+      Recorder_appendCharacteristicValue(series, os_getTime_ms(), attributeValue, attributeLength);
+   }
+}
+
+void lb_on_disconnectedFromDevice(struct LB_Device* device, enum HCI_StatusCode reason)
+{
+   printf("Device disconnected: %p\n", device);
+}
+
+/*
+ * Empty handlers
+ */
+void lb_on_observedDeviceAdvertisment(struct LB_Controller* controller, const uint8_t* address, int8_t rssi, const uint8_t* data, uint8_t length)
+{
+}
+
+void lb_on_deviceDiscoveryComplete(struct LB_Controller* controller)
+{
+}
+
+void lb_on_discoveredPrimaryService(struct LB_Device* device, uint16_t attributeHandle, uint16_t groupEndHandle, const uint8_t* attribute, uint8_t attributeLength)
+{
+}
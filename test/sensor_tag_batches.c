@@ -0,0 +1,213 @@
+/**
+ * @file sensor_tag_batches.c
+ * @brief Stream SensorTag IMU and barometer samples in batches
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+#include <stdio.h>
+
+#include <osal_core.h>
+#include <osal_io.h>
+
+#include <hci.h>
+#include <controller.h>
+#include <commands.h>
+#include <gap.h>
+#include <utils.h>
+
+#include "sensor_tag.h"
+#include "sensor_tag_stream.h"
+#include "sensor_tag_fusion.h"
+
+static struct SensorTag_Stream* stream = NULL;
+
+static float average(const float* values, uint32_t count)
+{
+   float sum = 0;
+
+   for (uint32_t ii = 0; ii < count; ii ++)
+   {
+      sum += values[ii];
+   }
+
+   return count ? (sum / count) : 0;
+}
+
+int main(int argc, char* argv[])
+{
+   if (argc < 2)
+   {
+      puts("Serial port missing");
+      return 1;
+   }
+
+   if (argc < 3)
+   {
+      puts("Bluetooth address missing");
+      return 1;
+   }
+
+   uint8_t peerAddress[6];
+   if (! utl_parseAddress(argv[2], peerAddress))
+   {
+      printf("Failed to parse input address: %s\n", argv[2]);
+      return 1;
+   }
+
+   if (lb_initialize() < 0)
+   {
+      puts("Failed to initialize lightBLUE library");
+      return 2;
+   }
+
+   io_setDebugLevel(0);
+   lb_setDebugLevel(0);
+
+   struct LB_Controller* controller = lb_connect(argv[1]);
+
+   if (! controller)
+   {
+      printf("Failed to connect to %s.\n", argv[1]);
+      return 3;
+   }
+
+   struct LB_Device* device = NULL;
+
+   if ((LB_OK != lb_initializeHCI(controller)) ||
+         (LB_OK != lb_configureAsCentral(controller)) ||
+         (LB_OK != lb_openDeviceConnection(controller, peerAddress, &device)))
+   {
+      goto done;
+   }
+
+   stream = SensorTag_createStream(device, SENSOR_TAG_ACCEL_RANGE_2G);
+
+   // shortest periods
+   const struct SensorTag_MovementConfig movementConfig =
+   {
+      .axes       = SENSOR_TAG_ALL_AXES,
+      .accelRange = SENSOR_TAG_ACCEL_RANGE_2G,
+      .notify     = true,
+      .period_ms  = 0,
+   };
+
+   const struct SensorTag_SensorConfig barometerConfig =
+   {
+      .enable     = true,
+      .notify     = true,
+      .period_ms  = 0,
+   };
+
+   if ((! SensorTag_configureMovement(device, &movementConfig)) ||
+         (! SensorTag_configureSensor(device, SENSOR_TAG_BAROMETER, &barometerConfig)))
+   {
+      puts("Failed to enable sensors");
+      goto done;
+   }
+
+   static struct SensorTag_IMUBatch imu;
+   static struct SensorTag_BarometerBatch barometer;
+
+   const struct SensorTag_FusionConfig fusionConfig =
+   {
+      .samplePeriod_ms = SensorTag_getMinimumPeriod(SENSOR_TAG_MOVEMENT),
+      .accelRange      = SENSOR_TAG_ACCEL_RANGE_2G,
+      .useMagnetometer = true,
+   };
+
+   static struct SensorTag_Fusion fusion;
+   static struct SensorTag_Quaternion orientation[SENSOR_TAG_BATCH_CAPACITY];
+
+   SensorTag_initializeFusion(&fusion, &fusionConfig);
+
+   while (! os_interrupted())
+   {
+      if (SensorTag_getIMUBatch(stream, &imu, 1000))
+      {
+         printf("IMU: %u samples (%u dropped)  Gyro: (%.2f, %.2f, %.2f)  Accel: (%.3f, %.3f, %.3f)  Mag: (%.1f, %.1f, %.1f)\n",
+               (unsigned) imu.count, (unsigned) imu.dropped,
+               average(imu.gyro_dps[0], imu.count), average(imu.gyro_dps[1], imu.count), average(imu.gyro_dps[2], imu.count),
+               average(imu.accel_g[0], imu.count), average(imu.accel_g[1], imu.count), average(imu.accel_g[2], imu.count),
+               average(imu.mag_uT[0], imu.count), average(imu.mag_uT[1], imu.count), average(imu.mag_uT[2], imu.count));
+
+         SensorTag_fuseIMUBatch(&fusion, &imu, orientation);
+
+         const struct SensorTag_Quaternion* last = &orientation[imu.count - 1];
+         printf("Orientation: (%.3f, %.3f, %.3f, %.3f)\n", last->w, last->x, last->y, last->z);
+      }
+
+      if (SensorTag_getBarometerBatch(stream, &barometer, 0))
+      {
+         printf("Barometer: %u samples  %.2f C  %.2f hPa\n",
+               (unsigned) barometer.count,
+               average(barometer.temperature_C, barometer.count), average(barometer.pressure_hPa, barometer.count));
+      }
+   }
+
+   const struct SensorTag_MovementConfig movementOff = { .axes = 0 };
+   const struct SensorTag_SensorConfig barometerOff = { .enable = false };
+
+   SensorTag_configureMovement(device, &movementOff);
+   SensorTag_configureSensor(device, SENSOR_TAG_BAROMETER, &barometerOff);
+
+done:
+
+   if (device)
+   {
+      lb_closeDeviceConnection(device);
+   }
+
+   SensorTag_destroyStream(stream);
+   stream = NULL;
+
+   lb_disconnect(controller);
+
+   lb_cleanup();
+
+   return 0;
+}
+
+void lb_on_receivedNotification(struct LB_Device* device, uint16_t attributeHandle, uint8_t status, const uint8_t* attributeValue, uint8_t attributeLength)
+{
+   if (stream)
+   {
+      SensorTag_on_streamNotification(stream, device, attributeHandle, attributeValue, attributeLength);
+   }
+}
+
+void lb_on_disconnectedFromDevice(struct LB_Device* device, enum HCI_StatusCode reason)
+{
+   printf("Device disconnected: %p\n", device);
+}
+
+/*
+ * Empty handlers
+ */
+void lb_on_observedDeviceAdvertisment(struct LB_Controller* controller, const uint8_t* address, int8_t rssi, const uint8_t* data, uint8_t length)
+{
+}
+
+void lb_on_deviceDiscoveryComplete(struct LB_Controller* controller)
+{
+}
+
+void lb_on_discoveredPrimaryService(struct LB_Device* device, uint16_t attributeHandle, uint16_t groupEndHandle, const uint8_t* attribute, uint8_t attributeLength)
+{
+}
@@ -0,0 +1,217 @@
+/**
+ * @file update_firmware.c
+ * @brief Download a firmware image to SensorTags, in parallel across controllers
+ * @author Florin Iucha <florin@signbit.net>
+ * @copyright Apache License, Version 2.0
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LightBLUE Bluetooth Smart Library
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <osal_core.h>
+#include <osal_io.h>
+
+#include <hci.h>
+#include <controller.h>
+#include <commands.h>
+#include <gap.h>
+#include <utils.h>
+
+#include "sensor_tag_oad.h"
+
+#define MAX_CONTROLLERS    8
+#define MAX_TAGS           32
+
+static uint8_t* readImage(const char* fileName, uint32_t* length)
+{
+   FILE* file = fopen(fileName, "rb");
+   if (! file)
+   {
+      return NULL;
+   }
+
+   fseek(file, 0, SEEK_END);
+   long size = ftell(file);
+   fseek(file, 0, SEEK_SET);
+
+   uint8_t* data = (size > 0) ? malloc((size_t) size) : NULL;
+   if (data && (1 != fread(data, (size_t) size, 1, file)))
+   {
+      free(data);
+      data = NULL;
+   }
+
+   fclose(file);
+
+   *length = (uint32_t) size;
+   return data;
+}
+
+int main(int argc, char* argv[])
+{
+   if ((argc < 6) || (argc % 2))
+   {
+      puts("Usage: update_firmware <image> <identify handle> <block handle> <serial port> <address> [<serial port> <address> ...]");
+      return 1;
+   }
+
+   struct SensorTag_OADImage image;
+   uint8_t* imageData = readImage(argv[1], &image.length);
+   if (! imageData)
+   {
+      printf("Failed to read image: %s\n", argv[1]);
+      return 1;
+   }
+   image.data = imageData;
+
+   const struct SensorTag_OADConfig config =
+   {
+      .identifyHandle = (uint16_t) strtoul(argv[2], NULL, 16),
+      .blockHandle    = (uint16_t) strtoul(argv[3], NULL, 16),
+      .window         = 8,
+      .maxAttempts    = 3,
+   };
+
+   if (lb_initialize() < 0)
+   {
+      puts("Failed to initialize lightBLUE library");
+      return 2;
+   }
+
+   io_setDebugLevel(0);
+   lb_setDebugLevel(0);
+
+   const char* portNames[MAX_CONTROLLERS];
+   struct LB_Controller* controllers[MAX_CONTROLLERS];
+   uint32_t controllerCount = 0;
+
+   struct SensorTag_OADJob jobs[MAX_TAGS];
+   uint32_t jobCount = 0;
+
+   int result = 0;
+
+   for (int ii = 4; (ii < argc) && (jobCount < MAX_TAGS); ii += 2)
+   {
+      struct SensorTag_OADJob* job = &jobs[jobCount];
+
+      if (! utl_parseAddress(argv[ii + 1], job->address))
+      {
+         printf("Failed to parse input address: %s\n", argv[ii + 1]);
+         result = 1;
+         goto done;
+      }
+
+      // tags on the same port share the controller
+      uint32_t jj = 0;
+      while ((jj < controllerCount) && strcmp(portNames[jj], argv[ii]))
+      {
+         jj ++;
+      }
+
+      if (jj == controllerCount)
+      {
+         if (MAX_CONTROLLERS == controllerCount)
+         {
+            puts("Too many controllers");
+            result = 1;
+            goto done;
+         }
+
+         struct LB_Controller* controller = lb_connect(argv[ii]);
+
+         if ((! controller) || (LB_OK != lb_initializeHCI(controller)) || (LB_OK != lb_configureAsCentral(controller)))
+         {
+            printf("Failed to initialize controller on %s.\n", argv[ii]);
+            if (controller)
+            {
+               lb_disconnect(controller);
+            }
+            result = 3;
+            goto done;
+         }
+
+         portNames[jj]   = argv[ii];
+         controllers[jj] = controller;
+         controllerCount ++;
+      }
+
+      job->controller = controllers[jj];
+      jobCount ++;
+   }
+
+   uint64_t start = os_getTime_ms();
+
+   uint32_t succeeded = SensorTag_updateFirmwareParallel(jobs, jobCount, &image, &config);
+
+   printf("Updated %u of %u devices in %u ms\n", (unsigned) succeeded, (unsigned) jobCount, (unsigned) (os_getTime_ms() - start));
+
+   for (uint32_t ii = 0; ii < jobCount; ii ++)
+   {
+      utl_printAddress(jobs[ii].address);
+      printf(": status %d, %u/%u blocks, %u sent, %u retransmitted, %u connections\n",
+            (int) jobs[ii].status,
+            (unsigned) jobs[ii].progress.blocksRequested, (unsigned) jobs[ii].progress.blockCount,
+            (unsigned) jobs[ii].progress.blocksSent, (unsigned) jobs[ii].progress.retransmissions,
+            (unsigned) jobs[ii].progress.connections);
+   }
+
+   if (succeeded != jobCount)
+   {
+      result = 4;
+   }
+
+done:
+
+   for (uint32_t jj = 0; jj < controllerCount; jj ++)
+   {
+      lb_disconnect(controllers[jj]);
+   }
+
+   lb_cleanup();
+
+   free(imageData);
+
+   return result;
+}
+
+void lb_on_disconnectedFromDevice(struct LB_Device* device, enum HCI_StatusCode reason)
+{
+   SensorTag_on_disconnectedFromDevice(device);
+}
+
+void lb_on_receivedNotification(struct LB_Device* device, uint16_t attributeHandle, uint8_t status, const uint8_t* attributeValue, uint8_t attributeLength)
+{
+   SensorTag_on_receivedNotification(device, attributeHandle, attributeValue, attributeLength);
+}
+
+/*
+ * Empty handlers
+ */
+void lb_on_observedDeviceAdvertisment(struct LB_Controller* controller, const uint8_t* address, int8_t rssi, const uint8_t* data, uint8_t length)
+{
+}
+
+void lb_on_deviceDiscoveryComplete(struct LB_Controller* controller)
+{
+}
+
+void lb_on_discoveredPrimaryService(struct LB_Device* device, uint16_t attributeHandle, uint16_t groupEndHandle, const uint8_t* attribute, uint8_t attributeLength)
+{
+}